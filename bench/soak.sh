@@ -0,0 +1,292 @@
+#!/bin/bash
+#
+# 浸泡测试：在网络命名空间中的 veth 对上运行 netmon，用 netmon-gen 从对端
+# 按给定速率发送 ARP 和 IPv4 帧，结束后检查：
+#   1. 计数器准确性：netmon_packets_total 的增量等于发送端 veth 的 tx_packets 增量，
+#      ARP 计数与发生器发送的 ARP 帧数一致（扣除发送端丢弃）；
+#   2. 事件丢失：ring buffer 已满与用户态队列已满丢弃的 ARP 事件比例；
+#   3. 资源：netmon 进程每秒的 CPU 使用率与 RSS（写入时间序列 CSV），RSS 增长不超过上限。
+# 结果以 "soak.<名称> <数值>" 格式写入结果文件，可与上一次的结果比较（-b）。
+# 任一检查失败或相对基线回归时退出码为 2。需要 root 权限。
+#
+# 用法：bench/soak.sh [选项] [-- netmon 参数]
+#
+
+set -u
+
+DURATION=10
+ARP_PPS=1000
+IPV4_PPS=10000
+SOURCES=256
+FLOWS=1024
+INTERVAL=1
+MAX_LOSS=0          # 允许的事件丢失比例（%）
+MAX_RSS_GROWTH=4096 # 允许的 RSS 增长（KB）
+RESULTS=soak-results.txt
+BASELINE=
+THRESHOLD=10        # 相对基线的回归阈值（%）
+XDP_MODE=native
+PORT=9899
+
+NS_RX=netmon-soak-rx
+NS_TX=netmon-soak-tx
+IF_RX=nsoak0
+IF_TX=nsoak1
+
+DIR=$(cd "$(dirname "$0")/.." && pwd)
+NETMON=$DIR/netmon
+GEN=$DIR/netmon-gen
+
+usage() {
+    cat >&2 <<EOF
+Usage: $0 [options] [-- netmon options]
+  -d seconds    Traffic duration (default: $DURATION)
+  -a pps        ARP requests per second (default: $ARP_PPS)
+  -p pps        IPv4 frames per second (default: $IPV4_PPS)
+  -s sources    Distinct sender MAC/IP pairs (default: $SOURCES)
+  -f flows      Distinct IPv4 flows (default: $FLOWS)
+  -i seconds    netmon statistics interval (default: $INTERVAL)
+  -L percent    Maximum ARP event loss (default: $MAX_LOSS)
+  -G kb         Maximum RSS growth of netmon (default: $MAX_RSS_GROWTH)
+  -o file       Results file (default: $RESULTS); the CPU/RSS time series
+                goes to FILE.csv and the netmon log to FILE.log
+  -b file       Compare against a previous results file
+  -T percent    Regression threshold for -b (default: $THRESHOLD)
+  -x mode       XDP attach mode: native (default) or generic
+EOF
+}
+
+while getopts "d:a:p:s:f:i:L:G:o:b:T:x:h" opt; do
+    case $opt in
+        d) DURATION=$OPTARG ;;
+        a) ARP_PPS=$OPTARG ;;
+        p) IPV4_PPS=$OPTARG ;;
+        s) SOURCES=$OPTARG ;;
+        f) FLOWS=$OPTARG ;;
+        i) INTERVAL=$OPTARG ;;
+        L) MAX_LOSS=$OPTARG ;;
+        G) MAX_RSS_GROWTH=$OPTARG ;;
+        o) RESULTS=$OPTARG ;;
+        b) BASELINE=$OPTARG ;;
+        T) THRESHOLD=$OPTARG ;;
+        x) XDP_MODE=$OPTARG ;;
+        h) usage; exit 0 ;;
+        *) usage; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+[ "${1:-}" = "--" ] && shift
+
+if [ "$(id -u)" -ne 0 ]; then
+    echo "Error: $0 must be run as root" >&2
+    exit 1
+fi
+for bin in "$NETMON" "$GEN"; do
+    if [ ! -x "$bin" ]; then
+        echo "Error: $bin not found, run make first" >&2
+        exit 1
+    fi
+done
+
+NETMON_PID=
+SAMPLER_PID=
+
+cleanup() {
+    [ -n "$SAMPLER_PID" ] && kill "$SAMPLER_PID" 2>/dev/null
+    if [ -n "$NETMON_PID" ] && kill -0 "$NETMON_PID" 2>/dev/null; then
+        kill -INT "$NETMON_PID"
+        wait "$NETMON_PID" 2>/dev/null
+    fi
+    ip netns del "$NS_RX" 2>/dev/null
+    ip netns del "$NS_TX" 2>/dev/null
+}
+trap cleanup EXIT
+trap 'exit 1' INT TERM
+
+# 命名空间与 veth：关闭 IPv6 避免 DAD/RS 报文混入计数
+setup_netns() {
+    ip netns del "$NS_RX" 2>/dev/null
+    ip netns del "$NS_TX" 2>/dev/null
+    ip netns add "$NS_RX" && ip netns add "$NS_TX" || return 1
+    ip link add "$IF_RX" netns "$NS_RX" type veth peer name "$IF_TX" netns "$NS_TX" || return 1
+    for ns in "$NS_RX" "$NS_TX"; do
+        ip netns exec "$ns" sysctl -qw net.ipv6.conf.all.disable_ipv6=1
+        ip netns exec "$ns" sysctl -qw net.ipv6.conf.default.disable_ipv6=1
+    done
+    ip -n "$NS_RX" link set lo up
+    ip -n "$NS_RX" link set "$IF_RX" up
+    ip -n "$NS_TX" link set "$IF_TX" up
+}
+
+metrics() {
+    ip netns exec "$NS_RX" curl -sf "http://127.0.0.1:$PORT/metrics"
+}
+
+# metric <快照文件> <样本名，含标签>
+metric() {
+    awk -v m="$2" '$1 == m { v = $2 } END { print v + 0 }' "$1"
+}
+
+tx_stat() {
+    ip netns exec "$NS_TX" cat "/sys/class/net/$IF_TX/statistics/$1"
+}
+
+# 进程累计 CPU 时间（clock tick）与 RSS（KB）
+proc_cpu() {
+    awk '{ print $14 + $15 }' "/proc/$1/stat" 2>/dev/null
+}
+
+proc_rss() {
+    awk '/^VmRSS:/ { print $2 }' "/proc/$1/status" 2>/dev/null
+}
+
+# 每秒采样一次 CPU 使用率（%）与 RSS
+sample_loop() {
+    local pid=$1 hz prev cur t=0
+
+    hz=$(getconf CLK_TCK)
+    prev=$(proc_cpu "$pid")
+    echo "seconds,cpu_percent,rss_kb"
+    while sleep 1; do
+        cur=$(proc_cpu "$pid") || break
+        [ -z "$cur" ] && break
+        t=$((t + 1))
+        echo "$t,$(( (cur - prev) * 100 / hz )),$(proc_rss "$pid")"
+        prev=$cur
+    done
+}
+
+if ! setup_netns; then
+    echo "Error: Failed to set up network namespaces" >&2
+    exit 1
+fi
+
+ip netns exec "$NS_RX" "$NETMON" -i "$INTERVAL" -x "$XDP_MODE" -M "127.0.0.1:$PORT" \
+    "$@" "$IF_RX" >/dev/null 2>"$RESULTS.log" &
+NETMON_PID=$!
+
+for _ in $(seq 50); do
+    metrics >/dev/null && break
+    if ! kill -0 "$NETMON_PID" 2>/dev/null; then
+        echo "Error: netmon exited during startup, see $RESULTS.log" >&2
+        exit 1
+    fi
+    sleep 0.2
+done
+
+BEFORE=$(mktemp)
+AFTER=$(mktemp)
+GEN_OUT=$(mktemp)
+trap 'rm -f "$BEFORE" "$AFTER" "$GEN_OUT"; cleanup' EXIT
+
+# 等一个统计间隔，让基准快照反映启动后的稳定状态
+sleep "$INTERVAL"
+metrics >"$BEFORE" || { echo "Error: Metrics endpoint not reachable" >&2; exit 1; }
+tx_before=$(tx_stat tx_packets)
+txd_before=$(tx_stat tx_dropped)
+rss_start=$(proc_rss "$NETMON_PID")
+
+sample_loop "$NETMON_PID" >"$RESULTS.csv" &
+SAMPLER_PID=$!
+
+echo "Sending $ARP_PPS ARP pps and $IPV4_PPS IPv4 pps for ${DURATION}s..." >&2
+ip netns exec "$NS_TX" "$GEN" -i "$IF_TX" -a "$ARP_PPS" -p "$IPV4_PPS" -d "$DURATION" \
+    -s "$SOURCES" -f "$FLOWS" >"$GEN_OUT"
+gen_rc=$?
+
+# 指标每个统计间隔刷新一次
+sleep $((INTERVAL * 2))
+metrics >"$AFTER"
+tx_after=$(tx_stat tx_packets)
+txd_after=$(tx_stat tx_dropped)
+rss_end=$(proc_rss "$NETMON_PID")
+
+kill "$SAMPLER_PID" 2>/dev/null
+wait "$SAMPLER_PID" 2>/dev/null
+SAMPLER_PID=
+
+delta() {
+    echo $(( $(metric "$AFTER" "$1") - $(metric "$BEFORE" "$1") ))
+}
+
+label="interface=\"$IF_RX\""
+packets=$(delta "netmon_packets_total{$label}")
+arp=$(delta "netmon_arp_packets_total{$label,opcode=\"request\"}")
+submitted=$(delta 'netmon_arp_events_total{result="submitted"}')
+ringbuf_full=$(delta 'netmon_arp_events_total{result="ringbuf_full"}')
+queue_drops=$(delta 'netmon_event_queue_drops_total{queue="arp"}')
+tx_packets=$((tx_after - tx_before))
+tx_dropped=$((txd_after - txd_before))
+gen_arp=$(awk '$1 == "gen.arp_sent" { print $2 }' "$GEN_OUT")
+gen_ipv4=$(awk '$1 == "gen.ipv4_sent" { print $2 }' "$GEN_OUT")
+gen_pps=$(awk '$1 == "gen.pps" { print $2 }' "$GEN_OUT")
+gen_arp=${gen_arp:-0}
+gen_ipv4=${gen_ipv4:-0}
+
+lost=$((ringbuf_full + queue_drops))
+loss_pct=$(awk -v l="$lost" -v s="$submitted" 'BEGIN { printf "%.3f", s + l ? l * 100 / (s + l) : 0 }')
+cpu_avg=$(awk -F, 'NR > 1 { s += $2; n++ } END { printf "%.1f", n ? s / n : 0 }' "$RESULTS.csv")
+cpu_max=$(awk -F, 'NR > 1 && $2 > m { m = $2 } END { print m + 0 }' "$RESULTS.csv")
+rss_growth=$(( ${rss_end:-0} - ${rss_start:-0} ))
+
+{
+    echo "soak.seconds $DURATION"
+    echo "soak.gen_pps ${gen_pps:-0}"
+    echo "soak.gen_arp $gen_arp"
+    echo "soak.gen_ipv4 $gen_ipv4"
+    echo "soak.tx_packets $tx_packets"
+    echo "soak.tx_dropped $tx_dropped"
+    echo "soak.packets $packets"
+    echo "soak.arp_requests $arp"
+    echo "soak.events_submitted $submitted"
+    echo "soak.events_lost $lost"
+    echo "soak.event_loss_percent $loss_pct"
+    echo "soak.cpu_percent_avg $cpu_avg"
+    echo "soak.cpu_percent_max $cpu_max"
+    echo "soak.rss_start_kb ${rss_start:-0}"
+    echo "soak.rss_end_kb ${rss_end:-0}"
+    echo "soak.rss_growth_kb $rss_growth"
+} >"$RESULTS"
+cat "$RESULTS"
+
+fail=0
+check() {
+    if [ "$1" -ne 0 ]; then
+        echo "FAIL: $2" >&2
+        fail=1
+    fi
+}
+
+[ "$gen_rc" -eq 0 ]; check $? "traffic generator failed"
+kill -0 "$NETMON_PID" 2>/dev/null; check $? "netmon exited during the run, see $RESULTS.log"
+[ "$packets" -eq "$tx_packets" ]; check $? "netmon counted $packets packets, peer sent $tx_packets"
+[ "$arp" -le "$gen_arp" ] && [ "$arp" -ge $((gen_arp - tx_dropped)) ]
+check $? "netmon counted $arp ARP requests, generator sent $gen_arp ($tx_dropped dropped)"
+awk -v l="$loss_pct" -v m="$MAX_LOSS" 'BEGIN { exit !(l <= m) }'
+check $? "ARP event loss ${loss_pct}% exceeds ${MAX_LOSS}%"
+[ "$rss_growth" -le "$MAX_RSS_GROWTH" ]; check $? "RSS grew by ${rss_growth} KB (limit ${MAX_RSS_GROWTH} KB)"
+
+# 与基线比较：吞吐不应下降，CPU、丢失与 RSS 增长不应上升超过阈值
+if [ -n "$BASELINE" ]; then
+    awk -v t="$THRESHOLD" '
+        NR == FNR { base[$1] = $2; next }
+        $1 in base {
+            b = base[$1]; v = $2
+            if ($1 == "soak.gen_pps") {
+                bad = v < b * (1 - t / 100)
+            } else if ($1 ~ /cpu_percent_avg|event_loss_percent|rss_growth_kb/) {
+                bad = v > b * (1 + t / 100) && v - b > 1
+            } else {
+                next
+            }
+            printf "%-28s %12s -> %-12s%s\n", $1, b, v, bad ? "  REGRESSION" : ""
+            if (bad) failed = 1
+        }
+        END { exit failed }' "$BASELINE" "$RESULTS"
+    check $? "regression against $BASELINE"
+fi
+
+if [ "$fail" -ne 0 ]; then
+    exit 2
+fi
+echo "PASS" >&2
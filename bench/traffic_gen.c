@@ -0,0 +1,365 @@
+/*
+ * 流量发生器：soak 测试用的本地 ARP/IPv4 发包工具
+ *
+ * 通过 AF_PACKET 的 TX ring（PACKET_MMAP，TPACKET_V2）在指定接口上按给定速率发送
+ * ARP 请求和 IPv4/UDP 帧：帧直接写入与内核共享的环，一次 send() 提交一批，
+ * 并用 PACKET_QDISC_BYPASS 跳过 qdisc，单核即可产生数百万 pps。
+ * 发送方地址在 -s 个源之间轮换，UDP 端口在 -f 个流之间轮换，用于覆盖按源、按流统计的表。
+ * 结束时以 "gen.<名称> <数值>" 格式输出发送的帧数，便于脚本解析。
+ * 需要 root 权限（或 CAP_NET_RAW）。
+ */
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <linux/if_arp.h>
+#include <linux/ip.h>
+#include <linux/udp.h>
+
+#define DEFAULT_SECONDS     10
+#define DEFAULT_SOURCES     256
+#define DEFAULT_FLOWS       1024
+
+/* TX ring：每帧 256 字节（合成帧不超过 64 字节），64 个 64KB 的块，共 16384 帧 */
+#define RING_FRAME_SIZE     256
+#define RING_BLOCK_SIZE     (64 * 1024)
+#define RING_BLOCK_NR       64
+#define RING_FRAME_NR       (RING_BLOCK_SIZE / RING_FRAME_SIZE * RING_BLOCK_NR)
+
+/* 每批最多提交的帧数，以及速率计算的时间片 */
+#define TX_BATCH            1024
+#define TICK_NS             100000ULL
+
+#define FRAME_LEN           60
+
+/* 发送方 10.200.0.0/16，目标 10.201.0.1（接收端不拥有这些地址，不会应答） */
+#define SOURCE_NET          0x0AC80000
+#define TARGET_IP           0x0AC90001
+
+struct tx_ring {
+    int fd;
+    uint8_t *map;
+    size_t map_len;
+    uint32_t head;          /* 下一个写入的帧 */
+};
+
+static volatile sig_atomic_t keep_running = 1;
+
+static void sig_handler(int sig)
+{
+    keep_running = 0;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* 源 i 的 MAC：02:00:0a:c8:xx:xx */
+static void source_mac(uint32_t i, uint8_t *mac)
+{
+    mac[0] = 0x02;
+    mac[1] = 0x00;
+    mac[2] = 0x0a;
+    mac[3] = 0xc8;
+    mac[4] = i >> 8;
+    mac[5] = i;
+}
+
+/* 源 i 的 IPv4 地址（网络字节序），跳过 .0 与 .255 */
+static uint32_t source_ip(uint32_t i)
+{
+    return htonl(SOURCE_NET | ((i / 254) << 8) | (i % 254 + 1));
+}
+
+/* IPv4 头部校验和 */
+static uint16_t ip_checksum(const void *hdr, size_t len)
+{
+    const uint16_t *p = hdr;
+    uint32_t sum = 0;
+
+    for (; len > 1; len -= 2)
+        sum += *p++;
+    while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+    return ~sum;
+}
+
+/* 源 src 发出的广播 ARP 请求，询问 TARGET_IP */
+static uint32_t build_arp(uint8_t *buf, uint32_t src)
+{
+    struct ethhdr *eth = (struct ethhdr *)buf;
+    struct arphdr *arp = (struct arphdr *)(eth + 1);
+    uint8_t *payload = (uint8_t *)(arp + 1);
+    uint32_t sip = source_ip(src), tip = htonl(TARGET_IP);
+
+    memset(buf, 0, FRAME_LEN);
+    memset(eth->h_dest, 0xff, ETH_ALEN);
+    source_mac(src, eth->h_source);
+    eth->h_proto = htons(ETH_P_ARP);
+
+    arp->ar_hrd = htons(ARPHRD_ETHER);
+    arp->ar_pro = htons(ETH_P_IP);
+    arp->ar_hln = ETH_ALEN;
+    arp->ar_pln = 4;
+    arp->ar_op = htons(ARPOP_REQUEST);
+    memcpy(payload, eth->h_source, ETH_ALEN);
+    memcpy(payload + 6, &sip, 4);
+    memcpy(payload + 16, &tip, 4);
+    return FRAME_LEN;
+}
+
+/* 流 flow 的 IPv4/UDP 帧：源地址按源轮换，源端口按流区分 */
+static uint32_t build_ipv4(uint8_t *buf, uint32_t src, uint32_t flow)
+{
+    struct ethhdr *eth = (struct ethhdr *)buf;
+    struct iphdr *ip = (struct iphdr *)(eth + 1);
+    struct udphdr *udp = (struct udphdr *)(ip + 1);
+
+    memset(buf, 0, FRAME_LEN);
+    memset(eth->h_dest, 0xff, ETH_ALEN);
+    eth->h_dest[0] = 0x02;      /* 单播：接收端在 XDP 之后丢弃 */
+    source_mac(src, eth->h_source);
+    eth->h_proto = htons(ETH_P_IP);
+
+    ip->version = 4;
+    ip->ihl = 5;
+    ip->ttl = 64;
+    ip->protocol = IPPROTO_UDP;
+    ip->tot_len = htons(FRAME_LEN - sizeof(*eth));
+    ip->saddr = source_ip(src);
+    ip->daddr = htonl(TARGET_IP);
+    ip->check = ip_checksum(ip, sizeof(*ip));
+    udp->source = htons(1024 + flow);
+    udp->dest = htons(9);
+    udp->len = htons(FRAME_LEN - sizeof(*eth) - sizeof(*ip));
+    return FRAME_LEN;
+}
+
+static int ring_open(struct tx_ring *r, const char *ifname)
+{
+    struct tpacket_req req = {
+        .tp_block_size = RING_BLOCK_SIZE,
+        .tp_block_nr = RING_BLOCK_NR,
+        .tp_frame_size = RING_FRAME_SIZE,
+        .tp_frame_nr = RING_FRAME_NR,
+    };
+    struct sockaddr_ll sll = {
+        .sll_family = AF_PACKET,
+    };
+    int version = TPACKET_V2, one = 1;
+
+    memset(r, 0, sizeof(*r));
+    sll.sll_ifindex = if_nametoindex(ifname);
+    if (!sll.sll_ifindex) {
+        fprintf(stderr, "Error: Unknown interface %s\n", ifname);
+        return -1;
+    }
+
+    /* 协议为 0：只发送，不接收任何帧 */
+    r->fd = socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC, 0);
+    if (r->fd < 0) {
+        fprintf(stderr, "Error: Failed to create AF_PACKET socket: %s\n", strerror(errno));
+        return -1;
+    }
+    if (setsockopt(r->fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) ||
+        setsockopt(r->fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req))) {
+        fprintf(stderr, "Error: Failed to set up the TX ring: %s\n", strerror(errno));
+        close(r->fd);
+        return -1;
+    }
+    /* 旧内核不支持时退回经过 qdisc 的发送路径 */
+    setsockopt(r->fd, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof(one));
+
+    r->map_len = (size_t)RING_BLOCK_SIZE * RING_BLOCK_NR;
+    r->map = mmap(NULL, r->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, r->fd, 0);
+    if (r->map == MAP_FAILED) {
+        fprintf(stderr, "Error: Failed to map the TX ring: %s\n", strerror(errno));
+        close(r->fd);
+        return -1;
+    }
+    if (bind(r->fd, (struct sockaddr *)&sll, sizeof(sll))) {
+        fprintf(stderr, "Error: Failed to bind to %s: %s\n", ifname, strerror(errno));
+        munmap(r->map, r->map_len);
+        close(r->fd);
+        return -1;
+    }
+    return 0;
+}
+
+static void ring_close(struct tx_ring *r)
+{
+    munmap(r->map, r->map_len);
+    close(r->fd);
+}
+
+static inline struct tpacket2_hdr *ring_frame(struct tx_ring *r, uint32_t i)
+{
+    return (struct tpacket2_hdr *)(r->map + (size_t)i * RING_FRAME_SIZE);
+}
+
+/* 取得下一个空闲帧的数据区，环已满时返回 NULL */
+static uint8_t *ring_next(struct tx_ring *r)
+{
+    struct tpacket2_hdr *hdr = ring_frame(r, r->head);
+
+    if (hdr->tp_status != TP_STATUS_AVAILABLE)
+        return NULL;
+    return (uint8_t *)hdr + TPACKET2_HDRLEN - sizeof(struct sockaddr_ll);
+}
+
+/* 提交 ring_next 返回的帧 */
+static void ring_commit(struct tx_ring *r, uint32_t len)
+{
+    struct tpacket2_hdr *hdr = ring_frame(r, r->head);
+
+    hdr->tp_len = len;
+    __atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+    r->head = (r->head + 1) % RING_FRAME_NR;
+}
+
+/* 让内核发送所有已提交的帧，阻塞到处理完毕 */
+static int ring_flush(struct tx_ring *r)
+{
+    if (send(r->fd, NULL, 0, 0) < 0 && errno != ENOBUFS && errno != EAGAIN)
+        return -errno;
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s -i IFACE [options]\n", prog);
+    fprintf(stderr, "  -i iface      Interface to send on\n");
+    fprintf(stderr, "  -a pps        ARP requests per second (default: 0)\n");
+    fprintf(stderr, "  -p pps        IPv4/UDP frames per second (default: 0)\n");
+    fprintf(stderr, "  -d seconds    Duration (default: %d)\n", DEFAULT_SECONDS);
+    fprintf(stderr, "  -s sources    Distinct sender MAC/IP pairs (default: %d)\n", DEFAULT_SOURCES);
+    fprintf(stderr, "  -f flows      Distinct UDP flows (default: %d)\n", DEFAULT_FLOWS);
+    fprintf(stderr, "A rate of 0 for both sends as fast as possible, half ARP and half IPv4.\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *ifname = NULL;
+    uint64_t arp_pps = 0, ip_pps = 0;
+    uint64_t arp_sent = 0, ip_sent = 0, errors = 0;
+    uint64_t start, end, now;
+    uint32_t sources = DEFAULT_SOURCES, flows = DEFAULT_FLOWS;
+    uint32_t arp_src = 0, ip_src = 0, ip_flow = 0;
+    struct tx_ring ring;
+    int seconds = DEFAULT_SECONDS;
+    bool unlimited;
+    double elapsed;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "i:a:p:d:s:f:h")) != -1) {
+        switch (opt) {
+            case 'i':
+                ifname = optarg;
+                break;
+            case 'a':
+                arp_pps = strtoull(optarg, NULL, 10);
+                break;
+            case 'p':
+                ip_pps = strtoull(optarg, NULL, 10);
+                break;
+            case 'd':
+                seconds = atoi(optarg);
+                break;
+            case 's':
+                sources = atoi(optarg);
+                break;
+            case 'f':
+                flows = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (!ifname || seconds < 1 || sources < 1 || sources > 254 * 256 || flows < 1 || flows > 64000) {
+        usage(argv[0]);
+        return 1;
+    }
+    unlimited = arp_pps == 0 && ip_pps == 0;
+
+    if (ring_open(&ring, ifname))
+        return 1;
+
+    signal(SIGINT, sig_handler);
+    signal(SIGTERM, sig_handler);
+
+    start = now_ns();
+    end = start + (uint64_t)seconds * 1000000000ULL;
+    while (keep_running && (now = now_ns()) < end) {
+        double t = (now - start) / 1e9;
+        uint64_t arp_due, ip_due;
+        int batch = 0;
+
+        /* 按经过的时间计算应发送的帧数，落后时在后续批次中补发 */
+        if (unlimited) {
+            arp_due = ip_due = TX_BATCH / 2;
+        } else {
+            arp_due = (uint64_t)(arp_pps * t) - arp_sent;
+            ip_due = (uint64_t)(ip_pps * t) - ip_sent;
+        }
+
+        while (batch < TX_BATCH && (arp_due || ip_due)) {
+            uint8_t *data = ring_next(&ring);
+
+            if (!data)
+                break;
+            /* 两类帧交替，速率不同时多出的部分排在批次末尾 */
+            if (arp_due && (!ip_due || (batch & 1) == 0)) {
+                ring_commit(&ring, build_arp(data, arp_src));
+                arp_src = (arp_src + 1) % sources;
+                arp_sent++;
+                arp_due--;
+            } else {
+                ring_commit(&ring, build_ipv4(data, ip_src, ip_flow));
+                ip_src = (ip_src + 1) % sources;
+                ip_flow = (ip_flow + 1) % flows;
+                ip_sent++;
+                ip_due--;
+            }
+            batch++;
+        }
+
+        if (batch > 0) {
+            if (ring_flush(&ring))
+                errors++;
+        } else if (!unlimited) {
+            struct timespec ts = { 0, TICK_NS };
+
+            nanosleep(&ts, NULL);
+        }
+    }
+    /* 等待最后一批发送完毕 */
+    ring_flush(&ring);
+    elapsed = (now_ns() - start) / 1e9;
+    ring_close(&ring);
+
+    printf("gen.seconds %.2f\n", elapsed);
+    printf("gen.arp_sent %lu\n", (unsigned long)arp_sent);
+    printf("gen.ipv4_sent %lu\n", (unsigned long)ip_sent);
+    printf("gen.send_errors %lu\n", (unsigned long)errors);
+    printf("gen.pps %.0f\n", elapsed > 0 ? (arp_sent + ip_sent) / elapsed : 0);
+    return 0;
+}
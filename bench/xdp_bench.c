@@ -0,0 +1,1344 @@
+/*
+ * XDP 程序基准测试与回归检查
+ *
+ * 通过 BPF_PROG_TEST_RUN 离线运行 xdp_network_monitor，无需网卡：
+ *   1. 帧测试集：对每种合成帧高重复次数运行，报告 ns/packet，
+ *      并报告验证器处理的指令数，可与基线文件比较以发现回归；
+ *   2. 布局对比：在多个 CPU 上并发运行，对比 per-CPU 计数器布局
+ *      （src/monitor.bpf.o）与旧的共享数组 + 原子加布局
+ *      （src/monitor_shared.bpf.o）的吞吐。
+ *   3. 配置对比：用 monitor_config 关闭各项功能或启用子网过滤后重新测量，
+ *      确认关闭的功能与未启用的过滤每包开销接近于零。
+ *   4. 抓包过滤检查：确认 EtherType/ARP 操作码过滤对带 VLAN 标签的帧按内层 EtherType 匹配。
+ * 另外 -V 在真实的 veth 对上分别以 native 和 generic 模式附加程序，用 AF_PACKET
+ * 从对端发包，比较两种模式下 XDP 实际处理的 pps。
+ * 需要 root 权限（或 CAP_BPF + CAP_NET_ADMIN）。
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <linux/if_link.h>
+#include <linux/if_arp.h>
+#include <linux/ip.h>
+#include <linux/udp.h>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+#include "../include/detector.h"
+
+#define DEFAULT_PERCPU_OBJ  "src/monitor.bpf.o"
+#define DEFAULT_SHARED_OBJ  "src/monitor_shared.bpf.o"
+#define DEFAULT_REPEAT      1000000
+#define DEFAULT_THRESHOLD   10.0    /* 回归阈值（百分比） */
+#define MAX_FRAME_LEN       128
+#define MAX_FRAMES          16      /* 帧测试集的最大帧数 */
+#define LAYOUT_FRAME        1       /* 布局对比使用的帧：arp_request */
+
+/* BPF_PROG_TEST_RUN 以 loopback 作为接收设备，ctx->ingress_ifindex 为 1 */
+#define BENCH_IFINDEX       1
+
+/*
+ * 每批 BPF_PROG_TEST_RUN 的最大重复次数。批次之间清空 arp_events，
+ * 避免 ring buffer 写满后 ARP 帧走 reserve 失败的捷径而低估开销。
+ * 256KB / (事件 48 字节 + 8 字节记录头) ≈ 4681。
+ */
+#define RB_DRAIN_BATCH      4096
+
+/* 回放时单帧的最大长度，超过的帧被跳过 */
+#define REPLAY_MAX_FRAME    4096
+#define PCAP_LINKTYPE_ETHERNET 1
+
+/* veth 模式对比：每种模式的发包时长（秒）与每次 sendmmsg 的帧数 */
+#define VETH_DEFAULT_SECONDS 5
+#define VETH_TX_BATCH        64
+
+/* 合成测试帧 */
+struct bench_frame {
+    const char *name;
+    uint8_t data[MAX_FRAME_LEN];
+    uint32_t len;
+};
+
+/* 单个帧的测试结果 */
+struct frame_result {
+    double ns_per_pkt;
+    uint32_t retval;
+};
+
+/* 单个压测线程的参数与结果 */
+struct bench_thread {
+    pthread_t tid;
+    int prog_fd;
+    int cpu;
+    int repeat;
+    const uint8_t *frame;
+    uint32_t frame_len;
+    pthread_barrier_t *barrier;
+    uint32_t duration;      /* 每次运行的平均耗时（ns） */
+    int err;
+};
+
+/* 已加载的 BPF 对象 */
+struct bench_prog {
+    struct bpf_object *obj;
+    int prog_fd;
+    struct ring_buffer *rb;
+};
+
+static const uint8_t bench_src_mac[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+
+/* 填充以太网头部，返回负载起始位置 */
+uint8_t *build_eth(uint8_t *buf, uint16_t proto)
+{
+    struct ethhdr *eth = (struct ethhdr *)buf;
+
+    memset(eth->h_dest, 0xff, ETH_ALEN);
+    memcpy(eth->h_source, bench_src_mac, ETH_ALEN);
+    eth->h_proto = htons(proto);
+    return (uint8_t *)(eth + 1);
+}
+
+/* 构造一个 ARP 帧；hrd 为硬件类型，payload_len 为实际写入的 ARP 负载长度 */
+uint32_t build_arp_frame(uint8_t *buf, uint16_t opcode, uint16_t hrd, uint32_t payload_len)
+{
+    struct arphdr *arp = (struct arphdr *)build_eth(buf, ETH_P_ARP);
+    uint8_t *payload = (uint8_t *)(arp + 1);
+    uint32_t src_ip = htonl(0xC0A80164); /* 192.168.1.100 */
+    uint32_t dst_ip = htonl(0xC0A80101); /* 192.168.1.1 */
+
+    arp->ar_hrd = htons(hrd);
+    arp->ar_pro = htons(ETH_P_IP);
+    arp->ar_hln = 6;
+    arp->ar_pln = 4;
+    arp->ar_op = htons(opcode);
+
+    memcpy(payload, bench_src_mac, 6);
+    memcpy(payload + 6, &src_ip, 4);
+    memcpy(payload + 16, &dst_ip, 4);
+
+    return sizeof(struct ethhdr) + sizeof(struct arphdr) + payload_len;
+}
+
+/* 构造一个 IPv4/UDP 帧 */
+uint32_t build_ipv4_frame(uint8_t *buf)
+{
+    struct iphdr *ip = (struct iphdr *)build_eth(buf, ETH_P_IP);
+    struct udphdr *udp = (struct udphdr *)(ip + 1);
+
+    ip->version = 4;
+    ip->ihl = 5;
+    ip->ttl = 64;
+    ip->protocol = IPPROTO_UDP;
+    ip->tot_len = htons(46);
+    ip->saddr = htonl(0xC0A80164);
+    ip->daddr = htonl(0xC0A80101);
+    udp->source = htons(12345);
+    udp->dest = htons(53);
+    udp->len = htons(26);
+
+    return 60;
+}
+
+/* 在以太网源地址之后插入一个 VLAN 标签（先插入内层），返回新的帧长度 */
+uint32_t push_vlan_tag(uint8_t *buf, uint32_t len, uint16_t tpid, uint16_t vid)
+{
+    uint16_t tag[2] = { htons(tpid), htons(vid) };
+
+    memmove(buf + 2 * ETH_ALEN + sizeof(tag), buf + 2 * ETH_ALEN, len - 2 * ETH_ALEN);
+    memcpy(buf + 2 * ETH_ALEN, tag, sizeof(tag));
+    return len + sizeof(tag);
+}
+
+/* 生成帧测试集 */
+int build_frames(struct bench_frame *frames)
+{
+    int n = 0;
+
+    frames[n].name = "ipv4_udp";
+    frames[n].len = build_ipv4_frame(frames[n].data);
+    n++;
+
+    frames[n].name = "arp_request";
+    frames[n].len = build_arp_frame(frames[n].data, ARPOP_REQUEST, ARPHRD_ETHER, 20);
+    n++;
+
+    frames[n].name = "arp_reply";
+    frames[n].len = build_arp_frame(frames[n].data, ARPOP_REPLY, ARPHRD_ETHER, 20);
+    n++;
+
+    /* ARP 头部完整，但地址负载被截断 */
+    frames[n].name = "arp_truncated";
+    frames[n].len = build_arp_frame(frames[n].data, ARPOP_REQUEST, ARPHRD_ETHER, 10);
+    n++;
+
+    /* 非以太网硬件类型的 ARP */
+    frames[n].name = "arp_non_ether";
+    frames[n].len = build_arp_frame(frames[n].data, ARPOP_REQUEST, ARPHRD_IEEE802, 20);
+    n++;
+
+    /* 带标签的帧：与上面未打标签的帧对比可以看出 VLAN 解析的开销 */
+    frames[n].name = "vlan_ipv4_udp";
+    frames[n].len = build_ipv4_frame(frames[n].data);
+    frames[n].len = push_vlan_tag(frames[n].data, frames[n].len, ETH_P_8021Q, 100);
+    n++;
+
+    frames[n].name = "vlan_arp_request";
+    frames[n].len = build_arp_frame(frames[n].data, ARPOP_REQUEST, ARPHRD_ETHER, 20);
+    frames[n].len = push_vlan_tag(frames[n].data, frames[n].len, ETH_P_8021Q, 100);
+    n++;
+
+    frames[n].name = "qinq_arp_request";
+    frames[n].len = build_arp_frame(frames[n].data, ARPOP_REQUEST, ARPHRD_ETHER, 20);
+    frames[n].len = push_vlan_tag(frames[n].data, frames[n].len, ETH_P_8021Q, 100);
+    frames[n].len = push_vlan_tag(frames[n].data, frames[n].len, ETH_P_8021AD, 200);
+    n++;
+
+    return n;
+}
+
+/* ring buffer 回调：丢弃事件 */
+int drain_event(void *ctx, void *data, size_t data_sz)
+{
+    return 0;
+}
+
+/*
+ * 与 netmon 附加接口时一样，为测试用的 ifindex 预先插入按接口计数的条目，
+ * 使测得的是快速路径（单次查找）而不是首包插入
+ */
+int init_iface_counters(struct bpf_object *obj, int ifindex)
+{
+    static const char *names[] = { "packet_count", "arp_statistics", "ndp_statistics" };
+    uint32_t key = ifindex;
+    size_t i;
+
+    for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        struct bpf_map *map = bpf_object__find_map_by_name(obj, names[i]);
+        size_t size;
+        void *zero;
+        int err;
+
+        if (!map)
+            return -ENOENT;
+
+        size = (bpf_map__value_size(map) + 7) & ~(size_t)7;
+        if (bpf_map__type(map) == BPF_MAP_TYPE_PERCPU_HASH ||
+            bpf_map__type(map) == BPF_MAP_TYPE_PERCPU_ARRAY)
+            size *= libbpf_num_possible_cpus();
+
+        zero = calloc(1, size);
+        if (!zero)
+            return -ENOMEM;
+        err = bpf_map_update_elem(bpf_map__fd(map), &key, zero, BPF_ANY);
+        free(zero);
+        if (err)
+            return -errno;
+    }
+    return 0;
+}
+
+/* 与 netmon 默认配置一样，把所有协议处理程序装入 dispatch */
+int init_dispatch(struct bpf_object *obj)
+{
+    static const struct {
+        const char *prog;
+        uint32_t slot;
+    } handlers[] = {
+        { "handle_arp",  DISPATCH_ARP },
+        { "handle_ipv4", DISPATCH_IPV4 },
+        { "handle_ipv6", DISPATCH_IPV6 },
+        { "handle_vlan", DISPATCH_VLAN },
+    };
+    int map_fd = bpf_object__find_map_fd_by_name(obj, "dispatch");
+    size_t i;
+
+    if (map_fd < 0)
+        return map_fd;
+    for (i = 0; i < sizeof(handlers) / sizeof(handlers[0]); i++) {
+        struct bpf_program *prog = bpf_object__find_program_by_name(obj, handlers[i].prog);
+        int fd;
+
+        if (!prog)
+            return -ENOENT;
+        fd = bpf_program__fd(prog);
+        if (bpf_map_update_elem(map_fd, &handlers[i].slot, &fd, BPF_ANY))
+            return -errno;
+    }
+    return 0;
+}
+
+/* 打开并加载 BPF 对象，查找 XDP 程序 */
+int load_prog(const char *path, struct bench_prog *bp)
+{
+    struct bpf_program *prog;
+    int err, rb_fd;
+
+    memset(bp, 0, sizeof(*bp));
+
+    bp->obj = bpf_object__open_file(path, NULL);
+    if (libbpf_get_error(bp->obj)) {
+        fprintf(stderr, "Error: Failed to open BPF object file %s\n", path);
+        return -1;
+    }
+
+    err = bpf_object__load(bp->obj);
+    if (err) {
+        fprintf(stderr, "Error: Failed to load BPF object %s: %s\n", path, strerror(-err));
+        bpf_object__close(bp->obj);
+        return -1;
+    }
+
+    prog = bpf_object__find_program_by_name(bp->obj, "xdp_network_monitor");
+    if (!prog) {
+        fprintf(stderr, "Error: Failed to find BPF program in %s\n", path);
+        bpf_object__close(bp->obj);
+        return -1;
+    }
+    bp->prog_fd = bpf_program__fd(prog);
+
+    err = init_dispatch(bp->obj);
+    if (err) {
+        fprintf(stderr, "Error: Failed to set up protocol dispatch in %s: %s\n", path, strerror(-err));
+        bpf_object__close(bp->obj);
+        return -1;
+    }
+
+    err = init_iface_counters(bp->obj, BENCH_IFINDEX);
+    if (err) {
+        fprintf(stderr, "Error: Failed to initialize counters in %s: %s\n", path, strerror(-err));
+        bpf_object__close(bp->obj);
+        return -1;
+    }
+
+    rb_fd = bpf_object__find_map_fd_by_name(bp->obj, "arp_events");
+    if (rb_fd >= 0)
+        bp->rb = ring_buffer__new(rb_fd, drain_event, NULL, NULL);
+
+    return 0;
+}
+
+void unload_prog(struct bench_prog *bp)
+{
+    if (bp->rb)
+        ring_buffer__free(bp->rb);
+    bpf_object__close(bp->obj);
+}
+
+/* 读取验证器处理的指令数和翻译后的指令数 */
+int get_insn_counts(int prog_fd, uint32_t *verified, uint32_t *xlated)
+{
+    struct bpf_prog_info info;
+    uint32_t len = sizeof(info);
+
+    memset(&info, 0, sizeof(info));
+    if (bpf_obj_get_info_by_fd(prog_fd, &info, &len))
+        return -errno;
+
+    *verified = info.verified_insns;
+    *xlated = info.xlated_prog_len / sizeof(struct bpf_insn);
+    return 0;
+}
+
+/* 对单个帧分批运行 BPF_PROG_TEST_RUN，返回加权平均 ns/packet */
+int run_frame(struct bench_prog *bp, const struct bench_frame *frame,
+              int repeat, struct frame_result *res)
+{
+    double total_ns = 0;
+    int done = 0;
+
+    while (done < repeat) {
+        int batch = repeat - done;
+
+        if (batch > RB_DRAIN_BATCH)
+            batch = RB_DRAIN_BATCH;
+
+        LIBBPF_OPTS(bpf_test_run_opts, opts,
+            .data_in = frame->data,
+            .data_size_in = frame->len,
+            .repeat = batch,
+        );
+
+        if (bpf_prog_test_run_opts(bp->prog_fd, &opts))
+            return -errno;
+
+        total_ns += (double)opts.duration * batch;
+        res->retval = opts.retval;
+        done += batch;
+
+        if (bp->rb)
+            ring_buffer__consume(bp->rb);
+    }
+
+    res->ns_per_pkt = total_ns / repeat;
+    return 0;
+}
+
+/* 压测线程：绑定到指定 CPU 后执行 BPF_PROG_TEST_RUN */
+void *bench_worker(void *arg)
+{
+    struct bench_thread *t = arg;
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(t->cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+    LIBBPF_OPTS(bpf_test_run_opts, opts,
+        .data_in = t->frame,
+        .data_size_in = t->frame_len,
+        .repeat = t->repeat,
+    );
+
+    pthread_barrier_wait(t->barrier);
+    t->err = bpf_prog_test_run_opts(t->prog_fd, &opts);
+    if (t->err)
+        t->err = -errno;
+    t->duration = opts.duration;
+    return NULL;
+}
+
+/*
+ * 在 nthreads 个 CPU 上并发压测，返回总 Mpps。
+ * ring buffer 写满后 ARP 帧走 reserve 失败路径，两种布局一致，
+ * 不影响计数器争用的对比。
+ */
+int bench_concurrent(const char *path, int nthreads, int repeat,
+                     const struct bench_frame *frame, double *mpps, double *ns_per_pkt)
+{
+    struct bench_prog bp;
+    struct bench_thread *threads;
+    pthread_barrier_t barrier;
+    double total_pps = 0, total_ns = 0;
+    int i, err = 0;
+
+    if (load_prog(path, &bp))
+        return -1;
+
+    threads = calloc(nthreads, sizeof(*threads));
+    if (!threads) {
+        unload_prog(&bp);
+        return -1;
+    }
+
+    pthread_barrier_init(&barrier, NULL, nthreads);
+    for (i = 0; i < nthreads; i++) {
+        threads[i].prog_fd = bp.prog_fd;
+        threads[i].cpu = i;
+        threads[i].repeat = repeat;
+        threads[i].frame = frame->data;
+        threads[i].frame_len = frame->len;
+        threads[i].barrier = &barrier;
+        pthread_create(&threads[i].tid, NULL, bench_worker, &threads[i]);
+    }
+
+    for (i = 0; i < nthreads; i++) {
+        pthread_join(threads[i].tid, NULL);
+        if (threads[i].err) {
+            fprintf(stderr, "Error: BPF_PROG_TEST_RUN failed on CPU %d: %s\n",
+                    threads[i].cpu, strerror(-threads[i].err));
+            err = -1;
+            continue;
+        }
+        if (threads[i].duration > 0)
+            total_pps += 1e9 / threads[i].duration;
+        total_ns += threads[i].duration;
+    }
+    pthread_barrier_destroy(&barrier);
+
+    *mpps = total_pps / 1e6;
+    *ns_per_pkt = total_ns / nthreads;
+
+    free(threads);
+    unload_prog(&bp);
+    return err;
+}
+
+/* 从基线文件中查找指定条目，格式为每行 "<name> <value>" */
+int baseline_lookup(FILE *f, const char *name, double *value)
+{
+    char line[256], key[128];
+    double v;
+
+    rewind(f);
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "%127s %lf", key, &v) == 2 && strcmp(key, name) == 0) {
+            *value = v;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* 与基线比较，超过阈值返回 1 */
+int check_regression(FILE *baseline, const char *name, double value, double threshold)
+{
+    double base;
+
+    if (!baseline || baseline_lookup(baseline, name, &base) || base <= 0)
+        return 0;
+
+    if (value > base * (1.0 + threshold / 100.0)) {
+        printf("  REGRESSION: %s %.1f -> %.1f (+%.1f%%, threshold %.1f%%)\n",
+               name, base, value, (value / base - 1.0) * 100.0, threshold);
+        return 1;
+    }
+    return 0;
+}
+
+/* 帧测试集：报告 ns/packet 与指令数，可写入或比较基线 */
+int run_frame_suite(const char *path, int repeat, const char *baseline_path,
+                    const char *write_path, double threshold)
+{
+    static const struct {
+        const char *prog;
+        const char *suffix;     /* 基线条目名称的后缀 */
+    } insn_progs[] = {
+        { "xdp_network_monitor", "" },
+        { "handle_arp",          ".handle_arp" },
+        { "handle_ipv4",         ".handle_ipv4" },
+        { "handle_ipv6",         ".handle_ipv6" },
+        { "handle_vlan",         ".handle_vlan" },
+        { "handle_capture",      ".handle_capture" },
+    };
+    struct bench_frame frames[MAX_FRAMES];
+    struct frame_result res;
+    struct bench_prog bp;
+    uint32_t verified = 0, xlated = 0;
+    FILE *baseline = NULL, *out = NULL;
+    int nframes, i, regressions = 0;
+
+    if (load_prog(path, &bp))
+        return -1;
+
+    if (baseline_path) {
+        baseline = fopen(baseline_path, "r");
+        if (!baseline)
+            fprintf(stderr, "Warning: Failed to open baseline %s: %s\n",
+                    baseline_path, strerror(errno));
+    }
+    if (write_path) {
+        out = fopen(write_path, "w");
+        if (!out)
+            fprintf(stderr, "Warning: Failed to create baseline %s: %s\n",
+                    write_path, strerror(errno));
+    }
+
+    /*
+     * 入口程序只做分类，解析都在 dispatch 的处理程序中，每个程序分别报告并比较。
+     * 验证器指令数是确定值，同样按阈值比较；入口程序沿用 verified_insns 这一名称，旧基线仍可比较
+     */
+    printf("Program: %s\n", path);
+    printf("  %-22s %10s %10s\n", "Program", "Verified", "Translated");
+    for (i = 0; i < (int)(sizeof(insn_progs) / sizeof(insn_progs[0])); i++) {
+        struct bpf_program *prog = bpf_object__find_program_by_name(bp.obj, insn_progs[i].prog);
+        char name[64];
+
+        if (!prog || get_insn_counts(bpf_program__fd(prog), &verified, &xlated)) {
+            fprintf(stderr, "Warning: No instruction counts for %s\n", insn_progs[i].prog);
+            continue;
+        }
+        printf("  %-22s %10u %10u\n", insn_progs[i].prog, verified, xlated);
+        snprintf(name, sizeof(name), "verified_insns%s", insn_progs[i].suffix);
+        if (out)
+            fprintf(out, "%s %u\n", name, verified);
+        regressions += check_regression(baseline, name, verified, threshold);
+    }
+    printf("\n");
+
+    nframes = build_frames(frames);
+    printf("%-16s %6s %12s %12s %8s\n", "Frame", "Bytes", "ns/pkt", "Mpps", "Verdict");
+    for (i = 0; i < nframes; i++) {
+        if (run_frame(&bp, &frames[i], repeat, &res)) {
+            fprintf(stderr, "Error: BPF_PROG_TEST_RUN failed for %s: %s\n",
+                    frames[i].name, strerror(errno));
+            continue;
+        }
+        printf("%-16s %6u %12.2f %12.2f %8s\n", frames[i].name, frames[i].len,
+               res.ns_per_pkt, res.ns_per_pkt > 0 ? 1e3 / res.ns_per_pkt : 0,
+               res.retval == XDP_PASS ? "PASS" : "OTHER");
+        if (out)
+            fprintf(out, "%s %.2f\n", frames[i].name, res.ns_per_pkt);
+        regressions += check_regression(baseline, frames[i].name, res.ns_per_pkt, threshold);
+    }
+
+    if (baseline)
+        fclose(baseline);
+    if (out)
+        fclose(out);
+    unload_prog(&bp);
+    return regressions;
+}
+
+/* 配置对比中的一种配置；filter_addr/filter_len 为写入两个过滤 trie 的前缀（主机字节序） */
+struct config_case {
+    const char *name;
+    uint32_t disabled;
+    uint32_t subnet_filter;
+    uint32_t filter_addr;
+    uint32_t filter_len;
+};
+
+/* 写入 monitor_config，并把前缀写入两个过滤 trie */
+int apply_config_case(struct bench_prog *bp, const struct config_case *c)
+{
+    struct monitor_config cfg = {
+        .disabled = c->disabled,
+        .subnet_filter = c->subnet_filter,
+    };
+    static const char *tries[] = { "filter_src", "filter_dst" };
+    uint32_t key = 0, one = 1;
+    size_t i;
+    int fd;
+
+    for (i = 0; i < sizeof(tries) / sizeof(tries[0]) && c->subnet_filter; i++) {
+        struct subnet_key sk = {
+            .prefixlen = c->filter_len,
+            .addr = htonl(c->filter_addr),
+        };
+
+        fd = bpf_object__find_map_fd_by_name(bp->obj, tries[i]);
+        if (fd < 0 || bpf_map_update_elem(fd, &sk, &one, BPF_ANY))
+            return -1;
+    }
+
+    fd = bpf_object__find_map_fd_by_name(bp->obj, "monitor_config");
+    if (fd < 0 || bpf_map_update_elem(fd, &key, &cfg, BPF_ANY))
+        return -1;
+    return 0;
+}
+
+/*
+ * 配置对比：对 ipv4_udp 与 arp_request 帧分别在各配置下测量 ns/packet，
+ * 与默认配置的差值即为功能本身或过滤判断的开销
+ */
+int run_config_suite(const char *path, int repeat)
+{
+    static const struct config_case cases[] = {
+        { "default",         0, 0, 0, 0 },
+        { "flows-off",       FEATURE_FLOW_STATS, 0, 0, 0 },
+        { "ip-stats-off",    FEATURE_IP_STATS | FEATURE_FLOW_STATS, 0, 0, 0 },
+        { "events-off",      FEATURE_ARP_EVENTS | FEATURE_NDP_EVENTS, 0, 0, 0 },
+        { "latency-off",     FEATURE_ARP_LATENCY, 0, 0, 0 },
+        { "all-off",         FEATURE_IP_STATS | FEATURE_FLOW_STATS | FEATURE_ARP_EVENTS |
+                             FEATURE_NDP_EVENTS | FEATURE_ARP_LATENCY | FEATURE_VLAN_STATS, 0, 0, 0 },
+        { "src-filter-hit",  0, FILTER_SRC, 0xC0A80100, 24 },               /* 192.168.1.0/24 */
+        { "src-filter-miss", 0, FILTER_SRC, 0x0A000000, 8 },                /* 10.0.0.0/8 */
+        { "both-filters",    0, FILTER_SRC | FILTER_DST, 0xC0A80000, 16 },  /* 192.168.0.0/16 */
+    };
+    static const int frame_idx[] = { 0, LAYOUT_FRAME };   /* ipv4_udp, arp_request */
+    struct bench_frame frames[MAX_FRAMES];
+    struct frame_result res;
+    struct bench_prog bp;
+    double base[2] = {0};
+    size_t i, f;
+
+    build_frames(frames);
+    printf("%-16s %12s %10s %12s %10s\n", "Config", frames[frame_idx[0]].name, "delta",
+           frames[frame_idx[1]].name, "delta");
+
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        /* 每种配置重新加载，流表、时延表等不受上一种配置的残留条目影响 */
+        if (load_prog(path, &bp))
+            return -1;
+        if (apply_config_case(&bp, &cases[i])) {
+            fprintf(stderr, "Error: Failed to apply config %s: %s\n", cases[i].name, strerror(errno));
+            unload_prog(&bp);
+            return -1;
+        }
+
+        printf("%-16s", cases[i].name);
+        for (f = 0; f < 2; f++) {
+            if (run_frame(&bp, &frames[frame_idx[f]], repeat, &res)) {
+                printf(" %12s %10s", "error", "");
+                continue;
+            }
+            if (i == 0)
+                base[f] = res.ns_per_pkt;
+            printf(" %12.2f %+10.2f", res.ns_per_pkt, res.ns_per_pkt - base[f]);
+        }
+        printf("\n");
+        unload_prog(&bp);
+    }
+    return 0;
+}
+
+/* 抓包过滤检查中的一种过滤条件与帧，match 为期望是否被抓取 */
+struct capture_case {
+    const char *filter;
+    uint16_t ethertype;
+    uint16_t arp_op;
+    int frame;          /* build_frames() 中的下标 */
+    int match;
+};
+
+/* 读取 event_stats 中抓包条目各 CPU 之和（写入成功与 perf buffer 失败都算匹配） */
+int read_capture_matches(struct bench_prog *bp, uint64_t *matched)
+{
+    int fd = bpf_object__find_map_fd_by_name(bp->obj, "event_stats");
+    int ncpus = libbpf_num_possible_cpus();
+    uint32_t key = EVENT_SRC_CAPTURE;
+    struct event_stats *v;
+    int i;
+
+    if (fd < 0 || ncpus < 0)
+        return -1;
+    v = calloc(ncpus, sizeof(*v));
+    if (!v)
+        return -1;
+    if (bpf_map_lookup_elem(fd, &key, v)) {
+        free(v);
+        return -1;
+    }
+    *matched = 0;
+    for (i = 0; i < ncpus; i++)
+        *matched += v[i].submitted + v[i].ringbuf_full;
+    free(v);
+    return 0;
+}
+
+/*
+ * 抓包过滤检查：把 handle_capture 装入 dispatch，对未打标签与 802.1Q/QinQ 帧逐一运行，
+ * 检查 EtherType/ARP 操作码过滤是否按内层 EtherType 匹配。没有 perf buffer 读取方，
+ * 匹配的帧计入 ringbuf_full，不影响判断。返回不符合期望的条目数
+ */
+int run_capture_suite(const char *path)
+{
+    static const struct capture_case cases[] = {
+        { "arp",         ETH_P_ARP, 0,             1, 1 },  /* arp_request */
+        { "arp",         ETH_P_ARP, 0,             0, 0 },  /* ipv4_udp */
+        { "arp",         ETH_P_ARP, 0,             6, 1 },  /* vlan_arp_request */
+        { "arp",         ETH_P_ARP, 0,             7, 1 },  /* qinq_arp_request */
+        { "arp:request", ETH_P_ARP, ARPOP_REQUEST, 6, 1 },
+        { "arp:request", ETH_P_ARP, ARPOP_REQUEST, 7, 1 },
+        { "arp:reply",   ETH_P_ARP, ARPOP_REPLY,   6, 0 },
+        { "ipv4",        ETH_P_IP,  0,             5, 1 },  /* vlan_ipv4_udp */
+        { "ipv4",        ETH_P_IP,  0,             6, 0 },
+        { "0x8100",      ETH_P_8021Q, 0,           6, 1 },  /* 外层 EtherType 仍可匹配 */
+    };
+    struct bench_frame frames[MAX_FRAMES];
+    uint32_t capture_slot = DISPATCH_CAPTURE;
+    struct bpf_program *prog;
+    struct bench_prog bp;
+    uint32_t key = 0;
+    int mismatches = 0, map_fd, fd;
+    size_t i;
+
+    build_frames(frames);
+    if (load_prog(path, &bp))
+        return -1;
+    prog = bpf_object__find_program_by_name(bp.obj, "handle_capture");
+    map_fd = bpf_object__find_map_fd_by_name(bp.obj, "dispatch");
+    if (!prog || map_fd < 0) {
+        fprintf(stderr, "Error: Failed to find handle_capture in %s\n", path);
+        unload_prog(&bp);
+        return -1;
+    }
+    fd = bpf_program__fd(prog);
+    if (bpf_map_update_elem(map_fd, &capture_slot, &fd, BPF_ANY)) {
+        fprintf(stderr, "Error: Failed to install handle_capture: %s\n", strerror(errno));
+        unload_prog(&bp);
+        return -1;
+    }
+
+    printf("%-12s %-18s %9s %9s\n", "Filter", "Frame", "Expected", "Captured");
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        const struct bench_frame *frame = &frames[cases[i].frame];
+        struct monitor_config cfg = {
+            .capture_snaplen = MAX_FRAME_LEN,
+            .capture_ethertype = cases[i].ethertype,
+            .capture_arp_op = cases[i].arp_op,
+        };
+        uint64_t before, after;
+        int captured;
+
+        LIBBPF_OPTS(bpf_test_run_opts, opts,
+            .data_in = frame->data,
+            .data_size_in = frame->len,
+            .repeat = 1,
+        );
+
+        fd = bpf_object__find_map_fd_by_name(bp.obj, "monitor_config");
+        if (fd < 0 || bpf_map_update_elem(fd, &key, &cfg, BPF_ANY) ||
+            read_capture_matches(&bp, &before) ||
+            bpf_prog_test_run_opts(bp.prog_fd, &opts) ||
+            read_capture_matches(&bp, &after)) {
+            fprintf(stderr, "Error: Capture check %s/%s failed: %s\n",
+                    cases[i].filter, frame->name, strerror(errno));
+            mismatches++;
+            continue;
+        }
+        captured = after > before;
+        printf("%-12s %-18s %9s %9s%s\n", cases[i].filter, frame->name,
+               cases[i].match ? "yes" : "no", captured ? "yes" : "no",
+               captured != cases[i].match ? "  MISMATCH" : "");
+        if (captured != cases[i].match)
+            mismatches++;
+    }
+
+    unload_prog(&bp);
+    return mismatches;
+}
+
+/* 构造发送方/目标可指定的 ARP 帧，用于检测器回放场景 */
+uint32_t build_arp_claim(uint8_t *buf, uint16_t opcode, const uint8_t *sha,
+                         uint32_t sip, uint32_t tip)
+{
+    struct ethhdr *eth = (struct ethhdr *)buf;
+    struct arphdr *arp = (struct arphdr *)(eth + 1);
+    uint8_t *payload = (uint8_t *)(arp + 1);
+
+    memset(eth->h_dest, 0xff, ETH_ALEN);
+    memcpy(eth->h_source, sha, ETH_ALEN);
+    eth->h_proto = htons(ETH_P_ARP);
+
+    arp->ar_hrd = htons(ARPHRD_ETHER);
+    arp->ar_pro = htons(ETH_P_IP);
+    arp->ar_hln = 6;
+    arp->ar_pln = 4;
+    arp->ar_op = htons(opcode);
+
+    memcpy(payload, sha, 6);
+    memcpy(payload + 6, &sip, 4);
+    memset(payload + 10, 0, 6);
+    memcpy(payload + 16, &tip, 4);
+
+    return 60;
+}
+
+/* 检测器回放上下文：事件时间戳改写为帧的抓包时间，使窗口与超时按原始时间线计算 */
+struct replay_ctx {
+    struct detector det;
+    struct output out;
+    uint64_t frame_ns;
+    uint64_t frames;
+    uint64_t events;
+};
+
+int replay_event(void *ctx, void *data, size_t data_sz)
+{
+    struct replay_ctx *rc = ctx;
+    struct arp_event event;
+
+    if (data_sz < sizeof(event))
+        return 0;
+    memcpy(&event, data, sizeof(event));
+    event.timestamp = rc->frame_ns;
+    rc->events++;
+    detector_process(&rc->det, &event);
+    return 0;
+}
+
+int replay_init(struct replay_ctx *rc, struct bench_prog *bp, const char *path)
+{
+    int rb_fd;
+
+    memset(rc, 0, sizeof(*rc));
+    if (load_prog(path, bp))
+        return -1;
+
+    /* 用回放回调替换默认的丢弃回调 */
+    if (bp->rb)
+        ring_buffer__free(bp->rb);
+    rb_fd = bpf_object__find_map_fd_by_name(bp->obj, "arp_events");
+    bp->rb = rb_fd >= 0 ? ring_buffer__new(rb_fd, replay_event, rc, NULL) : NULL;
+    if (!bp->rb) {
+        fprintf(stderr, "Error: Failed to open arp_events ring buffer\n");
+        unload_prog(bp);
+        return -1;
+    }
+
+    if (output_init(&rc->out, STDOUT_FILENO, OUTPUT_TEXT) ||
+        detector_init(&rc->det, NULL, &rc->out)) {
+        fprintf(stderr, "Error: Failed to initialize detector\n");
+        output_free(&rc->out);
+        unload_prog(bp);
+        return -1;
+    }
+    return 0;
+}
+
+void replay_free(struct replay_ctx *rc, struct bench_prog *bp)
+{
+    output_flush(&rc->out);
+    detector_free(&rc->det);
+    output_free(&rc->out);
+    unload_prog(bp);
+}
+
+/* 将一帧送入 XDP 程序，再把产生的事件交给检测器 */
+int replay_frame(struct replay_ctx *rc, struct bench_prog *bp,
+                 const uint8_t *data, uint32_t len, uint64_t ts_ns)
+{
+    LIBBPF_OPTS(bpf_test_run_opts, opts,
+        .data_in = data,
+        .data_size_in = len,
+        .repeat = 1,
+    );
+
+    rc->frame_ns = ts_ns;
+    rc->frames++;
+    if (bpf_prog_test_run_opts(bp->prog_fd, &opts))
+        return -errno;
+    ring_buffer__consume(bp->rb);
+    return 0;
+}
+
+/* 输出检测结果，每行 "detector.<名称> <值>"，便于脚本比较 */
+void print_detector_results(struct replay_ctx *rc)
+{
+    int i;
+
+    output_flush(&rc->out);
+    printf("detector.frames %lu\n", (unsigned long)rc->frames);
+    printf("detector.events %lu\n", (unsigned long)rc->events);
+    for (i = 0; i < DET_NR_ALERTS; i++)
+        printf("detector.%s %lu\n", detector_alert_str(i), (unsigned long)rc->det.alerts[i]);
+}
+
+static inline uint32_t pcap_u32(uint32_t v, int swapped)
+{
+    return swapped ? __builtin_bswap32(v) : v;
+}
+
+/* 回放经典 pcap 文件（以太网链路层），返回 0 成功 */
+int replay_pcap(const char *obj_path, const char *pcap_path)
+{
+    struct {
+        uint32_t magic;
+        uint16_t version_major, version_minor;
+        int32_t thiszone;
+        uint32_t sigfigs, snaplen, linktype;
+    } hdr;
+    struct {
+        uint32_t ts_sec, ts_frac, incl_len, orig_len;
+    } rec;
+    static uint8_t frame[REPLAY_MAX_FRAME];
+    struct replay_ctx rc;
+    struct bench_prog bp;
+    uint64_t frac_ns, skipped = 0;
+    int swapped, ret = 0;
+    FILE *f;
+
+    f = fopen(pcap_path, "rb");
+    if (!f) {
+        fprintf(stderr, "Error: Failed to open %s: %s\n", pcap_path, strerror(errno));
+        return -1;
+    }
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1) {
+        fprintf(stderr, "Error: %s is too short for a pcap header\n", pcap_path);
+        fclose(f);
+        return -1;
+    }
+
+    switch (hdr.magic) {
+        case 0xa1b2c3d4: swapped = 0; frac_ns = 1000; break;
+        case 0xd4c3b2a1: swapped = 1; frac_ns = 1000; break;
+        case 0xa1b23c4d: swapped = 0; frac_ns = 1; break;     /* 纳秒精度 */
+        case 0x4d3cb2a1: swapped = 1; frac_ns = 1; break;
+        default:
+            fprintf(stderr, "Error: %s is not a classic pcap file (pcapng is not supported)\n",
+                    pcap_path);
+            fclose(f);
+            return -1;
+    }
+    if (pcap_u32(hdr.linktype, swapped) != PCAP_LINKTYPE_ETHERNET) {
+        fprintf(stderr, "Error: %s: unsupported link type %u\n",
+                pcap_path, pcap_u32(hdr.linktype, swapped));
+        fclose(f);
+        return -1;
+    }
+
+    if (replay_init(&rc, &bp, obj_path)) {
+        fclose(f);
+        return -1;
+    }
+
+    while (fread(&rec, sizeof(rec), 1, f) == 1) {
+        uint32_t len = pcap_u32(rec.incl_len, swapped);
+        uint64_t ts = pcap_u32(rec.ts_sec, swapped) * 1000000000ULL +
+                      pcap_u32(rec.ts_frac, swapped) * frac_ns;
+
+        if (len > REPLAY_MAX_FRAME) {
+            if (fseek(f, len, SEEK_CUR))
+                break;
+            skipped++;
+            continue;
+        }
+        if (fread(frame, 1, len, f) != len)
+            break;
+        if (len < sizeof(struct ethhdr)) {
+            skipped++;
+            continue;
+        }
+        if (replay_frame(&rc, &bp, frame, len, ts)) {
+            fprintf(stderr, "Error: BPF_PROG_TEST_RUN failed: %s\n", strerror(errno));
+            ret = -1;
+            break;
+        }
+    }
+
+    print_detector_results(&rc);
+    printf("detector.skipped %lu\n", (unsigned long)skipped);
+    replay_free(&rc, &bp);
+    fclose(f);
+    return ret;
+}
+
+/* 合成场景中的一帧 */
+struct scenario_step {
+    uint64_t ts_ms;
+    uint16_t opcode;
+    uint8_t mac;        /* 发送方 MAC 的最后一个字节 */
+    uint8_t sip;        /* 10.0.0.x */
+    uint8_t tip;
+};
+
+/*
+ * 合成检测场景：覆盖每种线上告警，结果与期望值不一致时返回非 0。
+ * 不连接内核邻居表，NEIGH_MISMATCH 期望为 0。
+ */
+int replay_scenario(const char *obj_path)
+{
+    static const struct scenario_step steps[] = {
+        /* 正常的请求/应答，不告警 */
+        {     0, ARPOP_REQUEST, 0x0a, 1, 2 },
+        {   100, ARPOP_REPLY,   0x0b, 2, 1 },
+        /* 没有请求的应答 */
+        {  1000, ARPOP_REPLY,   0x0c, 3, 1 },
+        /* 另一个 MAC 在 0x0b 仍活跃时声明 10.0.0.2：IP 冲突（同时也是未请求的应答） */
+        {  1500, ARPOP_REPLY,   0x0d, 2, 1 },
+        /* 长时间后 10.0.0.2 换回原 MAC：MAC 变化 */
+        { 10000, ARPOP_REQUEST, 0x0b, 2, 1 },
+    };
+    static const uint64_t expected[DET_NR_ALERTS] = {
+        [DET_MAC_FLIP]          = 1,
+        [DET_DUPLICATE_IP]      = 1,
+        [DET_GARP_FLOOD]        = 1,
+        [DET_UNSOLICITED_REPLY] = 2,
+        [DET_NEIGH_MISMATCH]    = 0,
+    };
+    uint8_t mac[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x00};
+    uint8_t frame[MAX_FRAME_LEN] = {0};
+    struct replay_ctx rc;
+    struct bench_prog bp;
+    uint32_t len, ip;
+    int i, failures = 0;
+    size_t n;
+
+    if (replay_init(&rc, &bp, obj_path))
+        return -1;
+
+    for (n = 0; n < sizeof(steps) / sizeof(steps[0]); n++) {
+        mac[5] = steps[n].mac;
+        len = build_arp_claim(frame, steps[n].opcode, mac,
+                              htonl(0x0A000000 | steps[n].sip), htonl(0x0A000000 | steps[n].tip));
+        if (replay_frame(&rc, &bp, frame, len, steps[n].ts_ms * 1000000ULL))
+            goto fail;
+    }
+
+    /* 免费 ARP 风暴：10ms 间隔发送阈值 + 5 个 */
+    mac[5] = 0x0e;
+    ip = htonl(0x0A000009);
+    for (i = 0; i < DET_GARP_THRESHOLD + 5; i++) {
+        len = build_arp_claim(frame, ARPOP_REQUEST, mac, ip, ip);
+        if (replay_frame(&rc, &bp, frame, len, (20000 + i * 10) * 1000000ULL))
+            goto fail;
+    }
+
+    print_detector_results(&rc);
+    for (i = 0; i < DET_NR_ALERTS; i++) {
+        if (rc.det.alerts[i] != expected[i]) {
+            printf("detector.mismatch %s expected %lu got %lu\n", detector_alert_str(i),
+                   (unsigned long)expected[i], (unsigned long)rc.det.alerts[i]);
+            failures++;
+        }
+    }
+    printf("detector.result %s\n", failures ? "FAIL" : "PASS");
+    replay_free(&rc, &bp);
+    return failures;
+
+fail:
+    fprintf(stderr, "Error: BPF_PROG_TEST_RUN failed: %s\n", strerror(errno));
+    replay_free(&rc, &bp);
+    return -1;
+}
+
+double elapsed_sec(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* 读取接口在 packet_count 中的包数（各 CPU 求和） */
+uint64_t read_iface_packets(struct bench_prog *bp, int ifindex)
+{
+    int fd = bpf_object__find_map_fd_by_name(bp->obj, "packet_count");
+    int ncpus = libbpf_num_possible_cpus();
+    struct traffic_counter *values;
+    uint32_t key = ifindex;
+    uint64_t total = 0;
+    int i;
+
+    values = calloc(ncpus, sizeof(*values));
+    if (!values)
+        return 0;
+    if (bpf_map_lookup_elem(fd, &key, values) == 0) {
+        for (i = 0; i < ncpus; i++)
+            total += values[i].packets;
+    }
+    free(values);
+    return total;
+}
+
+/* 通过 AF_PACKET 在 sock 绑定的接口上持续发送 frame，返回发送的帧数 */
+uint64_t veth_send(int sock, const struct bench_frame *frame, int seconds, double *elapsed)
+{
+    struct mmsghdr msgs[VETH_TX_BATCH];
+    struct iovec iov = { (void *)frame->data, frame->len };
+    struct timespec start;
+    uint64_t sent = 0;
+    int i, n;
+
+    memset(msgs, 0, sizeof(msgs));
+    for (i = 0; i < VETH_TX_BATCH; i++) {
+        msgs[i].msg_hdr.msg_iov = &iov;
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        n = sendmmsg(sock, msgs, VETH_TX_BATCH, 0);
+        if (n > 0)
+            sent += n;
+        else if (errno != ENOBUFS && errno != EAGAIN && errno != EINTR)
+            break;
+    } while (elapsed_sec(&start) < seconds);
+
+    *elapsed = elapsed_sec(&start);
+    return sent;
+}
+
+/*
+ * 在 veth 对上比较 native 与 generic 模式：程序附加到 rx_name，从对端 tx_name 发送
+ * IPv4/UDP 帧，以 packet_count 的增量计算 XDP 实际处理的 pps。
+ * 驱动不支持的模式报告为 skipped。
+ */
+int veth_mode_compare(const char *obj_path, const char *pair, int seconds)
+{
+    static const struct {
+        const char *name;
+        uint32_t flags;
+    } modes[] = {
+        { "native",  XDP_FLAGS_DRV_MODE },
+        { "generic", XDP_FLAGS_SKB_MODE },
+    };
+    struct sockaddr_ll addr = { .sll_family = AF_PACKET };
+    char rx_name[IF_NAMESIZE], tx_name[IF_NAMESIZE];
+    struct bench_frame frames[MAX_FRAMES];
+    struct bench_prog bp;
+    int rx, tx, sock, one = 1;
+    size_t i;
+
+    if (sscanf(pair, "%15[^,],%15s", rx_name, tx_name) != 2) {
+        fprintf(stderr, "Error: Expected -V RX_DEV,TX_DEV, got %s\n", pair);
+        return -1;
+    }
+    rx = if_nametoindex(rx_name);
+    tx = if_nametoindex(tx_name);
+    if (!rx || !tx) {
+        fprintf(stderr, "Error: Interface %s not found\n", rx ? tx_name : rx_name);
+        return -1;
+    }
+
+    if (load_prog(obj_path, &bp))
+        return -1;
+    if (init_iface_counters(bp.obj, rx)) {
+        fprintf(stderr, "Error: Failed to initialize counters for %s\n", rx_name);
+        unload_prog(&bp);
+        return -1;
+    }
+
+    sock = socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC, 0);
+    addr.sll_ifindex = tx;
+    if (sock < 0 || bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "Error: Failed to open AF_PACKET socket on %s: %s\n",
+                tx_name, strerror(errno));
+        if (sock >= 0)
+            close(sock);
+        unload_prog(&bp);
+        return -1;
+    }
+    /* 跳过 qdisc，让发送端尽量不成为瓶颈 */
+    setsockopt(sock, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof(one));
+
+    build_frames(frames);
+    printf("═══ XDP attach mode comparison: %s -> %s, %ds per mode, %s frame ═══\n\n",
+           tx_name, rx_name, seconds, frames[0].name);
+    printf("%-10s %12s %12s %10s\n", "Mode", "TX pps", "XDP pps", "Mpps");
+
+    for (i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+        uint64_t before, after, sent;
+        double elapsed;
+        int err;
+
+        err = bpf_xdp_attach(rx, bp.prog_fd, XDP_FLAGS_UPDATE_IF_NOEXIST | modes[i].flags, NULL);
+        if (err) {
+            printf("%-10s skipped (%s)\n", modes[i].name, strerror(-err));
+            continue;
+        }
+
+        before = read_iface_packets(&bp, rx);
+        sent = veth_send(sock, &frames[0], seconds, &elapsed);
+        usleep(100000);     /* 等待对端队列中的帧处理完 */
+        after = read_iface_packets(&bp, rx);
+        bpf_xdp_detach(rx, XDP_FLAGS_UPDATE_IF_NOEXIST | modes[i].flags, NULL);
+
+        printf("%-10s %12.0f %12.0f %10.2f\n", modes[i].name, sent / elapsed,
+               (after - before) / elapsed, (after - before) / elapsed / 1e6);
+    }
+
+    close(sock);
+    unload_prog(&bp);
+    return 0;
+}
+
+void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [options] [percpu_obj] [shared_obj]\n", prog);
+    fprintf(stderr, "  -n repeat     BPF_PROG_TEST_RUN repeat count (default: %d)\n",
+            DEFAULT_REPEAT);
+    fprintf(stderr, "  -t threads    CPUs for the layout comparison (default: all online)\n");
+    fprintf(stderr, "  -b file       Compare against a baseline file, exit 2 on regression\n");
+    fprintf(stderr, "  -w file       Write results as a new baseline file\n");
+    fprintf(stderr, "  -T percent    Regression threshold (default: %.0f%%)\n",
+            DEFAULT_THRESHOLD);
+    fprintf(stderr, "  -s            Frame suite only, skip the config and layout comparisons\n");
+    fprintf(stderr, "  -p file.pcap  Replay a pcap through the program and the ARP detector\n");
+    fprintf(stderr, "  -S            Run the synthetic detector scenario, exit 2 on mismatch\n");
+    fprintf(stderr, "  -V rx,tx      Compare native and generic XDP on a veth pair: attach to rx,\n");
+    fprintf(stderr, "                send from its peer tx via AF_PACKET (both ends must be up)\n");
+    fprintf(stderr, "  -d seconds    Traffic duration per mode for -V (default: %d)\n",
+            VETH_DEFAULT_SECONDS);
+}
+
+int main(int argc, char **argv)
+{
+    const char *percpu_obj = DEFAULT_PERCPU_OBJ;
+    const char *shared_obj = DEFAULT_SHARED_OBJ;
+    const char *baseline_path = NULL, *write_path = NULL;
+    int nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    int repeat = DEFAULT_REPEAT;
+    double threshold = DEFAULT_THRESHOLD;
+    int suite_only = 0, scenario = 0;
+    const char *pcap_path = NULL;
+    const char *veth_pair = NULL;
+    int veth_seconds = VETH_DEFAULT_SECONDS;
+    struct bench_frame frames[MAX_FRAMES];
+    double mpps, ns;
+    int opt, ret, capture_mismatches;
+
+    while ((opt = getopt(argc, argv, "n:t:b:w:T:sp:SV:d:h")) != -1) {
+        switch (opt) {
+            case 'n':
+                repeat = atoi(optarg);
+                break;
+            case 't':
+                nthreads = atoi(optarg);
+                break;
+            case 'b':
+                baseline_path = optarg;
+                break;
+            case 'w':
+                write_path = optarg;
+                break;
+            case 'T':
+                threshold = atof(optarg);
+                break;
+            case 's':
+                suite_only = 1;
+                break;
+            case 'p':
+                pcap_path = optarg;
+                break;
+            case 'S':
+                scenario = 1;
+                break;
+            case 'V':
+                veth_pair = optarg;
+                break;
+            case 'd':
+                veth_seconds = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind < argc)
+        percpu_obj = argv[optind++];
+    if (optind < argc)
+        shared_obj = argv[optind++];
+
+    if (nthreads < 1 || repeat < 1 || veth_seconds < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    libbpf_set_print(NULL);
+
+    /* 检测器回放模式不运行性能测试 */
+    if (pcap_path)
+        return replay_pcap(percpu_obj, pcap_path) ? 1 : 0;
+    if (scenario) {
+        ret = replay_scenario(percpu_obj);
+        return ret < 0 ? 1 : ret > 0 ? 2 : 0;
+    }
+    if (veth_pair)
+        return veth_mode_compare(percpu_obj, veth_pair, veth_seconds) ? 1 : 0;
+
+    printf("═══ XDP frame suite (repeat %d) ═══\n\n", repeat);
+    ret = run_frame_suite(percpu_obj, repeat, baseline_path, write_path, threshold);
+    if (ret < 0)
+        return 1;
+
+    /* 抓包过滤是正确性检查，只运行一次，-s 时也运行 */
+    printf("\n═══ Capture filter check ═══\n\n");
+    capture_mismatches = run_capture_suite(percpu_obj);
+    if (capture_mismatches < 0)
+        return 1;
+
+    if (!suite_only) {
+        printf("\n═══ Runtime config comparison (ns/pkt, delta vs default) ═══\n\n");
+        run_config_suite(percpu_obj, repeat);
+
+        build_frames(frames);
+        printf("\n═══ Counter layout comparison: %d CPU(s), %s frame ═══\n\n",
+               nthreads, frames[LAYOUT_FRAME].name);
+        printf("%-16s %12s %12s\n", "Layout", "ns/pkt", "Mpps");
+
+        if (bench_concurrent(percpu_obj, nthreads, repeat, &frames[LAYOUT_FRAME], &mpps, &ns) == 0)
+            printf("%-16s %12.1f %12.2f\n", "percpu", ns, mpps);
+
+        if (bench_concurrent(shared_obj, nthreads, repeat, &frames[LAYOUT_FRAME], &mpps, &ns) == 0)
+            printf("%-16s %12.1f %12.2f\n", "shared-atomic", ns, mpps);
+    }
+
+    if (capture_mismatches > 0)
+        printf("\n%d capture filter mismatch(es)\n", capture_mismatches);
+    if (ret > 0)
+        printf("\n%d regression(s) against %s\n", ret, baseline_path);
+    return ret > 0 || capture_mismatches > 0 ? 2 : 0;
+}
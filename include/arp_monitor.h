@@ -3,6 +3,25 @@
 
 #include <stdint.h>
 
+/* 同一对象可附加的最大接口数（与 eBPF 程序中的定义一致） */
+#define MAX_INTERFACES 1024
+
+/* 流量计数：包数与字节数（与 eBPF 程序中的结构一致） */
+struct traffic_counter {
+    uint64_t packets;
+    uint64_t bytes;
+};
+
+/* IPv4 五元组流标识（网络字节序） */
+struct flow_key {
+    uint32_t saddr;
+    uint32_t daddr;
+    uint16_t sport;
+    uint16_t dport;
+    uint8_t proto;
+    uint8_t pad[3];
+};
+
 /* ARP 操作类型统计（与 eBPF 程序中的结构一致） */
 struct arp_stats {
     uint64_t arp_request;   /* ARP 请求 */
@@ -20,6 +39,210 @@ struct arp_event {
     uint8_t dst_mac[6];     /* 目标 MAC 地址 */
     uint16_t opcode;        /* ARP 操作码 */
     uint64_t timestamp;     /* 时间戳 */
+    uint64_t first_seen;    /* 聚合模式下本事件覆盖的起始时间 */
+    uint32_t count;         /* 聚合模式下本事件代表的 ARP 包数 */
+    uint32_t ifindex;       /* 接收接口 */
+};
+
+/* ARP 聚合 key：(接收接口, 源 IP, 目标 IP, 操作码) */
+struct arp_agg_key {
+    uint32_t src_ip;
+    uint32_t dst_ip;
+    uint32_t ifindex;
+    uint16_t opcode;
+    uint16_t pad;
+};
+
+/* ARP 聚合状态 */
+struct arp_agg_value {
+    uint64_t count;         /* 当前窗口内被合并、尚未上报的次数 */
+    uint64_t first_seen;    /* 元组首次出现时间 */
+    uint64_t last_seen;     /* 最近一次出现时间 */
+    uint64_t window_start;  /* 当前窗口起始时间（上次上报时间） */
+};
+
+/* 运行时配置（与 eBPF 程序中的结构一致） */
+struct monitor_config {
+    uint32_t sample_rate;      /* 事件 1-in-N 采样，0 或 1 表示全部上报 */
+    uint32_t rate_limit_pps;   /* 每个源（MAC + IP）每 CPU 每秒事件数，0 表示不限速 */
+    uint32_t rate_limit_burst; /* 令牌桶容量 */
+    uint32_t agg_window_ms;    /* 聚合窗口（毫秒），0 表示不聚合 */
+    uint32_t enforce;          /* 非 0 时丢弃违反可信绑定的 ARP 应答与免费 ARP */
+    uint32_t capture_snaplen;  /* 抓包时每帧复制的最大字节数，0 表示不抓包 */
+    uint16_t capture_ethertype; /* 只抓该 EtherType 的帧（主机字节序），0 表示全部 */
+    uint16_t capture_arp_op;   /* 只抓该操作码的 ARP 帧，0 表示全部 */
+    uint32_t disabled;         /* 关闭的功能（FEATURE_*），0 表示全部启用 */
+    uint32_t subnet_filter;    /* 启用的子网过滤（FILTER_SRC/FILTER_DST） */
+};
+
+/* 功能开关（monitor_config.disabled 中的位，与 eBPF 程序一致） */
+#define FEATURE_IP_STATS    0x01    /* IPv4 协议与源地址统计 */
+#define FEATURE_FLOW_STATS  0x02    /* IPv4 五元组流统计 */
+#define FEATURE_ARP_EVENTS  0x04    /* ARP 事件上报 */
+#define FEATURE_NDP_EVENTS  0x08    /* NDP 事件上报 */
+#define FEATURE_ARP_LATENCY 0x10    /* ARP 解析时延 */
+#define FEATURE_VLAN_STATS  0x20    /* 按 VLAN 统计 */
+
+/* 子网过滤（monitor_config.subnet_filter 中的位） */
+#define FILTER_SRC          0x1
+#define FILTER_DST          0x2
+
+/* 子网过滤 LPM trie 的 key（与 eBPF 程序一致），地址为网络字节序 */
+struct subnet_key {
+    uint32_t prefixlen;
+    uint32_t addr;
+};
+
+/* 被子网过滤跳过的报文数 */
+struct filter_stats {
+    uint64_t ipv4_filtered;
+    uint64_t arp_filtered;
+};
+
+/* event_stats 的索引（与 eBPF 程序一致） */
+enum event_source {
+    EVENT_SRC_ARP,
+    EVENT_SRC_NDP,
+    EVENT_SRC_CAPTURE,
+    EVENT_SRC_MAX
+};
+
+/* 事件上报统计 */
+struct event_stats {
+    uint64_t submitted;     /* 成功提交到 ring buffer */
+    uint64_t sampled_out;   /* 采样丢弃 */
+    uint64_t rate_limited;  /* 令牌桶限速丢弃 */
+    uint64_t ringbuf_full;  /* ring buffer 已满丢弃 */
+    uint64_t aggregated;    /* 聚合窗口内被合并的重复事件 */
+};
+
+/* 可信绑定 key（与 eBPF 程序中的结构一致） */
+struct binding_key {
+    uint32_t ifindex;
+    uint32_t ip;            /* 网络字节序 */
+};
+
+/* 静态文件中的绑定，邻居表变化不会修改或删除 */
+#define BINDING_STATIC 0x1
+
+/* 可信绑定 */
+struct binding_value {
+    uint8_t mac[6];
+    uint16_t flags;
+};
+
+/* 强制模式统计 */
+struct enforce_stats {
+    uint64_t checked;          /* 检查过的 ARP 应答与免费 ARP */
+    uint64_t unknown;          /* 没有可信绑定，放行 */
+    uint64_t reply_mismatch;   /* 应答的发送方 MAC 与可信绑定不一致 */
+    uint64_t garp_mismatch;    /* 免费 ARP 的发送方 MAC 与可信绑定不一致 */
+    uint64_t sha_mismatch;     /* 以太网源地址与 ARP 发送方硬件地址不一致（只计数，不丢弃） */
+};
+
+/* IPv6 邻居发现消息类型（ICMPv6） */
+#define NDP_ROUTER_SOLICIT      133
+#define NDP_ROUTER_ADVERT       134
+#define NDP_NEIGH_SOLICIT       135
+#define NDP_NEIGH_ADVERT        136
+
+/* 邻居通告标志 */
+#define NDP_NA_FLAG_ROUTER      0x80
+#define NDP_NA_FLAG_SOLICITED   0x40
+#define NDP_NA_FLAG_OVERRIDE    0x20
+
+/* NDP 统计（与 eBPF 程序中的结构一致） */
+struct ndp_stats {
+    uint64_t router_solicit;   /* RS */
+    uint64_t router_advert;    /* RA */
+    uint64_t neigh_solicit;    /* NS */
+    uint64_t neigh_advert;     /* NA */
+    uint64_t total_packets;    /* 总 NDP 包数 */
+};
+
+/* NDP 事件记录 */
+struct ndp_event {
+    uint8_t src_ip[16];     /* IPv6 源地址 */
+    uint8_t dst_ip[16];     /* IPv6 目标地址 */
+    uint8_t target[16];     /* NS/NA 的目标地址，RS/RA 为全零 */
+    uint8_t src_mac[6];     /* 以太网源地址 */
+    uint8_t lladdr[6];      /* 源/目标链路层地址选项，缺失时为全零 */
+    uint8_t type;           /* ICMPv6 类型 */
+    uint8_t flags;          /* NA 的 R/S/O 标志 */
+    uint16_t pad;
+    uint64_t timestamp;     /* 时间戳 */
+    uint64_t first_seen;    /* 聚合模式下本事件覆盖的起始时间 */
+    uint32_t count;         /* 聚合模式下本事件代表的 NDP 包数 */
+    uint32_t ifindex;       /* 接收接口 */
+};
+
+/* NDP 聚合 key：(接收接口, 源地址, 目标地址, 类型)，值为 struct arp_agg_value */
+struct ndp_agg_key {
+    uint8_t src_ip[16];
+    uint8_t target[16];
+    uint32_t ifindex;
+    uint8_t type;
+    uint8_t pad[3];
+};
+
+/* 协议处理程序在 dispatch（BPF_MAP_TYPE_PROG_ARRAY）中的槽位，与 eBPF 程序一致 */
+enum dispatch_slot {
+    DISPATCH_ARP,
+    DISPATCH_IPV4,
+    DISPATCH_IPV6,
+    DISPATCH_VLAN,
+    DISPATCH_CAPTURE,
+    DISPATCH_MAX
+};
+
+/* VLAN 计数 key（与 eBPF 程序一致）：单层标签的 inner_vid 为 0 */
+struct vlan_key {
+    uint32_t ifindex;
+    uint16_t vid;           /* 外层 VID（802.1ad S-tag 或唯一的 802.1Q 标签） */
+    uint16_t inner_vid;     /* QinQ 内层 VID */
+};
+
+/* VLAN 计数器 */
+struct vlan_counter {
+    uint64_t packets;
+    uint64_t bytes;
+    uint64_t arp_packets;
+};
+
+/* 抓包记录头（与 eBPF 程序一致），随后是帧的前 caplen 字节 */
+struct capture_hdr {
+    uint64_t timestamp;     /* bpf_ktime_get_ns() */
+    uint32_t ifindex;       /* 接收接口 */
+    uint32_t len;           /* 帧的实际长度 */
+    uint32_t caplen;        /* 随后的字节数 */
+    uint32_t pad;
+};
+
+/*
+ * ARP 解析时延直方图（与 eBPF 程序中的定义一致）：按 log2(微秒) 分桶，
+ * 桶 i 覆盖 [2^i, 2^(i+1)) 微秒，桶 0 含 0–1 微秒
+ */
+#define ARP_LATENCY_SLOTS       24
+#define ARP_LATENCY_TIMEOUT     ARP_LATENCY_SLOTS       /* 内核计数的超时请求 */
+#define ARP_LATENCY_EXPIRED     (ARP_LATENCY_SLOTS + 1) /* 用户空间清扫的超时请求 */
+#define ARP_RESOLVE_TIMEOUT_NS  (3ULL * 1000000000ULL)
+
+/* 未应答的 ARP 请求（网络字节序） */
+struct arp_pending_key {
+    uint32_t target_ip;
+    uint32_t requester_ip;
+};
+
+struct arp_pending_value {
+    uint64_t timestamp;     /* 第一次请求的时间（CLOCK_MONOTONIC 纳秒） */
+    uint32_t ifindex;
+    uint32_t pad;
+};
+
+/* 时延直方图 key，值为 struct traffic_counter（次数，时延之和纳秒） */
+struct arp_latency_key {
+    uint32_t ifindex;
+    uint32_t slot;
 };
 
 /* Netlink ARP 表事件类型 */
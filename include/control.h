@@ -0,0 +1,41 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "arp_monitor.h"
+
+/* pin 模式的默认目录，"netmon config" 通过其中的 map 修改运行中的配置 */
+#define DEFAULT_PIN_DIR "/sys/fs/bpf/netmon"
+
+/* 每个子网过滤 LPM trie 的最大前缀数（与 eBPF 程序一致） */
+#define SUBNET_FILTER_MAX   1024
+
+/* 解析逗号分隔的功能名称（ip、flows、arp-events、ndp-events、events、arp-latency、vlan、all） */
+int control_parse_features(const char *arg, uint32_t *mask);
+/* 把 FEATURE_* 位格式化为逗号分隔的名称，没有任何位时为 "none" */
+const char *control_format_features(uint32_t mask, char *buf, size_t size);
+
+/* 解析 "a.b.c.d[/len]"，省略长度时为 /32 */
+int control_parse_subnet(const char *arg, struct subnet_key *key);
+/* 解析逗号分隔的前缀列表（去重）到 keys（SUBNET_FILTER_MAX 项），返回前缀数，失败返回负 errno */
+int control_parse_subnets(const char *list, struct subnet_key *keys);
+/* 读取 LPM trie 中的前缀到 keys（SUBNET_FILTER_MAX 项），返回前缀数 */
+int control_read_subnets(int map_fd, struct subnet_key *keys);
+/*
+ * 把 LPM trie 替换为 keys 中的 n 个前缀：先插入新前缀再删除多余的，
+ * 替换过程中匹配的是新旧两组前缀的并集，不会出现空表。返回前缀数，失败返回负 errno
+ */
+int control_replace_subnets(int map_fd, const struct subnet_key *keys, int n);
+/* 解析逗号分隔的前缀列表（"" 表示清空）后替换 LPM trie */
+int control_load_subnets(int map_fd, const char *list);
+/* 打印 LPM trie 中的前缀，每行一个，前面加 indent */
+void control_print_subnets(int map_fd, const char *indent);
+
+/* 打印运行时配置（功能开关、采样、限速与子网过滤） */
+void control_print(const struct monitor_config *cfg, int src_fd, int dst_fd);
+
+/* "netmon config" 子命令：查看或修改 pin 模式下运行中的配置，不重新加载程序 */
+int control_main(int argc, char **argv);
+
+#endif /* CONTROL_H */
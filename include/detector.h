@@ -0,0 +1,87 @@
+#ifndef DETECTOR_H
+#define DETECTOR_H
+
+#include <stdint.h>
+#include "arp_monitor.h"
+#include "neigh_table.h"
+#include "output.h"
+
+/* 默认检测参数 */
+#define DET_REQUEST_TIMEOUT_NS  (5 * 1000000000ULL)  /* 请求等待应答的时间 */
+#define DET_DUP_WINDOW_NS       (2 * 1000000000ULL)  /* 旧 MAC 在该时间内仍活跃视为 IP 冲突 */
+#define DET_GARP_WINDOW_NS      (1 * 1000000000ULL)  /* 免费 ARP 计数窗口 */
+#define DET_GARP_THRESHOLD      10                   /* 每个窗口内同一源的免费 ARP 上限 */
+#define DET_ALERT_HOLDOFF_NS    (1 * 1000000000ULL)  /* 同一 IP 同类告警的最小间隔 */
+
+/* 告警类型 */
+enum det_alert {
+    DET_MAC_FLIP,           /* IP 绑定的 MAC 发生变化 */
+    DET_DUPLICATE_IP,       /* 两个 MAC 同时声明同一 IP */
+    DET_GARP_FLOOD,         /* 同一源的免费 ARP 超过阈值 */
+    DET_UNSOLICITED_REPLY,  /* 没有对应请求的 ARP 应答 */
+    DET_NEIGH_MISMATCH,     /* 线上看到的绑定与内核邻居表不一致 */
+    DET_NR_ALERTS
+};
+
+/*
+ * 检测表的公共槽位头：key 不超过 16 字节，last_seen 用于淘汰。
+ * 各表容量固定、探测长度有上限，找不到空槽时替换探测窗口内最久未使用的条目，
+ * 查找与插入都是 O(1)，不会因 ARP 风暴而增长。
+ */
+struct det_slot {
+    uint8_t key[16];
+    uint64_t last_seen;
+    uint8_t used;
+};
+
+/* IP -> MAC 绑定 */
+struct det_binding {
+    struct det_slot slot;   /* key: ifindex, ip */
+    uint8_t mac[6];
+    uint8_t prev_mac[6];
+    uint64_t first_seen;
+    uint64_t flips;
+    uint64_t alert_ns[DET_NR_ALERTS];
+};
+
+/* 未应答的 ARP 请求 */
+struct det_request {
+    struct det_slot slot;   /* key: ifindex, 请求方 IP, 目标 IP */
+    uint32_t pending;       /* 收到应答后清零，一个请求只匹配一次应答 */
+};
+
+/* 每个源 MAC 的免费 ARP 计数 */
+struct det_garp {
+    struct det_slot slot;   /* key: ifindex, MAC */
+    uint64_t window_start;
+    uint32_t count;
+    uint32_t alerted;
+};
+
+struct det_table {
+    void *slots;
+    uint32_t mask;
+    uint32_t entry_size;
+};
+
+struct detector {
+    struct det_table bindings;
+    struct det_table requests;
+    struct det_table garps;
+    struct neigh_table *neigh;  /* 可为 NULL，用于与内核邻居表关联及接口名 */
+    struct output *out;
+    uint64_t events;
+    uint64_t alerts[DET_NR_ALERTS];
+};
+
+int detector_init(struct detector *d, struct neigh_table *neigh, struct output *out);
+void detector_free(struct detector *d);
+
+/* 处理一个线上 ARP 事件 */
+void detector_process(struct detector *d, const struct arp_event *event);
+/* 内核邻居表变化时调用，与线上绑定比较 */
+void detector_neigh_update(struct detector *d, const struct neigh_entry *e, uint64_t now);
+
+const char *detector_alert_str(enum det_alert alert);
+
+#endif /* DETECTOR_H */
@@ -0,0 +1,69 @@
+#ifndef EXPORTER_H
+#define EXPORTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* 默认监听地址（只监听本机） */
+#define EXPORTER_DEFAULT_ADDR   "127.0.0.1"
+
+/* 同时处理的最大连接数，超过时新连接直接关闭 */
+#define EXPORTER_MAX_CLIENTS    16
+/* 请求头的最大长度 */
+#define EXPORTER_REQ_SIZE       2048
+
+/* 一个 HTTP 连接 */
+struct exporter_client {
+    int fd;                 /* -1 表示空闲 */
+    size_t req_len;
+    char req[EXPORTER_REQ_SIZE];
+    char *pending;          /* 未能一次写完的响应剩余部分 */
+    size_t pending_len;
+    size_t pending_off;
+};
+
+/* 渲染缓冲区 */
+struct exporter_buf {
+    char *data;
+    size_t len;
+    size_t cap;
+};
+
+/*
+ * OpenMetrics 导出器：统计定时器触发时渲染一份文本快照，
+ * 每次抓取只把缓存的快照写给客户端，不读取任何 BPF map。
+ */
+struct exporter {
+    int listen_fd;
+    int epfd;               /* 监听 socket 和所有连接，整体注册到主 epoll */
+    struct exporter_buf body;   /* 对外提供的快照 */
+    struct exporter_buf next;   /* 正在渲染的快照 */
+    uint64_t renders;
+    uint64_t scrapes;
+    uint64_t errors;        /* 错误请求与写失败 */
+    struct exporter_client clients[EXPORTER_MAX_CLIENTS];
+};
+
+/* addr 为 "[地址:]端口"，省略地址时监听 EXPORTER_DEFAULT_ADDR */
+int exporter_init(struct exporter *exp, const char *addr);
+void exporter_free(struct exporter *exp);
+
+/* 主 epoll 中注册的 fd，可读时调用 exporter_handle */
+static inline int exporter_fd(const struct exporter *exp)
+{
+    return exp->epfd;
+}
+void exporter_handle(struct exporter *exp);
+
+/* 渲染：exporter_begin 之后逐个添加指标族和样本，exporter_commit 替换对外快照 */
+void exporter_begin(struct exporter *exp);
+/* type 为 "counter"、"gauge" 或 "info"；counter 的样本名需带 _total 后缀，info 带 _info 后缀 */
+void exporter_family(struct exporter *exp, const char *name, const char *type, const char *help);
+/* labels 为 NULL 或已格式化的 'name="value",...'，值需经 exporter_escape 处理 */
+void exporter_sample(struct exporter *exp, const char *name, const char *labels, uint64_t value);
+void exporter_commit(struct exporter *exp);
+
+/* 转义标签值中的 \ 和 " 以及换行 */
+const char *exporter_escape(const char *value, char *buf, size_t size);
+
+#endif /* EXPORTER_H */
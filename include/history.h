@@ -0,0 +1,110 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* 默认采样间隔（秒）与内存中保留的采样数（1 秒分辨率下 1 小时） */
+#define HISTORY_DEFAULT_RESOLUTION  1
+#define HISTORY_DEFAULT_SAMPLES     3600
+/* 历史文件默认保留时长（小时） */
+#define HISTORY_DEFAULT_RETENTION   168
+/* 选项上限：采样间隔 1 小时，内存中约 90MB 的采样，历史文件保留 1 年 */
+#define HISTORY_MAX_RESOLUTION      3600
+#define HISTORY_MAX_SAMPLES         (1U << 20)
+#define HISTORY_MAX_RETENTION       8760
+/* 历史文件写回磁盘的间隔（秒） */
+#define HISTORY_SYNC_INTERVAL       60
+
+#define HISTORY_MAGIC       "NMHIST1"
+#define HISTORY_VERSION     1
+
+/* 每个采样记录的计数器（采样间隔内的增量，所有被监控接口之和） */
+enum history_counter {
+    HIST_PACKETS,
+    HIST_BYTES,
+    HIST_ARP,
+    HIST_ARP_REQUEST,
+    HIST_ARP_REPLY,
+    HIST_NDP,
+    HIST_EVENTS,        /* 提交到 ring buffer 的 ARP/NDP 事件 */
+    HIST_EVENT_DROPS,   /* 采样、限速和 ring buffer 已满丢弃的事件 */
+    HISTORY_NR_COUNTERS
+};
+
+/* 一个采样：定长记录，内存环与历史文件使用同一格式 */
+struct history_record {
+    uint64_t timestamp_ns;  /* 采样时间（CLOCK_REALTIME） */
+    uint32_t interval_ms;   /* 与上一个采样的实际间隔 */
+    uint32_t pad;
+    uint64_t delta[HISTORY_NR_COUNTERS];
+};
+
+/*
+ * 历史文件：头部之后是 capacity 个记录组成的环，整个文件 mmap 后直接写入记录，
+ * 采样路径上没有系统调用。written 为累计写入数，记录 i 位于 i % capacity，
+ * 最近的 min(written, capacity) 个记录有效且按时间排序，读取方可以二分查找时间范围。
+ */
+struct history_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t resolution;    /* 创建时的采样间隔（秒），记录中的 interval_ms 为准 */
+    uint32_t capacity;
+    uint64_t written;
+    uint8_t reserved[32];
+};
+
+/*
+ * 采样历史：内存中的固定大小环用于计算速率和显示峰值，可选地同时追加到历史文件。
+ * history_add() 接收累计计数器，与上一次的值相减得到增量；计数器变小
+ * （重新加载 map）时按重置处理，本次的值即为增量。
+ */
+struct history {
+    struct history_record *ring;
+    uint32_t capacity;
+    uint32_t count;
+    uint32_t head;          /* 下一个写入位置 */
+    uint32_t resolution;    /* 采样间隔（秒） */
+    uint64_t prev[HISTORY_NR_COUNTERS];
+    uint64_t prev_ns;       /* 上一次采样的 CLOCK_MONOTONIC 时间，0 表示还没有基准 */
+
+    int fd;                 /* 历史文件，-1 表示不写文件 */
+    struct history_file_header *hdr;
+    struct history_record *file_records;
+    size_t map_len;
+    uint64_t last_sync_ns;
+};
+
+/* 一段记录的汇总：各计数器的总量、峰值速率及其发生时间 */
+struct history_summary {
+    uint64_t samples;
+    uint64_t first_ns;      /* 第一个采样区间的起始时间 */
+    uint64_t last_ns;
+    uint64_t duration_ms;   /* 各采样间隔之和 */
+    uint64_t total[HISTORY_NR_COUNTERS];
+    double peak[HISTORY_NR_COUNTERS];       /* 每秒 */
+    uint64_t peak_ns[HISTORY_NR_COUNTERS];
+};
+
+/* samples 为 0 时只写文件（仍需 1 个采样的环） */
+int history_init(struct history *h, uint32_t samples, uint32_t resolution);
+/* 打开或创建历史文件，已有文件的容量和采样间隔必须一致；失败返回负 errno */
+int history_open_file(struct history *h, const char *path, uint32_t capacity);
+void history_free(struct history *h);
+
+/* 加入一个采样：counters 为累计值，now_real_ns/now_mono_ns 为当前时间 */
+void history_add(struct history *h, const uint64_t *counters,
+                 uint64_t now_real_ns, uint64_t now_mono_ns);
+
+/* 汇总最近 seconds 秒内的内存记录，返回记录数 */
+uint64_t history_recent(const struct history *h, uint32_t seconds, struct history_summary *sum);
+void history_summary_add(struct history_summary *sum, const struct history_record *r);
+/* 打印速率表（平均与峰值），title 为表头 */
+void history_print_summary(const struct history_summary *sum, const char *title);
+
+/* "netmon history" 子命令：汇总或导出历史文件中的一段时间 */
+int history_main(int argc, char **argv);
+
+#endif /* HISTORY_H */
@@ -0,0 +1,89 @@
+#ifndef NEIGH_TABLE_H
+#define NEIGH_TABLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <net/if.h>
+
+/* 邻居地址最大长度（IPv6） */
+#define NEIGH_ADDR_LEN      16
+
+/* NUD 状态位数（NUD_INCOMPLETE..NUD_PERMANENT），状态序号 0 表示无状态 */
+#define NEIGH_NR_STATES     9
+
+/* 邻居表 key：(地址族, 接口, 地址) */
+struct neigh_key {
+    uint8_t family;
+    uint8_t pad[3];
+    int32_t ifindex;
+    uint8_t addr[NEIGH_ADDR_LEN];
+};
+
+/* 邻居表条目 */
+struct neigh_entry {
+    struct neigh_key key;
+    uint8_t lladdr[6];
+    uint16_t state;         /* NUD_* */
+    uint64_t updated_ns;    /* 最近一次变化的单调时钟时间 */
+    uint64_t changes;       /* 状态或 MAC 变化次数 */
+    uint8_t used;           /* 槽位状态：0 空、1 占用、2 已删除 */
+};
+
+/* 一次更新对表的影响 */
+enum neigh_change {
+    NEIGH_UNCHANGED,        /* 条目已存在且状态、MAC 均未变化 */
+    NEIGH_ADDED,
+    NEIGH_UPDATED,
+    NEIGH_DELETED,
+};
+
+/*
+ * 用户空间邻居表：开放寻址哈希表，启动时由 RTM_GETNEIGH dump 填充，
+ * 之后按 RTM_NEWNEIGH/RTM_DELNEIGH 增量更新。同时缓存 ifindex 到接口名的映射，
+ * 由 RTM_NEWLINK/RTM_DELLINK 维护，避免每条消息调用 if_indextoname。
+ */
+struct neigh_table {
+    struct neigh_entry *slots;
+    uint32_t capacity;      /* 2 的幂 */
+    uint32_t count;
+    uint32_t tombstones;
+
+    /* 统计 */
+    uint64_t adds;
+    uint64_t updates;
+    uint64_t deletes;
+    uint64_t unchanged;
+    uint64_t transitions[NEIGH_NR_STATES][NEIGH_NR_STATES];    /* [旧状态][新状态] */
+
+    /* ifindex -> 接口名缓存，按 ifindex 直接索引 */
+    char (*ifnames)[IF_NAMESIZE];
+    uint32_t ifnames_cap;
+};
+
+int neigh_table_init(struct neigh_table *t, uint32_t capacity);
+void neigh_table_free(struct neigh_table *t);
+/* 清空邻居条目（保留统计和接口名缓存），用于重新 dump 同步 */
+void neigh_table_clear(struct neigh_table *t);
+
+struct neigh_entry *neigh_table_lookup(struct neigh_table *t, const struct neigh_key *key);
+/* 插入或更新条目；lladdr 可为 NULL（例如 INCOMPLETE 状态）；entry 返回更新后的条目 */
+enum neigh_change neigh_table_update(struct neigh_table *t, const struct neigh_key *key,
+                                     const uint8_t *lladdr, uint16_t state,
+                                     struct neigh_entry **entry);
+/* 删除条目，old 不为 NULL 时返回删除前的内容 */
+enum neigh_change neigh_table_delete(struct neigh_table *t, const struct neigh_key *key,
+                                     struct neigh_entry *old);
+
+/* 遍历有效条目：*pos 从 0 开始，结束时返回 NULL */
+struct neigh_entry *neigh_table_next(struct neigh_table *t, uint32_t *pos);
+
+/* NUD 状态位转换为 0..NEIGH_NR_STATES-1 的序号 */
+int neigh_state_index(uint16_t state);
+
+/* 接口名缓存 */
+int neigh_link_set(struct neigh_table *t, int ifindex, const char *name);
+void neigh_link_del(struct neigh_table *t, int ifindex);
+/* 缓存未命中时调用一次 if_indextoname 并缓存结果，失败返回 "?" */
+const char *neigh_link_name(struct neigh_table *t, int ifindex);
+
+#endif /* NEIGH_TABLE_H */
@@ -0,0 +1,57 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+/* 输出缓冲：OUTPUT_CHUNKS 个 OUTPUT_CHUNK_SIZE 字节的块，写满或超时后用 writev 一次写出 */
+#define OUTPUT_CHUNK_SIZE   (64 * 1024)
+#define OUTPUT_CHUNKS       16
+
+/* 单条记录的最大长度，output_reserve 保证至少有这么多空间 */
+#define OUTPUT_MAX_RECORD   512
+
+/* 输出格式 */
+enum output_format {
+    OUTPUT_TEXT,            /* 文本，每个事件一行 */
+    OUTPUT_BINARY,          /* 定长二进制记录（struct arp_event） */
+};
+
+/* 输出阶段 */
+struct output {
+    int fd;
+    enum output_format format;
+    char *buf;                      /* OUTPUT_CHUNKS * OUTPUT_CHUNK_SIZE */
+    struct iovec iov[OUTPUT_CHUNKS];
+    int cur;                        /* 当前写入的块 */
+    uint64_t last_flush_ns;
+    uint64_t bytes_written;
+    uint64_t flushes;
+};
+
+int output_init(struct output *out, int fd, enum output_format format);
+void output_free(struct output *out);
+
+/* 返回至少 len 字节的可写空间（len <= OUTPUT_MAX_RECORD），必要时先刷新 */
+char *output_reserve(struct output *out, size_t len);
+/* 提交 output_reserve 返回空间中实际写入的 len 字节 */
+void output_commit(struct output *out, size_t len);
+/* 追加任意数据 */
+void output_write(struct output *out, const void *data, size_t len);
+
+/* 将缓冲区内容用 writev 写出 */
+int output_flush(struct output *out);
+/* 距上次刷新超过 max_delay_ns 时刷新 */
+int output_flush_if_due(struct output *out, uint64_t now_ns, uint64_t max_delay_ns);
+/* 缓冲区中是否有未写出的数据 */
+int output_pending(const struct output *out);
+
+/* 无分配的格式化函数：写入 p，返回写入结束位置（不写入结尾的 '\0'） */
+char *fmt_str(char *p, const char *s);
+char *fmt_u64(char *p, uint64_t v);
+char *fmt_ipv4(char *p, uint32_t ip);           /* 网络字节序 */
+char *fmt_ipv6(char *p, const uint8_t *addr);   /* 16 字节，网络字节序 */
+char *fmt_mac(char *p, const uint8_t *mac);
+
+#endif /* OUTPUT_H */
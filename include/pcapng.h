@@ -0,0 +1,64 @@
+#ifndef PCAPNG_H
+#define PCAPNG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include <net/if.h>
+
+/* 写缓冲区大小，O_DIRECT 下每次写出其中的整块部分 */
+#define PCAPNG_BUF_SIZE     (1024 * 1024)
+/* O_DIRECT 要求的偏移、长度与内存对齐 */
+#define PCAPNG_ALIGN        4096
+/* 单个包记录的最大捕获长度 */
+#define PCAPNG_MAX_SNAPLEN  65535
+
+/* 文件中的一个接口（Interface Description Block），序号即 EPB 中的接口 ID */
+struct pcapng_iface {
+    int ifindex;
+    char name[IF_NAMESIZE];
+};
+
+/*
+ * pcapng 写入器：包记录追加到对齐的缓冲区，攒满后以 O_DIRECT pwrite 整块写出，
+ * 不经过页缓存、每次系统调用写入大量记录。文件系统不支持 O_DIRECT（如 tmpfs）时退回普通写。
+ * 未满一块的尾部由 pcapng_sync() 补零写出，关闭或轮转时截断到实际长度。
+ *
+ * rotate_bytes 不为 0 时，文件超过该大小后依次写入 path.0、path.1 ...，
+ * rotate_count 不为 0 时只保留 rotate_count 个文件，循环覆盖最旧的文件。
+ */
+struct pcapng_writer {
+    char path[PATH_MAX];
+    char file[PATH_MAX + 16];   /* 当前文件名（path 加轮转序号） */
+    int fd;
+    bool direct;                /* 当前文件以 O_DIRECT 打开 */
+    uint8_t *buf;               /* PCAPNG_BUF_SIZE 字节，PCAPNG_ALIGN 对齐 */
+    uint32_t len;               /* 缓冲区中的字节数 */
+    uint64_t buf_off;           /* 缓冲区起始位置在文件中的偏移（对齐） */
+    uint64_t rotate_bytes;
+    uint32_t rotate_count;
+    uint32_t file_index;
+    uint32_t snaplen;
+    const struct pcapng_iface *ifaces;
+    int nr_ifaces;
+    int last_iface;             /* 上一个包的接口序号，连续的包通常来自同一接口 */
+    int64_t realtime_offset_ns; /* CLOCK_REALTIME - CLOCK_MONOTONIC，转换 bpf_ktime_get_ns() */
+
+    uint64_t packets;           /* 已写入的包数 */
+    uint64_t bytes;             /* 已写入的字节数（所有文件） */
+    uint64_t files;             /* 已打开的文件数 */
+};
+
+/* 打开第一个文件并写入 Section Header 与每个接口的 Interface Description，失败返回负 errno */
+int pcapng_open(struct pcapng_writer *w, const char *path,
+                const struct pcapng_iface *ifaces, int nr_ifaces, uint32_t snaplen,
+                uint64_t rotate_bytes, uint32_t rotate_count);
+/* 追加一个 Enhanced Packet Block；timestamp_ns 为 CLOCK_MONOTONIC（bpf_ktime_get_ns） */
+int pcapng_write_packet(struct pcapng_writer *w, uint64_t timestamp_ns, int ifindex,
+                        const void *data, uint32_t caplen, uint32_t len);
+/* 写出缓冲区中的所有数据（包括未满一块的尾部），之后文件内容对读取方可见 */
+int pcapng_sync(struct pcapng_writer *w);
+/* 写出剩余数据、截断到实际长度并关闭 */
+int pcapng_close(struct pcapng_writer *w);
+
+#endif /* PCAPNG_H */
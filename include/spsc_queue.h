@@ -0,0 +1,119 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SPSC_CACHE_LINE 64
+
+/*
+ * 单生产者单消费者无锁队列，元素为定长记录。
+ * head 只由生产者写，tail 只由消费者写，各自独占一条 cache line；
+ * 双方缓存对方的索引，只有看起来满/空时才重新读取，减少 cache line 往返。
+ */
+struct spsc_queue {
+    /* 生产者 */
+    _Alignas(SPSC_CACHE_LINE) _Atomic uint32_t head;
+    uint32_t cached_tail;
+    _Atomic uint64_t drops;         /* 队列满时丢弃的记录数，任意线程可读 */
+    _Atomic uint32_t high_water;    /* 按批次更新的最大深度，任意线程可读 */
+
+    /* 消费者 */
+    _Alignas(SPSC_CACHE_LINE) _Atomic uint32_t tail;
+    uint32_t cached_head;
+
+    /* 只读 */
+    _Alignas(SPSC_CACHE_LINE) uint32_t mask;
+    uint32_t elem_size;
+    uint8_t *slots;
+};
+
+/* capacity 必须是 2 的幂 */
+static inline int spsc_init(struct spsc_queue *q, uint32_t capacity, uint32_t elem_size)
+{
+    memset(q, 0, sizeof(*q));
+    if (capacity == 0 || (capacity & (capacity - 1)))
+        return -1;
+
+    q->slots = calloc(capacity, elem_size);
+    if (!q->slots)
+        return -1;
+    q->mask = capacity - 1;
+    q->elem_size = elem_size;
+    return 0;
+}
+
+static inline void spsc_free(struct spsc_queue *q)
+{
+    free(q->slots);
+    q->slots = NULL;
+}
+
+static inline uint32_t spsc_capacity(const struct spsc_queue *q)
+{
+    return q->mask + 1;
+}
+
+/* 生产者：写入一条记录，队列满时返回 false */
+static inline bool spsc_push(struct spsc_queue *q, const void *elem)
+{
+    uint32_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+
+    if (head - q->cached_tail > q->mask) {
+        q->cached_tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+        if (head - q->cached_tail > q->mask) {
+            /* 只有生产者写 drops，无需原子读-改-写 */
+            atomic_store_explicit(&q->drops,
+                                  atomic_load_explicit(&q->drops, memory_order_relaxed) + 1,
+                                  memory_order_relaxed);
+            return false;
+        }
+    }
+
+    memcpy(q->slots + (size_t)(head & q->mask) * q->elem_size, elem, q->elem_size);
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+    return true;
+}
+
+/* 消费者：返回队首记录的指针，队列空时返回 NULL；处理完后调用 spsc_release */
+static inline void *spsc_front(struct spsc_queue *q)
+{
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+    if (tail == q->cached_head) {
+        q->cached_head = atomic_load_explicit(&q->head, memory_order_acquire);
+        if (tail == q->cached_head)
+            return NULL;
+    }
+    return q->slots + (size_t)(tail & q->mask) * q->elem_size;
+}
+
+static inline void spsc_release(struct spsc_queue *q)
+{
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+}
+
+/* 当前队列深度，任意线程可调用（近似值） */
+static inline uint32_t spsc_depth(struct spsc_queue *q)
+{
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+    uint32_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+
+    return head - tail;
+}
+
+/* 生产者：按批次更新高水位，避免每条记录都读取消费者的 cache line */
+static inline void spsc_update_high_water(struct spsc_queue *q)
+{
+    uint32_t depth = spsc_depth(q);
+
+    if (depth > atomic_load_explicit(&q->high_water, memory_order_relaxed))
+        atomic_store_explicit(&q->high_water, depth, memory_order_relaxed);
+}
+
+#endif /* SPSC_QUEUE_H */
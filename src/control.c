@@ -0,0 +1,499 @@
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <limits.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <bpf/bpf.h>
+#include "../include/control.h"
+
+/* 功能名称与 FEATURE_* 位，events 同时表示 ARP 与 NDP 事件 */
+static const struct {
+    const char *name;
+    uint32_t mask;
+} features[] = {
+    { "ip",          FEATURE_IP_STATS },
+    { "flows",       FEATURE_FLOW_STATS },
+    { "arp-events",  FEATURE_ARP_EVENTS },
+    { "ndp-events",  FEATURE_NDP_EVENTS },
+    { "arp-latency", FEATURE_ARP_LATENCY },
+    { "vlan",        FEATURE_VLAN_STATS },
+};
+
+#define FEATURE_ALL (FEATURE_IP_STATS | FEATURE_FLOW_STATS | FEATURE_ARP_EVENTS | \
+                     FEATURE_NDP_EVENTS | FEATURE_ARP_LATENCY | FEATURE_VLAN_STATS)
+
+int control_parse_features(const char *arg, uint32_t *mask)
+{
+    char buf[256], *tok, *save;
+    size_t i;
+
+    if (strlen(arg) >= sizeof(buf))
+        return -1;
+    strcpy(buf, arg);
+
+    *mask = 0;
+    for (tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        if (strcmp(tok, "all") == 0) {
+            *mask |= FEATURE_ALL;
+            continue;
+        }
+        if (strcmp(tok, "events") == 0) {
+            *mask |= FEATURE_ARP_EVENTS | FEATURE_NDP_EVENTS;
+            continue;
+        }
+        for (i = 0; i < sizeof(features) / sizeof(features[0]); i++) {
+            if (strcmp(tok, features[i].name) == 0)
+                break;
+        }
+        if (i == sizeof(features) / sizeof(features[0]))
+            return -1;
+        *mask |= features[i].mask;
+    }
+    return *mask ? 0 : -1;
+}
+
+const char *control_format_features(uint32_t mask, char *buf, size_t size)
+{
+    size_t i, off = 0;
+
+    buf[0] = '\0';
+    for (i = 0; i < sizeof(features) / sizeof(features[0]) && off < size; i++) {
+        if (mask & features[i].mask)
+            off += snprintf(buf + off, size - off, "%s%s", off ? "," : "", features[i].name);
+    }
+    if (off == 0)
+        snprintf(buf, size, "none");
+    return buf;
+}
+
+int control_parse_subnet(const char *arg, struct subnet_key *key)
+{
+    char addr[INET_ADDRSTRLEN];
+    const char *slash = strchr(arg, '/');
+    size_t n = slash ? (size_t)(slash - arg) : strlen(arg);
+    long len = 32;
+    uint32_t mask;
+
+    if (n == 0 || n >= sizeof(addr))
+        return -1;
+    memcpy(addr, arg, n);
+    addr[n] = '\0';
+    if (inet_pton(AF_INET, addr, &key->addr) != 1)
+        return -1;
+
+    if (slash) {
+        char *end;
+
+        len = strtol(slash + 1, &end, 10);
+        if (end == slash + 1 || *end != '\0' || len < 0 || len > 32)
+            return -1;
+    }
+
+    /* 清除前缀之外的主机位，同一子网的不同写法对应同一个 key */
+    mask = len ? htonl(~0U << (32 - len)) : 0;
+    key->addr &= mask;
+    key->prefixlen = len;
+    return 0;
+}
+
+/* 前缀是否在列表中 */
+static int subnet_listed(const struct subnet_key *keys, int n, const struct subnet_key *key)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (keys[i].prefixlen == key->prefixlen && keys[i].addr == key->addr)
+            return 1;
+    }
+    return 0;
+}
+
+int control_parse_subnets(const char *list, struct subnet_key *keys)
+{
+    char *buf, *tok, *save;
+    int n = 0, err = 0;
+
+    buf = strdup(list);
+    if (!buf)
+        return -ENOMEM;
+
+    for (tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        if (n == SUBNET_FILTER_MAX) {
+            err = -E2BIG;
+            break;
+        }
+        if (control_parse_subnet(tok, &keys[n])) {
+            fprintf(stderr, "Error: Invalid subnet: %s\n", tok);
+            err = -EINVAL;
+            break;
+        }
+        if (!subnet_listed(keys, n, &keys[n]))
+            n++;
+    }
+
+    free(buf);
+    return err ? err : n;
+}
+
+int control_read_subnets(int map_fd, struct subnet_key *keys)
+{
+    struct subnet_key key, next;
+    int n = 0;
+
+    if (bpf_map_get_next_key(map_fd, NULL, &next))
+        return 0;
+    do {
+        key = next;
+        if (n < SUBNET_FILTER_MAX)
+            keys[n++] = key;
+    } while (bpf_map_get_next_key(map_fd, &key, &next) == 0);
+    return n;
+}
+
+int control_replace_subnets(int map_fd, const struct subnet_key *keys, int n)
+{
+    struct subnet_key *stale;
+    uint32_t one = 1;
+    int nstale, i;
+
+    stale = calloc(SUBNET_FILTER_MAX, sizeof(*stale));
+    if (!stale)
+        return -ENOMEM;
+
+    for (i = 0; i < n; i++) {
+        if (bpf_map_update_elem(map_fd, &keys[i], &one, BPF_ANY)) {
+            int err = -errno;
+
+            free(stale);
+            return err;
+        }
+    }
+
+    /* 遍历时删除会打乱迭代顺序，先收集所有前缀再删除多余的 */
+    nstale = control_read_subnets(map_fd, stale);
+    for (i = 0; i < nstale; i++) {
+        if (!subnet_listed(keys, n, &stale[i]))
+            bpf_map_delete_elem(map_fd, &stale[i]);
+    }
+
+    free(stale);
+    return n;
+}
+
+int control_load_subnets(int map_fd, const char *list)
+{
+    struct subnet_key *keys;
+    int n;
+
+    keys = calloc(SUBNET_FILTER_MAX, sizeof(*keys));
+    if (!keys)
+        return -ENOMEM;
+    n = control_parse_subnets(list, keys);
+    if (n >= 0)
+        n = control_replace_subnets(map_fd, keys, n);
+    free(keys);
+    return n;
+}
+
+void control_print_subnets(int map_fd, const char *indent)
+{
+    struct subnet_key key, next;
+    char addr[INET_ADDRSTRLEN];
+
+    if (bpf_map_get_next_key(map_fd, NULL, &next))
+        return;
+    do {
+        key = next;
+        inet_ntop(AF_INET, &key.addr, addr, sizeof(addr));
+        printf("%s%s/%u\n", indent, addr, key.prefixlen);
+    } while (bpf_map_get_next_key(map_fd, &key, &next) == 0);
+}
+
+/* 统计 LPM trie 中的前缀数 */
+static int count_subnets(int map_fd)
+{
+    struct subnet_key key, next;
+    int n = 0;
+
+    if (bpf_map_get_next_key(map_fd, NULL, &next))
+        return 0;
+    do {
+        key = next;
+        n++;
+    } while (bpf_map_get_next_key(map_fd, &key, &next) == 0);
+    return n;
+}
+
+void control_print(const struct monitor_config *cfg, int src_fd, int dst_fd)
+{
+    char buf[128];
+
+    printf("Runtime configuration:\n");
+    printf("  Disabled features:   %s\n", control_format_features(cfg->disabled, buf, sizeof(buf)));
+    if (cfg->sample_rate > 1)
+        printf("  Event sampling:      1 in %u\n", cfg->sample_rate);
+    else
+        printf("  Event sampling:      all\n");
+    if (cfg->rate_limit_pps)
+        printf("  Event rate limit:    %u/s (burst %u)\n", cfg->rate_limit_pps, cfg->rate_limit_burst);
+    else
+        printf("  Event rate limit:    off\n");
+    if (cfg->agg_window_ms)
+        printf("  Aggregation window:  %u ms\n", cfg->agg_window_ms);
+    else
+        printf("  Aggregation window:  off\n");
+    printf("  ARP enforcement:     %s\n", cfg->enforce ? "on" : "off");
+    if (cfg->subnet_filter & FILTER_SRC) {
+        printf("  Source filter:       %d prefix(es)\n", count_subnets(src_fd));
+        control_print_subnets(src_fd, "    ");
+    } else {
+        printf("  Source filter:       off\n");
+    }
+    if (cfg->subnet_filter & FILTER_DST) {
+        printf("  Destination filter:  %d prefix(es)\n", count_subnets(dst_fd));
+        control_print_subnets(dst_fd, "    ");
+    } else {
+        printf("  Destination filter:  off\n");
+    }
+}
+
+/* 打开 pin 目录中的 map */
+static int open_pinned(const char *pin_dir, const char *name)
+{
+    char path[PATH_MAX];
+    int fd;
+
+    snprintf(path, sizeof(path), "%s/%s", pin_dir, name);
+    fd = bpf_obj_get(path);
+    if (fd < 0)
+        fprintf(stderr, "Error: Failed to open %s: %s\n", path, strerror(errno));
+    return fd;
+}
+
+/*
+ * 一个方向的子网过滤修改：list 为 NULL 时不修改，"none" 时关闭（clear）。
+ * 新前缀先全部解析校验，old 保存修改前的内容，写入失败时用于回滚。
+ */
+struct subnet_change {
+    const char *list;
+    int map_fd;
+    uint32_t flag;
+    bool clear;
+    bool loaded;
+    struct subnet_key keys[SUBNET_FILTER_MAX];
+    int n;
+    struct subnet_key old[SUBNET_FILTER_MAX];
+    int nold;
+};
+
+/* 解析并校验新前缀，不修改任何 map */
+static int subnet_change_prepare(struct subnet_change *c)
+{
+    if (!c->list)
+        return 0;
+    if (strcmp(c->list, "none") == 0) {
+        c->clear = true;
+        return 0;
+    }
+    c->n = control_parse_subnets(c->list, c->keys);
+    if (c->n < 0) {
+        fprintf(stderr, "Error: Failed to parse subnet filter: %s\n", strerror(-c->n));
+        return -1;
+    }
+    if (c->n == 0) {
+        fprintf(stderr, "Error: Empty subnet filter (use \"none\" to turn it off)\n");
+        return -1;
+    }
+    c->nold = control_read_subnets(c->map_fd, c->old);
+    return 0;
+}
+
+/*
+ * 启用时先写入前缀、再由调用方设置标志；"none" 时只清除标志，
+ * 调用方写回配置后再清空 trie
+ */
+static int subnet_change_apply(struct subnet_change *c, struct monitor_config *cfg)
+{
+    int err;
+
+    if (!c->list)
+        return 0;
+    if (c->clear) {
+        cfg->subnet_filter &= ~c->flag;
+        return 0;
+    }
+    c->loaded = true;
+    err = control_replace_subnets(c->map_fd, c->keys, c->n);
+    if (err < 0) {
+        fprintf(stderr, "Error: Failed to load subnet filter: %s\n", strerror(-err));
+        return -1;
+    }
+    cfg->subnet_filter |= c->flag;
+    return 0;
+}
+
+/* 把已写入（包括写入到一半）的 trie 恢复为修改前的前缀 */
+static void subnet_change_rollback(struct subnet_change *c)
+{
+    if (c->loaded && control_replace_subnets(c->map_fd, c->old, c->nold) < 0)
+        fprintf(stderr, "Warning: Failed to restore the previous subnet filter\n");
+}
+
+static void control_usage(void)
+{
+    fprintf(stderr, "Usage: netmon config [options]\n");
+    fprintf(stderr, "Show or change the configuration of a netmon running with -P, without\n");
+    fprintf(stderr, "reloading the XDP program. Without options, print the current configuration.\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "      --pin-path DIR    Pinned maps of the running netmon (default: %s)\n",
+            DEFAULT_PIN_DIR);
+    fprintf(stderr, "  -d, --disable LIST    Turn features off\n");
+    fprintf(stderr, "  -e, --enable LIST     Turn features back on\n");
+    fprintf(stderr, "                        Features: ip, flows, arp-events, ndp-events, events,\n");
+    fprintf(stderr, "                        arp-latency, vlan, all\n");
+    fprintf(stderr, "  -s, --sample N        Report 1 in N ARP/NDP events (1 = all)\n");
+    fprintf(stderr, "      --src-filter LIST Only track IPv4 and ARP from these prefixes, e.g.\n");
+    fprintf(stderr, "                        10.0.0.0/8,192.168.1.7 (\"none\" to turn off)\n");
+    fprintf(stderr, "      --dst-filter LIST Only track IPv4 and ARP to these prefixes\n");
+    fprintf(stderr, "  -h, --help            Show this help message\n");
+}
+
+enum {
+    OPT_CTL_PIN_PATH = 256,
+    OPT_CTL_SRC_FILTER,
+    OPT_CTL_DST_FILTER,
+};
+
+int control_main(int argc, char **argv)
+{
+    static const struct option long_options[] = {
+        {"pin-path",   required_argument, NULL, OPT_CTL_PIN_PATH},
+        {"disable",    required_argument, NULL, 'd'},
+        {"enable",     required_argument, NULL, 'e'},
+        {"sample",     required_argument, NULL, 's'},
+        {"src-filter", required_argument, NULL, OPT_CTL_SRC_FILTER},
+        {"dst-filter", required_argument, NULL, OPT_CTL_DST_FILTER},
+        {"help",       no_argument,       NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    const char *pin_dir = DEFAULT_PIN_DIR;
+    const char *src_list = NULL, *dst_list = NULL;
+    uint32_t disable = 0, enable = 0, mask, key = 0;
+    struct subnet_change *src = NULL, *dst = NULL;
+    struct monitor_config cfg;
+    bool changed = false;
+    long sample = -1;
+    int cfg_fd, src_fd, dst_fd, opt, ret = 1;
+
+    optind = 1;
+    while ((opt = getopt_long(argc, argv, "d:e:s:h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case OPT_CTL_PIN_PATH:
+                pin_dir = optarg;
+                break;
+            case 'd':
+            case 'e':
+                if (control_parse_features(optarg, &mask)) {
+                    fprintf(stderr, "Error: Invalid feature list: %s\n", optarg);
+                    return 1;
+                }
+                if (opt == 'd')
+                    disable |= mask;
+                else
+                    enable |= mask;
+                changed = true;
+                break;
+            case 's':
+                sample = atol(optarg);
+                if (sample < 1) {
+                    fprintf(stderr, "Error: Invalid sample rate: %s\n", optarg);
+                    return 1;
+                }
+                changed = true;
+                break;
+            case OPT_CTL_SRC_FILTER:
+                src_list = optarg;
+                changed = true;
+                break;
+            case OPT_CTL_DST_FILTER:
+                dst_list = optarg;
+                changed = true;
+                break;
+            case 'h':
+                control_usage();
+                return 0;
+            default:
+                control_usage();
+                return 1;
+        }
+    }
+    if (optind != argc) {
+        control_usage();
+        return 1;
+    }
+
+    cfg_fd = open_pinned(pin_dir, "monitor_config");
+    src_fd = open_pinned(pin_dir, "filter_src");
+    dst_fd = open_pinned(pin_dir, "filter_dst");
+    if (cfg_fd < 0 || src_fd < 0 || dst_fd < 0) {
+        fprintf(stderr, "Hint: runtime changes need a netmon started with -P/--pin-path\n");
+        goto out;
+    }
+    if (bpf_map_lookup_elem(cfg_fd, &key, &cfg)) {
+        fprintf(stderr, "Error: Failed to read monitor_config: %s\n", strerror(errno));
+        goto out;
+    }
+
+    if (changed) {
+        /* 两个列表都解析校验通过后才修改 map，任一步失败时恢复已写入的前缀 */
+        src = calloc(1, sizeof(*src));
+        dst = calloc(1, sizeof(*dst));
+        if (!src || !dst) {
+            fprintf(stderr, "Error: Out of memory\n");
+            goto out;
+        }
+        *src = (struct subnet_change){ .list = src_list, .map_fd = src_fd, .flag = FILTER_SRC };
+        *dst = (struct subnet_change){ .list = dst_list, .map_fd = dst_fd, .flag = FILTER_DST };
+        if (subnet_change_prepare(src) || subnet_change_prepare(dst))
+            goto out;
+
+        cfg.disabled = (cfg.disabled | disable) & ~enable;
+        if (sample > 0)
+            cfg.sample_rate = sample;
+        if (subnet_change_apply(src, &cfg) || subnet_change_apply(dst, &cfg))
+            goto rollback;
+
+        /* 程序每个包读取一次配置，写入后立即生效 */
+        if (bpf_map_update_elem(cfg_fd, &key, &cfg, BPF_ANY)) {
+            fprintf(stderr, "Error: Failed to update monitor_config: %s\n", strerror(errno));
+            goto rollback;
+        }
+        if (src->clear)
+            control_load_subnets(src_fd, "");
+        if (dst->clear)
+            control_load_subnets(dst_fd, "");
+    }
+
+    control_print(&cfg, src_fd, dst_fd);
+    ret = 0;
+    goto out;
+
+rollback:
+    subnet_change_rollback(src);
+    subnet_change_rollback(dst);
+out:
+    free(src);
+    free(dst);
+    if (cfg_fd >= 0)
+        close(cfg_fd);
+    if (src_fd >= 0)
+        close(src_fd);
+    if (dst_fd >= 0)
+        close(dst_fd);
+    return ret;
+}
@@ -0,0 +1,389 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <linux/neighbour.h>
+#include "../include/detector.h"
+
+/* 各检测表容量（槽位数，2 的幂） */
+#define DET_BINDINGS_SIZE   65536
+#define DET_REQUESTS_SIZE   16384
+#define DET_GARPS_SIZE      4096
+
+/* 最大探测长度，超过后替换探测窗口内最久未使用的条目 */
+#define DET_MAX_PROBE       8
+
+#define ARPOP_REQUEST_CODE  1
+#define ARPOP_REPLY_CODE    2
+
+/* 内核认为 lladdr 有效的邻居状态（NOARP 条目没有真实 MAC） */
+#define NEIGH_VALID_STATES  (NUD_PERMANENT | NUD_REACHABLE | NUD_PROBE | NUD_STALE | NUD_DELAY)
+/* 内核正在解析或确认的状态：此时收到的应答是本机请求的 */
+#define NEIGH_RESOLVING     (NUD_INCOMPLETE | NUD_PROBE | NUD_DELAY)
+
+static const char *alert_names[DET_NR_ALERTS] = {
+    [DET_MAC_FLIP]          = "MAC_FLIP",
+    [DET_DUPLICATE_IP]      = "DUPLICATE_IP",
+    [DET_GARP_FLOOD]        = "GARP_FLOOD",
+    [DET_UNSOLICITED_REPLY] = "UNSOLICITED_REPLY",
+    [DET_NEIGH_MISMATCH]    = "NEIGH_MISMATCH",
+};
+
+const char *detector_alert_str(enum det_alert alert)
+{
+    return alert < DET_NR_ALERTS ? alert_names[alert] : "UNKNOWN";
+}
+
+static int det_table_init(struct det_table *t, uint32_t size, uint32_t entry_size)
+{
+    t->slots = calloc(size, entry_size);
+    if (!t->slots)
+        return -ENOMEM;
+    t->mask = size - 1;
+    t->entry_size = entry_size;
+    return 0;
+}
+
+static inline struct det_slot *det_slot_at(struct det_table *t, uint32_t i)
+{
+    return (struct det_slot *)((uint8_t *)t->slots + (size_t)(i & t->mask) * t->entry_size);
+}
+
+static inline uint32_t det_hash(const uint8_t *key)
+{
+    uint64_t a, b;
+
+    memcpy(&a, key, 8);
+    memcpy(&b, key + 8, 8);
+    a ^= b * 0x9e3779b97f4a7c15ULL;
+    a ^= a >> 29;
+    a *= 0xbf58476d1ce4e5b9ULL;
+    return (uint32_t)(a >> 32);
+}
+
+/*
+ * 查找 key。命中时 *found 为 true；未命中且 create 为 true 时返回空槽或探测窗口内
+ * 最久未使用的槽（已清零并写入 key）。条目从不删除，空槽可以作为查找终点。
+ */
+static void *det_lookup(struct det_table *t, const uint8_t *key, bool create, bool *found)
+{
+    uint32_t start = det_hash(key), n;
+    struct det_slot *victim = NULL;
+
+    *found = false;
+    for (n = 0; n < DET_MAX_PROBE; n++) {
+        struct det_slot *s = det_slot_at(t, start + n);
+
+        if (!s->used) {
+            victim = s;
+            break;
+        }
+        if (memcmp(s->key, key, sizeof(s->key)) == 0) {
+            *found = true;
+            return s;
+        }
+        if (!victim || s->last_seen < victim->last_seen)
+            victim = s;
+    }
+    if (!create)
+        return NULL;
+
+    memset(victim, 0, t->entry_size);
+    memcpy(victim->key, key, sizeof(victim->key));
+    victim->used = 1;
+    return victim;
+}
+
+int detector_init(struct detector *d, struct neigh_table *neigh, struct output *out)
+{
+    memset(d, 0, sizeof(*d));
+    d->neigh = neigh;
+    d->out = out;
+
+    if (det_table_init(&d->bindings, DET_BINDINGS_SIZE, sizeof(struct det_binding)) ||
+        det_table_init(&d->requests, DET_REQUESTS_SIZE, sizeof(struct det_request)) ||
+        det_table_init(&d->garps, DET_GARPS_SIZE, sizeof(struct det_garp))) {
+        detector_free(d);
+        return -ENOMEM;
+    }
+    return 0;
+}
+
+void detector_free(struct detector *d)
+{
+    free(d->bindings.slots);
+    free(d->requests.slots);
+    free(d->garps.slots);
+    d->bindings.slots = d->requests.slots = d->garps.slots = NULL;
+}
+
+/* 告警行前缀："[ALERT] <类型>: <IP>" */
+static char *alert_begin(struct detector *d, enum det_alert type, uint32_t ip, char **line)
+{
+    char *p = output_reserve(d->out, OUTPUT_MAX_RECORD);
+
+    *line = p;
+    p = fmt_str(p, "[ALERT] ");
+    p = fmt_str(p, alert_names[type]);
+    p = fmt_str(p, ": ");
+    return fmt_ipv4(p, ip);
+}
+
+/* 告警行结尾：" (dev: <接口>)\n" */
+static void alert_end(struct detector *d, char *line, char *p, uint32_t ifindex)
+{
+    p = fmt_str(p, " (dev: ");
+    if (d->neigh) {
+        p = fmt_str(p, neigh_link_name(d->neigh, ifindex));
+    } else {
+        p = fmt_str(p, "if");
+        p = fmt_u64(p, ifindex);
+    }
+    p = fmt_str(p, ")\n");
+    output_commit(d->out, p - line);
+}
+
+/* 计数告警；同一绑定的同类告警在 DET_ALERT_HOLDOFF_NS 内只输出一次 */
+static bool alert_allowed(struct detector *d, enum det_alert type,
+                          struct det_binding *b, uint64_t now)
+{
+    d->alerts[type]++;
+    if (!b)
+        return true;
+    if (b->alert_ns[type] && now - b->alert_ns[type] < DET_ALERT_HOLDOFF_NS)
+        return false;
+    b->alert_ns[type] = now;
+    return true;
+}
+
+static void binding_key(uint8_t *key, uint32_t ifindex, uint32_t ip)
+{
+    memset(key, 0, 16);
+    memcpy(key, &ifindex, 4);
+    memcpy(key + 4, &ip, 4);
+}
+
+static struct neigh_entry *kernel_neigh(struct detector *d, uint32_t ifindex, uint32_t ip)
+{
+    struct neigh_key key = {0};
+
+    if (!d->neigh)
+        return NULL;
+    key.family = AF_INET;
+    key.ifindex = ifindex;
+    memcpy(key.addr, &ip, sizeof(ip));
+    return neigh_table_lookup(d->neigh, &key);
+}
+
+/* 线上的 (IP, MAC) 与内核邻居表中有效条目不一致时告警 */
+static void check_kernel_binding(struct detector *d, struct det_binding *b,
+                                 uint32_t ifindex, uint32_t ip, uint64_t now)
+{
+    struct neigh_entry *e = kernel_neigh(d, ifindex, ip);
+    char *line, *p;
+
+    if (!e || !(e->state & NEIGH_VALID_STATES) ||
+        memcmp(e->lladdr, b->mac, sizeof(b->mac)) == 0)
+        return;
+    if (!alert_allowed(d, DET_NEIGH_MISMATCH, b, now))
+        return;
+
+    p = alert_begin(d, DET_NEIGH_MISMATCH, ip, &line);
+    p = fmt_str(p, " wire ");
+    p = fmt_mac(p, b->mac);
+    p = fmt_str(p, " kernel ");
+    p = fmt_mac(p, e->lladdr);
+    alert_end(d, line, p, ifindex);
+}
+
+/* 记录发送方的 IP -> MAC 声明，检测 MAC 变化与 IP 冲突 */
+static struct det_binding *process_claim(struct detector *d, const struct arp_event *ev)
+{
+    uint8_t key[16];
+    struct det_binding *b;
+    enum det_alert type;
+    uint64_t now = ev->timestamp;
+    char *line, *p;
+    bool found;
+
+    binding_key(key, ev->ifindex, ev->src_ip);
+    b = det_lookup(&d->bindings, key, true, &found);
+    if (!found) {
+        memcpy(b->mac, ev->src_mac, sizeof(b->mac));
+        b->first_seen = now;
+        b->slot.last_seen = now;
+        check_kernel_binding(d, b, ev->ifindex, ev->src_ip, now);
+        return b;
+    }
+
+    if (memcmp(b->mac, ev->src_mac, sizeof(b->mac)) == 0) {
+        b->slot.last_seen = now;
+        return b;
+    }
+
+    /* 旧 MAC 最近仍在声明该 IP：两台主机同时使用，否则视为 MAC 变化 */
+    type = now - b->slot.last_seen < DET_DUP_WINDOW_NS ? DET_DUPLICATE_IP : DET_MAC_FLIP;
+    memcpy(b->prev_mac, b->mac, sizeof(b->mac));
+    memcpy(b->mac, ev->src_mac, sizeof(b->mac));
+    b->flips++;
+    b->slot.last_seen = now;
+
+    if (alert_allowed(d, type, b, now)) {
+        p = alert_begin(d, type, ev->src_ip, &line);
+        *p++ = ' ';
+        p = fmt_mac(p, b->prev_mac);
+        p = fmt_str(p, " -> ");
+        p = fmt_mac(p, b->mac);
+        p = fmt_str(p, " (changes: ");
+        p = fmt_u64(p, b->flips);
+        *p++ = ')';
+        alert_end(d, line, p, ev->ifindex);
+    }
+    check_kernel_binding(d, b, ev->ifindex, ev->src_ip, now);
+    return b;
+}
+
+/* 免费 ARP（发送方 IP == 目标 IP）：按源 MAC 在窗口内计数，超过阈值时告警一次 */
+static void check_garp(struct detector *d, const struct arp_event *ev, struct det_binding *b)
+{
+    uint8_t key[16] = {0};
+    struct det_garp *g;
+    uint64_t now = ev->timestamp;
+    char *line, *p;
+    bool found;
+
+    memcpy(key, &ev->ifindex, 4);
+    memcpy(key + 4, ev->src_mac, 6);
+    g = det_lookup(&d->garps, key, true, &found);
+    if (!found || now - g->window_start >= DET_GARP_WINDOW_NS) {
+        g->window_start = now;
+        g->count = 0;
+        g->alerted = 0;
+    }
+    g->slot.last_seen = now;
+
+    if (++g->count <= DET_GARP_THRESHOLD || g->alerted)
+        return;
+    g->alerted = 1;
+    if (!alert_allowed(d, DET_GARP_FLOOD, b, now))
+        return;
+
+    p = alert_begin(d, DET_GARP_FLOOD, ev->src_ip, &line);
+    *p++ = ' ';
+    p = fmt_mac(p, ev->src_mac);
+    p = fmt_str(p, " sent more than ");
+    p = fmt_u64(p, DET_GARP_THRESHOLD);
+    p = fmt_str(p, " gratuitous ARPs in ");
+    p = fmt_u64(p, DET_GARP_WINDOW_NS / 1000000);
+    p = fmt_str(p, "ms");
+    alert_end(d, line, p, ev->ifindex);
+}
+
+static void request_key(uint8_t *key, uint32_t ifindex, uint32_t requester, uint32_t target)
+{
+    memset(key, 0, 16);
+    memcpy(key, &ifindex, 4);
+    memcpy(key + 4, &requester, 4);
+    memcpy(key + 8, &target, 4);
+}
+
+/*
+ * 应答是否有对应的请求：线上看到的请求（XDP 只能看到接收方向），
+ * 或内核邻居表显示本机正在解析/刚刚更新该地址（本机发出的请求）。
+ */
+static bool reply_solicited(struct detector *d, const struct arp_event *ev)
+{
+    uint8_t key[16];
+    struct det_request *r;
+    struct neigh_entry *e;
+    uint64_t now = ev->timestamp;
+    int64_t age;
+    bool found;
+
+    request_key(key, ev->ifindex, ev->dst_ip, ev->src_ip);
+    r = det_lookup(&d->requests, key, false, &found);
+    if (r && r->pending && now - r->slot.last_seen <= DET_REQUEST_TIMEOUT_NS) {
+        r->pending = 0;
+        return true;
+    }
+
+    e = kernel_neigh(d, ev->ifindex, ev->src_ip);
+    if (!e)
+        return false;
+    if (e->state & NEIGH_RESOLVING)
+        return true;
+    age = (int64_t)(now - e->updated_ns);
+    return age < (int64_t)DET_REQUEST_TIMEOUT_NS && age > -(int64_t)DET_REQUEST_TIMEOUT_NS;
+}
+
+void detector_process(struct detector *d, const struct arp_event *ev)
+{
+    struct det_binding *b = NULL;
+    uint8_t key[16];
+    bool found;
+
+    d->events++;
+
+    /* 发送方 IP 为 0 的是地址探测（RFC 5227），不声明任何绑定 */
+    if (ev->src_ip == 0)
+        return;
+
+    b = process_claim(d, ev);
+
+    if (ev->src_ip == ev->dst_ip) {
+        check_garp(d, ev, b);
+        return;
+    }
+
+    if (ev->opcode == ARPOP_REQUEST_CODE) {
+        struct det_request *r;
+
+        request_key(key, ev->ifindex, ev->src_ip, ev->dst_ip);
+        r = det_lookup(&d->requests, key, true, &found);
+        r->slot.last_seen = ev->timestamp;
+        r->pending = 1;
+        return;
+    }
+
+    if (ev->opcode == ARPOP_REPLY_CODE && !reply_solicited(d, ev) &&
+        alert_allowed(d, DET_UNSOLICITED_REPLY, b, ev->timestamp)) {
+        char *line, *p;
+
+        p = alert_begin(d, DET_UNSOLICITED_REPLY, ev->src_ip, &line);
+        p = fmt_str(p, " is-at ");
+        p = fmt_mac(p, ev->src_mac);
+        p = fmt_str(p, " to ");
+        p = fmt_ipv4(p, ev->dst_ip);
+        alert_end(d, line, p, ev->ifindex);
+    }
+}
+
+void detector_neigh_update(struct detector *d, const struct neigh_entry *e, uint64_t now)
+{
+    struct det_binding *b;
+    uint8_t key[16];
+    uint32_t ip;
+    char *line, *p;
+    bool found;
+
+    if (e->key.family != AF_INET || !(e->state & NEIGH_VALID_STATES))
+        return;
+
+    memcpy(&ip, e->key.addr, sizeof(ip));
+    binding_key(key, e->key.ifindex, ip);
+    b = det_lookup(&d->bindings, key, false, &found);
+
+    /* 只与最近仍在线上出现的绑定比较 */
+    if (!b || now - b->slot.last_seen > DET_REQUEST_TIMEOUT_NS ||
+        memcmp(b->mac, e->lladdr, sizeof(b->mac)) == 0)
+        return;
+    if (!alert_allowed(d, DET_NEIGH_MISMATCH, b, now))
+        return;
+
+    p = alert_begin(d, DET_NEIGH_MISMATCH, ip, &line);
+    p = fmt_str(p, " kernel ");
+    p = fmt_mac(p, e->lladdr);
+    p = fmt_str(p, " wire ");
+    p = fmt_mac(p, b->mac);
+    alert_end(d, line, p, e->key.ifindex);
+}
@@ -0,0 +1,390 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "../include/exporter.h"
+
+#define CONTENT_TYPE "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+/* 解析 "[地址:]端口"，支持 IPv4 和 "[IPv6]:端口" */
+static int parse_addr(const char *addr, struct sockaddr_storage *ss, socklen_t *len)
+{
+    struct sockaddr_in *sin = (struct sockaddr_in *)ss;
+    struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)ss;
+    char host[INET6_ADDRSTRLEN + 2] = EXPORTER_DEFAULT_ADDR;
+    const char *colon = strrchr(addr, ':');
+    const char *port_str = addr;
+    char *end;
+    long port;
+
+    if (colon) {
+        size_t n = colon - addr;
+
+        if (n >= sizeof(host))
+            return -EINVAL;
+        memcpy(host, addr, n);
+        host[n] = '\0';
+        port_str = colon + 1;
+    }
+
+    port = strtol(port_str, &end, 10);
+    if (*port_str == '\0' || *end != '\0' || port <= 0 || port > 65535)
+        return -EINVAL;
+
+    memset(ss, 0, sizeof(*ss));
+    if (host[0] == '[') {
+        size_t n = strlen(host);
+
+        if (n < 2 || host[n - 1] != ']')
+            return -EINVAL;
+        host[n - 1] = '\0';
+        sin6->sin6_family = AF_INET6;
+        sin6->sin6_port = htons(port);
+        if (inet_pton(AF_INET6, host + 1, &sin6->sin6_addr) != 1)
+            return -EINVAL;
+        *len = sizeof(*sin6);
+        return 0;
+    }
+
+    sin->sin_family = AF_INET;
+    sin->sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &sin->sin_addr) != 1)
+        return -EINVAL;
+    *len = sizeof(*sin);
+    return 0;
+}
+
+static int exporter_watch(struct exporter *exp, int op, int fd, uint32_t events, void *ptr)
+{
+    struct epoll_event ev = {
+        .events = events,
+        .data.ptr = ptr,
+    };
+
+    return epoll_ctl(exp->epfd, op, fd, &ev);
+}
+
+int exporter_init(struct exporter *exp, const char *addr)
+{
+    struct sockaddr_storage ss;
+    socklen_t len;
+    int one = 1, err, i;
+
+    memset(exp, 0, sizeof(*exp));
+    exp->listen_fd = -1;
+    exp->epfd = -1;
+    for (i = 0; i < EXPORTER_MAX_CLIENTS; i++)
+        exp->clients[i].fd = -1;
+
+    err = parse_addr(addr, &ss, &len);
+    if (err)
+        return err;
+
+    exp->listen_fd = socket(ss.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (exp->listen_fd < 0)
+        return -errno;
+    setsockopt(exp->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(exp->listen_fd, (struct sockaddr *)&ss, len) < 0 ||
+        listen(exp->listen_fd, EXPORTER_MAX_CLIENTS) < 0)
+        goto fail;
+
+    exp->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (exp->epfd < 0 || exporter_watch(exp, EPOLL_CTL_ADD, exp->listen_fd, EPOLLIN, NULL) < 0)
+        goto fail;
+
+    /* 渲染第一份快照之前的抓取返回空结果 */
+    exporter_begin(exp);
+    exporter_commit(exp);
+    return 0;
+
+fail:
+    err = -errno;
+    exporter_free(exp);
+    return err;
+}
+
+static void client_close(struct exporter *exp, struct exporter_client *c)
+{
+    if (c->fd < 0)
+        return;
+    close(c->fd);   /* 关闭时自动从 epoll 中移除 */
+    free(c->pending);
+    c->fd = -1;
+    c->pending = NULL;
+    c->pending_len = c->pending_off = 0;
+    c->req_len = 0;
+}
+
+void exporter_free(struct exporter *exp)
+{
+    int i;
+
+    for (i = 0; i < EXPORTER_MAX_CLIENTS; i++)
+        client_close(exp, &exp->clients[i]);
+    if (exp->listen_fd >= 0)
+        close(exp->listen_fd);
+    if (exp->epfd >= 0)
+        close(exp->epfd);
+    free(exp->body.data);
+    free(exp->next.data);
+    memset(&exp->body, 0, sizeof(exp->body));
+    memset(&exp->next, 0, sizeof(exp->next));
+    exp->listen_fd = exp->epfd = -1;
+}
+
+/* 写出剩余的响应，全部写完后关闭连接 */
+static void client_flush(struct exporter *exp, struct exporter_client *c)
+{
+    while (c->pending_off < c->pending_len) {
+        ssize_t n = send(c->fd, c->pending + c->pending_off,
+                         c->pending_len - c->pending_off, MSG_NOSIGNAL);
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN)
+                return;
+            exp->errors++;
+            break;
+        }
+        c->pending_off += n;
+    }
+    client_close(exp, c);
+}
+
+/* 发送响应头和正文；一次没有写完时保存剩余部分，等待可写 */
+static void client_respond(struct exporter *exp, struct exporter_client *c, const char *status,
+                           const char *type, const char *body, size_t body_len)
+{
+    char header[256];
+    struct iovec iov[2];
+    size_t total, rest;
+    ssize_t n;
+    int hlen;
+
+    hlen = snprintf(header, sizeof(header),
+                    "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n"
+                    "Connection: close\r\n\r\n", status, type, body_len);
+    iov[0].iov_base = header;
+    iov[0].iov_len = hlen;
+    iov[1].iov_base = (void *)body;
+    iov[1].iov_len = body_len;
+    total = hlen + body_len;
+
+    do {
+        n = writev(c->fd, iov, 2);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0 && errno != EAGAIN) {
+        exp->errors++;
+        client_close(exp, c);
+        return;
+    }
+    if (n < 0)
+        n = 0;
+    if ((size_t)n == total) {
+        client_close(exp, c);
+        return;
+    }
+
+    /* 快照可能在写完之前被替换，复制剩余部分 */
+    rest = total - n;
+    c->pending = malloc(rest);
+    if (!c->pending) {
+        exp->errors++;
+        client_close(exp, c);
+        return;
+    }
+    if ((size_t)n < (size_t)hlen) {
+        memcpy(c->pending, header + n, hlen - n);
+        memcpy(c->pending + hlen - n, body, body_len);
+    } else {
+        memcpy(c->pending, body + (n - hlen), rest);
+    }
+    c->pending_len = rest;
+    c->pending_off = 0;
+    if (exporter_watch(exp, EPOLL_CTL_MOD, c->fd, EPOLLOUT, c) < 0) {
+        exp->errors++;
+        client_close(exp, c);
+    }
+}
+
+/* 读取请求头，收到完整请求头后响应 */
+static void client_read(struct exporter *exp, struct exporter_client *c)
+{
+    static const char not_found[] = "Not Found\n";
+    static const char bad_request[] = "Bad Request\n";
+    ssize_t n;
+
+    for (;;) {
+        n = recv(c->fd, c->req + c->req_len, sizeof(c->req) - 1 - c->req_len, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        break;
+    }
+    if (n < 0 && errno == EAGAIN)
+        return;
+    if (n <= 0) {
+        client_close(exp, c);
+        return;
+    }
+    c->req_len += n;
+    c->req[c->req_len] = '\0';
+
+    if (!strstr(c->req, "\r\n\r\n") && !strstr(c->req, "\n\n")) {
+        if (c->req_len < sizeof(c->req) - 1)
+            return;
+        exp->errors++;
+        client_respond(exp, c, "400 Bad Request", "text/plain", bad_request,
+                       sizeof(bad_request) - 1);
+        return;
+    }
+
+    if (strncmp(c->req, "GET /metrics ", 13) == 0 || strncmp(c->req, "GET / ", 6) == 0) {
+        exp->scrapes++;
+        client_respond(exp, c, "200 OK", CONTENT_TYPE, exp->body.data, exp->body.len);
+    } else {
+        exp->errors++;
+        client_respond(exp, c, "404 Not Found", "text/plain", not_found, sizeof(not_found) - 1);
+    }
+}
+
+static void accept_clients(struct exporter *exp)
+{
+    for (;;) {
+        int fd = accept4(exp->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        struct exporter_client *c = NULL;
+        int i;
+
+        if (fd < 0)
+            return;
+        for (i = 0; i < EXPORTER_MAX_CLIENTS; i++) {
+            if (exp->clients[i].fd < 0) {
+                c = &exp->clients[i];
+                break;
+            }
+        }
+        if (!c || exporter_watch(exp, EPOLL_CTL_ADD, fd, EPOLLIN, c) < 0) {
+            exp->errors++;
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        c->req_len = 0;
+    }
+}
+
+void exporter_handle(struct exporter *exp)
+{
+    struct epoll_event events[EXPORTER_MAX_CLIENTS + 1];
+    int n, i;
+
+    n = epoll_wait(exp->epfd, events, EXPORTER_MAX_CLIENTS + 1, 0);
+    for (i = 0; i < n; i++) {
+        struct exporter_client *c = events[i].data.ptr;
+
+        if (!c)
+            accept_clients(exp);
+        else if (c->fd < 0)
+            continue;
+        else if (events[i].events & (EPOLLERR | EPOLLHUP))
+            client_close(exp, c);
+        else if (c->pending)
+            client_flush(exp, c);
+        else
+            client_read(exp, c);
+    }
+}
+
+static void buf_append(struct exporter_buf *b, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    for (;;) {
+        size_t avail = b->cap - b->len;
+
+        va_start(ap, fmt);
+        n = vsnprintf(b->data ? b->data + b->len : NULL, avail, fmt, ap);
+        va_end(ap);
+        if (n < 0)
+            return;
+        if ((size_t)n < avail) {
+            b->len += n;
+            return;
+        }
+
+        size_t cap = b->cap ? b->cap * 2 : 16384;
+        char *data;
+
+        while (cap < b->len + n + 1)
+            cap *= 2;
+        data = realloc(b->data, cap);
+        if (!data)
+            return;
+        b->data = data;
+        b->cap = cap;
+    }
+}
+
+void exporter_begin(struct exporter *exp)
+{
+    exp->next.len = 0;
+}
+
+void exporter_family(struct exporter *exp, const char *name, const char *type, const char *help)
+{
+    buf_append(&exp->next, "# TYPE %s %s\n# HELP %s %s\n", name, type, name, help);
+}
+
+void exporter_sample(struct exporter *exp, const char *name, const char *labels, uint64_t value)
+{
+    if (labels)
+        buf_append(&exp->next, "%s{%s} %lu\n", name, labels, (unsigned long)value);
+    else
+        buf_append(&exp->next, "%s %lu\n", name, (unsigned long)value);
+}
+
+void exporter_commit(struct exporter *exp)
+{
+    struct exporter_buf tmp;
+
+    /* 导出器自身的计数也放在快照中 */
+    exporter_family(exp, "netmon_exporter_scrapes", "counter", "Metric scrapes served");
+    exporter_sample(exp, "netmon_exporter_scrapes_total", NULL, exp->scrapes);
+    exporter_family(exp, "netmon_exporter_errors", "counter",
+                    "Rejected requests and failed writes");
+    exporter_sample(exp, "netmon_exporter_errors_total", NULL, exp->errors);
+    buf_append(&exp->next, "# EOF\n");
+
+    tmp = exp->body;
+    exp->body = exp->next;
+    exp->next = tmp;
+    exp->renders++;
+}
+
+const char *exporter_escape(const char *value, char *buf, size_t size)
+{
+    size_t o = 0;
+
+    for (; *value && o + 2 < size; value++) {
+        if (*value == '\\' || *value == '"') {
+            buf[o++] = '\\';
+            buf[o++] = *value;
+        } else if (*value == '\n') {
+            buf[o++] = '\\';
+            buf[o++] = 'n';
+        } else {
+            buf[o++] = *value;
+        }
+    }
+    buf[o] = '\0';
+    return buf;
+}
@@ -0,0 +1,447 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../include/history.h"
+
+/* 计数器名称：显示用与 CSV 列名 */
+static const char *counter_names[HISTORY_NR_COUNTERS] = {
+    "Packets", "Bytes", "ARP", "ARP Requests", "ARP Replies", "NDP", "Events", "Event Drops",
+};
+static const char *counter_columns[HISTORY_NR_COUNTERS] = {
+    "packets", "bytes", "arp", "arp_request", "arp_reply", "ndp", "events", "event_drops",
+};
+
+int history_init(struct history *h, uint32_t samples, uint32_t resolution)
+{
+    memset(h, 0, sizeof(*h));
+    h->fd = -1;
+    h->resolution = resolution;
+    h->capacity = samples ? samples : 1;
+    h->ring = calloc(h->capacity, sizeof(*h->ring));
+    return h->ring ? 0 : -ENOMEM;
+}
+
+/* 检查已有文件的头部与大小 */
+static int check_header(const struct history_file_header *hdr, size_t size)
+{
+    if (size < sizeof(*hdr) ||
+        memcmp(hdr->magic, HISTORY_MAGIC, sizeof(HISTORY_MAGIC)) != 0 ||
+        hdr->version != HISTORY_VERSION ||
+        hdr->record_size != sizeof(struct history_record) ||
+        hdr->capacity == 0 ||
+        size < sizeof(*hdr) + (size_t)hdr->capacity * sizeof(struct history_record))
+        return -EINVAL;
+    return 0;
+}
+
+int history_open_file(struct history *h, const char *path, uint32_t capacity)
+{
+    size_t size = sizeof(struct history_file_header) + (size_t)capacity * sizeof(struct history_record);
+    struct history_file_header *hdr;
+    struct stat st;
+    bool created;
+    int fd, err;
+
+    fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return -errno;
+    /* 同一文件只能有一个写入者 */
+    if (flock(fd, LOCK_EX | LOCK_NB) || fstat(fd, &st)) {
+        err = errno == EWOULDBLOCK ? -EBUSY : -errno;
+        close(fd);
+        return err;
+    }
+    created = st.st_size == 0;
+    if (created && ftruncate(fd, size)) {
+        err = -errno;
+        close(fd);
+        return err;
+    }
+    if (!created && (size_t)st.st_size != size) {
+        close(fd);
+        return -EINVAL;
+    }
+
+    hdr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (hdr == MAP_FAILED) {
+        err = -errno;
+        close(fd);
+        return err;
+    }
+    if (created) {
+        memcpy(hdr->magic, HISTORY_MAGIC, sizeof(HISTORY_MAGIC));
+        hdr->version = HISTORY_VERSION;
+        hdr->record_size = sizeof(struct history_record);
+        hdr->resolution = h->resolution;
+        hdr->capacity = capacity;
+    } else if (check_header(hdr, size) || hdr->capacity != capacity ||
+               hdr->resolution != h->resolution) {
+        munmap(hdr, size);
+        close(fd);
+        return -EINVAL;
+    }
+
+    h->fd = fd;
+    h->hdr = hdr;
+    h->file_records = (struct history_record *)(hdr + 1);
+    h->map_len = size;
+    return 0;
+}
+
+void history_free(struct history *h)
+{
+    if (h->hdr) {
+        msync(h->hdr, h->map_len, MS_SYNC);
+        munmap(h->hdr, h->map_len);
+        h->hdr = NULL;
+    }
+    if (h->fd >= 0)
+        close(h->fd);
+    h->fd = -1;
+    free(h->ring);
+    h->ring = NULL;
+}
+
+void history_add(struct history *h, const uint64_t *counters,
+                 uint64_t now_real_ns, uint64_t now_mono_ns)
+{
+    struct history_record r = {
+        .timestamp_ns = now_real_ns,
+    };
+    int i;
+
+    /* 第一次只记录基准值：进程启动前（pin 复用）的累计值不属于任何采样 */
+    if (h->prev_ns == 0) {
+        memcpy(h->prev, counters, sizeof(h->prev));
+        h->prev_ns = now_mono_ns;
+        h->last_sync_ns = now_mono_ns;
+        return;
+    }
+
+    r.interval_ms = (now_mono_ns - h->prev_ns) / 1000000;
+    for (i = 0; i < HISTORY_NR_COUNTERS; i++)
+        r.delta[i] = counters[i] >= h->prev[i] ? counters[i] - h->prev[i] : counters[i];
+    memcpy(h->prev, counters, sizeof(h->prev));
+    h->prev_ns = now_mono_ns;
+
+    h->ring[h->head] = r;
+    h->head = (h->head + 1) % h->capacity;
+    if (h->count < h->capacity)
+        h->count++;
+
+    if (!h->hdr)
+        return;
+    /* 先写记录再发布 written，并发读取的 "netmon history" 不会看到未写完的记录 */
+    h->file_records[h->hdr->written % h->hdr->capacity] = r;
+    __atomic_store_n(&h->hdr->written, h->hdr->written + 1, __ATOMIC_RELEASE);
+    if (now_mono_ns - h->last_sync_ns >= HISTORY_SYNC_INTERVAL * 1000000000ULL) {
+        msync(h->hdr, h->map_len, MS_ASYNC);
+        h->last_sync_ns = now_mono_ns;
+    }
+}
+
+void history_summary_add(struct history_summary *sum, const struct history_record *r)
+{
+    int i;
+
+    if (sum->samples++ == 0)
+        sum->first_ns = r->timestamp_ns - (uint64_t)r->interval_ms * 1000000;
+    sum->last_ns = r->timestamp_ns;
+    sum->duration_ms += r->interval_ms;
+    for (i = 0; i < HISTORY_NR_COUNTERS; i++) {
+        double rate = r->interval_ms ? r->delta[i] * 1000.0 / r->interval_ms : 0;
+
+        sum->total[i] += r->delta[i];
+        if (rate > sum->peak[i]) {
+            sum->peak[i] = rate;
+            sum->peak_ns[i] = r->timestamp_ns;
+        }
+    }
+}
+
+uint64_t history_recent(const struct history *h, uint32_t seconds, struct history_summary *sum)
+{
+    uint64_t window_ms = (uint64_t)seconds * 1000, covered = 0;
+    uint32_t n = 0, i;
+
+    memset(sum, 0, sizeof(*sum));
+    /* 从最新的记录向前找到覆盖 seconds 秒的起点，再按时间顺序汇总 */
+    while (n < h->count && covered < window_ms) {
+        covered += h->ring[(h->head + h->capacity - 1 - n) % h->capacity].interval_ms;
+        n++;
+    }
+    for (i = 0; i < n; i++)
+        history_summary_add(sum, &h->ring[(h->head + h->capacity - n + i) % h->capacity]);
+    return n;
+}
+
+/* 格式化本地时间 */
+static const char *format_time(uint64_t ns, char *buf, size_t size)
+{
+    time_t t = ns / 1000000000ULL;
+    struct tm tm;
+
+    if (!localtime_r(&t, &tm) || !strftime(buf, size, "%Y-%m-%d %H:%M:%S", &tm))
+        snprintf(buf, size, "%lu", (unsigned long)t);
+    return buf;
+}
+
+void history_print_summary(const struct history_summary *sum, const char *title)
+{
+    char when[32];
+    int i;
+
+    printf("%s:\n", title);
+    printf("  %-14s %14s %14s %14s  %s\n", "Counter", "Total", "Avg/s", "Peak/s", "Peak at");
+    for (i = 0; i < HISTORY_NR_COUNTERS; i++) {
+        double avg = sum->duration_ms ? sum->total[i] * 1000.0 / sum->duration_ms : 0;
+
+        printf("  %-14s %14lu %14.1f %14.1f  %s\n", counter_names[i],
+               (unsigned long)sum->total[i], avg, sum->peak[i],
+               sum->peak[i] > 0 ? format_time(sum->peak_ns[i], when, sizeof(when)) : "-");
+    }
+    printf("\n");
+}
+
+/*
+ * 解析时间：Unix 秒数、相对当前时间的 "-N[smhd]"，
+ * 或本地时间 "YYYY-MM-DD HH:MM[:SS]"（日期与时间之间也可以用 'T'）
+ */
+static int parse_time(const char *arg, uint64_t now_ns, uint64_t *out)
+{
+    static const char *formats[] = {
+        "%Y-%m-%d %H:%M:%S", "%Y-%m-%dT%H:%M:%S", "%Y-%m-%d %H:%M", "%Y-%m-%dT%H:%M", "%Y-%m-%d",
+    };
+    struct tm tm;
+    char *end;
+    size_t i;
+
+    if (arg[0] == '-') {
+        long v = strtol(arg + 1, &end, 10);
+        uint64_t unit = 1;
+
+        if (end == arg + 1 || v < 0)
+            return -1;
+        switch (*end) {
+            case 'd': unit *= 24;   /* fall through */
+            case 'h': unit *= 60;   /* fall through */
+            case 'm': unit *= 60;   /* fall through */
+            case 's':
+            case '\0':
+                break;
+            default:
+                return -1;
+        }
+        if (*end && end[1])
+            return -1;
+        *out = now_ns - (uint64_t)v * unit * 1000000000ULL;
+        return 0;
+    }
+
+    for (i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+        memset(&tm, 0, sizeof(tm));
+        end = strptime(arg, formats[i], &tm);
+        if (end && *end == '\0') {
+            tm.tm_isdst = -1;
+            *out = (uint64_t)mktime(&tm) * 1000000000ULL;
+            return 0;
+        }
+    }
+
+    *out = strtoull(arg, &end, 10) * 1000000000ULL;
+    return end != arg && *end == '\0' ? 0 : -1;
+}
+
+/* 只读打开的历史文件：有效记录按时间排序，逻辑序号 i 对应 records[(start + i) % capacity] */
+struct history_view {
+    const struct history_file_header *hdr;
+    const struct history_record *records;
+    size_t map_len;
+    uint64_t start;
+    uint64_t count;
+};
+
+static const struct history_record *view_at(const struct history_view *v, uint64_t i)
+{
+    return &v->records[(v->start + i) % v->hdr->capacity];
+}
+
+/* 第一个时间戳 >= ts 的逻辑序号（二分查找，只访问 O(log n) 个记录） */
+static uint64_t view_lower_bound(const struct history_view *v, uint64_t ts)
+{
+    uint64_t lo = 0, hi = v->count;
+
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+
+        if (view_at(v, mid)->timestamp_ns < ts)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static int view_open(struct history_view *v, const char *path)
+{
+    struct stat st;
+    uint64_t written;
+    void *map;
+    int fd, err = 0;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -errno;
+    if (fstat(fd, &st)) {
+        err = -errno;
+        close(fd);
+        return err;
+    }
+    if ((size_t)st.st_size < sizeof(struct history_file_header)) {
+        close(fd);
+        return -EINVAL;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -errno;
+
+    v->hdr = map;
+    v->records = (const struct history_record *)(v->hdr + 1);
+    v->map_len = st.st_size;
+    if (check_header(v->hdr, v->map_len)) {
+        munmap(map, v->map_len);
+        return -EINVAL;
+    }
+    written = __atomic_load_n(&v->hdr->written, __ATOMIC_ACQUIRE);
+    v->count = written < v->hdr->capacity ? written : v->hdr->capacity;
+    v->start = written < v->hdr->capacity ? 0 : written % v->hdr->capacity;
+    return 0;
+}
+
+static void history_usage(void)
+{
+    fprintf(stderr, "Usage: netmon history [options] FILE\n");
+    fprintf(stderr, "Summarize or export samples recorded with --history-file.\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -f, --from TIME  Start of the range (default: first sample)\n");
+    fprintf(stderr, "  -t, --to TIME    End of the range (default: last sample)\n");
+    fprintf(stderr, "  -c, --csv        Print one CSV line per sample instead of a summary\n");
+    fprintf(stderr, "  -h, --help       Show this help message\n");
+    fprintf(stderr, "TIME is Unix seconds, \"YYYY-MM-DD[ HH:MM[:SS]]\" (local time) or\n");
+    fprintf(stderr, "relative to now, e.g. -30m, -2h, -1d\n");
+}
+
+int history_main(int argc, char **argv)
+{
+    static const struct option long_options[] = {
+        {"from", required_argument, NULL, 'f'},
+        {"to",   required_argument, NULL, 't'},
+        {"csv",  no_argument,       NULL, 'c'},
+        {"help", no_argument,       NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    struct timespec ts;
+    struct history_view v = {0};
+    struct history_summary sum = {0};
+    const char *from_arg = NULL, *to_arg = NULL;
+    uint64_t now, from = 0, to = UINT64_MAX, lo, hi, i;
+    char a[32], b[32];
+    bool csv = false;
+    int opt, err;
+
+    optind = 1;
+    while ((opt = getopt_long(argc, argv, "f:t:ch", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'f':
+                from_arg = optarg;
+                break;
+            case 't':
+                to_arg = optarg;
+                break;
+            case 'c':
+                csv = true;
+                break;
+            case 'h':
+                history_usage();
+                return 0;
+            default:
+                history_usage();
+                return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        history_usage();
+        return 1;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    now = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    if (from_arg && parse_time(from_arg, now, &from)) {
+        fprintf(stderr, "Error: Invalid time: %s\n", from_arg);
+        return 1;
+    }
+    if (to_arg && parse_time(to_arg, now, &to)) {
+        fprintf(stderr, "Error: Invalid time: %s\n", to_arg);
+        return 1;
+    }
+
+    err = view_open(&v, argv[optind]);
+    if (err) {
+        fprintf(stderr, "Error: Failed to open history file %s: %s\n", argv[optind],
+                err == -EINVAL ? "not a netmon history file" : strerror(-err));
+        return 1;
+    }
+
+    lo = view_lower_bound(&v, from);
+    hi = to == UINT64_MAX ? v.count : view_lower_bound(&v, to + 1);
+
+    if (csv) {
+        int c;
+
+        printf("timestamp,interval_ms");
+        for (c = 0; c < HISTORY_NR_COUNTERS; c++)
+            printf(",%s", counter_columns[c]);
+        printf("\n");
+        for (i = lo; i < hi; i++) {
+            const struct history_record *r = view_at(&v, i);
+
+            printf("%lu.%03lu,%u", (unsigned long)(r->timestamp_ns / 1000000000ULL),
+                   (unsigned long)(r->timestamp_ns / 1000000 % 1000), r->interval_ms);
+            for (c = 0; c < HISTORY_NR_COUNTERS; c++)
+                printf(",%lu", (unsigned long)r->delta[c]);
+            printf("\n");
+        }
+        munmap((void *)v.hdr, v.map_len);
+        return 0;
+    }
+
+    printf("History file: %s\n", argv[optind]);
+    printf("  Resolution:  %u s, %lu of %u samples stored\n", v.hdr->resolution,
+           (unsigned long)v.count, v.hdr->capacity);
+    if (v.count > 0)
+        printf("  Recorded:    %s .. %s\n", format_time(view_at(&v, 0)->timestamp_ns, a, sizeof(a)),
+               format_time(view_at(&v, v.count - 1)->timestamp_ns, b, sizeof(b)));
+    for (i = lo; i < hi; i++)
+        history_summary_add(&sum, view_at(&v, i));
+    if (sum.samples == 0) {
+        printf("  No samples in the selected range\n");
+        munmap((void *)v.hdr, v.map_len);
+        return 0;
+    }
+    printf("  Selected:    %s .. %s (%lu samples, %.0f s)\n\n",
+           format_time(sum.first_ns, a, sizeof(a)), format_time(sum.last_ns, b, sizeof(b)),
+           (unsigned long)sum.samples, sum.duration_ms / 1000.0);
+    history_print_summary(&sum, "Rates over the selected range");
+    munmap((void *)v.hdr, v.map_len);
+    return 0;
+}
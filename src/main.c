@@ -1,409 +1,4150 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
 #include <signal.h>
 #include <time.h>
+#include <getopt.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <sched.h>
 #include <arpa/inet.h>
 #include <linux/rtnetlink.h>
 #include <linux/neighbour.h>
 #include <sys/socket.h>
-#include <sys/select.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <dirent.h>
+#include <linux/magic.h>
 #include <bpf/bpf.h>
 #include <bpf/libbpf.h>
 #include <net/if.h>
+#include <net/if_arp.h>
+#include <linux/if_ether.h>
 #include <linux/if_link.h>
 #include "../include/arp_monitor.h"
+#include "../include/output.h"
+#include "../include/spsc_queue.h"
+#include "../include/neigh_table.h"
+#include "../include/detector.h"
+#include "../include/exporter.h"
+#include "../include/pcapng.h"
+#include "../include/history.h"
+#include "../include/control.h"
+#include "monitor.skel.h"
 
 static volatile sig_atomic_t keep_running = 1;
 
+/* 收到 SIGUSR1 时输出当前邻居表 */
+static volatile sig_atomic_t dump_requested = 0;
+
+/* 可能的 CPU 数量，per-CPU map 每个 key 对应 nr_cpus 份值 */
+static int nr_cpus;
+
+/* 默认显示的 Top-N 流数量 */
+#define DEFAULT_TOP_FLOWS 10
+
+/* 默认统计显示间隔（秒） */
+#define DEFAULT_STATS_INTERVAL 10
+
+/*
+ * ring buffer 有未消费事件时 epoll_wait 的超时（毫秒）。
+ * eBPF 程序在积压较少时使用 BPF_RB_NO_WAKEUP，该超时保证这类事件的最大延迟；
+ * 空闲时无限期等待，进程不会被周期性唤醒。
+ */
+#define RB_FLUSH_INTERVAL_MS 50
+
+/* 输出缓冲的最大滞留时间（纳秒），有未写出数据时 epoll_wait 同样使用 RB_FLUSH_INTERVAL_MS 超时 */
+#define OUTPUT_FLUSH_INTERVAL_NS (RB_FLUSH_INTERVAL_MS * 1000000ULL)
+
+/* Netlink 批量接收：每次 recvmmsg 最多 NL_BATCH 个数据报 */
+#define NL_BATCH        16
+#define NL_BUF_SIZE     (32 * 1024)
+/* Netlink 接收缓冲区大小，ARP 风暴或大量接口变化时避免溢出 */
+#define NL_RCVBUF_SIZE  (4 * 1024 * 1024)
+
+/* 邻居表初始容量（条目），按需扩容 */
+#define NEIGH_TABLE_SIZE 1024
+
+/* 消费线程与格式化线程之间的事件队列容量（条），必须是 2 的幂 */
+#define EVENT_QUEUE_CAPACITY 65536
+
+/* 抓包 perf buffer 每 CPU 的页数（2 的幂），4 KB 页时每 CPU 1 MB */
+#define CAPTURE_PERF_PAGES 256
+
+/* 抓包空闲时把写缓冲区的尾部写出的间隔（毫秒），文件可以被边写边读 */
+#define CAPTURE_SYNC_INTERVAL_MS 1000
+
+/* epoll 事件来源 */
+enum epoll_source {
+    EV_NETLINK,
+    EV_RINGBUF,
+    EV_STATS_TIMER,
+    EV_QUEUE,
+    EV_EXPORTER,
+    EV_STOP,
+    EV_HISTORY_TIMER,
+};
+
+/*
+ * ring buffer 消费线程：只负责把 arp_events/ndp_events 中的事件搬运到各自的 SPSC 队列，
+ * 格式化和输出由主线程完成，慢速的 stdout 或磁盘不会阻塞 ring buffer 的消费
+ */
+struct consumer {
+    pthread_t thread;
+    struct ring_buffer *rb;
+    struct spsc_queue *queue;
+    struct spsc_queue *ndp_queue;
+    int notify_fd;          /* eventfd：通知主线程队列中有新事件 */
+    int stop_fd;            /* eventfd：通知消费线程退出 */
+    int cpu;                /* 绑定的 CPU，-1 表示不绑定 */
+};
+
+/*
+ * 抓包线程：从 capture_events perf buffer 读取帧并写入 pcapng 文件，
+ * 与事件消费线程分开，磁盘写入不会延迟 ARP/NDP 事件。计数器供主线程显示。
+ */
+struct capture {
+    pthread_t thread;
+    struct perf_buffer *pb;
+    struct pcapng_writer writer;
+    struct pcapng_iface ifaces[MAX_INTERFACES];
+    int dispatch_fd;        /* 写入失败时从 dispatch 中移除抓包程序 */
+    int stop_fd;            /* eventfd：通知抓包线程退出 */
+    int err;                /* 写入失败的 errno，之后不再写入 */
+    _Atomic uint64_t packets;
+    _Atomic uint64_t bytes;
+    _Atomic uint64_t files;
+    _Atomic uint64_t lost;  /* perf buffer 已满被内核丢弃的记录 */
+};
+
+/* 强制模式：维护 trusted_bindings map（静态文件和/或从邻居表学习） */
+struct enforcer {
+    int map_fd;
+    bool learn;                 /* 从邻居表学习绑定 */
+    const struct iface_list *ifaces;    /* 只学习被监控接口上的邻居 */
+    uint32_t static_count;      /* 静态文件中的绑定数 */
+    uint32_t learned;           /* 当前从邻居表学习到的绑定数 */
+};
+
+/* Netlink 邻居表监听：订阅的 socket、用户空间邻居表和批量接收缓冲区 */
+struct netlink_ctx {
+    int sock;
+    struct neigh_table table;
+    struct mmsghdr msgs[NL_BATCH];
+    struct iovec iov[NL_BATCH];
+    char *bufs;                 /* NL_BATCH * NL_BUF_SIZE */
+    uint32_t seq;
+    uint64_t overruns;          /* 接收缓冲区溢出（ENOBUFS）次数，每次都会重新 dump */
+    struct detector *detector;  /* 启用检测时与邻居表变化关联，否则为 NULL */
+    struct enforcer *enforcer;  /* 从邻居表学习可信绑定时不为 NULL */
+};
+
+/* XDP 附加模式（-x/--xdp-mode） */
+enum xdp_mode {
+    XDP_MODE_AUTO,      /* 优先 native，驱动不支持时回退到 generic */
+    XDP_MODE_NATIVE,
+    XDP_MODE_GENERIC,
+};
+
+/* 被监控的网络接口 */
+struct monitor_iface {
+    int ifindex;
+    char name[IF_NAMESIZE];
+    bool attached;
+    struct bpf_link *link;  /* pin 模式下的 XDP bpf_link，否则为 NULL */
+    uint32_t xdp_flags;     /* 附加时使用的模式标志，分离时必须一致 */
+    uint8_t attach_mode;    /* 内核报告的实际附加模式（XDP_ATTACHED_*） */
+    bool link_created;      /* link 由本次运行创建并 pin，启动失败时要 unpin */
+    int prev_prog_fd;       /* 热替换前 link 上的程序，启动完成前保留以便回滚，否则为 -1 */
+};
+
+/* 接口列表：同一个 XDP 程序附加到所有接口，计数器按 ifindex 区分 */
+struct iface_list {
+    struct monitor_iface items[MAX_INTERFACES];
+    int count;
+    /* 按 ifindex 索引的 items 下标 + 1（0 表示不在列表中），事件输出路径上查找接口名不遍历列表 */
+    uint16_t *slots;
+    uint32_t slots_cap;
+};
+
+/*
+ * 事件输出：events 接收 XDP ARP 事件，text 接收 Netlink 等文本消息。
+ * 文本模式下二者指向同一个输出；二进制模式下 events 写原始 stdout，text 写 stderr。
+ */
+struct monitor_output {
+    struct output *events;
+    struct output *text;
+    const struct iface_list *ifaces;    /* 将事件中的 ifindex 转换为接口名 */
+    struct detector *detector;          /* 未启用检测时为 NULL */
+};
+
+/* eBPF map 文件描述符 */
+struct monitor_maps {
+    int packet_count;
+    int arp_statistics;
+    int arp_events;
+    int ethertype_stats;
+    int ipproto_stats;
+    int ip_stats;
+    int flow_stats;
+    int arp_aggregation;
+    int monitor_config;
+    int event_stats;
+    int trusted_bindings;
+    int enforce_stats;
+    int dispatch;
+    int arp_pending;
+    int arp_latency;
+    int ndp_statistics;
+    int ndp_events;
+    int ndp_aggregation;
+    int vlan_stats;
+    int filter_src;
+    int filter_dst;
+    int filter_stats;
+};
+
+/* 内核未导出到用户空间的错误码，批量操作不支持时返回 */
+#ifndef ENOTSUPP
+#define ENOTSUPP 524
+#endif
+
+/* struct traffic_counter 中的字段序号，用于按字段排序 */
+#define TRAFFIC_FIELD_PACKETS 0
+#define TRAFFIC_FIELD_BYTES   1
+
+/*
+ * map 快照：预分配的 key/value 缓冲区，每次刷新通过批量操作读取整个 map，
+ * 然后按 CPU 求和到 sums。值必须全部由 uint64_t 计数器组成。
+ */
+struct map_snapshot {
+    const char *name;
+    int map_fd;
+    uint32_t key_size;
+    uint32_t value_size;    /* 单份值大小（8 字节对齐） */
+    uint32_t nr_fields;     /* 值中 uint64_t 计数器个数 */
+    uint32_t nr_copies;     /* per-CPU map 为 nr_cpus，否则为 1 */
+    uint32_t max_entries;
+    bool is_array;
+    bool keep;              /* 数组和非 LRU 哈希表（按 ifindex 预先插入的计数器）差量模式下也不删除 */
+    bool delta;             /* 差量模式：LRU 哈希表读后删除，其余减去上一次的值 */
+    bool use_batch;         /* 内核不支持批量操作时退回逐条读取 */
+    uint8_t *keys;          /* max_entries * key_size */
+    uint8_t *values;        /* max_entries * nr_copies * value_size */
+    uint64_t *sums;         /* max_entries * nr_fields，按 CPU 求和后的值 */
+    uint64_t *prev;         /* 不删除的差量模式下上一次的和 */
+    uint8_t *prev_keys;     /* 哈希表的 prev 对应的 key（数组按序号对应，为 NULL） */
+    uint32_t prev_count;
+    uint64_t *next;         /* 哈希表本次的和与 key，刷新后与 prev/prev_keys 交换 */
+    uint8_t *next_keys;
+    uint32_t *order;        /* 排序后的条目序号 */
+    uint32_t sort_field;
+    uint32_t count;         /* 本次读取的条目数 */
+    uint32_t syscalls;      /* 本次读取的系统调用次数 */
+    uint64_t latency_ns;    /* 本次读取耗时 */
+};
+
+/* 统计 map 快照序号 */
+enum {
+    SNAP_PACKET_COUNT,
+    SNAP_ARP_STATISTICS,
+    SNAP_ETHERTYPE_STATS,
+    SNAP_IPPROTO_STATS,
+    SNAP_IP_STATS,
+    SNAP_FLOW_STATS,
+    SNAP_EVENT_STATS,
+    SNAP_ENFORCE_STATS,
+    SNAP_ARP_LATENCY,
+    SNAP_NDP_STATISTICS,
+    SNAP_VLAN_STATS,
+    SNAP_FILTER_STATS,
+    SNAP_COUNT
+};
+
+/* 所有统计 map 的快照 */
+struct monitor_snapshots {
+    struct map_snapshot snap[SNAP_COUNT];
+    struct map_snapshot pending;    /* arp_pending，只由 arp_latency_sweep() 读取，不参与统计刷新 */
+    bool delta;
+    uint64_t entries;
+    uint32_t syscalls;
+    uint64_t latency_ns;
+};
+
+void snapshot_free(struct map_snapshot *snap);
+void snapshots_free(struct monitor_snapshots *snaps);
+
+static inline uint8_t *snapshot_key(struct map_snapshot *snap, uint32_t i)
+{
+    return snap->keys + (size_t)i * snap->key_size;
+}
+
+static inline uint64_t *snapshot_sum(struct map_snapshot *snap, uint32_t i)
+{
+    return snap->sums + (size_t)i * snap->nr_fields;
+}
+
 void sig_handler(int signo)
 {
-    keep_running = 0;
+    if (signo == SIGUSR1) {
+        dump_requested = 1;
+        return;
+    }
+    keep_running = 0;
+}
+
+/* 将 MAC 地址转换为字符串 */
+void mac_to_str(const uint8_t *mac, char *str)
+{
+    *fmt_mac(str, mac) = '\0';
+}
+
+/* 将 IP 地址转换为字符串 */
+void ip_to_str(uint32_t ip, char *str)
+{
+    *fmt_ipv4(str, ip) = '\0';
+}
+
+/* 按地址族格式化邻居地址，返回写入结束位置 */
+char *neigh_fmt_addr(char *p, const struct neigh_key *key)
+{
+    uint32_t ip;
+
+    if (key->family == AF_INET6)
+        return fmt_ipv6(p, key->addr);
+    memcpy(&ip, key->addr, sizeof(ip));
+    return fmt_ipv4(p, ip);
+}
+
+/* 获取 ARP 操作类型字符串 */
+const char* get_arp_opcode_str(uint16_t opcode)
+{
+    switch (opcode) {
+        case 1: return "REQUEST";
+        case 2: return "REPLY";
+        case 3: return "RARP-REQUEST";
+        case 4: return "RARP-REPLY";
+        default: return "UNKNOWN";
+    }
+}
+
+/* 获取 NDP 消息类型字符串 */
+const char *get_ndp_type_str(uint8_t type)
+{
+    switch (type) {
+        case NDP_ROUTER_SOLICIT: return "RS";
+        case NDP_ROUTER_ADVERT: return "RA";
+        case NDP_NEIGH_SOLICIT: return "NS";
+        case NDP_NEIGH_ADVERT: return "NA";
+        default: return "UNKNOWN";
+    }
+}
+
+/* 获取 ARP 状态字符串 */
+const char* get_arp_state_str(uint16_t state)
+{
+    switch (state) {
+        case NUD_INCOMPLETE: return "INCOMPLETE";
+        case NUD_REACHABLE: return "REACHABLE";
+        case NUD_STALE: return "STALE";
+        case NUD_DELAY: return "DELAY";
+        case NUD_PROBE: return "PROBE";
+        case NUD_FAILED: return "FAILED";
+        case NUD_NOARP: return "NOARP";
+        case NUD_PERMANENT: return "PERMANENT";
+        default: return "UNKNOWN";
+    }
+}
+
+/* 添加接口，已存在时忽略 */
+int iface_list_add(struct iface_list *list, int ifindex, const char *name)
+{
+    int i;
+
+    for (i = 0; i < list->count; i++) {
+        if (list->items[i].ifindex == ifindex)
+            return 0;
+    }
+    if (list->count >= MAX_INTERFACES)
+        return -E2BIG;
+    if (ifindex <= 0)
+        return -EINVAL;
+
+    if ((uint32_t)ifindex >= list->slots_cap) {
+        uint32_t cap = list->slots_cap ? list->slots_cap : 64;
+        uint16_t *slots;
+
+        while (cap <= (uint32_t)ifindex)
+            cap <<= 1;
+        slots = realloc(list->slots, (size_t)cap * sizeof(*slots));
+        if (!slots)
+            return -ENOMEM;
+        memset(slots + list->slots_cap, 0, (size_t)(cap - list->slots_cap) * sizeof(*slots));
+        list->slots = slots;
+        list->slots_cap = cap;
+    }
+    list->slots[ifindex] = list->count + 1;
+
+    list->items[list->count].ifindex = ifindex;
+    snprintf(list->items[list->count].name, IF_NAMESIZE, "%s", name);
+    list->items[list->count].attached = false;
+    list->items[list->count].attach_mode = XDP_ATTACHED_NONE;
+    list->items[list->count].prev_prog_fd = -1;
+    list->count++;
+    return 0;
+}
+
+/* 解析接口名或 glob 模式（如 "veth*"），返回匹配的接口数 */
+int iface_list_resolve(struct iface_list *list, const char *pattern)
+{
+    struct if_nameindex *names, *it;
+    int ifindex, matched = 0, err;
+
+    /* 普通接口名 */
+    if (!strpbrk(pattern, "*?[")) {
+        ifindex = if_nametoindex(pattern);
+        if (ifindex == 0)
+            return -errno;
+        err = iface_list_add(list, ifindex, pattern);
+        return err ? err : 1;
+    }
+
+    names = if_nameindex();
+    if (!names)
+        return -errno;
+
+    for (it = names; it->if_index != 0; it++) {
+        if (fnmatch(pattern, it->if_name, 0) != 0)
+            continue;
+        err = iface_list_add(list, it->if_index, it->if_name);
+        if (err) {
+            if_freenameindex(names);
+            return err;
+        }
+        matched++;
+    }
+    if_freenameindex(names);
+    return matched;
+}
+
+/* 查找 ifindex 对应的接口名，不在列表中时返回 NULL */
+const char *iface_name(const struct iface_list *list, uint32_t ifindex)
+{
+    if (ifindex >= list->slots_cap || !list->slots[ifindex])
+        return NULL;
+    return list->items[list->slots[ifindex] - 1].name;
+}
+
+void iface_list_free(struct iface_list *list)
+{
+    free(list->slots);
+    list->slots = NULL;
+    list->slots_cap = 0;
+}
+
+/*
+ * 从所有接口分离程序。pin 模式下只关闭 link 的 fd，pin 文件保持 link 存活，
+ * 程序继续运行，下一个 netmon 进程可以接管。只用于正常退出，启动失败时用 iface_list_abort。
+ */
+void iface_list_detach(struct iface_list *list)
+{
+    int i;
+
+    for (i = 0; i < list->count; i++) {
+        struct monitor_iface *iface = &list->items[i];
+
+        if (iface->link) {
+            bpf_link__disconnect(iface->link);
+            bpf_link__destroy(iface->link);
+            iface->link = NULL;
+        } else if (iface->attached) {
+            bpf_xdp_detach(iface->ifindex, XDP_FLAGS_UPDATE_IF_NOEXIST | iface->xdp_flags, NULL);
+        }
+        iface->attached = false;
+    }
+}
+
+/* 启动完成：不再需要回滚，释放为回滚保留的旧程序 */
+void iface_list_commit(struct iface_list *list)
+{
+    int i;
+
+    for (i = 0; i < list->count; i++) {
+        struct monitor_iface *iface = &list->items[i];
+
+        if (iface->prev_prog_fd >= 0)
+            close(iface->prev_prog_fd);
+        iface->prev_prog_fd = -1;
+        iface->link_created = false;
+    }
+}
+
+/*
+ * 启动失败时撤销本次运行的附加：本次创建的 link 先 unpin 再销毁，内核随即分离程序；
+ * 热替换过的 link 换回原来的程序，避免部分接口运行新程序、部分运行旧程序。
+ */
+void iface_list_abort(struct iface_list *list)
+{
+    int i;
+
+    for (i = 0; i < list->count; i++) {
+        struct monitor_iface *iface = &list->items[i];
+
+        if (!iface->link)
+            continue;
+        if (iface->link_created) {
+            if (bpf_link__unpin(iface->link))
+                fprintf(stderr, "Warning: Failed to unpin XDP link on %s\n", iface->name);
+        } else if (iface->prev_prog_fd < 0 ||
+                   bpf_link_update(bpf_link__fd(iface->link), iface->prev_prog_fd, NULL)) {
+            fprintf(stderr, "Warning: Failed to restore previous XDP program on %s\n",
+                    iface->name);
+        }
+    }
+    iface_list_commit(list);
+    iface_list_detach(list);
+}
+
+const char *xdp_attach_mode_str(uint8_t mode)
+{
+    switch (mode) {
+        case XDP_ATTACHED_DRV:   return "native";
+        case XDP_ATTACHED_SKB:   return "generic";
+        case XDP_ATTACHED_HW:    return "offload";
+        case XDP_ATTACHED_MULTI: return "multi";
+        default:                 return "none";
+    }
+}
+
+/* 向内核查询接口上实际生效的 XDP 模式，记录到 iface->attach_mode */
+const char *iface_query_mode(struct monitor_iface *iface)
+{
+    LIBBPF_OPTS(bpf_xdp_query_opts, opts);
+
+    iface->attach_mode = XDP_ATTACHED_NONE;
+    if (bpf_xdp_query(iface->ifindex, 0, &opts) == 0)
+        iface->attach_mode = opts.attach_mode;
+    return xdp_attach_mode_str(iface->attach_mode);
+}
+
+/*
+ * pin 模式下附加到一个接口：已有 pin 的 link 时用 bpf_link_update 原子替换程序
+ * （沿用该 link 原来的模式），否则以 flags 指定的模式创建 XDP link 并 pin 到
+ * <pin_dir>/link_<接口名>。
+ */
+int iface_attach_link(struct monitor_iface *iface, struct bpf_program *prog,
+                      const char *pin_dir, uint32_t flags)
+{
+    LIBBPF_OPTS(bpf_link_create_opts, opts, .flags = flags);
+    char path[PATH_MAX];
+    struct bpf_link *link;
+    int err, fd;
+
+    snprintf(path, sizeof(path), "%s/link_%s", pin_dir, iface->name);
+
+    link = bpf_link__open(path);
+    if (!libbpf_get_error(link)) {
+        struct bpf_link_info info = {};
+        uint32_t info_len = sizeof(info);
+
+        /* 保留旧程序的引用：替换后 link 是它唯一的持有者，回滚时需要它 */
+        if (bpf_obj_get_info_by_fd(bpf_link__fd(link), &info, &info_len) == 0)
+            iface->prev_prog_fd = bpf_prog_get_fd_by_id(info.prog_id);
+        err = bpf_link__update_program(link, prog);
+        if (err) {
+            if (iface->prev_prog_fd >= 0)
+                close(iface->prev_prog_fd);
+            iface->prev_prog_fd = -1;
+            bpf_link__disconnect(link);
+            bpf_link__destroy(link);
+            return err;
+        }
+        iface->link = link;
+        printf("✓ Replaced XDP program on %s via pinned link %s (mode: %s)\n",
+               iface->name, path, iface_query_mode(iface));
+        return 0;
+    }
+
+    /* bpf_program__attach_xdp 不能指定模式，先创建并 pin link，再通过 pin 路径打开 */
+    fd = bpf_link_create(bpf_program__fd(prog), iface->ifindex, BPF_XDP, &opts);
+    if (fd < 0)
+        return -errno;
+    err = bpf_obj_pin(fd, path) ? -errno : 0;
+    close(fd);
+    if (err)
+        return err;
+    link = bpf_link__open(path);
+    err = libbpf_get_error(link);
+    if (err) {
+        unlink(path);
+        return err;
+    }
+    iface->link = link;
+    iface->link_created = true;
+    printf("✓ Successfully attached XDP program to %s (mode: %s, link pinned at %s)\n",
+           iface->name, iface_query_mode(iface), path);
+    return 0;
+}
+
+/* 以 flags 指定的模式（XDP_FLAGS_DRV_MODE / XDP_FLAGS_SKB_MODE）附加到一个接口 */
+int iface_attach(struct monitor_iface *iface, struct bpf_program *prog,
+                 const char *pin_dir, uint32_t flags)
+{
+    int err;
+
+    if (pin_dir)
+        return iface_attach_link(iface, prog, pin_dir, flags);
+
+    err = bpf_xdp_attach(iface->ifindex, bpf_program__fd(prog),
+                         XDP_FLAGS_UPDATE_IF_NOEXIST | flags, NULL);
+    if (err)
+        return err;
+    printf("✓ Successfully attached XDP program to %s (mode: %s)\n",
+           iface->name, iface_query_mode(iface));
+    return 0;
+}
+
+/*
+ * 附加到所有接口；pin_dir 不为 NULL 时使用 pin 的 bpf_link。
+ * auto 模式下驱动不支持 native XDP 时回退到 generic（SKB）模式并给出警告；
+ * 接口上已有程序（EEXIST/EBUSY）或权限不足时不回退。
+ */
+int iface_list_attach(struct iface_list *list, struct bpf_program *prog,
+                      const char *pin_dir, enum xdp_mode mode)
+{
+    int i, err;
+
+    for (i = 0; i < list->count; i++) {
+        struct monitor_iface *iface = &list->items[i];
+        uint32_t flags = mode == XDP_MODE_GENERIC ? XDP_FLAGS_SKB_MODE : XDP_FLAGS_DRV_MODE;
+
+        err = iface_attach(iface, prog, pin_dir, flags);
+        if (err && mode == XDP_MODE_AUTO &&
+            err != -EEXIST && err != -EBUSY && err != -EPERM) {
+            printf("⚠ Warning: Native XDP unavailable on %s (%s), falling back to generic mode\n",
+                   iface->name, strerror(-err));
+            flags = XDP_FLAGS_SKB_MODE;
+            err = iface_attach(iface, prog, pin_dir, flags);
+        }
+        if (err) {
+            fprintf(stderr, "Error: Failed to attach XDP program to %s: %s\n",
+                    iface->name, strerror(-err));
+            iface_list_abort(list);
+            return err;
+        }
+        iface->xdp_flags = flags;
+        iface->attached = true;
+    }
+    return 0;
+}
+
+/*
+ * 为每个接口在按 ifindex 索引的计数器 map 中预先插入零值，
+ * eBPF 快速路径因此只需一次查找
+ */
+int iface_list_init_counters(const struct iface_list *list, int map_fd, size_t value_size)
+{
+    void *zero;
+    int i, err = 0;
+
+    zero = calloc(nr_cpus, (value_size + 7) & ~(size_t)7);
+    if (!zero)
+        return -ENOMEM;
+
+    for (i = 0; i < list->count; i++) {
+        uint32_t key = list->items[i].ifindex;
+
+        if (bpf_map_update_elem(map_fd, &key, zero, BPF_NOEXIST) && errno != EEXIST) {
+            err = -errno;
+            break;
+        }
+    }
+    free(zero);
+    return err;
+}
+
+/*
+ * 为对象中的所有 map 设置 pin 路径 <pin_dir>/<map 名>。加载时 libbpf 复用已存在且定义兼容的
+ * pin map（计数器得以保留），不存在的 map 在加载后 pin。返回复用的 map 数，失败返回负值。
+ */
+int pin_maps_setup(struct bpf_object *obj, const char *pin_dir)
+{
+    char path[PATH_MAX];
+    struct bpf_map *map;
+    struct statfs st;
+    int reused = 0, err;
+
+    if (mkdir(pin_dir, 0700) && errno != EEXIST)
+        return -errno;
+    if (statfs(pin_dir, &st) == 0 && st.f_type != BPF_FS_MAGIC)
+        fprintf(stderr, "Warning: %s is not on a bpffs mount\n", pin_dir);
+
+    bpf_object__for_each_map(map, obj) {
+        /* .rodata/.bss 等内部 map 不 pin；perf event 数组中的 fd 属于创建它的进程，也不 pin */
+        if (strchr(bpf_map__name(map), '.') ||
+            bpf_map__type(map) == BPF_MAP_TYPE_PERF_EVENT_ARRAY)
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", pin_dir, bpf_map__name(map));
+        err = bpf_map__set_pin_path(map, path);
+        if (err)
+            return err;
+        if (access(path, F_OK) == 0)
+            reused++;
+    }
+    return reused;
+}
+
+/* 删除 pin 目录中的所有 map 和 link（删除 link 的 pin 会分离程序） */
+int unpin_all(const char *pin_dir)
+{
+    struct dirent *de;
+    char path[PATH_MAX];
+    int removed = 0, err = 0;
+    DIR *dir;
+
+    dir = opendir(pin_dir);
+    if (!dir) {
+        fprintf(stderr, "Error: Failed to open %s: %s\n", pin_dir, strerror(errno));
+        return -1;
+    }
+    while ((de = readdir(dir))) {
+        if (de->d_name[0] == '.')
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", pin_dir, de->d_name);
+        if (unlink(path)) {
+            fprintf(stderr, "Error: Failed to remove %s: %s\n", path, strerror(errno));
+            err = -1;
+            continue;
+        }
+        removed++;
+    }
+    closedir(dir);
+    if (!err && rmdir(pin_dir))
+        fprintf(stderr, "Warning: Failed to remove %s: %s\n", pin_dir, strerror(errno));
+    printf("✓ Removed %d pinned objects from %s\n", removed, pin_dir);
+    return err;
+}
+
+/* ring buffer 回调（消费线程）：将 ARP/NDP 事件放入各自的队列，队列满时丢弃并计数 */
+int handle_ring_event(void *ctx, void *data, size_t data_sz)
+{
+    struct spsc_queue *queue = ctx;
+
+    spsc_push(queue, data);
+    return 0;
+}
+
+/* 将一个 ARP 事件格式化到输出缓冲区 */
+void format_arp_event(struct monitor_output *mo, const struct arp_event *event)
+{
+    const char *name;
+    char *line, *p;
+
+    /* 二进制模式：直接输出定长记录 */
+    if (mo->events->format == OUTPUT_BINARY) {
+        output_write(mo->events, event, sizeof(*event));
+        return;
+    }
+
+    line = p = output_reserve(mo->events, OUTPUT_MAX_RECORD);
+    p = fmt_str(p, "[ARP] ");
+    p = fmt_str(p, get_arp_opcode_str(event->opcode));
+    p = fmt_str(p, ": ");
+    p = fmt_ipv4(p, event->src_ip);
+    p = fmt_str(p, " (");
+    p = fmt_mac(p, event->src_mac);
+    p = fmt_str(p, ") -> ");
+    p = fmt_ipv4(p, event->dst_ip);
+    p = fmt_str(p, " (");
+    p = fmt_mac(p, event->dst_mac);
+    *p++ = ')';
+
+    /* 聚合模式下窗口到期的事件代表多个 ARP 包 */
+    if (event->count > 1) {
+        uint64_t tenths = (event->timestamp - event->first_seen) / 100000000ULL;
+
+        p = fmt_str(p, " x");
+        p = fmt_u64(p, event->count);
+        p = fmt_str(p, " in ");
+        p = fmt_u64(p, tenths / 10);
+        *p++ = '.';
+        *p++ = '0' + tenths % 10;
+        *p++ = 's';
+    }
+
+    p = fmt_str(p, " (dev: ");
+    name = iface_name(mo->ifaces, event->ifindex);
+    if (name) {
+        p = fmt_str(p, name);
+    } else {
+        p = fmt_str(p, "if");
+        p = fmt_u64(p, event->ifindex);
+    }
+    *p++ = ')';
+    *p++ = '\n';
+    output_commit(mo->events, p - line);
+}
+
+/* 将一个 NDP 事件格式化到输出缓冲区，二进制模式下写入文本输出（记录格式只有 ARP） */
+void format_ndp_event(struct monitor_output *mo, const struct ndp_event *event)
+{
+    static const uint8_t zero_mac[6];
+    const char *name;
+    char *line, *p;
+
+    line = p = output_reserve(mo->text, OUTPUT_MAX_RECORD);
+    p = fmt_str(p, "[NDP] ");
+    p = fmt_str(p, get_ndp_type_str(event->type));
+    p = fmt_str(p, ": ");
+    p = fmt_ipv6(p, event->src_ip);
+    p = fmt_str(p, " (");
+    p = fmt_mac(p, event->src_mac);
+    p = fmt_str(p, ") -> ");
+    p = fmt_ipv6(p, event->dst_ip);
+    if (event->type == NDP_NEIGH_SOLICIT || event->type == NDP_NEIGH_ADVERT) {
+        p = fmt_str(p, " target ");
+        p = fmt_ipv6(p, event->target);
+    }
+    if (memcmp(event->lladdr, zero_mac, sizeof(zero_mac))) {
+        p = fmt_str(p, " lladdr ");
+        p = fmt_mac(p, event->lladdr);
+    }
+    if (event->type == NDP_NEIGH_ADVERT && event->flags) {
+        p = fmt_str(p, " [");
+        if (event->flags & NDP_NA_FLAG_ROUTER)
+            *p++ = 'R';
+        if (event->flags & NDP_NA_FLAG_SOLICITED)
+            *p++ = 'S';
+        if (event->flags & NDP_NA_FLAG_OVERRIDE)
+            *p++ = 'O';
+        *p++ = ']';
+    }
+
+    if (event->count > 1) {
+        uint64_t tenths = (event->timestamp - event->first_seen) / 100000000ULL;
+
+        p = fmt_str(p, " x");
+        p = fmt_u64(p, event->count);
+        p = fmt_str(p, " in ");
+        p = fmt_u64(p, tenths / 10);
+        *p++ = '.';
+        *p++ = '0' + tenths % 10;
+        *p++ = 's';
+    }
+
+    p = fmt_str(p, " (dev: ");
+    name = iface_name(mo->ifaces, event->ifindex);
+    if (name) {
+        p = fmt_str(p, name);
+    } else {
+        p = fmt_str(p, "if");
+        p = fmt_u64(p, event->ifindex);
+    }
+    *p++ = ')';
+    *p++ = '\n';
+    output_commit(mo->text, p - line);
+}
+
+/* 格式化队列中的所有事件（主线程） */
+void drain_event_queue(struct spsc_queue *queue, struct monitor_output *mo)
+{
+    const struct arp_event *event;
+
+    while ((event = spsc_front(queue))) {
+        format_arp_event(mo, event);
+        if (mo->detector)
+            detector_process(mo->detector, event);
+        spsc_release(queue);
+    }
+}
+
+/* 格式化 NDP 事件队列（主线程） */
+void drain_ndp_queue(struct spsc_queue *queue, struct monitor_output *mo)
+{
+    const struct ndp_event *event;
+
+    while ((event = spsc_front(queue))) {
+        format_ndp_event(mo, event);
+        spsc_release(queue);
+    }
+}
+
+/* 写出所有输出缓冲区，在使用 printf 输出统计之前调用以保持顺序 */
+void monitor_output_flush(struct monitor_output *mo)
+{
+    output_flush(mo->events);
+    if (mo->text != mo->events)
+        output_flush(mo->text);
+}
+
+/* 输出缓冲区中是否有未写出的数据 */
+bool monitor_output_pending(struct monitor_output *mo)
+{
+    return output_pending(mo->events) || output_pending(mo->text);
+}
+
+/* 创建 Netlink 套接字用于监听 ARP 表和接口变化 */
+int create_netlink_socket(void)
+{
+    int sock, size = NL_RCVBUF_SIZE;
+    struct sockaddr_nl addr;
+
+    sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (sock < 0) {
+        fprintf(stderr, "Warning: Failed to create netlink socket: %s\n", strerror(errno));
+        return -1;
+    }
+
+    /* SO_RCVBUFFORCE 可突破 rmem_max（需要 CAP_NET_ADMIN），失败时退回 SO_RCVBUF */
+    if (setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) < 0)
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = RTMGRP_NEIGH | RTMGRP_LINK; /* 订阅邻居表（ARP）和接口变化 */
+
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "Warning: Failed to bind netlink socket: %s\n", strerror(errno));
+        close(sock);
+        return -1;
+    }
+
+    return sock;
+}
+
+/* 创建周期性统计定时器 */
+int create_stats_timer(int interval_sec)
+{
+    struct itimerspec its = {
+        .it_interval = { .tv_sec = interval_sec },
+        .it_value = { .tv_sec = interval_sec },
+    };
+    int fd;
+
+    fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0)
+        return -1;
+
+    if (timerfd_settime(fd, 0, &its, NULL) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* 将文件描述符加入 epoll 集合，source 标识事件来源 */
+int epoll_add(int epfd, int fd, enum epoll_source source)
+{
+    struct epoll_event ev = {
+        .events = EPOLLIN,
+        .data.u32 = source,
+    };
+
+    return epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+/* 将线程绑定到指定 CPU，cpu < 0 时不绑定 */
+int pin_thread(pthread_t thread, int cpu)
+{
+    cpu_set_t set;
+
+    if (cpu < 0)
+        return 0;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(thread, sizeof(set), &set);
+}
+
+/* 写 eventfd 计数，唤醒等待方 */
+static void notify(int fd)
+{
+    uint64_t one = 1;
+
+    if (write(fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        fprintf(stderr, "Warning: eventfd write failed: %s\n", strerror(errno));
+}
+
+/*
+ * 消费线程：等待 ring buffer 可读（或积压事件的刷新超时），把事件搬运到队列，
+ * 每批结束后通知主线程一次。收到 stop_fd 通知后做最后一次消费并退出。
+ */
+void *consumer_thread(void *arg)
+{
+    struct consumer *c = arg;
+    bool rb_pending = false;
+    int epfd, err;
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0 ||
+        epoll_add(epfd, ring_buffer__epoll_fd(c->rb), EV_RINGBUF) < 0 ||
+        epoll_add(epfd, c->stop_fd, EV_STOP) < 0) {
+        fprintf(stderr, "Error: Failed to set up consumer event loop: %s\n", strerror(errno));
+        goto out;
+    }
+
+    for (;;) {
+        struct epoll_event events[2];
+        int timeout = rb_pending ? RB_FLUSH_INTERVAL_MS : -1;
+        bool stop = false;
+        int n, i;
+
+        n = epoll_wait(epfd, events, sizeof(events) / sizeof(events[0]), timeout);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "Error: epoll_wait failed: %s\n", strerror(errno));
+            break;
+        }
+        for (i = 0; i < n; i++) {
+            if (events[i].data.u32 == EV_STOP)
+                stop = true;
+        }
+        if (stop)
+            break;
+
+        /* 可读或超时都消费一次：超时用于处理未触发唤醒的积压事件 */
+        err = ring_buffer__consume(c->rb);
+        if (err < 0) {
+            fprintf(stderr, "Error: Failed to consume ring buffer: %s\n", strerror(-err));
+            break;
+        }
+        rb_pending = err > 0;
+        if (err > 0) {
+            spsc_update_high_water(c->queue);
+            spsc_update_high_water(c->ndp_queue);
+            notify(c->notify_fd);
+        }
+    }
+
+out:
+    ring_buffer__consume(c->rb);
+    keep_running = 0;
+    notify(c->notify_fd);
+    if (epfd >= 0)
+        close(epfd);
+    return NULL;
+}
+
+/* perf buffer 回调（抓包线程）：capture_hdr 之后是 caplen 字节的帧数据 */
+static void handle_capture_sample(void *ctx, int cpu, void *data, __u32 size)
+{
+    struct capture *c = ctx;
+    const struct capture_hdr *hdr = data;
+    int err;
+
+    if (c->err || size < sizeof(*hdr) || hdr->caplen > size - sizeof(*hdr))
+        return;
+
+    err = pcapng_write_packet(&c->writer, hdr->timestamp, hdr->ifindex,
+                              hdr + 1, hdr->caplen, hdr->len);
+    if (err) {
+        c->err = -err;
+        return;
+    }
+    atomic_store_explicit(&c->packets, c->writer.packets, memory_order_relaxed);
+    atomic_store_explicit(&c->bytes, c->writer.bytes, memory_order_relaxed);
+    atomic_store_explicit(&c->files, c->writer.files, memory_order_relaxed);
+}
+
+static void handle_capture_lost(void *ctx, int cpu, __u64 cnt)
+{
+    struct capture *c = ctx;
+
+    atomic_fetch_add_explicit(&c->lost, cnt, memory_order_relaxed);
+}
+
+/* 启用或禁用 dispatch 中的抓包程序，禁用后入口程序对空槽位的尾调用直接放行 */
+int capture_slot(int map_fd, struct bpf_object *obj, bool enable)
+{
+    struct bpf_program *prog;
+    uint32_t slot = DISPATCH_CAPTURE;
+    int fd;
+
+    if (!enable) {
+        if (bpf_map_delete_elem(map_fd, &slot) && errno != ENOENT)
+            return -errno;
+        return 0;
+    }
+    prog = bpf_object__find_program_by_name(obj, "handle_capture");
+    if (!prog)
+        return -ENOENT;
+    fd = bpf_program__fd(prog);
+    if (bpf_map_update_elem(map_fd, &slot, &fd, BPF_ANY))
+        return -errno;
+    return 0;
+}
+
+/* 打开 pcapng 文件（每个被监控接口一个接口描述）并创建 perf buffer，失败返回负 errno */
+int capture_init(struct capture *c, const char *path, const struct iface_list *ifaces,
+                 int map_fd, uint32_t snaplen, uint64_t rotate_bytes, uint32_t rotate_count)
+{
+    int i, err;
+
+    c->stop_fd = -1;
+    for (i = 0; i < ifaces->count; i++) {
+        c->ifaces[i].ifindex = ifaces->items[i].ifindex;
+        memcpy(c->ifaces[i].name, ifaces->items[i].name, IF_NAMESIZE);
+    }
+    err = pcapng_open(&c->writer, path, c->ifaces, ifaces->count, snaplen,
+                      rotate_bytes, rotate_count);
+    if (err)
+        return err;
+
+    c->pb = perf_buffer__new(map_fd, CAPTURE_PERF_PAGES, handle_capture_sample,
+                             handle_capture_lost, c, NULL);
+    c->stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (!c->pb || c->stop_fd < 0) {
+        err = -errno;
+        pcapng_close(&c->writer);
+        if (c->pb)
+            perf_buffer__free(c->pb);
+        if (c->stop_fd >= 0)
+            close(c->stop_fd);
+        c->pb = NULL;
+        return err;
+    }
+    atomic_store_explicit(&c->files, c->writer.files, memory_order_relaxed);
+    return 0;
+}
+
+/* 释放 perf buffer 并关闭文件（写出剩余数据），返回关闭文件的错误 */
+int capture_free(struct capture *c)
+{
+    if (!c->pb)
+        return 0;
+    perf_buffer__free(c->pb);
+    c->pb = NULL;
+    if (c->stop_fd >= 0)
+        close(c->stop_fd);
+    return pcapng_close(&c->writer);
+}
+
+/*
+ * 抓包线程：等待 perf buffer 可读并写入文件；空闲 CAPTURE_SYNC_INTERVAL_MS 后写出缓冲区尾部。
+ * 写入失败时移除抓包程序并退出，收到 stop_fd 通知后做最后一次消费并退出。
+ */
+void *capture_thread(void *arg)
+{
+    struct capture *c = arg;
+    int epfd, err;
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0 ||
+        epoll_add(epfd, perf_buffer__epoll_fd(c->pb), EV_RINGBUF) < 0 ||
+        epoll_add(epfd, c->stop_fd, EV_STOP) < 0) {
+        fprintf(stderr, "Error: Failed to set up capture event loop: %s\n", strerror(errno));
+        goto out;
+    }
+
+    while (!c->err) {
+        struct epoll_event events[2];
+        bool stop = false;
+        int n, i;
+
+        n = epoll_wait(epfd, events, sizeof(events) / sizeof(events[0]), CAPTURE_SYNC_INTERVAL_MS);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "Error: epoll_wait failed: %s\n", strerror(errno));
+            break;
+        }
+        if (n == 0) {
+            c->err = -pcapng_sync(&c->writer);
+            continue;
+        }
+        for (i = 0; i < n; i++) {
+            if (events[i].data.u32 == EV_STOP)
+                stop = true;
+        }
+        if (stop)
+            break;
+
+        err = perf_buffer__consume(c->pb);
+        if (err < 0) {
+            fprintf(stderr, "Error: Failed to consume capture buffer: %s\n", strerror(-err));
+            break;
+        }
+    }
+
+out:
+    if (!c->err)
+        perf_buffer__consume(c->pb);
+    if (c->err) {
+        fprintf(stderr, "Error: Capture to %s failed: %s; capture stopped\n",
+                c->writer.file, strerror(c->err));
+        capture_slot(c->dispatch_fd, NULL, false);
+    }
+    if (epfd >= 0)
+        close(epfd);
+    return NULL;
+}
+
+/* 可以作为可信绑定学习的邻居状态（已确认或静态配置，且有 MAC） */
+#define NEIGH_TRUSTED_STATES (NUD_PERMANENT | NUD_REACHABLE | NUD_STALE | NUD_DELAY | NUD_PROBE)
+
+/* 写入一条可信绑定；学习到的绑定不覆盖静态绑定。返回 1 表示新增 */
+int enforcer_set(struct enforcer *enf, uint32_t ifindex, uint32_t ip,
+                 const uint8_t *mac, uint16_t flags)
+{
+    struct binding_key key = { .ifindex = ifindex, .ip = ip };
+    struct binding_value val = { .flags = flags }, old;
+    bool exists;
+
+    exists = bpf_map_lookup_elem(enf->map_fd, &key, &old) == 0;
+    if (exists && (old.flags & BINDING_STATIC) && !(flags & BINDING_STATIC))
+        return 0;
+
+    memcpy(val.mac, mac, sizeof(val.mac));
+    if (bpf_map_update_elem(enf->map_fd, &key, &val, BPF_ANY))
+        return -errno;
+    return !exists;
+}
+
+/*
+ * 加载静态绑定文件，每行 "<IPv4> <MAC> [接口]"，# 开始注释。
+ * 省略接口时绑定应用于所有被监控的接口。
+ */
+int enforcer_load_file(struct enforcer *enf, const char *path, const struct iface_list *ifaces)
+{
+    char line[256], ip_str[64], mac_str[64], dev[IF_NAMESIZE + 1];
+    unsigned int lineno = 0;
+    FILE *f;
+    int err = 0;
+
+    f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "Error: Failed to open binding file %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        char *hash = strchr(line, '#');
+        struct in_addr addr;
+        uint8_t mac[6];
+        int n, i, ret;
+
+        lineno++;
+        if (hash)
+            *hash = '\0';
+        n = sscanf(line, "%63s %63s %16s", ip_str, mac_str, dev);
+        if (n <= 0)
+            continue;
+        if (n < 2 || inet_pton(AF_INET, ip_str, &addr) != 1 ||
+            sscanf(mac_str, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx",
+                   &mac[0], &mac[1], &mac[2], &mac[3], &mac[4], &mac[5]) != 6) {
+            fprintf(stderr, "Error: %s:%u: expected \"<ip> <mac> [interface]\"\n", path, lineno);
+            err = -1;
+            break;
+        }
+
+        for (i = 0; i < ifaces->count; i++) {
+            if (n == 3 && strcmp(dev, ifaces->items[i].name) != 0)
+                continue;
+            ret = enforcer_set(enf, ifaces->items[i].ifindex, addr.s_addr, mac, BINDING_STATIC);
+            if (ret < 0) {
+                fprintf(stderr, "Error: Failed to add binding %s: %s\n", ip_str, strerror(-ret));
+                err = -1;
+                goto out;
+            }
+            enf->static_count += ret;
+        }
+    }
+out:
+    fclose(f);
+    return err;
+}
+
+/* 邻居表变化时同步学习到的绑定（静态绑定不受影响） */
+void enforcer_neigh_update(struct enforcer *enf, enum neigh_change change,
+                           const struct neigh_entry *e)
+{
+    struct binding_key key = { .ifindex = e->key.ifindex };
+    struct binding_value old;
+
+    if (e->key.family != AF_INET || !iface_name(enf->ifaces, e->key.ifindex))
+        return;
+    memcpy(&key.ip, e->key.addr, sizeof(key.ip));
+
+    if (change == NEIGH_ADDED || change == NEIGH_UPDATED) {
+        if (e->state & NEIGH_TRUSTED_STATES) {
+            if (enforcer_set(enf, key.ifindex, key.ip, e->lladdr, 0) > 0)
+                enf->learned++;
+            return;
+        }
+        /* 变为 FAILED/INCOMPLETE 等状态时不再信任原来的 MAC */
+    } else if (change != NEIGH_DELETED) {
+        return;
+    }
+
+    if (bpf_map_lookup_elem(enf->map_fd, &key, &old) == 0 && !(old.flags & BINDING_STATIC) &&
+        bpf_map_delete_elem(enf->map_fd, &key) == 0)
+        enf->learned--;
+}
+
+/* 从当前邻居表学习所有可信绑定 */
+void enforcer_learn_all(struct enforcer *enf, struct neigh_table *table)
+{
+    struct neigh_entry *e;
+    uint32_t pos = 0;
+
+    while ((e = neigh_table_next(table, &pos)))
+        enforcer_neigh_update(enf, NEIGH_ADDED, e);
+}
+
+/* 输出一条 ARP/NDP 表变化 */
+void print_neigh_change(struct output *out, struct neigh_table *table,
+                        enum neigh_change change, const struct neigh_entry *e)
+{
+    static const char *change_str[] = {
+        [NEIGH_ADDED]   = "ADD",
+        [NEIGH_UPDATED] = "UPDATE",
+        [NEIGH_DELETED] = "DELETE",
+    };
+    char *line, *p;
+
+    line = p = output_reserve(out, OUTPUT_MAX_RECORD);
+    p = fmt_str(p, e->key.family == AF_INET6 ? "[NDP TABLE] " : "[ARP TABLE] ");
+    p = fmt_str(p, change_str[change]);
+    p = fmt_str(p, ": ");
+    p = neigh_fmt_addr(p, &e->key);
+    p = fmt_str(p, " -> ");
+    p = fmt_mac(p, e->lladdr);
+    p = fmt_str(p, " (dev: ");
+    p = fmt_str(p, neigh_link_name(table, e->key.ifindex));
+    p = fmt_str(p, ", state: ");
+    p = fmt_str(p, get_arp_state_str(e->state));
+    p = fmt_str(p, ")\n");
+    output_commit(out, p - line);
+}
+
+/*
+ * 将一条 rtnetlink 消息应用到邻居表和接口名缓存。
+ * out 不为 NULL 时输出邻居表的实际变化（状态与 MAC 均未变化的刷新不输出）。
+ */
+void netlink_apply(struct netlink_ctx *nl, struct nlmsghdr *nlh, struct output *out)
+{
+    struct rtattr *rta;
+    int attrlen;
+
+    if (nlh->nlmsg_type == RTM_NEWLINK || nlh->nlmsg_type == RTM_DELLINK) {
+        struct ifinfomsg *ifi = NLMSG_DATA(nlh);
+
+        if (nlh->nlmsg_type == RTM_DELLINK) {
+            neigh_link_del(&nl->table, ifi->ifi_index);
+            return;
+        }
+        rta = IFLA_RTA(ifi);
+        attrlen = IFLA_PAYLOAD(nlh);
+        for (; RTA_OK(rta, attrlen); rta = RTA_NEXT(rta, attrlen)) {
+            if (rta->rta_type == IFLA_IFNAME)
+                neigh_link_set(&nl->table, ifi->ifi_index, RTA_DATA(rta));
+        }
+        return;
+    }
+
+    /* 只处理邻居表消息 */
+    if (nlh->nlmsg_type != RTM_NEWNEIGH && nlh->nlmsg_type != RTM_DELNEIGH)
+        return;
+
+    struct ndmsg *ndm = NLMSG_DATA(nlh);
+    struct neigh_key key = {0};
+    struct neigh_entry *e, old;
+    const uint8_t *lladdr = NULL;
+    enum neigh_change change;
+    bool has_dst = false;
+
+    /* 处理 ARP（IPv4）与 NDP（IPv6）条目 */
+    if (ndm->ndm_family != AF_INET && ndm->ndm_family != AF_INET6)
+        return;
+
+    key.family = ndm->ndm_family;
+    key.ifindex = ndm->ndm_ifindex;
+
+    /* 解析属性 */
+    rta = (struct rtattr *)((char *)ndm + NLMSG_ALIGN(sizeof(struct ndmsg)));
+    attrlen = nlh->nlmsg_len - NLMSG_ALIGN(sizeof(struct nlmsghdr)) - NLMSG_ALIGN(sizeof(struct ndmsg));
+
+    for (; RTA_OK(rta, attrlen); rta = RTA_NEXT(rta, attrlen)) {
+        switch (rta->rta_type) {
+            case NDA_DST:
+                if (RTA_PAYLOAD(rta) == (ndm->ndm_family == AF_INET ? 4 : 16)) {
+                    memcpy(key.addr, RTA_DATA(rta), RTA_PAYLOAD(rta));
+                    has_dst = true;
+                }
+                break;
+            case NDA_LLADDR:
+                if (RTA_PAYLOAD(rta) == 6)
+                    lladdr = RTA_DATA(rta);
+                break;
+        }
+    }
+    if (!has_dst)
+        return;
+
+    if (nlh->nlmsg_type == RTM_DELNEIGH) {
+        change = neigh_table_delete(&nl->table, &key, &old);
+        e = &old;
+    } else {
+        change = neigh_table_update(&nl->table, &key, lladdr, ndm->ndm_state, &e);
+    }
+
+    if (out && change != NEIGH_UNCHANGED)
+        print_neigh_change(out, &nl->table, change, e);
+    if (nl->detector && (change == NEIGH_ADDED || change == NEIGH_UPDATED))
+        detector_neigh_update(nl->detector, e, e->updated_ns);
+    if (nl->enforcer && change != NEIGH_UNCHANGED)
+        enforcer_neigh_update(nl->enforcer, change, e);
+}
+
+/* 通过独立的 socket 请求一次 dump（RTM_GETLINK/RTM_GETNEIGH），逐条应用到邻居表 */
+int netlink_dump(struct netlink_ctx *nl, uint16_t type)
+{
+    struct {
+        struct nlmsghdr nlh;
+        struct ndmsg ndm;
+    } req = {
+        .nlh = {
+            .nlmsg_len = NLMSG_LENGTH(sizeof(struct ndmsg)),
+            .nlmsg_type = type,
+            .nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP,
+            .nlmsg_seq = ++nl->seq,
+        },
+        /* ndmsg 与 rtgenmsg 的首字节都是地址族；邻居表同时 dump IPv4 与 IPv6 */
+        .ndm = { .ndm_family = AF_UNSPEC },
+    };
+    int sock, len, err = 0;
+    bool done = false;
+
+    sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (sock < 0)
+        return -errno;
+
+    if (send(sock, &req, req.nlh.nlmsg_len, 0) < 0) {
+        err = -errno;
+        goto out;
+    }
+
+    while (!done) {
+        struct nlmsghdr *nlh;
+
+        len = recv(sock, nl->bufs, NL_BUF_SIZE, 0);
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+            err = -errno;
+            break;
+        }
+        if (len == 0)
+            break;
+
+        for (nlh = (struct nlmsghdr *)nl->bufs; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+            if (nlh->nlmsg_type == NLMSG_DONE) {
+                done = true;
+                break;
+            }
+            if (nlh->nlmsg_type == NLMSG_ERROR) {
+                struct nlmsgerr *e = NLMSG_DATA(nlh);
+
+                err = e->error;
+                done = true;
+                break;
+            }
+            netlink_apply(nl, nlh, NULL);
+        }
+    }
+
+out:
+    close(sock);
+    return err;
+}
+
+/* 清空邻居表并从内核重新 dump 接口和邻居表 */
+int netlink_sync(struct netlink_ctx *nl)
+{
+    int err;
+
+    neigh_table_clear(&nl->table);
+    err = netlink_dump(nl, RTM_GETLINK);
+    if (!err)
+        err = netlink_dump(nl, RTM_GETNEIGH);
+    return err;
+}
+
+/* 初始化 Netlink 监听：订阅 socket、邻居表、接收缓冲区，并 dump 一次当前状态 */
+int netlink_init(struct netlink_ctx *nl)
+{
+    int i, err;
+
+    memset(nl, 0, sizeof(*nl));
+    nl->sock = -1;
+
+    nl->bufs = malloc((size_t)NL_BATCH * NL_BUF_SIZE);
+    if (!nl->bufs || neigh_table_init(&nl->table, NEIGH_TABLE_SIZE)) {
+        free(nl->bufs);
+        nl->bufs = NULL;
+        return -ENOMEM;
+    }
+    for (i = 0; i < NL_BATCH; i++) {
+        nl->iov[i].iov_base = nl->bufs + (size_t)i * NL_BUF_SIZE;
+        nl->iov[i].iov_len = NL_BUF_SIZE;
+        nl->msgs[i].msg_hdr.msg_iov = &nl->iov[i];
+        nl->msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    /* 先订阅再 dump，dump 期间到达的变化会在之后的增量消息中应用 */
+    nl->sock = create_netlink_socket();
+    if (nl->sock < 0)
+        return -1;
+
+    err = netlink_sync(nl);
+    if (err)
+        fprintf(stderr, "Warning: Failed to dump neighbor table: %s\n", strerror(-err));
+    return 0;
+}
+
+void netlink_free(struct netlink_ctx *nl)
+{
+    if (nl->sock >= 0)
+        close(nl->sock);
+    if (nl->bufs)
+        neigh_table_free(&nl->table);
+    free(nl->bufs);
+    nl->sock = -1;
+    nl->bufs = NULL;
+}
+
+/* 处理 Netlink ARP 表与接口事件：用 recvmmsg 批量读取直到 socket 为空 */
+void handle_netlink_arp(struct netlink_ctx *nl, struct output *out)
+{
+    int n, i;
+
+    do {
+        n = recvmmsg(nl->sock, nl->msgs, NL_BATCH, MSG_DONTWAIT, NULL);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == ENOBUFS) {
+                /* 接收缓冲区溢出，丢失的增量无法恢复：重新 dump 同步 */
+                static const char msg[] = "[ARP TABLE] netlink overrun, resynchronizing\n";
+
+                nl->overruns++;
+                output_write(out, msg, sizeof(msg) - 1);
+                netlink_sync(nl);
+                n = NL_BATCH;
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                fprintf(stderr, "Error: Netlink recv failed: %s\n", strerror(errno));
+            return;
+        }
+
+        for (i = 0; i < n; i++) {
+            int len = nl->msgs[i].msg_len;
+            struct nlmsghdr *nlh;
+
+            for (nlh = nl->iov[i].iov_base; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+                if (nlh->nlmsg_type == NLMSG_DONE)
+                    break;
+                if (nlh->nlmsg_type == NLMSG_ERROR) {
+                    fprintf(stderr, "Error: Netlink message error\n");
+                    continue;
+                }
+                netlink_apply(nl, nlh, out);
+            }
+        }
+    } while (n == NL_BATCH);
+}
+
+/* 获取单调时钟纳秒数 */
+uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* 输出当前邻居表与状态转换计数（SIGUSR1） */
+void dump_neigh_table(struct netlink_ctx *nl)
+{
+    struct neigh_table *t = &nl->table;
+    struct neigh_entry *e;
+    char ip_str[INET6_ADDRSTRLEN], mac_str[18];
+    uint64_t now = now_ns();
+    uint32_t i, j, pos = 0;
+
+    printf("\nNeighbor table (%u entries):\n", t->count);
+    printf("  %-16s %-18s %-16s %-11s %8s %10s\n",
+           "Address", "MAC", "Device", "State", "Changes", "Age");
+    while ((e = neigh_table_next(t, &pos))) {
+        *neigh_fmt_addr(ip_str, &e->key) = '\0';
+        mac_to_str(e->lladdr, mac_str);
+        printf("  %-16s %-18s %-16s %-11s %8lu %9.1fs\n", ip_str, mac_str,
+               neigh_link_name(t, e->key.ifindex), get_arp_state_str(e->state),
+               (unsigned long)e->changes, (now - e->updated_ns) / 1e9);
+    }
+
+    printf("State transitions (NONE = added/deleted):\n");
+    for (i = 0; i < NEIGH_NR_STATES; i++) {
+        for (j = 0; j < NEIGH_NR_STATES; j++) {
+            /* 序号 i 对应 NUD 状态位 1 << (i - 1)，0 表示条目不存在 */
+            if (t->transitions[i][j])
+                printf("  %-11s -> %-11s %10lu\n",
+                       i ? get_arp_state_str(1 << (i - 1)) : "NONE",
+                       j ? get_arp_state_str(1 << (j - 1)) : "NONE",
+                       (unsigned long)t->transitions[i][j]);
+        }
+    }
+    printf("\n");
+}
+
+/* 判断 map 类型是否为 per-CPU */
+bool map_type_is_percpu(uint32_t type)
+{
+    return type == BPF_MAP_TYPE_PERCPU_ARRAY ||
+           type == BPF_MAP_TYPE_PERCPU_HASH ||
+           type == BPF_MAP_TYPE_LRU_PERCPU_HASH;
+}
+
+/*
+ * 初始化快照：按 map 的 max_entries 一次性分配 key/value 缓冲区，
+ * 之后每次刷新复用。map 的值必须全部由 uint64_t 计数器组成。
+ */
+int snapshot_init(struct map_snapshot *snap, const char *name, int map_fd, bool delta)
+{
+    struct bpf_map_info info;
+    uint32_t info_len = sizeof(info);
+    size_t copies;
+
+    memset(snap, 0, sizeof(*snap));
+    memset(&info, 0, sizeof(info));
+    if (bpf_obj_get_info_by_fd(map_fd, &info, &info_len))
+        return -errno;
+
+    snap->name = name;
+    snap->map_fd = map_fd;
+    snap->key_size = info.key_size;
+    snap->value_size = (info.value_size + 7) & ~7U;
+    snap->nr_fields = info.value_size / sizeof(uint64_t);
+    snap->max_entries = info.max_entries;
+    snap->is_array = info.type == BPF_MAP_TYPE_ARRAY ||
+                     info.type == BPF_MAP_TYPE_PERCPU_ARRAY;
+    /*
+     * 按 ifindex 计数的哈希表读后删除会丢失与删除并发的自增，之后快速路径还要重新插入，
+     * 因此和数组一样只读，减去上一次的值
+     */
+    snap->keep = snap->is_array || info.type == BPF_MAP_TYPE_HASH ||
+                 info.type == BPF_MAP_TYPE_PERCPU_HASH;
+    snap->nr_copies = map_type_is_percpu(info.type) ? nr_cpus : 1;
+    snap->delta = delta;
+    snap->use_batch = true;
+
+    copies = (size_t)snap->max_entries * snap->nr_copies;
+    snap->keys = calloc(snap->max_entries, snap->key_size);
+    snap->values = calloc(copies, snap->value_size);
+    snap->sums = calloc((size_t)snap->max_entries * snap->nr_fields, sizeof(uint64_t));
+    snap->order = calloc(snap->max_entries, sizeof(uint32_t));
+    if (delta && snap->keep)
+        snap->prev = calloc((size_t)snap->max_entries * snap->nr_fields, sizeof(uint64_t));
+    if (delta && snap->keep && !snap->is_array) {
+        snap->prev_keys = calloc(snap->max_entries, snap->key_size);
+        snap->next = calloc((size_t)snap->max_entries * snap->nr_fields, sizeof(uint64_t));
+        snap->next_keys = calloc(snap->max_entries, snap->key_size);
+    }
+
+    if (!snap->keys || !snap->values || !snap->sums || !snap->order ||
+        (delta && snap->keep && !snap->prev) ||
+        (delta && snap->keep && !snap->is_array &&
+         (!snap->prev_keys || !snap->next || !snap->next_keys))) {
+        snapshot_free(snap);
+        return -ENOMEM;
+    }
+    return 0;
+}
+
+void snapshot_free(struct map_snapshot *snap)
+{
+    free(snap->keys);
+    free(snap->values);
+    free(snap->sums);
+    free(snap->prev);
+    free(snap->prev_keys);
+    free(snap->next);
+    free(snap->next_keys);
+    free(snap->order);
+    memset(snap, 0, sizeof(*snap));
+}
+
+/* 批量读取：LRU 哈希表差量模式下读取并删除，其余只读 */
+int snapshot_read_batch(struct map_snapshot *snap)
+{
+    bool del = snap->delta && !snap->keep;
+    size_t stride = (size_t)snap->value_size * snap->nr_copies;
+    uint32_t in_batch, out_batch, count, n = 0;
+    void *in = NULL;
+    int err;
+
+    LIBBPF_OPTS(bpf_map_batch_opts, opts);
+
+    while (n < snap->max_entries) {
+        count = snap->max_entries - n;
+        if (del)
+            err = bpf_map_lookup_and_delete_batch(snap->map_fd, in, &out_batch,
+                                                  snap->keys + (size_t)n * snap->key_size,
+                                                  snap->values + n * stride, &count, &opts);
+        else
+            err = bpf_map_lookup_batch(snap->map_fd, in, &out_batch,
+                                       snap->keys + (size_t)n * snap->key_size,
+                                       snap->values + n * stride, &count, &opts);
+        snap->syscalls++;
+        n += count;
+        if (err) {
+            /* ENOENT 表示已遍历完所有条目 */
+            if (errno == ENOENT)
+                break;
+            snap->count = n;
+            return -errno;
+        }
+        in_batch = out_batch;
+        in = &in_batch;
+    }
+
+    snap->count = n;
+    return 0;
+}
+
+/*
+ * 逐条读取（内核不支持批量操作时的后备路径）：
+ * 先收集所有 key，再逐个读取，避免边遍历边删除导致遍历重新开始。
+ */
+int snapshot_read_iter(struct map_snapshot *snap)
+{
+    bool del = snap->delta && !snap->keep;
+    size_t stride = (size_t)snap->value_size * snap->nr_copies;
+    uint32_t n = 0, i, kept = 0;
+    void *prev_key = NULL;
+
+    while (n < snap->max_entries) {
+        uint8_t *key = snap->keys + (size_t)n * snap->key_size;
+
+        snap->syscalls++;
+        if (bpf_map_get_next_key(snap->map_fd, prev_key, key))
+            break;
+        prev_key = key;
+        n++;
+    }
+
+    for (i = 0; i < n; i++) {
+        uint8_t *key = snap->keys + (size_t)i * snap->key_size;
+        int err;
+
+        snap->syscalls++;
+        if (del)
+            err = bpf_map_lookup_and_delete_elem(snap->map_fd, key, snap->values + kept * stride);
+        else
+            err = bpf_map_lookup_elem(snap->map_fd, key, snap->values + kept * stride);
+
+        /* 条目可能在两次调用之间被 LRU 淘汰 */
+        if (err)
+            continue;
+        if (kept != i)
+            memcpy(snap->keys + (size_t)kept * snap->key_size, key, snap->key_size);
+        kept++;
+    }
+
+    snap->count = kept;
+    return 0;
+}
+
+/*
+ * 哈希表中 key 在上一次读取里的和，不存在（新接口）时返回 NULL。
+ * 两次读取之间条目通常不变，遍历顺序相同，先试同一序号。
+ */
+static uint64_t *snapshot_prev(struct map_snapshot *snap, uint32_t i)
+{
+    const uint8_t *key = snapshot_key(snap, i);
+    uint32_t j;
+
+    if (i < snap->prev_count && !memcmp(snap->prev_keys + (size_t)i * snap->key_size, key,
+                                        snap->key_size))
+        return snap->prev + (size_t)i * snap->nr_fields;
+    for (j = 0; j < snap->prev_count; j++) {
+        if (!memcmp(snap->prev_keys + (size_t)j * snap->key_size, key, snap->key_size))
+            return snap->prev + (size_t)j * snap->nr_fields;
+    }
+    return NULL;
+}
+
+/* 刷新快照：读取 map，按 CPU 求和，不删除的差量模式下减去上一次的值 */
+int snapshot_refresh(struct map_snapshot *snap)
+{
+    size_t stride = (size_t)snap->value_size * snap->nr_copies;
+    uint64_t start = now_ns();
+    uint32_t i, f, c;
+    int err = 0;
+
+    snap->count = 0;
+    snap->syscalls = 0;
+
+    if (snap->use_batch) {
+        err = snapshot_read_batch(snap);
+        /* 旧内核不支持该 map 类型的批量操作时退回逐条读取 */
+        if (err == -EINVAL || err == -EOPNOTSUPP || err == -ENOTSUPP) {
+            snap->use_batch = false;
+            snap->count = 0;
+        }
+    }
+    if (!snap->use_batch)
+        err = snapshot_read_iter(snap);
+
+    for (i = 0; i < snap->count; i++) {
+        uint64_t *sum = snapshot_sum(snap, i);
+        uint8_t *value = snap->values + i * stride;
+
+        for (f = 0; f < snap->nr_fields; f++) {
+            sum[f] = 0;
+            for (c = 0; c < snap->nr_copies; c++)
+                sum[f] += ((uint64_t *)(value + (size_t)c * snap->value_size))[f];
+        }
+
+        if (snap->prev && !snap->prev_keys) {
+            uint64_t *prev = snap->prev + (size_t)i * snap->nr_fields;
+
+            for (f = 0; f < snap->nr_fields; f++) {
+                uint64_t cur = sum[f];
+
+                sum[f] = cur - prev[f];
+                prev[f] = cur;
+            }
+        }
+    }
+
+    /* 哈希表按 key 对应上一次的和，本次的和记入 next，全部算完后与 prev 交换 */
+    if (snap->prev_keys) {
+        uint64_t *tmp_sums;
+        uint8_t *tmp_keys;
+
+        for (i = 0; i < snap->count; i++) {
+            uint64_t *sum = snapshot_sum(snap, i);
+            uint64_t *prev = snapshot_prev(snap, i);
+
+            memcpy(snap->next + (size_t)i * snap->nr_fields, sum, snap->nr_fields * sizeof(uint64_t));
+            for (f = 0; prev && f < snap->nr_fields; f++)
+                sum[f] -= prev[f];
+        }
+        memcpy(snap->next_keys, snap->keys, (size_t)snap->count * snap->key_size);
+
+        tmp_sums = snap->prev;
+        snap->prev = snap->next;
+        snap->next = tmp_sums;
+        tmp_keys = snap->prev_keys;
+        snap->prev_keys = snap->next_keys;
+        snap->next_keys = tmp_keys;
+        snap->prev_count = snap->count;
+    }
+
+    snap->latency_ns = now_ns() - start;
+    return err;
+}
+
+/* 按 sums 中的指定字段降序排序，结果写入 order */
+int compare_snapshot_field(const void *a, const void *b, void *arg)
+{
+    struct map_snapshot *snap = arg;
+    uint64_t va = snapshot_sum(snap, *(const uint32_t *)a)[snap->sort_field];
+    uint64_t vb = snapshot_sum(snap, *(const uint32_t *)b)[snap->sort_field];
+
+    if (va == vb)
+        return 0;
+    return va < vb ? 1 : -1;
+}
+
+void snapshot_sort_desc(struct map_snapshot *snap, uint32_t field)
+{
+    uint32_t i;
+
+    for (i = 0; i < snap->count; i++)
+        snap->order[i] = i;
+    snap->sort_field = field;
+    qsort_r(snap->order, snap->count, sizeof(uint32_t), compare_snapshot_field, snap);
+}
+
+/* 初始化所有统计 map 的快照 */
+int snapshots_init(struct monitor_snapshots *snaps, struct monitor_maps *maps, bool delta)
+{
+    struct {
+        const char *name;
+        int fd;
+    } table[SNAP_COUNT] = {
+        [SNAP_PACKET_COUNT]    = {"packet_count",    maps->packet_count},
+        [SNAP_ARP_STATISTICS]  = {"arp_statistics",  maps->arp_statistics},
+        [SNAP_ETHERTYPE_STATS] = {"ethertype_stats", maps->ethertype_stats},
+        [SNAP_IPPROTO_STATS]   = {"ipproto_stats",   maps->ipproto_stats},
+        [SNAP_IP_STATS]        = {"ip_stats",        maps->ip_stats},
+        [SNAP_FLOW_STATS]      = {"flow_stats",      maps->flow_stats},
+        [SNAP_EVENT_STATS]     = {"event_stats",     maps->event_stats},
+        [SNAP_ENFORCE_STATS]   = {"enforce_stats",   maps->enforce_stats},
+        [SNAP_ARP_LATENCY]     = {"arp_latency",     maps->arp_latency},
+        [SNAP_NDP_STATISTICS]  = {"ndp_statistics",  maps->ndp_statistics},
+        [SNAP_VLAN_STATS]      = {"vlan_stats",      maps->vlan_stats},
+        [SNAP_FILTER_STATS]    = {"filter_stats",    maps->filter_stats},
+    };
+    int i, err;
+
+    memset(snaps, 0, sizeof(*snaps));
+    snaps->delta = delta;
+    for (i = 0; i < SNAP_COUNT; i++) {
+        err = snapshot_init(&snaps->snap[i], table[i].name, table[i].fd, delta);
+        if (err) {
+            fprintf(stderr, "Error: Failed to create snapshot for %s map: %s\n",
+                    table[i].name, strerror(-err));
+            snapshots_free(snaps);
+            return err;
+        }
+    }
+    err = snapshot_init(&snaps->pending, "arp_pending", maps->arp_pending, false);
+    if (err) {
+        fprintf(stderr, "Error: Failed to create snapshot for arp_pending map: %s\n",
+                strerror(-err));
+        snapshots_free(snaps);
+        return err;
+    }
+    return 0;
+}
+
+void snapshots_free(struct monitor_snapshots *snaps)
+{
+    int i;
+
+    for (i = 0; i < SNAP_COUNT; i++)
+        snapshot_free(&snaps->snap[i]);
+    snapshot_free(&snaps->pending);
+}
+
+/* 刷新所有快照并汇总耗时、条目数和系统调用次数 */
+void snapshots_refresh(struct monitor_snapshots *snaps)
+{
+    uint64_t start = now_ns();
+    int i, err;
+
+    snaps->entries = 0;
+    snaps->syscalls = 0;
+    for (i = 0; i < SNAP_COUNT; i++) {
+        err = snapshot_refresh(&snaps->snap[i]);
+        if (err)
+            fprintf(stderr, "Warning: Failed to snapshot %s map: %s\n",
+                    snaps->snap[i].name, strerror(-err));
+        snaps->entries += snaps->snap[i].count;
+        snaps->syscalls += snaps->snap[i].syscalls;
+    }
+    snaps->latency_ns = now_ns() - start;
+}
+
+/* 将字节数格式化为易读形式 */
+void format_bytes(uint64_t bytes, char *str, size_t len)
+{
+    const char *units[] = {"B", "KB", "MB", "GB", "TB"};
+    double value = bytes;
+    int unit = 0;
+
+    while (value >= 1024 && unit < 4) {
+        value /= 1024;
+        unit++;
+    }
+
+    if (unit == 0)
+        snprintf(str, len, "%lu B", (unsigned long)bytes);
+    else
+        snprintf(str, len, "%.1f %s", value, units[unit]);
+}
+
+/* 获取 EtherType 名称 */
+const char* get_ethertype_str(uint16_t ethertype, char *buf, size_t len)
+{
+    switch (ethertype) {
+        case 0x0800: return "IPv4";
+        case 0x0806: return "ARP";
+        case 0x86DD: return "IPv6";
+        case 0x8100: return "802.1Q";
+        case 0x88A8: return "802.1ad";
+        case 0x8035: return "RARP";
+        case 0x88CC: return "LLDP";
+        default:
+            snprintf(buf, len, "0x%04x", ethertype);
+            return buf;
+    }
+}
+
+/* 获取 IP 协议名称 */
+const char* get_ipproto_str(uint8_t proto)
+{
+    switch (proto) {
+        case IPPROTO_TCP: return "TCP";
+        case IPPROTO_UDP: return "UDP";
+        case IPPROTO_ICMP: return "ICMP";
+        default: return "Other";
+    }
+}
+
+/* 打印一行协议统计 */
+void print_traffic_line(const char *label, const struct traffic_counter *c)
+{
+    char bytes_str[16];
+
+    format_bytes(c->bytes, bytes_str, sizeof(bytes_str));
+    printf("║   %-8s%12lu pkts %10s    ║\n",
+           label, (unsigned long)c->packets, bytes_str);
+}
+
+/*
+ * 原子地读取并删除一个聚合条目：快照只用来挑出候选，输出的计数来自删除时的值，
+ * 快照之后到达的重复事件不会丢失。内核不支持哈希表的 lookup_and_delete（5.14 以前）时
+ * 退回到读取后删除。条目已被 LRU 淘汰时返回 -1
+ */
+static int agg_take(int map_fd, const void *key, struct arp_agg_value *v)
+{
+    if (!bpf_map_lookup_and_delete_elem(map_fd, key, v))
+        return 0;
+    if (errno == ENOENT || bpf_map_lookup_elem(map_fd, key, v))
+        return -1;
+    bpf_map_delete_elem(map_fd, key);
+    return 0;
+}
+
+/*
+ * 输出聚合表中空闲超过一个窗口、仍有未上报重复次数的元组汇总，并删除这些条目。
+ * 计数属于从 window_start（上次上报）开始的窗口，汇总中显示窗口起点。
+ * all 为 true 时（退出前）输出所有有未上报次数的元组。
+ */
+void flush_arp_aggregation(struct map_snapshot *snap, const struct iface_list *ifaces,
+                           uint64_t window_ns, bool all)
+{
+    char src_ip_str[INET_ADDRSTRLEN], dst_ip_str[INET_ADDRSTRLEN];
+    struct arp_agg_value final;
+    const char *name;
+    uint64_t now = now_ns();
+    uint32_t i;
+    int err;
+
+    err = snapshot_refresh(snap);
+    if (err) {
+        fprintf(stderr, "Warning: Failed to snapshot arp_aggregation map: %s\n", strerror(-err));
+        return;
+    }
+
+    for (i = 0; i < snap->count; i++) {
+        struct arp_agg_key *key = (struct arp_agg_key *)snapshot_key(snap, i);
+        struct arp_agg_value *v = (struct arp_agg_value *)snapshot_sum(snap, i);
+
+        if (v->count == 0 || (!all && now - v->last_seen < window_ns))
+            continue;
+        if (agg_take(snap->map_fd, key, &final) || final.count == 0)
+            continue;
+
+        ip_to_str(key->src_ip, src_ip_str);
+        ip_to_str(key->dst_ip, dst_ip_str);
+        name = iface_name(ifaces, key->ifindex);
+        printf("[ARP SUMMARY] %s: %s -> %s x%lu (window start %.1fs ago, last %.1fs ago, dev: %s)\n",
+               get_arp_opcode_str(key->opcode), src_ip_str, dst_ip_str,
+               (unsigned long)final.count,
+               (now - final.window_start) / 1e9, (now - final.last_seen) / 1e9,
+               name ? name : "?");
+    }
+}
+
+/* 与 flush_arp_aggregation 相同，输出 NDP 聚合表的汇总 */
+void flush_ndp_aggregation(struct map_snapshot *snap, const struct iface_list *ifaces,
+                           uint64_t window_ns, bool all)
+{
+    static const uint8_t zero_addr[16];
+    char src_str[INET6_ADDRSTRLEN], target_str[INET6_ADDRSTRLEN];
+    struct arp_agg_value final;
+    const char *name;
+    uint64_t now = now_ns();
+    uint32_t i;
+    int err;
+
+    err = snapshot_refresh(snap);
+    if (err) {
+        fprintf(stderr, "Warning: Failed to snapshot ndp_aggregation map: %s\n", strerror(-err));
+        return;
+    }
+
+    for (i = 0; i < snap->count; i++) {
+        struct ndp_agg_key *key = (struct ndp_agg_key *)snapshot_key(snap, i);
+        struct arp_agg_value *v = (struct arp_agg_value *)snapshot_sum(snap, i);
+
+        if (v->count == 0 || (!all && now - v->last_seen < window_ns))
+            continue;
+        if (agg_take(snap->map_fd, key, &final) || final.count == 0)
+            continue;
+
+        *fmt_ipv6(src_str, key->src_ip) = '\0';
+        if (memcmp(key->target, zero_addr, sizeof(zero_addr)))
+            *fmt_ipv6(target_str, key->target) = '\0';
+        else
+            strcpy(target_str, "-");
+        name = iface_name(ifaces, key->ifindex);
+        printf("[NDP SUMMARY] %s: %s target %s x%lu (window start %.1fs ago, last %.1fs ago, dev: %s)\n",
+               get_ndp_type_str(key->type), src_str, target_str,
+               (unsigned long)final.count,
+               (now - final.window_start) / 1e9, (now - final.last_seen) / 1e9,
+               name ? name : "?");
+    }
+}
+
+/* 显示 EtherType 与 IP 协议统计 */
+void display_protocol_statistics(struct monitor_snapshots *snaps)
+{
+    struct map_snapshot *eth = &snaps->snap[SNAP_ETHERTYPE_STATS];
+    struct map_snapshot *ipp = &snaps->snap[SNAP_IPPROTO_STATS];
+    struct traffic_counter l4[4] = {0}; /* TCP, UDP, ICMP, Other */
+    char name_buf[8];
+    uint32_t i;
+
+    printf("║ EtherType Statistics:                     ║\n");
+    snapshot_sort_desc(eth, TRAFFIC_FIELD_BYTES);
+    for (i = 0; i < eth->count; i++) {
+        uint32_t idx = eth->order[i];
+        uint16_t ethertype;
+
+        memcpy(&ethertype, snapshot_key(eth, idx), sizeof(ethertype));
+        print_traffic_line(get_ethertype_str(ethertype, name_buf, sizeof(name_buf)),
+                           (struct traffic_counter *)snapshot_sum(eth, idx));
+    }
+
+    printf("╠════════════════════════════════════════════╣\n");
+    printf("║ IP Protocol Statistics:                   ║\n");
+    for (i = 0; i < ipp->count; i++) {
+        struct traffic_counter *c = (struct traffic_counter *)snapshot_sum(ipp, i);
+        uint32_t proto;
+        int slot;
+
+        memcpy(&proto, snapshot_key(ipp, i), sizeof(proto));
+        switch (proto) {
+            case IPPROTO_TCP: slot = 0; break;
+            case IPPROTO_UDP: slot = 1; break;
+            case IPPROTO_ICMP: slot = 2; break;
+            default: slot = 3; break;
+        }
+        l4[slot].packets += c->packets;
+        l4[slot].bytes += c->bytes;
+    }
+
+    print_traffic_line("TCP", &l4[0]);
+    print_traffic_line("UDP", &l4[1]);
+    print_traffic_line("ICMP", &l4[2]);
+    print_traffic_line("Other", &l4[3]);
+}
+
+/* 显示按字节数排序的 Top-N 五元组流 */
+void display_top_flows(struct map_snapshot *snap, int top_n)
+{
+    char src[INET_ADDRSTRLEN + 6], dst[INET_ADDRSTRLEN + 6];
+    char ip_str[INET_ADDRSTRLEN], bytes_str[16];
+    int n = snap->count, i;
+
+    snapshot_sort_desc(snap, TRAFFIC_FIELD_BYTES);
+    if (top_n > n)
+        top_n = n;
+
+    printf("Top %d flows by bytes (%d tracked):\n", top_n, n);
+    printf("  %-6s %-21s %-21s %12s %10s\n", "Proto", "Source", "Destination", "Packets", "Bytes");
+    for (i = 0; i < top_n; i++) {
+        uint32_t idx = snap->order[i];
+        struct traffic_counter *c = (struct traffic_counter *)snapshot_sum(snap, idx);
+        struct flow_key flow;
+
+        memcpy(&flow, snapshot_key(snap, idx), sizeof(flow));
+        ip_to_str(flow.saddr, ip_str);
+        snprintf(src, sizeof(src), "%s:%u", ip_str, ntohs(flow.sport));
+        ip_to_str(flow.daddr, ip_str);
+        snprintf(dst, sizeof(dst), "%s:%u", ip_str, ntohs(flow.dport));
+        format_bytes(c->bytes, bytes_str, sizeof(bytes_str));
+
+        printf("  %-6s %-21s %-21s %12lu %10s\n", get_ipproto_str(flow.proto),
+               src, dst, (unsigned long)c->packets, bytes_str);
+    }
+    printf("\n");
+}
+
+/* 显示按字节数排序的 Top-N 源 IP */
+void display_top_sources(struct map_snapshot *snap, int top_n)
+{
+    char ip_str[INET_ADDRSTRLEN], bytes_str[16];
+    int n = snap->count, i;
+
+    snapshot_sort_desc(snap, TRAFFIC_FIELD_BYTES);
+    if (top_n > n)
+        top_n = n;
+
+    printf("Top %d source IPs by bytes (%d tracked):\n", top_n, n);
+    printf("  %-21s %12s %10s\n", "Source", "Packets", "Bytes");
+    for (i = 0; i < top_n; i++) {
+        uint32_t idx = snap->order[i];
+        struct traffic_counter *c = (struct traffic_counter *)snapshot_sum(snap, idx);
+        uint32_t saddr;
+
+        memcpy(&saddr, snapshot_key(snap, idx), sizeof(saddr));
+        ip_to_str(saddr, ip_str);
+        format_bytes(c->bytes, bytes_str, sizeof(bytes_str));
+        printf("  %-21s %12lu %10s\n", ip_str, (unsigned long)c->packets, bytes_str);
+    }
+    printf("\n");
+}
+
+/* 显示按字节数排序的 Top-N VLAN（接口、外层/内层 VID） */
+void display_top_vlans(struct map_snapshot *snap, const struct iface_list *ifaces, int top_n)
+{
+    char vlan_str[16], bytes_str[16];
+    int n = snap->count, i;
+
+    if (n == 0)
+        return;
+    snapshot_sort_desc(snap, TRAFFIC_FIELD_BYTES);
+    if (top_n > n)
+        top_n = n;
+
+    printf("Top %d VLANs by bytes (%d tracked):\n", top_n, n);
+    printf("  %-16s %-10s %12s %10s %10s\n", "Interface", "VLAN", "Packets", "Bytes", "ARP");
+    for (i = 0; i < top_n; i++) {
+        uint32_t idx = snap->order[i];
+        struct vlan_counter *c = (struct vlan_counter *)snapshot_sum(snap, idx);
+        struct vlan_key key;
+        const char *name;
+
+        memcpy(&key, snapshot_key(snap, idx), sizeof(key));
+        name = iface_name(ifaces, key.ifindex);
+        if (key.inner_vid)
+            snprintf(vlan_str, sizeof(vlan_str), "%u.%u", key.vid, key.inner_vid);
+        else
+            snprintf(vlan_str, sizeof(vlan_str), "%u", key.vid);
+        format_bytes(c->bytes, bytes_str, sizeof(bytes_str));
+        printf("  %-16s %-10s %12lu %10s %10lu\n", name ? name : "?", vlan_str,
+               (unsigned long)c->packets, bytes_str, (unsigned long)c->arp_packets);
+    }
+    printf("\n");
+}
+
+/* 按 key 查找快照中的条目，返回求和后的值，不存在时返回 NULL */
+uint64_t *snapshot_find(struct map_snapshot *snap, const void *key)
+{
+    uint32_t i;
+
+    for (i = 0; i < snap->count; i++) {
+        if (memcmp(snapshot_key(snap, i), key, snap->key_size) == 0)
+            return snapshot_sum(snap, i);
+    }
+    return NULL;
+}
+
+/* 将快照中所有条目的各字段相加，结果写入 total（nr_fields 个计数器） */
+void snapshot_total(struct map_snapshot *snap, uint64_t *total)
+{
+    uint32_t i, f;
+
+    memset(total, 0, snap->nr_fields * sizeof(uint64_t));
+    for (i = 0; i < snap->count; i++) {
+        uint64_t *sum = snapshot_sum(snap, i);
+
+        for (f = 0; f < snap->nr_fields; f++)
+            total[f] += sum[f];
+    }
+}
+
+/* 一个接口的 ARP 解析时延直方图（全部为 uint64_t，可直接累加） */
+struct latency_hist {
+    uint64_t slots[ARP_LATENCY_SLOTS];
+    uint64_t replies;
+    uint64_t sum_ns;
+    uint64_t timeouts;      /* 内核计数与用户空间清扫之和 */
+};
+
+/* 从 arp_latency 快照中收集 ifindex 的直方图，没有任何数据时返回 false */
+bool latency_collect(struct map_snapshot *snap, uint32_t ifindex, struct latency_hist *h)
+{
+    uint32_t i;
+
+    memset(h, 0, sizeof(*h));
+    for (i = 0; i < snap->count; i++) {
+        const struct arp_latency_key *k = (const struct arp_latency_key *)snapshot_key(snap, i);
+        const struct traffic_counter *c = (const struct traffic_counter *)snapshot_sum(snap, i);
+
+        if (k->ifindex != ifindex)
+            continue;
+        if (k->slot < ARP_LATENCY_SLOTS) {
+            h->slots[k->slot] += c->packets;
+            h->replies += c->packets;
+            h->sum_ns += c->bytes;
+        } else if (k->slot == ARP_LATENCY_TIMEOUT || k->slot == ARP_LATENCY_EXPIRED) {
+            h->timeouts += c->packets;
+        }
+    }
+    return h->replies || h->timeouts;
+}
+
+/* 第 p（0–1）分位的时延（微秒），在命中的 log2 桶内线性插值 */
+double latency_percentile(const struct latency_hist *h, double p)
+{
+    double target = p * h->replies, cum = 0;
+    int i;
+
+    if (!h->replies)
+        return 0;
+    for (i = 0; i < ARP_LATENCY_SLOTS; i++) {
+        double lo = i ? (double)(1ULL << i) : 0, hi = (double)(1ULL << (i + 1));
+
+        if (h->slots[i] && cum + h->slots[i] >= target)
+            return lo + (hi - lo) * (target - cum) / h->slots[i];
+        cum += h->slots[i];
+    }
+    return (double)(1ULL << ARP_LATENCY_SLOTS);
+}
+
+void format_usec(double us, char *str, size_t len)
+{
+    if (us >= 1000000)
+        snprintf(str, len, "%.2f s", us / 1000000);
+    else if (us >= 1000)
+        snprintf(str, len, "%.2f ms", us / 1000);
+    else
+        snprintf(str, len, "%.0f us", us);
+}
+
+/*
+ * 清扫超过 ARP_RESOLVE_TIMEOUT_NS 仍未应答、之后也没有重传的请求：从 arp_pending 删除，
+ * 按请求所在接口计入 ARP_LATENCY_EXPIRED 桶。该桶只由用户空间写入，不与内核的
+ * per-CPU 计数竞争。在统计定时器上、刷新快照之前调用。
+ * arp_pending 通过快照批量读取，过期的 key 批量删除，系统调用次数与条目数无关；
+ * 只有删除成功的条目计为超时，读取之后才收到应答（内核已删除）的不计入。
+ */
+void arp_latency_sweep(struct monitor_snapshots *snaps, const struct monitor_maps *maps, uint64_t now)
+{
+    struct map_snapshot *pending = &snaps->pending;
+    struct {
+        uint32_t ifindex;
+        uint64_t expired;
+    } ifs[MAX_INTERFACES];
+    struct traffic_counter *counts;
+    uint32_t n = 0, i, done;
+    int nifs = 0, j, err;
+
+    err = snapshot_refresh(pending);
+    if (err) {
+        fprintf(stderr, "Warning: Failed to snapshot arp_pending map: %s\n", strerror(-err));
+        return;
+    }
+
+    /* 过期的 key 前移到 keys 开头，按接口累计，之后一次批量删除 */
+    for (i = 0; i < pending->count; i++) {
+        const struct arp_pending_value *v = (const struct arp_pending_value *)snapshot_sum(pending, i);
+
+        if (now <= v->timestamp || now - v->timestamp < ARP_RESOLVE_TIMEOUT_NS)
+            continue;
+        if (n != i) {
+            memcpy(snapshot_key(pending, n), snapshot_key(pending, i), pending->key_size);
+            memcpy(snapshot_sum(pending, n), v, sizeof(*v));
+        }
+        n++;
+    }
+    if (!n)
+        return;
+
+    /* 条目被内核删除（应答已处理）时批量删除在该处停止，跳过它继续 */
+    for (done = 0; done < n; ) {
+        LIBBPF_OPTS(bpf_map_batch_opts, opts);
+        uint32_t count = n - done, k;
+        const struct arp_pending_value *v;
+
+        err = bpf_map_delete_batch(pending->map_fd, snapshot_key(pending, done), &count, &opts);
+        if (err && errno != ENOENT && count == 0) {
+            /* 内核不支持批量删除：逐条删除 */
+            count = bpf_map_delete_elem(pending->map_fd, snapshot_key(pending, done)) ? 0 : 1;
+            err = count ? 0 : -1;
+        }
+        for (k = done; k < done + count; k++) {
+            v = (const struct arp_pending_value *)snapshot_sum(pending, k);
+            for (j = 0; j < nifs && ifs[j].ifindex != v->ifindex; j++)
+                ;
+            if (j == nifs) {
+                if (nifs == MAX_INTERFACES)
+                    continue;
+                ifs[nifs].ifindex = v->ifindex;
+                ifs[nifs++].expired = 0;
+            }
+            ifs[j].expired++;
+        }
+        done += count + (err ? 1 : 0);
+    }
+
+    counts = calloc(nr_cpus, sizeof(*counts));
+    if (!counts)
+        return;
+    for (j = 0; j < nifs; j++) {
+        struct arp_latency_key lk = {
+            .ifindex = ifs[j].ifindex,
+            .slot = ARP_LATENCY_EXPIRED,
+        };
+        int c;
+
+        if (bpf_map_lookup_elem(maps->arp_latency, &lk, counts))
+            for (c = 0; c < nr_cpus; c++)
+                counts[c].packets = counts[c].bytes = 0;
+        counts[0].packets += ifs[j].expired;
+        bpf_map_update_elem(maps->arp_latency, &lk, counts, BPF_ANY);
+    }
+    free(counts);
+}
+
+/* 显示每个接口的 ARP 解析时延分位数 */
+void display_latency_statistics(struct monitor_snapshots *snaps, const struct iface_list *ifaces)
+{
+    struct map_snapshot *lat = &snaps->snap[SNAP_ARP_LATENCY];
+    char avg[16], p50[16], p90[16], p99[16];
+    struct latency_hist h;
+    bool header = false;
+    int i;
+
+    for (i = 0; i < ifaces->count; i++) {
+        if (!latency_collect(lat, ifaces->items[i].ifindex, &h))
+            continue;
+        if (!header) {
+            printf("ARP resolution latency (request -> reply):\n");
+            printf("  %-16s %10s %10s %10s %10s %10s %10s\n",
+                   "Interface", "Replies", "Timeouts", "Avg", "p50", "p90", "p99");
+            header = true;
+        }
+        format_usec(h.replies ? h.sum_ns / 1000.0 / h.replies : 0, avg, sizeof(avg));
+        format_usec(latency_percentile(&h, 0.50), p50, sizeof(p50));
+        format_usec(latency_percentile(&h, 0.90), p90, sizeof(p90));
+        format_usec(latency_percentile(&h, 0.99), p99, sizeof(p99));
+        printf("  %-16s %10lu %10lu %10s %10s %10s %10s\n", ifaces->items[i].name,
+               (unsigned long)h.replies, (unsigned long)h.timeouts, avg, p50, p90, p99);
+    }
+    if (header)
+        printf("\n");
+}
+
+/* 显示每个接口的包数、字节数与 ARP/NDP 统计 */
+void display_interface_statistics(struct monitor_snapshots *snaps, const struct iface_list *ifaces)
+{
+    struct map_snapshot *pkt = &snaps->snap[SNAP_PACKET_COUNT];
+    struct map_snapshot *arp = &snaps->snap[SNAP_ARP_STATISTICS];
+    struct map_snapshot *ndp = &snaps->snap[SNAP_NDP_STATISTICS];
+    char bytes_str[16];
+    int i;
+
+    printf("Per-interface statistics (%d interfaces):\n", ifaces->count);
+    printf("  %-16s %-8s %12s %10s %10s %10s %10s %10s %10s\n",
+           "Interface", "Mode", "Packets", "Bytes", "ARP", "Requests", "Replies", "NDP", "NS");
+    for (i = 0; i < ifaces->count; i++) {
+        uint32_t key = ifaces->items[i].ifindex;
+        struct traffic_counter *c = (struct traffic_counter *)snapshot_find(pkt, &key);
+        struct arp_stats *a = (struct arp_stats *)snapshot_find(arp, &key);
+        struct ndp_stats *nd = (struct ndp_stats *)snapshot_find(ndp, &key);
+
+        format_bytes(c ? c->bytes : 0, bytes_str, sizeof(bytes_str));
+        printf("  %-16s %-8s %12lu %10s %10lu %10lu %10lu %10lu %10lu\n", ifaces->items[i].name,
+               xdp_attach_mode_str(ifaces->items[i].attach_mode),
+               (unsigned long)(c ? c->packets : 0), bytes_str,
+               (unsigned long)(a ? a->total_packets : 0),
+               (unsigned long)(a ? a->arp_request : 0),
+               (unsigned long)(a ? a->arp_reply : 0),
+               (unsigned long)(nd ? nd->total_packets : 0),
+               (unsigned long)(nd ? nd->neigh_solicit : 0));
+    }
+    printf("\n");
+}
+
+/* 显示一类事件的投递统计（event_stats 中的一个条目） */
+static void display_event_delivery(const char *title, struct map_snapshot *ev, uint32_t src)
+{
+    struct event_stats *es = (struct event_stats *)snapshot_find(ev, &src);
+
+    if (!es) {
+        printf("║ %-4s Event Delivery:   N/A                ║\n", title);
+        return;
+    }
+    printf("║ %-4s Event Delivery:                      ║\n", title);
+    printf("║   Submitted:           %-18lu ║\n", (unsigned long)es->submitted);
+    printf("║   Sampled Out:         %-18lu ║\n", (unsigned long)es->sampled_out);
+    printf("║   Rate Limited:        %-18lu ║\n", (unsigned long)es->rate_limited);
+    printf("║   Ring Buffer Full:    %-18lu ║\n", (unsigned long)es->ringbuf_full);
+    printf("║   Aggregated:          %-18lu ║\n", (unsigned long)es->aggregated);
+    printf("║   Dropped Total:       %-18lu ║\n",
+           (unsigned long)(es->sampled_out + es->rate_limited + es->ringbuf_full));
+}
+
+/* 显示综合统计信息 */
+void display_statistics(struct monitor_snapshots *snaps, struct spsc_queue *queue,
+                        struct spsc_queue *ndp_queue,
+                        const struct iface_list *ifaces, const struct netlink_ctx *nl,
+                        const struct enforcer *enf, struct capture *cap, int top_n)
+{
+    struct map_snapshot *pkt = &snaps->snap[SNAP_PACKET_COUNT];
+    struct map_snapshot *arp = &snaps->snap[SNAP_ARP_STATISTICS];
+    struct map_snapshot *ndp = &snaps->snap[SNAP_NDP_STATISTICS];
+    struct map_snapshot *ev = &snaps->snap[SNAP_EVENT_STATS];
+    struct traffic_counter total;
+    struct arp_stats arp_total;
+    struct ndp_stats ndp_total;
+    char bytes_str[16];
+
+    snapshots_refresh(snaps);
+    snapshot_total(pkt, (uint64_t *)&total);
+    snapshot_total(arp, (uint64_t *)&arp_total);
+    snapshot_total(ndp, (uint64_t *)&ndp_total);
+
+    printf("\n");
+    printf("╔════════════════════════════════════════════╗\n");
+    if (snaps->delta)
+        printf("║  Network Monitor Statistics (interval)    ║\n");
+    else
+        printf("║       Network Monitor Statistics          ║\n");
+    printf("╠════════════════════════════════════════════╣\n");
+
+    /* 所有接口的总数据包计数 */
+    format_bytes(total.bytes, bytes_str, sizeof(bytes_str));
+    printf("║ Total Packets:         %-18lu ║\n", (unsigned long)total.packets);
+    printf("║ Total Bytes:           %-18s ║\n", bytes_str);
+    printf("║ Interfaces:            %-18d ║\n", ifaces->count);
+
+    printf("╠════════════════════════════════════════════╣\n");
+
+    display_protocol_statistics(snaps);
+
+    printf("╠════════════════════════════════════════════╣\n");
+
+    /* 所有接口的 ARP 统计 */
+    printf("║ ARP Statistics:                           ║\n");
+    printf("║   Total ARP Packets:   %-18lu ║\n", (unsigned long)arp_total.total_packets);
+    printf("║   ARP Requests:        %-18lu ║\n", (unsigned long)arp_total.arp_request);
+    printf("║   ARP Replies:         %-18lu ║\n", (unsigned long)arp_total.arp_reply);
+    printf("║   RARP Requests:       %-18lu ║\n", (unsigned long)arp_total.rarp_request);
+    printf("║   RARP Replies:        %-18lu ║\n", (unsigned long)arp_total.rarp_reply);
+
+    printf("╠════════════════════════════════════════════╣\n");
+
+    /* 所有接口的 IPv6 邻居发现统计 */
+    printf("║ NDP Statistics:                           ║\n");
+    printf("║   Total NDP Packets:   %-18lu ║\n", (unsigned long)ndp_total.total_packets);
+    printf("║   Neighbor Solicits:   %-18lu ║\n", (unsigned long)ndp_total.neigh_solicit);
+    printf("║   Neighbor Adverts:    %-18lu ║\n", (unsigned long)ndp_total.neigh_advert);
+    printf("║   Router Solicits:     %-18lu ║\n", (unsigned long)ndp_total.router_solicit);
+    printf("║   Router Adverts:      %-18lu ║\n", (unsigned long)ndp_total.router_advert);
+
+    printf("╠════════════════════════════════════════════╣\n");
+
+    /* 事件投递统计 */
+    display_event_delivery("ARP", ev, EVENT_SRC_ARP);
+    display_event_delivery("NDP", ev, EVENT_SRC_NDP);
+
+    printf("╠════════════════════════════════════════════╣\n");
+    printf("║ Event Queue:                              ║\n");
+    printf("║   Depth:               %-18u ║\n", spsc_depth(queue));
+    printf("║   High Water:          %-18u ║\n",
+           atomic_load_explicit(&queue->high_water, memory_order_relaxed));
+    printf("║   Capacity:            %-18u ║\n", spsc_capacity(queue));
+    printf("║   Queue Drops:         %-18lu ║\n",
+           (unsigned long)atomic_load_explicit(&queue->drops, memory_order_relaxed));
+    printf("║   NDP Depth:           %-18u ║\n", spsc_depth(ndp_queue));
+    printf("║   NDP Queue Drops:     %-18lu ║\n",
+           (unsigned long)atomic_load_explicit(&ndp_queue->drops, memory_order_relaxed));
+
+    /* 抓包到文件 */
+    if (cap) {
+        struct event_stats *es = (struct event_stats *)snapshot_find(ev, &(uint32_t){EVENT_SRC_CAPTURE});
+
+        format_bytes(atomic_load_explicit(&cap->bytes, memory_order_relaxed),
+                     bytes_str, sizeof(bytes_str));
+        printf("╠════════════════════════════════════════════╣\n");
+        printf("║ Capture:                                  ║\n");
+        printf("║   Packets Written:     %-18lu ║\n",
+               (unsigned long)atomic_load_explicit(&cap->packets, memory_order_relaxed));
+        printf("║   Bytes Written:       %-18s ║\n", bytes_str);
+        printf("║   Files:               %-18lu ║\n",
+               (unsigned long)atomic_load_explicit(&cap->files, memory_order_relaxed));
+        printf("║   Buffer Full Drops:   %-18lu ║\n", es ? (unsigned long)es->ringbuf_full : 0UL);
+        printf("║   Lost Samples:        %-18lu ║\n",
+               (unsigned long)atomic_load_explicit(&cap->lost, memory_order_relaxed));
+    }
+
+    /* 子网过滤（可能在运行中由 "netmon config" 启用，有计数时显示） */
+    {
+        struct map_snapshot *fss = &snaps->snap[SNAP_FILTER_STATS];
+        struct filter_stats *fs = fss->count > 0 ?
+            (struct filter_stats *)snapshot_sum(fss, 0) : NULL;
+
+        if (fs && (fs->ipv4_filtered || fs->arp_filtered)) {
+            printf("╠════════════════════════════════════════════╣\n");
+            printf("║ Subnet Filter:                            ║\n");
+            printf("║   IPv4 Filtered:       %-18lu ║\n", (unsigned long)fs->ipv4_filtered);
+            printf("║   ARP Filtered:        %-18lu ║\n", (unsigned long)fs->arp_filtered);
+        }
+    }
+
+    /* 用户空间邻居表 */
+    if (nl->sock >= 0) {
+        printf("╠════════════════════════════════════════════╣\n");
+        printf("║ Neighbor Table:                           ║\n");
+        printf("║   Entries:             %-18u ║\n", nl->table.count);
+        printf("║   Adds:                %-18lu ║\n", (unsigned long)nl->table.adds);
+        printf("║   Updates:             %-18lu ║\n", (unsigned long)nl->table.updates);
+        printf("║   Deletes:             %-18lu ║\n", (unsigned long)nl->table.deletes);
+        printf("║   Netlink Overruns:    %-18lu ║\n", (unsigned long)nl->overruns);
+    }
+
+    /* 强制模式丢弃统计 */
+    if (enf) {
+        struct map_snapshot *ens = &snaps->snap[SNAP_ENFORCE_STATS];
+        struct enforce_stats *st = ens->count > 0 ?
+            (struct enforce_stats *)snapshot_sum(ens, 0) : NULL;
+
+        printf("╠════════════════════════════════════════════╣\n");
+        printf("║ ARP Enforcement:                          ║\n");
+        printf("║   Trusted Bindings:    %-18u ║\n", enf->static_count + enf->learned);
+        if (st) {
+            printf("║   Checked:             %-18lu ║\n", (unsigned long)st->checked);
+            printf("║   No Binding:          %-18lu ║\n", (unsigned long)st->unknown);
+            printf("║   Reply Mismatch:      %-18lu ║\n", (unsigned long)st->reply_mismatch);
+            printf("║   GARP Mismatch:       %-18lu ║\n", (unsigned long)st->garp_mismatch);
+            printf("║   SHA Mismatch:        %-18lu ║\n", (unsigned long)st->sha_mismatch);
+            printf("║   Dropped Total:       %-18lu ║\n",
+                   (unsigned long)(st->reply_mismatch + st->garp_mismatch));
+        }
+    }
+
+    /* ARP 欺骗/冲突检测 */
+    if (nl->detector) {
+        struct detector *det = nl->detector;
+
+        printf("╠════════════════════════════════════════════╣\n");
+        printf("║ ARP Detector:                             ║\n");
+        printf("║   Events Checked:      %-18lu ║\n", (unsigned long)det->events);
+        printf("║   MAC Flips:           %-18lu ║\n", (unsigned long)det->alerts[DET_MAC_FLIP]);
+        printf("║   Duplicate IPs:       %-18lu ║\n", (unsigned long)det->alerts[DET_DUPLICATE_IP]);
+        printf("║   GARP Floods:         %-18lu ║\n", (unsigned long)det->alerts[DET_GARP_FLOOD]);
+        printf("║   Unsolicited Replies: %-18lu ║\n",
+               (unsigned long)det->alerts[DET_UNSOLICITED_REPLY]);
+        printf("║   Neighbor Mismatches: %-18lu ║\n",
+               (unsigned long)det->alerts[DET_NEIGH_MISMATCH]);
+    }
+
+    printf("╠════════════════════════════════════════════╣\n");
+    snprintf(bytes_str, sizeof(bytes_str), "%.1f us", snaps->latency_ns / 1000.0);
+    printf("║ Snapshot Latency:      %-18s ║\n", bytes_str);
+    printf("║ Snapshot Entries:      %-18lu ║\n", (unsigned long)snaps->entries);
+    printf("║ Snapshot Syscalls:     %-18u ║\n", snaps->syscalls);
+    printf("╚════════════════════════════════════════════╝\n");
+    printf("\n");
+
+    if (ifaces->count > 1)
+        display_interface_statistics(snaps, ifaces);
+    display_latency_statistics(snaps, ifaces);
+
+    if (top_n > 0) {
+        display_top_flows(&snaps->snap[SNAP_FLOW_STATS], top_n);
+        display_top_sources(&snaps->snap[SNAP_IP_STATS], top_n);
+        display_top_vlans(&snaps->snap[SNAP_VLAN_STATS], ifaces, top_n);
+    }
+}
+
+/*
+ * 导出的累计计数。差量模式下快照是每个周期的增量（LRU 哈希表读后删除，其余减去上一次的值），
+ * 这里累加后导出，保证 OpenMetrics counter 单调递增。
+ */
+struct metrics_totals {
+    struct traffic_counter pkt[MAX_INTERFACES];    /* 与 iface_list 中的顺序一致 */
+    struct arp_stats arp[MAX_INTERFACES];
+    struct latency_hist lat[MAX_INTERFACES];
+    struct ndp_stats ndp[MAX_INTERFACES];
+    struct event_stats events[EVENT_SRC_MAX];
+    struct enforce_stats enforce;
+    struct filter_stats filter;
+};
+
+/* 累加（差量模式）或覆盖（累计模式）n 个计数器；src 为 NULL 时视为全 0 */
+static void metrics_accumulate(uint64_t *dst, const uint64_t *src, size_t n, bool delta)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        uint64_t v = src ? src[i] : 0;
+
+        dst[i] = delta ? dst[i] + v : v;
+    }
 }
 
-/* 将 MAC 地址转换为字符串 */
-void mac_to_str(const uint8_t *mac, char *str)
+#define METRICS_FIELDS(type) (sizeof(type) / sizeof(uint64_t))
+
+/* 根据最近一次快照渲染 OpenMetrics 文本（统计定时器触发，display_statistics 之后调用） */
+void render_metrics(struct exporter *exp, struct metrics_totals *tot,
+                    struct monitor_snapshots *snaps, struct spsc_queue *queue,
+                    struct spsc_queue *ndp_queue,
+                    const struct iface_list *ifaces, const struct netlink_ctx *nl,
+                    const struct enforcer *enf, struct capture *cap)
 {
-    sprintf(str, "%02x:%02x:%02x:%02x:%02x:%02x",
-            mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    static const char *opcodes[] = { "request", "reply", "rarp_request", "rarp_reply" };
+    static const char *ndp_types[] = { "rs", "ra", "ns", "na" };
+    static const char *event_sources[] = { "arp", "ndp" };
+    static const char *event_results[] = {
+        "submitted", "sampled_out", "rate_limited", "ringbuf_full", "aggregated",
+    };
+    static const char *enforce_results[] = {
+        "checked", "no_binding", "reply_mismatch", "garp_mismatch", "sha_mismatch",
+    };
+    struct map_snapshot *pkt = &snaps->snap[SNAP_PACKET_COUNT];
+    struct map_snapshot *arp = &snaps->snap[SNAP_ARP_STATISTICS];
+    struct map_snapshot *ev = &snaps->snap[SNAP_EVENT_STATS];
+    struct map_snapshot *ens = &snaps->snap[SNAP_ENFORCE_STATS];
+    struct map_snapshot *lat = &snaps->snap[SNAP_ARP_LATENCY];
+    struct map_snapshot *ndp = &snaps->snap[SNAP_NDP_STATISTICS];
+    struct map_snapshot *fss = &snaps->snap[SNAP_FILTER_STATS];
+    struct spsc_queue *queues[] = { queue, ndp_queue };
+    char name[IF_NAMESIZE * 2];
+    char labels[128];
+    uint64_t *v;
+    uint32_t src;
+    int i, j;
+
+    for (i = 0; i < ifaces->count; i++) {
+        uint32_t key = ifaces->items[i].ifindex;
+        struct latency_hist h;
+
+        latency_collect(lat, key, &h);
+        metrics_accumulate((uint64_t *)&tot->lat[i], (uint64_t *)&h,
+                           METRICS_FIELDS(struct latency_hist), snaps->delta);
+
+        metrics_accumulate((uint64_t *)&tot->pkt[i], snapshot_find(pkt, &key),
+                           METRICS_FIELDS(struct traffic_counter), snaps->delta);
+        metrics_accumulate((uint64_t *)&tot->arp[i], snapshot_find(arp, &key),
+                           METRICS_FIELDS(struct arp_stats), snaps->delta);
+        metrics_accumulate((uint64_t *)&tot->ndp[i], snapshot_find(ndp, &key),
+                           METRICS_FIELDS(struct ndp_stats), snaps->delta);
+    }
+    for (src = 0; src < EVENT_SRC_MAX; src++)
+        metrics_accumulate((uint64_t *)&tot->events[src], snapshot_find(ev, &src),
+                           METRICS_FIELDS(struct event_stats), snaps->delta);
+    metrics_accumulate((uint64_t *)&tot->enforce, ens->count ? snapshot_sum(ens, 0) : NULL,
+                       METRICS_FIELDS(struct enforce_stats), snaps->delta);
+    metrics_accumulate((uint64_t *)&tot->filter, fss->count ? snapshot_sum(fss, 0) : NULL,
+                       METRICS_FIELDS(struct filter_stats), snaps->delta);
+
+    exporter_begin(exp);
+
+    exporter_family(exp, "netmon_packets", "counter", "Packets received per interface");
+    for (i = 0; i < ifaces->count; i++) {
+        exporter_escape(ifaces->items[i].name, name, sizeof(name));
+        snprintf(labels, sizeof(labels), "interface=\"%s\"", name);
+        exporter_sample(exp, "netmon_packets_total", labels, tot->pkt[i].packets);
+    }
+    exporter_family(exp, "netmon_bytes", "counter", "Bytes received per interface");
+    for (i = 0; i < ifaces->count; i++) {
+        exporter_escape(ifaces->items[i].name, name, sizeof(name));
+        snprintf(labels, sizeof(labels), "interface=\"%s\"", name);
+        exporter_sample(exp, "netmon_bytes_total", labels, tot->pkt[i].bytes);
+    }
+
+    exporter_family(exp, "netmon_xdp_attach_mode", "info",
+                    "XDP attach mode in effect per interface (generic is much slower)");
+    for (i = 0; i < ifaces->count; i++) {
+        exporter_escape(ifaces->items[i].name, name, sizeof(name));
+        snprintf(labels, sizeof(labels), "interface=\"%s\",mode=\"%s\"", name,
+                 xdp_attach_mode_str(ifaces->items[i].attach_mode));
+        exporter_sample(exp, "netmon_xdp_attach_mode_info", labels, 1);
+    }
+
+    exporter_family(exp, "netmon_arp_packets", "counter", "ARP packets per interface and opcode");
+    for (i = 0; i < ifaces->count; i++) {
+        /* struct arp_stats 的前四个字段与 opcodes 顺序一致 */
+        uint64_t *a = (uint64_t *)&tot->arp[i];
+
+        exporter_escape(ifaces->items[i].name, name, sizeof(name));
+        for (j = 0; j < 4; j++) {
+            snprintf(labels, sizeof(labels), "interface=\"%s\",opcode=\"%s\"", name, opcodes[j]);
+            exporter_sample(exp, "netmon_arp_packets_total", labels, a[j]);
+        }
+    }
+
+    exporter_family(exp, "netmon_ndp_packets", "counter",
+                    "IPv6 Neighbor Discovery packets per interface and type");
+    for (i = 0; i < ifaces->count; i++) {
+        /* struct ndp_stats 的前四个字段与 ndp_types 顺序一致 */
+        uint64_t *a = (uint64_t *)&tot->ndp[i];
+
+        exporter_escape(ifaces->items[i].name, name, sizeof(name));
+        for (j = 0; j < 4; j++) {
+            snprintf(labels, sizeof(labels), "interface=\"%s\",type=\"%s\"", name, ndp_types[j]);
+            exporter_sample(exp, "netmon_ndp_packets_total", labels, a[j]);
+        }
+    }
+
+    /* 桶边界为 log2 微秒；超时的请求不进入直方图，单独计数 */
+    exporter_family(exp, "netmon_arp_resolution_microseconds", "histogram",
+                    "ARP request to reply latency per interface");
+    for (i = 0; i < ifaces->count; i++) {
+        const struct latency_hist *h = &tot->lat[i];
+        uint64_t cum = 0;
+
+        exporter_escape(ifaces->items[i].name, name, sizeof(name));
+        for (j = 0; j < ARP_LATENCY_SLOTS; j++) {
+            cum += h->slots[j];
+            snprintf(labels, sizeof(labels), "interface=\"%s\",le=\"%llu\"", name,
+                     1ULL << (j + 1));
+            exporter_sample(exp, "netmon_arp_resolution_microseconds_bucket", labels, cum);
+        }
+        snprintf(labels, sizeof(labels), "interface=\"%s\",le=\"+Inf\"", name);
+        exporter_sample(exp, "netmon_arp_resolution_microseconds_bucket", labels, h->replies);
+        snprintf(labels, sizeof(labels), "interface=\"%s\"", name);
+        exporter_sample(exp, "netmon_arp_resolution_microseconds_count", labels, h->replies);
+        exporter_sample(exp, "netmon_arp_resolution_microseconds_sum", labels, h->sum_ns / 1000);
+    }
+    exporter_family(exp, "netmon_arp_resolution_timeouts", "counter",
+                    "ARP requests left unanswered for 3 seconds");
+    for (i = 0; i < ifaces->count; i++) {
+        exporter_escape(ifaces->items[i].name, name, sizeof(name));
+        snprintf(labels, sizeof(labels), "interface=\"%s\"", name);
+        exporter_sample(exp, "netmon_arp_resolution_timeouts_total", labels, tot->lat[i].timeouts);
+    }
+
+    exporter_family(exp, "netmon_arp_events", "counter",
+                    "ARP event delivery results (everything except submitted is dropped)");
+    v = (uint64_t *)&tot->events[EVENT_SRC_ARP];
+    for (j = 0; j < (int)METRICS_FIELDS(struct event_stats); j++) {
+        snprintf(labels, sizeof(labels), "result=\"%s\"", event_results[j]);
+        exporter_sample(exp, "netmon_arp_events_total", labels, v[j]);
+    }
+    exporter_family(exp, "netmon_ndp_events", "counter",
+                    "NDP event delivery results (everything except submitted is dropped)");
+    v = (uint64_t *)&tot->events[EVENT_SRC_NDP];
+    for (j = 0; j < (int)METRICS_FIELDS(struct event_stats); j++) {
+        snprintf(labels, sizeof(labels), "result=\"%s\"", event_results[j]);
+        exporter_sample(exp, "netmon_ndp_events_total", labels, v[j]);
+    }
+
+    exporter_family(exp, "netmon_subnet_filtered", "counter",
+                    "Packets skipped by the subnet filter by protocol");
+    exporter_sample(exp, "netmon_subnet_filtered_total", "proto=\"ipv4\"", tot->filter.ipv4_filtered);
+    exporter_sample(exp, "netmon_subnet_filtered_total", "proto=\"arp\"", tot->filter.arp_filtered);
+
+    exporter_family(exp, "netmon_event_queue_drops", "counter",
+                    "Events dropped because the userspace queue was full");
+    for (j = 0; j < (int)(sizeof(queues) / sizeof(queues[0])); j++) {
+        snprintf(labels, sizeof(labels), "queue=\"%s\"", event_sources[j]);
+        exporter_sample(exp, "netmon_event_queue_drops_total", labels,
+                        atomic_load_explicit(&queues[j]->drops, memory_order_relaxed));
+    }
+    exporter_family(exp, "netmon_event_queue_depth", "gauge", "Userspace event queue depth");
+    for (j = 0; j < (int)(sizeof(queues) / sizeof(queues[0])); j++) {
+        snprintf(labels, sizeof(labels), "queue=\"%s\"", event_sources[j]);
+        exporter_sample(exp, "netmon_event_queue_depth", labels, spsc_depth(queues[j]));
+    }
+    exporter_family(exp, "netmon_event_queue_high_water", "gauge", "Highest userspace event queue depth seen");
+    for (j = 0; j < (int)(sizeof(queues) / sizeof(queues[0])); j++) {
+        snprintf(labels, sizeof(labels), "queue=\"%s\"", event_sources[j]);
+        exporter_sample(exp, "netmon_event_queue_high_water", labels,
+                        atomic_load_explicit(&queues[j]->high_water, memory_order_relaxed));
+    }
+
+    /* 最近一次批量快照的开销 */
+    exporter_family(exp, "netmon_snapshot_latency_microseconds", "gauge", "Duration of the last map snapshot");
+    exporter_sample(exp, "netmon_snapshot_latency_microseconds", NULL, snaps->latency_ns / 1000);
+    exporter_family(exp, "netmon_snapshot_syscalls", "gauge", "BPF syscalls used by the last map snapshot");
+    exporter_sample(exp, "netmon_snapshot_syscalls", NULL, snaps->syscalls);
+    exporter_family(exp, "netmon_snapshot_entries", "gauge", "Map entries read by the last map snapshot");
+    exporter_sample(exp, "netmon_snapshot_entries", NULL, snaps->entries);
+
+    if (cap) {
+        exporter_family(exp, "netmon_capture_packets", "counter", "Packets written to the capture file");
+        exporter_sample(exp, "netmon_capture_packets_total", NULL,
+                        atomic_load_explicit(&cap->packets, memory_order_relaxed));
+        exporter_family(exp, "netmon_capture_bytes", "counter",
+                        "Bytes written to the capture file (pcapng blocks)");
+        exporter_sample(exp, "netmon_capture_bytes_total", NULL,
+                        atomic_load_explicit(&cap->bytes, memory_order_relaxed));
+        exporter_family(exp, "netmon_capture_drops", "counter",
+                        "Packets matching the capture filter that were not written");
+        exporter_sample(exp, "netmon_capture_drops_total", "reason=\"buffer_full\"",
+                        tot->events[EVENT_SRC_CAPTURE].ringbuf_full);
+        exporter_sample(exp, "netmon_capture_drops_total", "reason=\"lost\"",
+                        atomic_load_explicit(&cap->lost, memory_order_relaxed));
+    }
+
+    if (nl->sock >= 0) {
+        exporter_family(exp, "netmon_neighbor_entries", "gauge", "Entries in the neighbor table");
+        exporter_sample(exp, "netmon_neighbor_entries", NULL, nl->table.count);
+        exporter_family(exp, "netmon_netlink_overruns", "counter",
+                        "Netlink receive buffer overruns (each triggers a resync)");
+        exporter_sample(exp, "netmon_netlink_overruns_total", NULL, nl->overruns);
+    }
+
+    if (enf) {
+        exporter_family(exp, "netmon_enforce", "counter",
+                        "ARP enforcement results (binding mismatches are dropped)");
+        v = (uint64_t *)&tot->enforce;
+        for (j = 0; j < (int)METRICS_FIELDS(struct enforce_stats); j++) {
+            snprintf(labels, sizeof(labels), "result=\"%s\"", enforce_results[j]);
+            exporter_sample(exp, "netmon_enforce_total", labels, v[j]);
+        }
+        exporter_family(exp, "netmon_trusted_bindings", "gauge", "Trusted IP-MAC bindings");
+        exporter_sample(exp, "netmon_trusted_bindings", NULL, enf->static_count + enf->learned);
+    }
+
+    if (nl->detector) {
+        exporter_family(exp, "netmon_detector_alerts", "counter", "ARP detector alerts by type");
+        for (j = 0; j < DET_NR_ALERTS; j++) {
+            snprintf(labels, sizeof(labels), "type=\"%s\"", detector_alert_str(j));
+            exporter_sample(exp, "netmon_detector_alerts_total", labels, nl->detector->alerts[j]);
+        }
+    }
+
+    exporter_commit(exp);
 }
 
-/* 将 IP 地址转换为字符串 */
-void ip_to_str(uint32_t ip, char *str)
+/*
+ * 采样历史的数据源：只读取按接口计数的 map 和 event_stats（累计模式，不影响统计显示），
+ * 每个采样间隔只有几次系统调用
+ */
+struct history_source {
+    struct map_snapshot pkt;
+    struct map_snapshot arp;
+    struct map_snapshot ndp;
+    struct map_snapshot ev;
+};
+
+static int history_source_init(struct history_source *src, const struct monitor_maps *maps)
 {
-    struct in_addr addr;
-    addr.s_addr = ip;
-    strcpy(str, inet_ntoa(addr));
+    memset(src, 0, sizeof(*src));
+    if (snapshot_init(&src->pkt, "packet_count", maps->packet_count, false) ||
+        snapshot_init(&src->arp, "arp_statistics", maps->arp_statistics, false) ||
+        snapshot_init(&src->ndp, "ndp_statistics", maps->ndp_statistics, false) ||
+        snapshot_init(&src->ev, "event_stats", maps->event_stats, false)) {
+        snapshot_free(&src->pkt);
+        snapshot_free(&src->arp);
+        snapshot_free(&src->ndp);
+        return -1;
+    }
+    return 0;
 }
 
-/* 获取 ARP 操作类型字符串 */
-const char* get_arp_opcode_str(uint16_t opcode)
+static void history_source_free(struct history_source *src)
 {
-    switch (opcode) {
-        case 1: return "REQUEST";
-        case 2: return "REPLY";
-        case 3: return "RARP-REQUEST";
-        case 4: return "RARP-REPLY";
-        default: return "UNKNOWN";
-    }
+    snapshot_free(&src->pkt);
+    snapshot_free(&src->arp);
+    snapshot_free(&src->ndp);
+    snapshot_free(&src->ev);
 }
 
-/* 获取 ARP 状态字符串 */
-const char* get_arp_state_str(uint16_t state)
+/* 读取所有接口之和的累计计数器，顺序与 enum history_counter 一致 */
+static void history_source_read(struct history_source *src, uint64_t *counters)
 {
-    switch (state) {
-        case NUD_INCOMPLETE: return "INCOMPLETE";
-        case NUD_REACHABLE: return "REACHABLE";
-        case NUD_STALE: return "STALE";
-        case NUD_DELAY: return "DELAY";
-        case NUD_PROBE: return "PROBE";
-        case NUD_FAILED: return "FAILED";
-        case NUD_NOARP: return "NOARP";
-        case NUD_PERMANENT: return "PERMANENT";
-        default: return "UNKNOWN";
+    struct traffic_counter pkt;
+    struct arp_stats arp;
+    struct ndp_stats ndp;
+    uint32_t key;
+
+    snapshot_refresh(&src->pkt);
+    snapshot_refresh(&src->arp);
+    snapshot_refresh(&src->ndp);
+    snapshot_refresh(&src->ev);
+    snapshot_total(&src->pkt, (uint64_t *)&pkt);
+    snapshot_total(&src->arp, (uint64_t *)&arp);
+    snapshot_total(&src->ndp, (uint64_t *)&ndp);
+
+    memset(counters, 0, HISTORY_NR_COUNTERS * sizeof(uint64_t));
+    counters[HIST_PACKETS] = pkt.packets;
+    counters[HIST_BYTES] = pkt.bytes;
+    counters[HIST_ARP] = arp.total_packets;
+    counters[HIST_ARP_REQUEST] = arp.arp_request;
+    counters[HIST_ARP_REPLY] = arp.arp_reply;
+    counters[HIST_NDP] = ndp.total_packets;
+    for (key = EVENT_SRC_ARP; key <= EVENT_SRC_NDP; key++) {
+        struct event_stats *es = (struct event_stats *)snapshot_find(&src->ev, &key);
+
+        if (!es)
+            continue;
+        counters[HIST_EVENTS] += es->submitted;
+        counters[HIST_EVENT_DROPS] += es->sampled_out + es->rate_limited + es->ringbuf_full;
     }
 }
 
-/* 处理 ring buffer 中的 ARP 事件 */
-int handle_arp_event(void *ctx, void *data, size_t data_sz)
+/* 显示最近一个统计间隔内的平均与峰值速率（峰值按采样间隔计算，能看到两次显示之间的突发） */
+static void display_rates(const struct history *h, int stats_interval)
+{
+    struct history_summary sum;
+    char title[96];
+
+    if (history_recent(h, stats_interval, &sum) == 0)
+        return;
+    snprintf(title, sizeof(title), "Rates (last %ds, %us resolution, %lu samples)",
+             stats_interval, h->resolution, (unsigned long)sum.samples);
+    history_print_summary(&sum, title);
+}
+
+/* 解析限速参数 "PPS" 或 "PPS/BURST" */
+int parse_rate_limit(const char *arg, struct monitor_config *cfg)
 {
-    struct arp_event *event = data;
-    char src_ip_str[INET_ADDRSTRLEN];
-    char dst_ip_str[INET_ADDRSTRLEN];
-    char src_mac_str[18];
-    char dst_mac_str[18];
+    char *end;
+    long pps, burst;
+
+    pps = strtol(arg, &end, 10);
+    if (end == arg || pps < 0)
+        return -1;
 
-    ip_to_str(event->src_ip, src_ip_str);
-    ip_to_str(event->dst_ip, dst_ip_str);
-    mac_to_str(event->src_mac, src_mac_str);
-    mac_to_str(event->dst_mac, dst_mac_str);
+    burst = pps;
+    if (*end == '/') {
+        const char *burst_str = end + 1;
 
-    printf("[ARP] %s: %s (%s) -> %s (%s)\n",
-           get_arp_opcode_str(event->opcode),
-           src_ip_str, src_mac_str,
-           dst_ip_str, dst_mac_str);
+        burst = strtol(burst_str, &end, 10);
+        if (end == burst_str || burst <= 0)
+            return -1;
+    }
+    if (*end != '\0')
+        return -1;
 
+    cfg->rate_limit_pps = pps;
+    cfg->rate_limit_burst = burst > 0 ? burst : 1;
     return 0;
 }
 
-/* 创建 Netlink 套接字用于监听 ARP 表变化 */
-int create_netlink_socket(void)
+/* 解析抓包过滤条件：all、arp、arp:request、arp:reply、ipv4、ipv6 或 EtherType（如 0x88cc） */
+int parse_capture_filter(const char *arg, struct monitor_config *cfg)
 {
-    int sock;
-    struct sockaddr_nl addr;
+    char *end;
+    long ethertype;
 
-    sock = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
-    if (sock < 0) {
-        fprintf(stderr, "Warning: Failed to create netlink socket: %s\n", strerror(errno));
-        return -1;
+    cfg->capture_ethertype = 0;
+    cfg->capture_arp_op = 0;
+    if (strcmp(arg, "all") == 0)
+        return 0;
+    if (strcmp(arg, "arp") == 0 || strcmp(arg, "arp:request") == 0 || strcmp(arg, "arp:reply") == 0) {
+        cfg->capture_ethertype = ETH_P_ARP;
+        if (strcmp(arg, "arp:request") == 0)
+            cfg->capture_arp_op = ARPOP_REQUEST;
+        else if (strcmp(arg, "arp:reply") == 0)
+            cfg->capture_arp_op = ARPOP_REPLY;
+        return 0;
+    }
+    if (strcmp(arg, "ipv4") == 0) {
+        cfg->capture_ethertype = ETH_P_IP;
+        return 0;
+    }
+    if (strcmp(arg, "ipv6") == 0) {
+        cfg->capture_ethertype = ETH_P_IPV6;
+        return 0;
     }
 
-    memset(&addr, 0, sizeof(addr));
-    addr.nl_family = AF_NETLINK;
-    addr.nl_groups = RTMGRP_NEIGH; /* 订阅邻居表（ARP）变化 */
+    ethertype = strtol(arg, &end, 0);
+    if (end == arg || *end != '\0' || ethertype <= 0 || ethertype > 0xffff)
+        return -1;
+    cfg->capture_ethertype = ethertype;
+    return 0;
+}
 
-    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
-        fprintf(stderr, "Warning: Failed to bind netlink socket: %s\n", strerror(errno));
-        close(sock);
+/* 解析抓包文件轮转参数 "SIZE_MB" 或 "SIZE_MB/COUNT" */
+int parse_capture_rotate(const char *arg, uint64_t *bytes, uint32_t *count)
+{
+    char *end;
+    long size_mb, files = 0;
+
+    size_mb = strtol(arg, &end, 10);
+    if (end == arg || size_mb <= 0)
         return -1;
+    if (*end == '/') {
+        const char *count_str = end + 1;
+
+        files = strtol(count_str, &end, 10);
+        if (end == count_str || files <= 0)
+            return -1;
     }
+    if (*end != '\0')
+        return -1;
 
-    return sock;
+    *bytes = (uint64_t)size_mb * 1024 * 1024;
+    *count = files;
+    return 0;
 }
 
-/* 处理 Netlink ARP 表事件 */
-void handle_netlink_arp(int sock)
+/* 解析 [min, max] 范围内的无符号整数选项 */
+int parse_u32(const char *arg, uint32_t min, uint32_t max, uint32_t *out)
 {
-    char buf[4096];
-    struct nlmsghdr *nlh;
-    struct ndmsg *ndm;
-    struct rtattr *rta;
-    int len, attrlen;
-
-    len = recv(sock, buf, sizeof(buf), MSG_DONTWAIT);
-    if (len < 0) {
-        if (errno != EAGAIN && errno != EWOULDBLOCK)
-            fprintf(stderr, "Error: Netlink recv failed: %s\n", strerror(errno));
-        return;
-    }
+    char *end;
+    unsigned long v;
 
-    for (nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
-        if (nlh->nlmsg_type == NLMSG_DONE)
-            break;
+    if (*arg == '-')
+        return -1;
+    errno = 0;
+    v = strtoul(arg, &end, 10);
+    if (end == arg || *end != '\0' || errno || v < min || v > max)
+        return -1;
+    *out = v;
+    return 0;
+}
 
-        if (nlh->nlmsg_type == NLMSG_ERROR) {
-            fprintf(stderr, "Error: Netlink message error\n");
-            continue;
-        }
+/* 解析线程绑定的 CPU 编号：-1 表示不绑定，否则必须小于可能的 CPU 数 */
+int parse_cpu(const char *arg, int *cpu)
+{
+    int ncpus = libbpf_num_possible_cpus();
+    char *end;
+    long v;
 
-        /* 只处理邻居表消息 */
-        if (nlh->nlmsg_type != RTM_NEWNEIGH && nlh->nlmsg_type != RTM_DELNEIGH)
-            continue;
+    v = strtol(arg, &end, 10);
+    if (end == arg || *end != '\0' || v < -1 || v >= CPU_SETSIZE || (ncpus > 0 && v >= ncpus))
+        return -1;
+    *cpu = v;
+    return 0;
+}
 
-        ndm = (struct ndmsg *)NLMSG_DATA(nlh);
+/* 将运行时配置写入 eBPF 程序的 monitor_config map */
+int apply_monitor_config(int config_map_fd, const struct monitor_config *cfg)
+{
+    uint32_t key = 0;
 
-        /* 只处理 ARP（IPv4）条目 */
-        if (ndm->ndm_family != AF_INET)
-            continue;
+    if (bpf_map_update_elem(config_map_fd, &key, cfg, BPF_ANY) != 0) {
+        fprintf(stderr, "Error: Failed to update monitor_config map: %s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
 
-        char ip_str[INET_ADDRSTRLEN] = {0};
-        char mac_str[18] = {0};
-        char ifname[IF_NAMESIZE] = {0};
-        uint32_t ip_addr = 0;
-        uint8_t mac_addr[6] = {0};
+/* 协议处理程序：名称、dispatch 槽位，程序名为 handle_<名称> */
+static const struct {
+    const char *name;
+    uint32_t slot;
+} dispatch_handlers[] = {
+    { "arp",  DISPATCH_ARP },
+    { "ipv4", DISPATCH_IPV4 },
+    { "ipv6", DISPATCH_IPV6 },
+    { "vlan", DISPATCH_VLAN },
+};
 
-        /* 获取接口名 */
-        if_indextoname(ndm->ndm_ifindex, ifname);
+#define DISPATCH_ALL ((1U << DISPATCH_ARP) | (1U << DISPATCH_IPV4) | (1U << DISPATCH_IPV6) | \
+                      (1U << DISPATCH_VLAN))
 
-        /* 解析属性 */
-        rta = (struct rtattr *)((char *)ndm + NLMSG_ALIGN(sizeof(struct ndmsg)));
-        attrlen = nlh->nlmsg_len - NLMSG_ALIGN(sizeof(struct nlmsghdr)) - NLMSG_ALIGN(sizeof(struct ndmsg));
+/* 解析逗号分隔的处理程序列表（"none" 表示全部禁用），返回按槽位的位图，失败返回 -1 */
+int64_t parse_handlers(const char *arg)
+{
+    char buf[128], *tok, *save;
+    uint32_t mask = 0;
+    size_t i;
 
-        for (; RTA_OK(rta, attrlen); rta = RTA_NEXT(rta, attrlen)) {
-            switch (rta->rta_type) {
-                case NDA_DST:
-                    ip_addr = *(uint32_t *)RTA_DATA(rta);
-                    ip_to_str(ip_addr, ip_str);
-                    break;
-                case NDA_LLADDR:
-                    memcpy(mac_addr, RTA_DATA(rta), 6);
-                    mac_to_str(mac_addr, mac_str);
-                    break;
-            }
+    if (strcmp(arg, "none") == 0)
+        return 0;
+    snprintf(buf, sizeof(buf), "%s", arg);
+    for (tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        for (i = 0; i < sizeof(dispatch_handlers) / sizeof(dispatch_handlers[0]); i++) {
+            if (strcmp(tok, dispatch_handlers[i].name) == 0)
+                break;
         }
-
-        /* 打印 ARP 表事件 */
-        const char *event_str = (nlh->nlmsg_type == RTM_NEWNEIGH) ? "ADD/UPDATE" : "DELETE";
-        printf("[ARP TABLE] %s: %s -> %s (dev: %s, state: %s)\n",
-               event_str, ip_str, mac_str, ifname, get_arp_state_str(ndm->ndm_state));
+        if (i == sizeof(dispatch_handlers) / sizeof(dispatch_handlers[0]))
+            return -1;
+        mask |= 1U << dispatch_handlers[i].slot;
     }
+    return mask;
 }
 
-/* 显示综合统计信息 */
-void display_statistics(int packet_map_fd, int arp_map_fd)
+/*
+ * 按位图启用或禁用协议处理程序：启用的槽位写入程序 fd，禁用的槽位删除，
+ * 入口程序对空槽位的尾调用直接放行。可在运行时重复调用。
+ */
+int dispatch_apply(int map_fd, struct bpf_object *obj, uint32_t mask)
 {
-    uint32_t key = 0;
-    uint64_t packet_count = 0;
-    struct arp_stats arp_stats;
+    char prog_name[32];
+    size_t i;
 
-    printf("\n");
-    printf("╔════════════════════════════════════════════╗\n");
-    printf("║       Network Monitor Statistics          ║\n");
-    printf("╠════════════════════════════════════════════╣\n");
+    for (i = 0; i < sizeof(dispatch_handlers) / sizeof(dispatch_handlers[0]); i++) {
+        uint32_t slot = dispatch_handlers[i].slot;
+        struct bpf_program *prog;
+        int fd;
 
-    /* 读取总数据包计数 */
-    if (bpf_map_lookup_elem(packet_map_fd, &key, &packet_count) == 0) {
-        printf("║ Total Packets:         %-18lu ║\n", (unsigned long)packet_count);
-    } else {
-        printf("║ Total Packets:         N/A                ║\n");
+        if (!(mask & (1U << slot))) {
+            if (bpf_map_delete_elem(map_fd, &slot) && errno != ENOENT)
+                return -errno;
+            continue;
+        }
+        snprintf(prog_name, sizeof(prog_name), "handle_%s", dispatch_handlers[i].name);
+        prog = bpf_object__find_program_by_name(obj, prog_name);
+        if (!prog)
+            return -ENOENT;
+        fd = bpf_program__fd(prog);
+        if (bpf_map_update_elem(map_fd, &slot, &fd, BPF_ANY))
+            return -errno;
     }
+    return 0;
+}
 
-    printf("╠════════════════════════════════════════════╣\n");
-
-    /* 读取 ARP 统计 */
-    if (bpf_map_lookup_elem(arp_map_fd, &key, &arp_stats) == 0) {
-        printf("║ ARP Statistics:                           ║\n");
-        printf("║   Total ARP Packets:   %-18lu ║\n", (unsigned long)arp_stats.total_packets);
-        printf("║   ARP Requests:        %-18lu ║\n", (unsigned long)arp_stats.arp_request);
-        printf("║   ARP Replies:         %-18lu ║\n", (unsigned long)arp_stats.arp_reply);
-        printf("║   RARP Requests:       %-18lu ║\n", (unsigned long)arp_stats.rarp_request);
-        printf("║   RARP Replies:        %-18lu ║\n", (unsigned long)arp_stats.rarp_reply);
-    } else {
-        printf("║ ARP Statistics:        N/A                ║\n");
-    }
+/* 只有长选项的命令行参数 */
+enum {
+    OPT_PIN_PATH = 256,
+    OPT_UNPIN,
+    OPT_HISTORY_RESOLUTION,
+    OPT_HISTORY_SAMPLES,
+    OPT_HISTORY_FILE,
+    OPT_HISTORY_RETENTION,
+    OPT_DISABLE,
+    OPT_SRC_FILTER,
+    OPT_DST_FILTER,
+};
 
-    printf("╚════════════════════════════════════════════╝\n");
-    printf("\n");
+void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [options] <interface|glob>...\n", prog);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -n, --top-flows N   Show the top N flows, source IPs and VLANs by bytes\n");
+    fprintf(stderr, "                      (default: %d, 0 to disable)\n",
+            DEFAULT_TOP_FLOWS);
+    fprintf(stderr, "  -d, --delta         Show per-interval deltas instead of totals\n");
+    fprintf(stderr, "                      (flow and source IP tables are reset on each read)\n");
+    fprintf(stderr, "  -i, --interval SEC  Statistics display interval (default: %d)\n",
+            DEFAULT_STATS_INTERVAL);
+    fprintf(stderr, "  -s, --sample N      Deliver 1 in N ARP events (statistics stay exact)\n");
+    fprintf(stderr, "  -a, --aggregate MS  Aggregate repeated ARP (src, dst, opcode) tuples\n");
+    fprintf(stderr, "                      and report them once per MS window\n");
+    fprintf(stderr, "  -r, --rate-limit PPS[/BURST]\n");
+    fprintf(stderr, "                      Limit ARP events per source MAC/IP per CPU\n");
+    fprintf(stderr, "  -o, --output FORMAT ARP event output format: text (default) or binary\n");
+    fprintf(stderr, "                      (binary writes raw struct arp_event records to stdout,\n");
+    fprintf(stderr, "                      everything else goes to stderr)\n");
+    fprintf(stderr, "  -c, --consumer-cpu CPU\n");
+    fprintf(stderr, "                      Pin the ring buffer consumer thread to CPU\n");
+    fprintf(stderr, "  -f, --formatter-cpu CPU\n");
+    fprintf(stderr, "                      Pin the formatting/statistics thread to CPU\n");
+    fprintf(stderr, "  -D, --detect        Detect ARP spoofing and IP/MAC conflicts and print\n");
+    fprintf(stderr, "                      [ALERT] lines (MAC flips, duplicate IPs, GARP floods,\n");
+    fprintf(stderr, "                      unsolicited replies, kernel neighbor mismatches)\n");
+    fprintf(stderr, "  -E, --enforce SOURCE\n");
+    fprintf(stderr, "                      Drop ARP replies and gratuitous ARPs that contradict a\n");
+    fprintf(stderr, "                      trusted IP->MAC binding. SOURCE is \"neigh\" (learn from\n");
+    fprintf(stderr, "                      the kernel neighbor table) or a file of \"<ip> <mac> [dev]\"\n");
+    fprintf(stderr, "                      lines; repeat to combine both\n");
+    fprintf(stderr, "  -M, --metrics [ADDR:]PORT\n");
+    fprintf(stderr, "                      Serve OpenMetrics on http://ADDR:PORT/metrics (default\n");
+    fprintf(stderr, "                      address %s); refreshed every statistics interval\n",
+            EXPORTER_DEFAULT_ADDR);
+    fprintf(stderr, "  -x, --xdp-mode MODE XDP attach mode: auto (default; native, falling back to\n");
+    fprintf(stderr, "                      generic if the driver lacks support), native or generic\n");
+    fprintf(stderr, "  -H, --handlers LIST Protocol handlers to enable: comma-separated list of\n");
+    fprintf(stderr, "                      arp, ipv4, ipv6, vlan (default: all) or \"none\"; disabled\n");
+    fprintf(stderr, "                      protocols are only counted per interface and EtherType;\n");
+    fprintf(stderr, "                      without vlan, tagged frames are not parsed further\n");
+    fprintf(stderr, "      --disable LIST  Features to turn off: comma-separated list of ip, flows,\n");
+    fprintf(stderr, "                      arp-events, ndp-events, events, arp-latency, vlan or all;\n");
+    fprintf(stderr, "                      per-interface, EtherType and ARP/NDP type counters stay on\n");
+    fprintf(stderr, "      --src-filter LIST\n");
+    fprintf(stderr, "                      Only track IPv4 traffic and ARP from these prefixes,\n");
+    fprintf(stderr, "                      e.g. 10.0.0.0/8,192.168.1.7\n");
+    fprintf(stderr, "      --dst-filter LIST\n");
+    fprintf(stderr, "                      Only track IPv4 traffic and ARP to these prefixes\n");
+    fprintf(stderr, "  -w, --capture FILE  Write matching frames to FILE in pcapng format\n");
+    fprintf(stderr, "  -F, --capture-filter FILTER\n");
+    fprintf(stderr, "                      Frames to capture: all (default), arp, arp:request,\n");
+    fprintf(stderr, "                      arp:reply, ipv4, ipv6 or an EtherType such as 0x88cc\n");
+    fprintf(stderr, "                      (matched against the outer and, on VLAN-tagged frames,\n");
+    fprintf(stderr, "                      the inner EtherType)\n");
+    fprintf(stderr, "  -S, --snaplen N     Capture at most N bytes per frame (default: %d)\n",
+            PCAPNG_MAX_SNAPLEN);
+    fprintf(stderr, "  -R, --capture-rotate SIZE_MB[/COUNT]\n");
+    fprintf(stderr, "                      Start a new FILE.N every SIZE_MB megabytes, keeping at\n");
+    fprintf(stderr, "                      most COUNT files (oldest overwritten)\n");
+    fprintf(stderr, "  -P, --pin           Pin maps and XDP links under %s so that counters\n",
+            DEFAULT_PIN_DIR);
+    fprintf(stderr, "                      survive restarts and upgrades replace the program\n");
+    fprintf(stderr, "                      atomically; the program stays attached on exit\n");
+    fprintf(stderr, "      --pin-path DIR  Pin under DIR instead (implies --pin)\n");
+    fprintf(stderr, "      --unpin         Remove the pinned maps and links (detaching the program)\n");
+    fprintf(stderr, "                      and exit\n");
+    fprintf(stderr, "      --history-resolution SEC\n");
+    fprintf(stderr, "                      Sample totals every SEC seconds for rates and peaks\n");
+    fprintf(stderr, "                      (default: %d)\n", HISTORY_DEFAULT_RESOLUTION);
+    fprintf(stderr, "      --history-samples N\n");
+    fprintf(stderr, "                      Samples kept in memory (default: %d, 0 to disable\n",
+            HISTORY_DEFAULT_SAMPLES);
+    fprintf(stderr, "                      unless --history-file is given)\n");
+    fprintf(stderr, "      --history-file FILE\n");
+    fprintf(stderr, "                      Also append samples to FILE (fixed-size, memory-mapped,\n");
+    fprintf(stderr, "                      survives restarts); read it with \"%s history\"\n", prog);
+    fprintf(stderr, "      --history-retention HOURS\n");
+    fprintf(stderr, "                      Hours of samples kept in FILE (default: %d)\n",
+            HISTORY_DEFAULT_RETENTION);
+    fprintf(stderr, "  -h, --help          Show this help message\n");
+    fprintf(stderr, "Example: %s eth0\n", prog);
+    fprintf(stderr, "         %s eth0 eth1 'veth*'\n", prog);
+    fprintf(stderr, "         %s history -f -1h FILE\n", prog);
+    fprintf(stderr, "         %s config --disable flows --src-filter 10.0.0.0/8\n", prog);
+    fprintf(stderr, "Run \"%s config -h\" or \"%s history -h\" for the subcommands.\n", prog, prog);
 }
 
 int main(int argc, char **argv)
 {
-    struct bpf_object *obj;
+    static struct iface_list ifaces;
+    struct monitor_bpf *skel;
     struct bpf_program *prog;
     struct ring_buffer *rb = NULL;
-    int prog_fd, packet_map_fd, arp_stats_map_fd, arp_events_map_fd, netlink_sock;
-    int ifindex;
-    int err;
+    struct spsc_queue queue, ndp_queue;
+    struct consumer consumer = { .cpu = -1 };
+    int formatter_cpu = -1;
+    bool consumer_started = false;
+    sigset_t sigs, old_sigs;
+    struct monitor_maps maps;
+    struct monitor_snapshots snaps;
+    struct map_snapshot agg_snap = {0}, ndp_agg_snap = {0};
+    static struct netlink_ctx nl;
+    static struct detector detector;
+    bool detect = false;
+    struct enforcer enforcer = { .map_fd = -1 };
+    const char *binding_file = NULL;
+    static struct exporter exporter;
+    static struct metrics_totals metrics;
+    const char *metrics_addr = NULL;
+    const char *pin_dir = NULL;
+    bool unpin = false;
+    enum xdp_mode xdp_mode = XDP_MODE_AUTO;
+    int64_t handlers = DISPATCH_ALL;
+    static struct capture capture;
+    const char *capture_path = NULL;
+    uint32_t snaplen = PCAPNG_MAX_SNAPLEN;
+    uint64_t rotate_bytes = 0;
+    uint32_t rotate_count = 0;
+    bool capture_started = false;
+    static struct history history;
+    static struct history_source hist_src;
+    uint32_t hist_resolution = HISTORY_DEFAULT_RESOLUTION;
+    uint32_t hist_samples = HISTORY_DEFAULT_SAMPLES;
+    uint32_t hist_retention = HISTORY_DEFAULT_RETENTION;
+    const char *hist_file = NULL;
+    const char *src_filter = NULL, *dst_filter = NULL;
+    int nsrc, ndst;
+    bool hist_enabled;
+    int hist_timer_fd = -1;
+    int reused_maps = 0;
+    uint64_t startup_ns[4];
+    int prog_fd;
+    int top_n = DEFAULT_TOP_FLOWS;
+    int stats_interval = DEFAULT_STATS_INTERVAL;
+    int epfd, timer_fd;
+    bool delta = false;
+    struct monitor_config config = {0};
+    struct output event_out, text_out;
+    struct monitor_output mo = { &event_out, &event_out, NULL, NULL };
+    enum output_format format = OUTPUT_TEXT;
+    int event_fd = STDOUT_FILENO;
+    int err, opt;
 
-    printf("╔════════════════════════════════════════════════════════╗\n");
-    printf("║   Integrated Network Monitor - Packet & ARP Tracker   ║\n");
-    printf("╚════════════════════════════════════════════════════════╝\n\n");
+    static const struct option long_options[] = {
+        {"top-flows", required_argument, NULL, 'n'},
+        {"delta",     no_argument,       NULL, 'd'},
+        {"interval",  required_argument, NULL, 'i'},
+        {"sample",    required_argument, NULL, 's'},
+        {"aggregate", required_argument, NULL, 'a'},
+        {"rate-limit", required_argument, NULL, 'r'},
+        {"output",    required_argument, NULL, 'o'},
+        {"consumer-cpu",  required_argument, NULL, 'c'},
+        {"formatter-cpu", required_argument, NULL, 'f'},
+        {"detect",    no_argument,       NULL, 'D'},
+        {"enforce",   required_argument, NULL, 'E'},
+        {"metrics",   required_argument, NULL, 'M'},
+        {"xdp-mode",  required_argument, NULL, 'x'},
+        {"handlers",  required_argument, NULL, 'H'},
+        {"capture",   required_argument, NULL, 'w'},
+        {"capture-filter", required_argument, NULL, 'F'},
+        {"snaplen",   required_argument, NULL, 'S'},
+        {"capture-rotate", required_argument, NULL, 'R'},
+        {"pin",       no_argument,       NULL, 'P'},
+        {"pin-path",  required_argument, NULL, OPT_PIN_PATH},
+        {"unpin",     no_argument,       NULL, OPT_UNPIN},
+        {"history-resolution", required_argument, NULL, OPT_HISTORY_RESOLUTION},
+        {"history-samples",    required_argument, NULL, OPT_HISTORY_SAMPLES},
+        {"history-file",       required_argument, NULL, OPT_HISTORY_FILE},
+        {"history-retention",  required_argument, NULL, OPT_HISTORY_RETENTION},
+        {"disable",    required_argument, NULL, OPT_DISABLE},
+        {"src-filter", required_argument, NULL, OPT_SRC_FILTER},
+        {"dst-filter", required_argument, NULL, OPT_DST_FILTER},
+        {"help",      no_argument,       NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    /* "netmon history FILE"：读取历史文件，不加载 BPF 程序 */
+    if (argc > 1 && strcmp(argv[1], "history") == 0)
+        return history_main(argc - 1, argv + 1);
+    /* "netmon config"：修改 pin 模式下运行中的配置 */
+    if (argc > 1 && strcmp(argv[1], "config") == 0)
+        return control_main(argc - 1, argv + 1);
+
+    while ((opt = getopt_long(argc, argv, "n:di:s:a:r:o:c:f:DE:M:x:H:w:F:S:R:Ph", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'n':
+                top_n = atoi(optarg);
+                break;
+            case 'd':
+                delta = true;
+                break;
+            case 'i':
+                stats_interval = atoi(optarg);
+                break;
+            case 's':
+                config.sample_rate = atoi(optarg);
+                break;
+            case 'a':
+                config.agg_window_ms = atoi(optarg);
+                break;
+            case 'r':
+                if (parse_rate_limit(optarg, &config)) {
+                    fprintf(stderr, "Error: Invalid rate limit: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'o':
+                if (strcmp(optarg, "text") == 0) {
+                    format = OUTPUT_TEXT;
+                } else if (strcmp(optarg, "binary") == 0) {
+                    format = OUTPUT_BINARY;
+                } else {
+                    fprintf(stderr, "Error: Invalid output format: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'c':
+                if (parse_cpu(optarg, &consumer.cpu)) {
+                    fprintf(stderr, "Error: Invalid consumer CPU: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'f':
+                if (parse_cpu(optarg, &formatter_cpu)) {
+                    fprintf(stderr, "Error: Invalid formatter CPU: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'D':
+                detect = true;
+                break;
+            case 'E':
+                config.enforce = 1;
+                if (strcmp(optarg, "neigh") == 0)
+                    enforcer.learn = true;
+                else
+                    binding_file = optarg;
+                break;
+            case 'M':
+                metrics_addr = optarg;
+                break;
+            case 'x':
+                if (strcmp(optarg, "auto") == 0) {
+                    xdp_mode = XDP_MODE_AUTO;
+                } else if (strcmp(optarg, "native") == 0 || strcmp(optarg, "drv") == 0) {
+                    xdp_mode = XDP_MODE_NATIVE;
+                } else if (strcmp(optarg, "generic") == 0 || strcmp(optarg, "skb") == 0) {
+                    xdp_mode = XDP_MODE_GENERIC;
+                } else {
+                    fprintf(stderr, "Error: Invalid XDP mode: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'H':
+                handlers = parse_handlers(optarg);
+                if (handlers < 0) {
+                    fprintf(stderr, "Error: Invalid handler list: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'w':
+                capture_path = optarg;
+                break;
+            case 'F':
+                if (parse_capture_filter(optarg, &config)) {
+                    fprintf(stderr, "Error: Invalid capture filter: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'S':
+                snaplen = atoi(optarg);
+                if (snaplen == 0 || snaplen > PCAPNG_MAX_SNAPLEN) {
+                    fprintf(stderr, "Error: Invalid snaplen: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'R':
+                if (parse_capture_rotate(optarg, &rotate_bytes, &rotate_count)) {
+                    fprintf(stderr, "Error: Invalid capture rotation: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'P':
+                if (!pin_dir)
+                    pin_dir = DEFAULT_PIN_DIR;
+                break;
+            case OPT_PIN_PATH:
+                pin_dir = optarg;
+                break;
+            case OPT_UNPIN:
+                unpin = true;
+                break;
+            case OPT_HISTORY_RESOLUTION:
+                if (parse_u32(optarg, 1, HISTORY_MAX_RESOLUTION, &hist_resolution)) {
+                    fprintf(stderr, "Error: Invalid history resolution: %s (1-%d seconds)\n",
+                            optarg, HISTORY_MAX_RESOLUTION);
+                    return 1;
+                }
+                break;
+            case OPT_HISTORY_SAMPLES:
+                if (parse_u32(optarg, 0, HISTORY_MAX_SAMPLES, &hist_samples)) {
+                    fprintf(stderr, "Error: Invalid history sample count: %s (0-%u)\n",
+                            optarg, HISTORY_MAX_SAMPLES);
+                    return 1;
+                }
+                break;
+            case OPT_HISTORY_FILE:
+                hist_file = optarg;
+                break;
+            case OPT_HISTORY_RETENTION:
+                if (parse_u32(optarg, 1, HISTORY_MAX_RETENTION, &hist_retention)) {
+                    fprintf(stderr, "Error: Invalid history retention: %s (1-%d hours)\n",
+                            optarg, HISTORY_MAX_RETENTION);
+                    return 1;
+                }
+                break;
+            case OPT_DISABLE:
+                if (control_parse_features(optarg, &config.disabled)) {
+                    fprintf(stderr, "Error: Invalid feature list: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case OPT_SRC_FILTER:
+                src_filter = optarg;
+                break;
+            case OPT_DST_FILTER:
+                dst_filter = optarg;
+                break;
+            case 'h':
+                usage(argv[0]);
+                return 0;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    /* --unpin：清理 pin 的 map 和 link 后退出，不需要接口参数 */
+    if (unpin)
+        return unpin_all(pin_dir ? pin_dir : DEFAULT_PIN_DIR) ? 1 : 0;
 
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <network_interface>\n", argv[0]);
-        fprintf(stderr, "Example: %s eth0\n", argv[0]);
+    if (optind >= argc || stats_interval <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    hist_enabled = hist_samples > 0 || hist_file;
+
+    /* 解析接口名与 glob 模式 */
+    mo.ifaces = &ifaces;
+    for (; optind < argc; optind++) {
+        err = iface_list_resolve(&ifaces, argv[optind]);
+        if (err < 0) {
+            fprintf(stderr, "Error: Failed to resolve interface %s: %s\n",
+                    argv[optind], strerror(-err));
+            return 1;
+        }
+        if (err == 0) {
+            fprintf(stderr, "Error: No interface matches %s\n", argv[optind]);
+            return 1;
+        }
+    }
+
+    /*
+     * 二进制模式：事件记录独占原来的 stdout，其余输出（printf 与 Netlink 文本）
+     * 全部重定向到 stderr，避免混入记录流
+     */
+    if (format == OUTPUT_BINARY) {
+        event_fd = dup(STDOUT_FILENO);
+        if (event_fd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+            fprintf(stderr, "Error: Failed to redirect stdout: %s\n", strerror(errno));
+            return 1;
+        }
+    }
+    if (output_init(&event_out, event_fd, format)) {
+        fprintf(stderr, "Error: Failed to allocate output buffer\n");
         return 1;
     }
+    if (format == OUTPUT_BINARY) {
+        if (output_init(&text_out, STDOUT_FILENO, OUTPUT_TEXT)) {
+            fprintf(stderr, "Error: Failed to allocate output buffer\n");
+            output_free(&event_out);
+            return 1;
+        }
+        mo.text = &text_out;
+    }
+
+    printf("╔════════════════════════════════════════════════════════╗\n");
+    printf("║   Integrated Network Monitor - Packet & ARP Tracker   ║\n");
+    printf("╚════════════════════════════════════════════════════════╝\n\n");
 
-    /* 获取网络接口索引 */
-    ifindex = if_nametoindex(argv[1]);
-    if (ifindex == 0) {
-        fprintf(stderr, "Error: Failed to get interface index for %s: %s\n",
-                argv[1], strerror(errno));
+    nr_cpus = libbpf_num_possible_cpus();
+    if (nr_cpus < 0) {
+        fprintf(stderr, "Error: Failed to get number of possible CPUs: %s\n",
+                strerror(-nr_cpus));
         return 1;
     }
 
     /* 设置 libbpf 日志级别 */
     libbpf_set_print(NULL);
 
-    /* 打开并加载 eBPF 对象文件 */
-    obj = bpf_object__open_file("src/monitor.bpf.o", NULL);
-    if (libbpf_get_error(obj)) {
-        fprintf(stderr, "Error: Failed to open BPF object file\n");
+    /* 打开嵌入在二进制中的 eBPF 对象（skeleton），不依赖工作目录 */
+    startup_ns[0] = now_ns();
+    skel = monitor_bpf__open();
+    if (!skel) {
+        fprintf(stderr, "Error: Failed to open BPF skeleton: %s\n", strerror(errno));
         return 1;
     }
+    startup_ns[1] = now_ns();
+
+    /* pin 模式：复用已 pin 的 map，新建的 map 在加载后 pin */
+    if (pin_dir) {
+        reused_maps = pin_maps_setup(skel->obj, pin_dir);
+        if (reused_maps < 0) {
+            fprintf(stderr, "Error: Failed to set up pinning under %s: %s\n",
+                    pin_dir, strerror(-reused_maps));
+            monitor_bpf__destroy(skel);
+            return 1;
+        }
+    }
 
     /* 加载 eBPF 程序到内核 */
-    err = bpf_object__load(obj);
+    err = monitor_bpf__load(skel);
     if (err) {
         fprintf(stderr, "Error: Failed to load BPF object: %s\n", strerror(-err));
-        bpf_object__close(obj);
+        if (pin_dir && reused_maps > 0)
+            fprintf(stderr, "       Pinned maps in %s may be incompatible with this build; "
+                    "run with --unpin to remove them\n", pin_dir);
+        monitor_bpf__destroy(skel);
         return 1;
     }
+    startup_ns[2] = now_ns();
+    if (reused_maps > 0)
+        printf("✓ Reusing %d pinned maps from %s (counters preserved)\n", reused_maps, pin_dir);
 
     /* 获取 eBPF 程序 */
-    prog = bpf_object__find_program_by_name(obj, "xdp_network_monitor");
-    if (!prog) {
-        fprintf(stderr, "Error: Failed to find BPF program\n");
-        bpf_object__close(obj);
-        return 1;
-    }
-
+    prog = skel->progs.xdp_network_monitor;
     prog_fd = bpf_program__fd(prog);
     if (prog_fd < 0) {
         fprintf(stderr, "Error: Failed to get program FD\n");
-        bpf_object__close(obj);
+        monitor_bpf__destroy(skel);
+        return 1;
+    }
+
+    /* 获取 map 文件描述符 */
+    maps.packet_count     = bpf_map__fd(skel->maps.packet_count);
+    maps.arp_statistics   = bpf_map__fd(skel->maps.arp_statistics);
+    maps.arp_events       = bpf_map__fd(skel->maps.arp_events);
+    maps.ethertype_stats  = bpf_map__fd(skel->maps.ethertype_stats);
+    maps.ipproto_stats    = bpf_map__fd(skel->maps.ipproto_stats);
+    maps.ip_stats         = bpf_map__fd(skel->maps.ip_stats);
+    maps.flow_stats       = bpf_map__fd(skel->maps.flow_stats);
+    maps.arp_aggregation  = bpf_map__fd(skel->maps.arp_aggregation);
+    maps.monitor_config   = bpf_map__fd(skel->maps.monitor_config);
+    maps.event_stats      = bpf_map__fd(skel->maps.event_stats);
+    maps.trusted_bindings = bpf_map__fd(skel->maps.trusted_bindings);
+    maps.enforce_stats    = bpf_map__fd(skel->maps.enforce_stats);
+    maps.dispatch         = bpf_map__fd(skel->maps.dispatch);
+    maps.arp_pending      = bpf_map__fd(skel->maps.arp_pending);
+    maps.arp_latency      = bpf_map__fd(skel->maps.arp_latency);
+    maps.ndp_statistics   = bpf_map__fd(skel->maps.ndp_statistics);
+    maps.ndp_events       = bpf_map__fd(skel->maps.ndp_events);
+    maps.ndp_aggregation  = bpf_map__fd(skel->maps.ndp_aggregation);
+    maps.vlan_stats       = bpf_map__fd(skel->maps.vlan_stats);
+    maps.filter_src       = bpf_map__fd(skel->maps.filter_src);
+    maps.filter_dst       = bpf_map__fd(skel->maps.filter_dst);
+    maps.filter_stats     = bpf_map__fd(skel->maps.filter_stats);
+
+    /* 强制模式：先加载静态绑定，邻居表中的绑定在 Netlink 初始化后学习 */
+    enforcer.map_fd = maps.trusted_bindings;
+    enforcer.ifaces = &ifaces;
+    if (binding_file && enforcer_load_file(&enforcer, binding_file, &ifaces)) {
+        monitor_bpf__destroy(skel);
+        return 1;
+    }
+
+    /* 抓包：附加前打开文件并创建 perf buffer，程序输出的帧不会因为没有读取方而丢失 */
+    if (capture_path) {
+        config.capture_snaplen = snaplen;
+        capture.dispatch_fd = maps.dispatch;
+        err = capture_init(&capture, capture_path, &ifaces,
+                           bpf_map__fd(skel->maps.capture_events), snaplen,
+                           rotate_bytes, rotate_count);
+        if (err) {
+            fprintf(stderr, "Error: Failed to start capture to %s: %s\n",
+                    capture_path, strerror(-err));
+            monitor_bpf__destroy(skel);
+            return 1;
+        }
+    }
+
+    /*
+     * 子网过滤：pin 模式复用的 trie 可能留有上次运行（或 "netmon config"）写入的前缀，
+     * 按命令行重新装载，未指定时清空
+     */
+    nsrc = control_load_subnets(maps.filter_src, src_filter ? src_filter : "");
+    ndst = control_load_subnets(maps.filter_dst, dst_filter ? dst_filter : "");
+    if (nsrc < 0 || ndst < 0 || (src_filter && nsrc == 0) || (dst_filter && ndst == 0)) {
+        fprintf(stderr, "Error: Failed to load subnet filter: %s\n",
+                strerror(nsrc < 0 ? -nsrc : ndst < 0 ? -ndst : EINVAL));
+        capture_free(&capture);
+        monitor_bpf__destroy(skel);
         return 1;
     }
+    config.subnet_filter = (src_filter ? FILTER_SRC : 0) | (dst_filter ? FILTER_DST : 0);
 
-    /* 将 XDP 程序附加到网络接口 */
-    err = bpf_xdp_attach(ifindex, prog_fd, XDP_FLAGS_UPDATE_IF_NOEXIST, NULL);
+    /* 写入采样、限速、强制模式、功能开关与抓包配置，为每个接口预先插入计数器 */
+    if (apply_monitor_config(maps.monitor_config, &config)) {
+        capture_free(&capture);
+        monitor_bpf__destroy(skel);
+        return 1;
+    }
+    /* 附加前装好协议处理程序，避免附加后短时间内漏计 */
+    err = dispatch_apply(maps.dispatch, skel->obj, handlers);
+    if (!err)
+        err = capture_slot(maps.dispatch, skel->obj, capture_path != NULL);
     if (err) {
-        fprintf(stderr, "Error: Failed to attach XDP program to %s: %s\n",
-                argv[1], strerror(-err));
-        bpf_object__close(obj);
+        fprintf(stderr, "Error: Failed to set up protocol dispatch: %s\n", strerror(-err));
+        capture_free(&capture);
+        monitor_bpf__destroy(skel);
+        return 1;
+    }
+    if ((err = iface_list_init_counters(&ifaces, maps.packet_count,
+                                        sizeof(struct traffic_counter))) ||
+        (err = iface_list_init_counters(&ifaces, maps.arp_statistics,
+                                        sizeof(struct arp_stats))) ||
+        (err = iface_list_init_counters(&ifaces, maps.ndp_statistics,
+                                        sizeof(struct ndp_stats)))) {
+        fprintf(stderr, "Error: Failed to initialize per-interface counters: %s\n",
+                strerror(-err));
+        capture_free(&capture);
+        monitor_bpf__destroy(skel);
         return 1;
     }
 
-    printf("✓ Successfully attached XDP program to %s\n", argv[1]);
+    /* 同一个程序附加到所有接口 */
+    if (iface_list_attach(&ifaces, prog, pin_dir, xdp_mode)) {
+        capture_free(&capture);
+        monitor_bpf__destroy(skel);
+        return 1;
+    }
+    startup_ns[3] = now_ns();
+    printf("✓ Startup: open %.2f ms, load %.2f ms, attach %.2f ms\n",
+           (startup_ns[1] - startup_ns[0]) / 1e6,
+           (startup_ns[2] - startup_ns[1]) / 1e6,
+           (startup_ns[3] - startup_ns[2]) / 1e6);
 
-    /* 获取 map 文件描述符 */
-    packet_map_fd = bpf_object__find_map_fd_by_name(obj, "packet_count");
-    if (packet_map_fd < 0) {
-        fprintf(stderr, "Error: Failed to find packet_count map\n");
-        bpf_xdp_detach(ifindex, XDP_FLAGS_UPDATE_IF_NOEXIST, NULL);
-        bpf_object__close(obj);
+    /* 为统计 map 预分配快照缓冲区 */
+    if (snapshots_init(&snaps, &maps, delta)) {
+        iface_list_abort(&ifaces);
+        capture_free(&capture);
+        monitor_bpf__destroy(skel);
         return 1;
     }
 
-    arp_stats_map_fd = bpf_object__find_map_fd_by_name(obj, "arp_statistics");
-    if (arp_stats_map_fd < 0) {
-        fprintf(stderr, "Error: Failed to find arp_statistics map\n");
-        bpf_xdp_detach(ifindex, XDP_FLAGS_UPDATE_IF_NOEXIST, NULL);
-        bpf_object__close(obj);
+    /* 聚合模式：为聚合表预分配快照缓冲区，用于定期输出汇总 */
+    if (config.agg_window_ms &&
+        (snapshot_init(&agg_snap, "arp_aggregation", maps.arp_aggregation, false) ||
+         snapshot_init(&ndp_agg_snap, "ndp_aggregation", maps.ndp_aggregation, false))) {
+        fprintf(stderr, "Error: Failed to create snapshot for aggregation maps\n");
+        snapshot_free(&agg_snap);
+        snapshots_free(&snaps);
+        iface_list_abort(&ifaces);
+        capture_free(&capture);
+        monitor_bpf__destroy(skel);
         return 1;
     }
 
-    arp_events_map_fd = bpf_object__find_map_fd_by_name(obj, "arp_events");
-    if (arp_events_map_fd < 0) {
-        fprintf(stderr, "Error: Failed to find arp_events map\n");
-        bpf_xdp_detach(ifindex, XDP_FLAGS_UPDATE_IF_NOEXIST, NULL);
-        bpf_object__close(obj);
+    /* 消费线程与主线程之间的事件队列及通知 eventfd */
+    consumer.queue = &queue;
+    consumer.ndp_queue = &ndp_queue;
+    consumer.notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    consumer.stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (spsc_init(&queue, EVENT_QUEUE_CAPACITY, sizeof(struct arp_event)) ||
+        spsc_init(&ndp_queue, EVENT_QUEUE_CAPACITY, sizeof(struct ndp_event)) ||
+        consumer.notify_fd < 0 || consumer.stop_fd < 0) {
+        fprintf(stderr, "Error: Failed to create event queue\n");
+        spsc_free(&queue);
+        snapshot_free(&ndp_agg_snap);
+        snapshot_free(&agg_snap);
+        snapshots_free(&snaps);
+        iface_list_abort(&ifaces);
+        capture_free(&capture);
+        monitor_bpf__destroy(skel);
         return 1;
     }
 
-    /* 创建 ring buffer 用于接收 ARP 事件 */
-    rb = ring_buffer__new(arp_events_map_fd, handle_arp_event, NULL, NULL);
-    if (!rb) {
+    /* 创建 ring buffer 用于接收 ARP/NDP 事件，回调在消费线程中把事件放入各自的队列 */
+    rb = ring_buffer__new(maps.arp_events, handle_ring_event, &queue, NULL);
+    if (!rb || ring_buffer__add(rb, maps.ndp_events, handle_ring_event, &ndp_queue)) {
         fprintf(stderr, "Error: Failed to create ring buffer\n");
-        bpf_xdp_detach(ifindex, XDP_FLAGS_UPDATE_IF_NOEXIST, NULL);
-        bpf_object__close(obj);
+        if (rb)
+            ring_buffer__free(rb);
+        spsc_free(&ndp_queue);
+        spsc_free(&queue);
+        snapshot_free(&ndp_agg_snap);
+        snapshot_free(&agg_snap);
+        snapshots_free(&snaps);
+        iface_list_abort(&ifaces);
+        capture_free(&capture);
+        monitor_bpf__destroy(skel);
         return 1;
     }
 
-    /* 创建 Netlink 套接字监听 ARP 表变化 */
-    netlink_sock = create_netlink_socket();
-    if (netlink_sock < 0) {
+    /* 启动步骤均已成功，不再回滚附加 */
+    iface_list_commit(&ifaces);
+
+    /* 创建 Netlink 套接字监听 ARP 表变化，并 dump 当前邻居表 */
+    if (netlink_init(&nl) < 0) {
         printf("⚠ Warning: ARP table monitoring disabled (Netlink socket creation failed)\n");
     }
 
+    /* 从邻居表学习可信绑定，之后随邻居表变化同步 */
+    if (enforcer.learn) {
+        if (nl.sock >= 0) {
+            enforcer_learn_all(&enforcer, &nl.table);
+            nl.enforcer = &enforcer;
+        } else {
+            printf("⚠ Warning: Cannot learn trusted bindings without the neighbor table\n");
+        }
+    }
+
+    /* ARP 欺骗/冲突检测：在格式化线程上处理事件，并与邻居表变化关联 */
+    if (detect) {
+        if (detector_init(&detector, nl.sock >= 0 ? &nl.table : NULL, mo.text) < 0) {
+            printf("⚠ Warning: ARP detector disabled (out of memory)\n");
+        } else {
+            nl.detector = &detector;
+            mo.detector = &detector;
+        }
+    }
+
+    /* 采样历史：失败时只是不显示速率，不影响其他监控 */
+    if (hist_enabled) {
+        err = history_init(&history, hist_samples, hist_resolution);
+        if (!err)
+            err = history_source_init(&hist_src, &maps);
+        if (!err && hist_file) {
+            err = history_open_file(&history, hist_file,
+                                    (uint64_t)hist_retention * 3600 / hist_resolution);
+            if (err == -EINVAL)
+                printf("⚠ Warning: History file disabled (%s: not a history file, or created with a "
+                       "different --history-resolution/--history-retention)\n", hist_file);
+            else if (err)
+                printf("⚠ Warning: History file disabled (%s: %s)\n", hist_file, strerror(-err));
+            err = 0;
+            if (history.fd < 0)
+                hist_file = NULL;
+        }
+        if (err) {
+            printf("⚠ Warning: Sample history disabled (out of memory)\n");
+            history_free(&history);
+            history_source_free(&hist_src);
+            hist_enabled = false;
+        } else {
+            uint64_t counters[HISTORY_NR_COUNTERS];
+
+            /* 第一个采样只建立基准 */
+            history_source_read(&hist_src, counters);
+            history_add(&history, counters, 0, now_ns());
+        }
+    }
+
     printf("✓ Monitoring enabled:\n");
-    printf("  • Packet counter: All packets\n");
-    printf("  • ARP packets: Requests/Replies via XDP\n");
-    if (netlink_sock >= 0) {
-        printf("  • ARP table: Add/Update/Delete via Netlink\n");
+    printf("  • Packet counter: All packets (packets and bytes)\n");
+    printf("  • Traffic accounting: EtherType%s\n",
+           handlers & (1U << DISPATCH_IPV4) ? ", IP protocol, source IP, 5-tuple flow" : "");
+    if (handlers & (1U << DISPATCH_ARP))
+        printf("  • ARP packets: Requests/Replies via XDP\n");
+    else
+        printf("  • ARP packets: handler disabled (-H)\n");
+    if (handlers & (1U << DISPATCH_IPV6))
+        printf("  • IPv6 Neighbor Discovery: RS/RA/NS/NA via XDP\n");
+    if (handlers & (1U << DISPATCH_VLAN))
+        printf("  • VLAN: 802.1Q/802.1ad (up to 2 tags), per-VLAN packets/bytes/ARP\n");
+    if (config.disabled) {
+        char features[128];
+
+        printf("  • Disabled features: %s\n",
+               control_format_features(config.disabled, features, sizeof(features)));
     }
+    if (src_filter)
+        printf("  • Source filter: %s (IPv4 accounting, ARP latency/events)\n", src_filter);
+    if (dst_filter)
+        printf("  • Destination filter: %s (IPv4 accounting, ARP latency/events)\n", dst_filter);
+    if (pin_dir)
+        printf("  • Runtime control: %s config --pin-path %s ...\n", argv[0], pin_dir);
+    if (config.sample_rate > 1)
+        printf("  • ARP/NDP event sampling: 1 in %u\n", config.sample_rate);
+    if (config.agg_window_ms)
+        printf("  • ARP/NDP event aggregation: %u ms window\n", config.agg_window_ms);
+    if (config.rate_limit_pps)
+        printf("  • ARP/NDP event rate limit: %u/s per source (burst %u)\n",
+               config.rate_limit_pps, config.rate_limit_burst);
+    if (nl.sock >= 0) {
+        printf("  • ARP/NDP table: Add/Update/Delete via Netlink (%u entries, SIGUSR1 to dump)\n",
+               nl.table.count);
+    }
+    if (consumer.cpu >= 0 || formatter_cpu >= 0)
+        printf("  • Threads: consumer on CPU %d, formatter on CPU %d (-1 = unpinned)\n",
+               consumer.cpu, formatter_cpu);
+    if (config.enforce)
+        printf("  • ARP enforcement: dropping mismatched replies/GARPs (%u static, %u learned bindings)\n",
+               enforcer.static_count, enforcer.learned);
+    if (metrics_addr) {
+        err = exporter_init(&exporter, metrics_addr);
+        if (err) {
+            printf("⚠ Warning: Metrics endpoint disabled (%s: %s)\n", metrics_addr, strerror(-err));
+            metrics_addr = NULL;
+        } else {
+            render_metrics(&exporter, &metrics, &snaps, &queue, &ndp_queue, &ifaces, &nl,
+                           config.enforce ? &enforcer : NULL, capture_path ? &capture : NULL);
+            printf("  • Metrics: OpenMetrics on http://%s%s%s/metrics (refreshed every %ds)\n",
+                   strchr(metrics_addr, ':') ? "" : EXPORTER_DEFAULT_ADDR,
+                   strchr(metrics_addr, ':') ? "" : ":", metrics_addr, stats_interval);
+        }
+    }
+    if (mo.detector)
+        printf("  • ARP detector: MAC flips, duplicate IPs, GARP floods, unsolicited replies%s\n",
+               nl.sock >= 0 ? ", neighbor mismatches" : "");
+    if (capture_path)
+        printf("  • Capture: %s%s (snaplen %u%s)\n", capture_path, rotate_bytes ? ".N" : "",
+               snaplen, capture.writer.direct ? ", O_DIRECT" : "");
+    if (hist_enabled && hist_samples)
+        printf("  • Rates: %us samples, peaks over the last %us\n",
+               hist_resolution, hist_resolution * hist_samples);
+    if (hist_file)
+        printf("  • History file: %s (%u hours, %lu samples written)\n", hist_file,
+               hist_retention, (unsigned long)history.hdr->written);
+    if (format == OUTPUT_BINARY)
+        printf("  • ARP event output: binary records (%zu bytes each), NDP events as text on stderr\n",
+               sizeof(struct arp_event));
     printf("\nPress Ctrl+C to stop\n");
     printf("════════════════════════════════════════════════════════\n\n");
+    fflush(stdout);
 
     /* 设置信号处理器 */
     signal(SIGINT, sig_handler);
     signal(SIGTERM, sig_handler);
+    signal(SIGUSR1, sig_handler);
 
-    /* 主循环：监听 ARP 事件和 Netlink 消息 */
-    time_t last_stats_time = time(NULL);
-    while (keep_running) {
-        fd_set readfds;
-        struct timeval tv;
-        int maxfd;
+    /* 启动消费线程和抓包线程，信号只由主线程处理 */
+    consumer.rb = rb;
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGINT);
+    sigaddset(&sigs, SIGTERM);
+    sigaddset(&sigs, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &sigs, &old_sigs);
+    err = pthread_create(&consumer.thread, NULL, consumer_thread, &consumer);
+    consumer_started = !err;
+    if (!err && capture_path) {
+        err = pthread_create(&capture.thread, NULL, capture_thread, &capture);
+        capture_started = !err;
+    }
+    pthread_sigmask(SIG_SETMASK, &old_sigs, NULL);
+    if (err) {
+        fprintf(stderr, "Error: Failed to start %s thread: %s\n",
+                consumer_started ? "capture" : "consumer", strerror(err));
+        keep_running = 0;
+    }
+    if (consumer_started &&
+        (pin_thread(consumer.thread, consumer.cpu) ||
+         pin_thread(pthread_self(), formatter_cpu))) {
+        fprintf(stderr, "Warning: Failed to pin threads to CPUs %d/%d\n",
+                consumer.cpu, formatter_cpu);
+    }
 
-        FD_ZERO(&readfds);
-        maxfd = -1;
+    /* 创建 epoll 集合：Netlink、事件队列通知和统计定时器 */
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    timer_fd = create_stats_timer(stats_interval);
+    if (epfd < 0 || timer_fd < 0 ||
+        epoll_add(epfd, consumer.notify_fd, EV_QUEUE) < 0 ||
+        epoll_add(epfd, timer_fd, EV_STATS_TIMER) < 0 ||
+        (nl.sock >= 0 && epoll_add(epfd, nl.sock, EV_NETLINK) < 0) ||
+        (metrics_addr && epoll_add(epfd, exporter_fd(&exporter), EV_EXPORTER) < 0)) {
+        fprintf(stderr, "Error: Failed to set up event loop: %s\n", strerror(errno));
+        keep_running = 0;
+    }
+    if (hist_enabled &&
+        ((hist_timer_fd = create_stats_timer(hist_resolution)) < 0 ||
+         epoll_add(epfd, hist_timer_fd, EV_HISTORY_TIMER) < 0)) {
+        fprintf(stderr, "Error: Failed to set up event loop: %s\n", strerror(errno));
+        keep_running = 0;
+    }
 
-        /* 添加 Netlink socket 到 select */
-        if (netlink_sock >= 0) {
-            FD_SET(netlink_sock, &readfds);
-            if (netlink_sock > maxfd)
-                maxfd = netlink_sock;
-        }
+    /* 主循环：格式化队列中的 ARP 事件，处理 Netlink 消息和统计定时器 */
+    while (keep_running) {
+        struct epoll_event events[8];
+        int timeout = monitor_output_pending(&mo) ? RB_FLUSH_INTERVAL_MS : -1;
+        int n, i;
 
-        /* 设置超时 */
-        tv.tv_sec = 0;
-        tv.tv_usec = 100000; /* 100ms */
+        /* SIGUSR1：输出当前邻居表（信号会让 epoll_wait 返回 EINTR） */
+        if (dump_requested) {
+            dump_requested = 0;
+            if (nl.sock >= 0) {
+                monitor_output_flush(&mo);
+                dump_neigh_table(&nl);
+                fflush(stdout);
+            }
+        }
 
-        int ret = select(maxfd + 1, &readfds, NULL, NULL, &tv);
-        if (ret < 0) {
+        n = epoll_wait(epfd, events, sizeof(events) / sizeof(events[0]), timeout);
+        if (n < 0) {
             if (errno == EINTR)
                 continue;
-            fprintf(stderr, "Error: select failed: %s\n", strerror(errno));
+            fprintf(stderr, "Error: epoll_wait failed: %s\n", strerror(errno));
             break;
         }
 
-        /* 处理 Netlink ARP 表事件 */
-        if (netlink_sock >= 0 && FD_ISSET(netlink_sock, &readfds)) {
-            handle_netlink_arp(netlink_sock);
+        /* 超时：写出滞留的输出 */
+        if (n == 0) {
+            monitor_output_flush(&mo);
+            continue;
         }
 
-        /* 轮询 ring buffer 中的 XDP ARP 事件 */
-        err = ring_buffer__poll(rb, 0);
-        if (err < 0 && err != -EINTR) {
-            fprintf(stderr, "Error: Failed to poll ring buffer: %s\n", strerror(-err));
-            break;
-        }
+        for (i = 0; i < n; i++) {
+            switch (events[i].data.u32) {
+                case EV_NETLINK:
+                    /* 处理 Netlink ARP 表事件 */
+                    handle_netlink_arp(&nl, mo.text);
+                    break;
+
+                case EV_QUEUE: {
+                    uint64_t pending;
+
+                    /* 格式化消费线程放入队列的 XDP ARP 事件 */
+                    if (read(consumer.notify_fd, &pending, sizeof(pending)) < 0)
+                        break;
+                    drain_event_queue(&queue, &mo);
+                    drain_ndp_queue(&ndp_queue, &mo);
+                    break;
+                }
+
+                case EV_STATS_TIMER: {
+                    uint64_t expirations;
+
+                    if (read(timer_fd, &expirations, sizeof(expirations)) < 0)
+                        break;
+                    drain_event_queue(&queue, &mo);
+                    drain_ndp_queue(&ndp_queue, &mo);
+                    monitor_output_flush(&mo);
+                    if (config.agg_window_ms) {
+                        flush_arp_aggregation(&agg_snap, &ifaces, config.agg_window_ms * 1000000ULL, false);
+                        flush_ndp_aggregation(&ndp_agg_snap, &ifaces, config.agg_window_ms * 1000000ULL, false);
+                    }
+                    arp_latency_sweep(&snaps, &maps, now_ns());
+                    display_statistics(&snaps, &queue, &ndp_queue, &ifaces, &nl,
+                                       config.enforce ? &enforcer : NULL,
+                                       capture_path ? &capture : NULL, top_n);
+                    if (hist_enabled)
+                        display_rates(&history, stats_interval);
+                    fflush(stdout);
+                    /* 导出器只提供这里渲染的快照，抓取不读取 BPF map */
+                    if (metrics_addr)
+                        render_metrics(&exporter, &metrics, &snaps, &queue, &ndp_queue, &ifaces, &nl,
+                                       config.enforce ? &enforcer : NULL,
+                                       capture_path ? &capture : NULL);
+                    break;
+                }
 
-        /* 每 10 秒显示一次统计信息 */
-        time_t now = time(NULL);
-        if (now - last_stats_time >= 10) {
-            display_statistics(packet_map_fd, arp_stats_map_fd);
-            last_stats_time = now;
+                case EV_HISTORY_TIMER: {
+                    uint64_t expirations, counters[HISTORY_NR_COUNTERS];
+                    struct timespec real;
+
+                    if (read(hist_timer_fd, &expirations, sizeof(expirations)) < 0)
+                        break;
+                    history_source_read(&hist_src, counters);
+                    clock_gettime(CLOCK_REALTIME, &real);
+                    history_add(&history, counters,
+                                (uint64_t)real.tv_sec * 1000000000ULL + real.tv_nsec, now_ns());
+                    break;
+                }
+
+                case EV_EXPORTER:
+                    exporter_handle(&exporter);
+                    break;
+            }
         }
+
+        /* 输出缓冲区写满时会自动刷新，这里保证事件的最大滞留时间 */
+        uint64_t now = now_ns();
+        output_flush_if_due(mo.events, now, OUTPUT_FLUSH_INTERVAL_NS);
+        output_flush_if_due(mo.text, now, OUTPUT_FLUSH_INTERVAL_NS);
+    }
+
+    /* 停止消费线程（退出前会做最后一次消费），写出剩余事件，之后的关闭信息才不会和事件交错 */
+    if (consumer_started) {
+        notify(consumer.stop_fd);
+        pthread_join(consumer.thread, NULL);
+    }
+    drain_event_queue(&queue, &mo);
+    drain_ndp_queue(&ndp_queue, &mo);
+    monitor_output_flush(&mo);
+
+    /* 先移除抓包程序，再停止抓包线程（退出前会消费剩余的帧） */
+    if (capture_path)
+        capture_slot(maps.dispatch, skel->obj, false);
+    if (capture_started) {
+        notify(capture.stop_fd);
+        pthread_join(capture.thread, NULL);
     }
 
     printf("\n\n════════════════════════════════════════════════════════\n");
     printf("Shutting down...\n");
 
-    /* 显示最终统计 */
-    display_statistics(packet_map_fd, arp_stats_map_fd);
+    /* 输出剩余的聚合汇总并显示最终统计 */
+    if (config.agg_window_ms) {
+        flush_arp_aggregation(&agg_snap, &ifaces, config.agg_window_ms * 1000000ULL, true);
+        flush_ndp_aggregation(&ndp_agg_snap, &ifaces, config.agg_window_ms * 1000000ULL, true);
+    }
+    arp_latency_sweep(&snaps, &maps, now_ns());
+    display_statistics(&snaps, &queue, &ndp_queue, &ifaces, &nl, config.enforce ? &enforcer : NULL,
+                       capture_path ? &capture : NULL, top_n);
+    if (hist_enabled)
+        display_rates(&history, stats_interval);
 
     /* 清理 */
-    if (netlink_sock >= 0)
-        close(netlink_sock);
+    if (timer_fd >= 0)
+        close(timer_fd);
+    if (hist_timer_fd >= 0)
+        close(hist_timer_fd);
+    if (hist_enabled) {
+        history_free(&history);
+        history_source_free(&hist_src);
+    }
+    if (epfd >= 0)
+        close(epfd);
+    netlink_free(&nl);
+    if (metrics_addr)
+        exporter_free(&exporter);
+    if (mo.detector)
+        detector_free(&detector);
     if (rb)
         ring_buffer__free(rb);
-    bpf_xdp_detach(ifindex, XDP_FLAGS_UPDATE_IF_NOEXIST, NULL);
-    bpf_object__close(obj);
+    if (capture_free(&capture))
+        fprintf(stderr, "Error: Failed to finish capture file %s\n", capture.writer.file);
+    close(consumer.notify_fd);
+    close(consumer.stop_fd);
+    spsc_free(&queue);
+    spsc_free(&ndp_queue);
+    snapshot_free(&agg_snap);
+    snapshot_free(&ndp_agg_snap);
+    snapshots_free(&snaps);
+    output_free(&event_out);
+    if (mo.text != mo.events)
+        output_free(&text_out);
+    iface_list_detach(&ifaces);
+    iface_list_free(&ifaces);
+    monitor_bpf__destroy(skel);
+    if (pin_dir)
+        printf("✓ XDP program left attached, maps and links pinned in %s\n", pin_dir);
 
     printf("✓ Program terminated successfully\n");
     return 0;
@@ -1,18 +1,99 @@
-#include <linux/bpf.h>
-#include <linux/if_ether.h>
-#include <linux/if_arp.h>
-#include <linux/ip.h>
+#include "vmlinux.h"
 #include <bpf/bpf_helpers.h>
 #include <bpf/bpf_endian.h>
 
-/* 全局数据包计数器 */
+/*
+ * 内核类型来自 vmlinux.h（由 BTF 生成，不依赖内核头文件包）。
+ * 只访问报文头和 xdp_md 这类 UAPI 稳定布局，无需 BPF_CORE_READ 重定位；
+ * uapi 头文件中的宏不在 BTF 里，这里补齐用到的几个。
+ */
+#define ETH_P_IP        0x0800
+#define ETH_P_ARP       0x0806
+#define ARPHRD_ETHER    1
+#define ARPOP_REQUEST   1
+#define ARPOP_REPLY     2
+#define ARPOP_RREQUEST  3
+#define ARPOP_RREPLY    4
+#ifndef NULL
+#define NULL            ((void *)0)
+#endif
+
+/*
+ * 计数器布局：默认使用按 ifindex 索引的 per-CPU 哈希表，每个 CPU 独占一份计数器，
+ * 快速路径上只需普通自增，多队列网卡下不会争用同一缓存行。
+ * 定义 NETMON_SHARED_COUNTERS 时退回旧的共享数组 + 原子加布局（以 ifindex 为下标，
+ * ifindex 不小于 MAX_INTERFACES 的接口不计数），仅用于基准测试对比（见 bench/xdp_bench.c）。
+ */
+#ifdef NETMON_SHARED_COUNTERS
+#define COUNTER_MAP_TYPE    BPF_MAP_TYPE_ARRAY
+#define counter_add(p, v)   __sync_fetch_and_add((p), (v))
+#else
+#define COUNTER_MAP_TYPE    BPF_MAP_TYPE_PERCPU_HASH
+#define counter_add(p, v)   (*(p) += (v))
+#endif
+
+/* 同一对象可附加的最大接口数（按 ifindex 计数的 map 容量） */
+#define MAX_INTERFACES 1024
+
+/* IPv4 分片偏移掩码（内核内部的 IP_OFFSET 不在 uapi 头文件中） */
+#define IP_FRAG_OFFSET_MASK 0x1FFF
+
+/* 流量计数：包数与字节数 */
+struct traffic_counter {
+    __u64 packets;
+    __u64 bytes;
+};
+
+/* IPv4 五元组流标识（网络字节序） */
+struct flow_key {
+    __u32 saddr;
+    __u32 daddr;
+    __u16 sport;
+    __u16 dport;
+    __u8 proto;
+    __u8 pad[3];
+};
+
+/* 按接收接口（ifindex）统计的数据包计数器（包数与字节数） */
 struct {
-    __uint(type, BPF_MAP_TYPE_ARRAY);
-    __uint(max_entries, 1);
+    __uint(type, COUNTER_MAP_TYPE);
+    __uint(max_entries, MAX_INTERFACES);
     __type(key, __u32);
-    __type(value, __u64);
+    __type(value, struct traffic_counter);
 } packet_count SEC(".maps");
 
+/* 按 EtherType 统计（主机字节序） */
+struct {
+    __uint(type, BPF_MAP_TYPE_LRU_PERCPU_HASH);
+    __uint(max_entries, 256);
+    __type(key, __u16);
+    __type(value, struct traffic_counter);
+} ethertype_stats SEC(".maps");
+
+/* 按 IP 协议号统计 */
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, 256);
+    __type(key, __u32);
+    __type(value, struct traffic_counter);
+} ipproto_stats SEC(".maps");
+
+/* 按 IPv4 源地址统计 */
+struct {
+    __uint(type, BPF_MAP_TYPE_LRU_PERCPU_HASH);
+    __uint(max_entries, 16384);
+    __type(key, __u32);
+    __type(value, struct traffic_counter);
+} ip_stats SEC(".maps");
+
+/* 按五元组流统计 */
+struct {
+    __uint(type, BPF_MAP_TYPE_LRU_PERCPU_HASH);
+    __uint(max_entries, 65536);
+    __type(key, struct flow_key);
+    __type(value, struct traffic_counter);
+} flow_stats SEC(".maps");
+
 /* ARP 操作类型统计 */
 struct arp_stats {
     __u64 arp_request;   /* ARP 请求 */
@@ -22,10 +103,10 @@ struct arp_stats {
     __u64 total_packets; /* 总 ARP 包数 */
 };
 
-/* 定义一个 eBPF Map 用于存储 ARP 统计信息 */
+/* 按接收接口（ifindex）存储 ARP 统计信息 */
 struct {
-    __uint(type, BPF_MAP_TYPE_ARRAY);
-    __uint(max_entries, 1);
+    __uint(type, COUNTER_MAP_TYPE);
+    __uint(max_entries, MAX_INTERFACES);
     __type(key, __u32);
     __type(value, struct arp_stats);
 } arp_statistics SEC(".maps");
@@ -38,6 +119,9 @@ struct arp_event {
     __u8 dst_mac[6];     /* 目标 MAC 地址 */
     __u16 opcode;        /* ARP 操作码 */
     __u64 timestamp;     /* 时间戳 */
+    __u64 first_seen;    /* 聚合模式下本事件覆盖的起始时间 */
+    __u32 count;         /* 聚合模式下本事件代表的 ARP 包数 */
+    __u32 ifindex;       /* 接收接口 */
 };
 
 /* Ring buffer 用于传递 ARP 事件到用户空间 */
@@ -46,127 +130,1311 @@ struct {
     __uint(max_entries, 256 * 1024); /* 256KB */
 } arp_events SEC(".maps");
 
-/* 整合的 XDP 程序：同时监控所有数据包和 ARP */
+/* 积压超过约 64 个事件（每条记录含 8 字节头）时强制唤醒消费者 */
+#define RB_WAKEUP_BATCH_EVENTS 64
+
+/*
+ * 自适应唤醒：需在写入事件之前调用。
+ * 缓冲区为空时使用默认策略（消费者已追上，内核会唤醒它），稀疏事件延迟最低；
+ * 已有未消费数据时消费者已被通知，不再重复唤醒，ARP 风暴下避免每个事件一次唤醒；
+ * 积压超过一批时强制唤醒，防止消费者长时间不处理。
+ */
+static __always_inline __u64 ringbuf_wakeup_flags(void *rb, __u64 event_size)
+{
+    __u64 avail = bpf_ringbuf_query(rb, BPF_RB_AVAIL_DATA);
+
+    if (avail == 0)
+        return 0;
+    if (avail >= RB_WAKEUP_BATCH_EVENTS * (event_size + 8))
+        return BPF_RB_FORCE_WAKEUP;
+    return BPF_RB_NO_WAKEUP;
+}
+
+/* 运行时配置（由用户空间写入，单条目） */
+struct monitor_config {
+    __u32 sample_rate;      /* 事件 1-in-N 采样，0 或 1 表示全部上报 */
+    __u32 rate_limit_pps;   /* 每个源（MAC + IP）每 CPU 每秒事件数，0 表示不限速 */
+    __u32 rate_limit_burst; /* 令牌桶容量 */
+    __u32 agg_window_ms;    /* 聚合窗口（毫秒），0 表示不聚合 */
+    __u32 enforce;          /* 非 0 时丢弃违反可信绑定的 ARP 应答与免费 ARP */
+    __u32 capture_snaplen;  /* 抓包时每帧复制的最大字节数，0 表示不抓包 */
+    __u16 capture_ethertype; /* 只抓该 EtherType 的帧（主机字节序），0 表示全部 */
+    __u16 capture_arp_op;   /* 只抓该操作码的 ARP 帧，0 表示全部 */
+    __u32 disabled;         /* 关闭的功能（FEATURE_*），0 表示全部启用 */
+    __u32 subnet_filter;    /* 启用的子网过滤（FILTER_SRC/FILTER_DST） */
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, __u32);
+    __type(value, struct monitor_config);
+} monitor_config SEC(".maps");
+
+/*
+ * 功能开关（monitor_config.disabled 中的位），与 include/arp_monitor.h 一致。
+ * 按接口、EtherType 与 ARP/NDP 类型的计数不受开关影响，始终精确。
+ */
+#define FEATURE_IP_STATS    0x01    /* IPv4 协议与源地址统计 */
+#define FEATURE_FLOW_STATS  0x02    /* IPv4 五元组流统计 */
+#define FEATURE_ARP_EVENTS  0x04    /* ARP 事件上报 */
+#define FEATURE_NDP_EVENTS  0x08    /* NDP 事件上报 */
+#define FEATURE_ARP_LATENCY 0x10    /* ARP 解析时延 */
+#define FEATURE_VLAN_STATS  0x20    /* 按 VLAN 统计 */
+
+/*
+ * 子网过滤：启用后只统计/上报源（目标）地址落在 filter_src（filter_dst）中某个前缀内的
+ * IPv4 流量与 ARP（ARP 按发送方/目标协议地址匹配）。未启用时只多一次标志判断，
+ * 不查找 LPM trie。
+ */
+#define FILTER_SRC          0x1
+#define FILTER_DST          0x2
+
+/* LPM trie key：前缀长度 + IPv4 地址（网络字节序） */
+struct subnet_key {
+    __u32 prefixlen;
+    __u32 addr;
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_LPM_TRIE);
+    __uint(max_entries, 1024);
+    __uint(map_flags, BPF_F_NO_PREALLOC);
+    __type(key, struct subnet_key);
+    __type(value, __u32);
+} filter_src SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_LPM_TRIE);
+    __uint(max_entries, 1024);
+    __uint(map_flags, BPF_F_NO_PREALLOC);
+    __type(key, struct subnet_key);
+    __type(value, __u32);
+} filter_dst SEC(".maps");
+
+/* 被子网过滤跳过的报文数 */
+struct filter_stats {
+    __u64 ipv4_filtered;
+    __u64 arp_filtered;
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, __u32);
+    __type(value, struct filter_stats);
+} filter_stats SEC(".maps");
+
+/* 地址对通过子网过滤时返回 1；未启用过滤时只有一次标志判断 */
+static __always_inline int subnet_filter_pass(const struct monitor_config *cfg,
+                                              __u32 saddr, __u32 daddr)
+{
+    struct subnet_key key = {
+        .prefixlen = 32,
+    };
+
+    if (!cfg->subnet_filter)
+        return 1;
+    if (cfg->subnet_filter & FILTER_SRC) {
+        key.addr = saddr;
+        if (!bpf_map_lookup_elem(&filter_src, &key))
+            return 0;
+    }
+    if (cfg->subnet_filter & FILTER_DST) {
+        key.addr = daddr;
+        if (!bpf_map_lookup_elem(&filter_dst, &key))
+            return 0;
+    }
+    return 1;
+}
+
+/* 记录一次被过滤的报文 */
+static __always_inline void filter_count(int arp)
+{
+    struct filter_stats *fs;
+    __u32 zero = 0;
+
+    fs = bpf_map_lookup_elem(&filter_stats, &zero);
+    if (!fs)
+        return;
+    if (arp)
+        fs->arp_filtered++;
+    else
+        fs->ipv4_filtered++;
+}
+
+/* 事件上报统计：统计计数始终精确，只有事件投递受采样和限速影响 */
+struct event_stats {
+    __u64 submitted;     /* 成功提交到 ring buffer */
+    __u64 sampled_out;   /* 采样丢弃 */
+    __u64 rate_limited;  /* 令牌桶限速丢弃 */
+    __u64 ringbuf_full;  /* ring buffer 已满丢弃 */
+    __u64 aggregated;    /* 聚合窗口内被合并的重复事件 */
+};
+
+/* event_stats 索引：ARP 与 NDP 事件分别统计 */
+#define EVENT_SRC_ARP       0
+#define EVENT_SRC_NDP       1
+#define EVENT_SRC_CAPTURE   2
+#define EVENT_SRC_MAX       3
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, EVENT_SRC_MAX);
+    __type(key, __u32);
+    __type(value, struct event_stats);
+} event_stats SEC(".maps");
+
+/* 可信绑定 key：(接收接口, IPv4 地址，网络字节序) */
+struct binding_key {
+    __u32 ifindex;
+    __u32 ip;
+};
+
+/* 可信绑定：IP 对应的 MAC */
+struct binding_value {
+    __u8 mac[6];
+    __u16 flags;        /* BINDING_STATIC 等，仅用户空间使用 */
+};
+
+/* 可信 IP -> MAC 绑定，由用户空间从静态文件或邻居表填充 */
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(max_entries, 16384);
+    __type(key, struct binding_key);
+    __type(value, struct binding_value);
+} trusted_bindings SEC(".maps");
+
+/* 强制模式统计，按丢弃原因分别计数 */
+struct enforce_stats {
+    __u64 checked;          /* 检查过的 ARP 应答与免费 ARP */
+    __u64 unknown;          /* 没有可信绑定，放行 */
+    __u64 reply_mismatch;   /* 应答的发送方 MAC 与可信绑定不一致 */
+    __u64 garp_mismatch;    /* 免费 ARP 的发送方 MAC 与可信绑定不一致 */
+    __u64 sha_mismatch;     /* 以太网源地址与 ARP 发送方硬件地址不一致（只计数，不丢弃） */
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(max_entries, 1);
+    __type(key, __u32);
+    __type(value, struct enforce_stats);
+} enforce_stats SEC(".maps");
+
+/*
+ * ARP 解析时延：直方图按 log2(微秒) 分桶，桶 i 覆盖 [2^i, 2^(i+1)) 微秒（桶 0 含 0–1 微秒）。
+ * slot 为 ARP_LATENCY_TIMEOUT 的条目计数超时的请求，ARP_LATENCY_EXPIRED 由用户空间清扫时写入。
+ */
+#define ARP_LATENCY_SLOTS       24
+#define ARP_LATENCY_TIMEOUT     ARP_LATENCY_SLOTS
+#define ARP_LATENCY_EXPIRED     (ARP_LATENCY_SLOTS + 1)
+#define ARP_RESOLVE_TIMEOUT_NS  (3ULL * 1000000000ULL)
+
+/* 未应答的请求：(目标 IP, 请求方 IP)，网络字节序 */
+struct arp_pending_key {
+    __u32 target_ip;
+    __u32 requester_ip;
+};
+
+struct arp_pending_value {
+    __u64 timestamp;    /* 第一次请求的时间（bpf_ktime_get_ns） */
+    __u32 ifindex;      /* 请求到达的接口，时延计入该接口 */
+    __u32 pad;
+};
+
+/* 请求与应答可能由不同 CPU 处理，使用共享的 LRU 表 */
+struct {
+    __uint(type, BPF_MAP_TYPE_LRU_HASH);
+    __uint(max_entries, 16384);
+    __type(key, struct arp_pending_key);
+    __type(value, struct arp_pending_value);
+} arp_pending SEC(".maps");
+
+/* 直方图桶：(接口, 桶序号) */
+struct arp_latency_key {
+    __u32 ifindex;
+    __u32 slot;
+};
+
+/* 值为 traffic_counter：packets 为次数，bytes 为时延之和（纳秒） */
+struct {
+    __uint(type, BPF_MAP_TYPE_LRU_PERCPU_HASH);
+    __uint(max_entries, 4096);
+    __type(key, struct arp_latency_key);
+    __type(value, struct traffic_counter);
+} arp_latency SEC(".maps");
+
+/* ARP 聚合 key：(接收接口, 源 IP, 目标 IP, 操作码) */
+struct arp_agg_key {
+    __u32 src_ip;
+    __u32 dst_ip;
+    __u32 ifindex;
+    __u16 opcode;
+    __u16 pad;
+};
+
+/* ARP 聚合状态 */
+struct arp_agg_value {
+    __u64 count;         /* 当前窗口内被合并、尚未上报的次数 */
+    __u64 first_seen;    /* 元组首次出现时间 */
+    __u64 last_seen;     /* 最近一次出现时间 */
+    __u64 window_start;  /* 当前窗口起始时间（上次上报时间） */
+};
+
+/* 聚合表，用户空间定期清理空闲条目并输出汇总 */
+struct {
+    __uint(type, BPF_MAP_TYPE_LRU_HASH);
+    __uint(max_entries, 16384);
+    __type(key, struct arp_agg_key);
+    __type(value, struct arp_agg_value);
+} arp_aggregation SEC(".maps");
+
+/*
+ * ARP/NDP 共用的聚合窗口：map 的值为 struct arp_agg_value。
+ * 新元组或窗口到期时返回 1 并填写 first_seen/count，窗口内的重复事件只累加计数并返回 0。
+ */
+static __always_inline int agg_window(void *map, const void *key, __u64 now, __u64 window_ns,
+                                      __u64 *first_seen, __u32 *count)
+{
+    struct arp_agg_value *v;
+
+    v = bpf_map_lookup_elem(map, key);
+    if (!v) {
+        struct arp_agg_value init = {
+            .first_seen = now,
+            .last_seen = now,
+            .window_start = now,
+        };
+
+        if (bpf_map_update_elem(map, key, &init, BPF_NOEXIST) == 0) {
+            *first_seen = now;
+            *count = 1;
+            return 1;
+        }
+        /* 另一个 CPU 抢先插入了同一元组：重新查找，按窗口内的重复事件累加 */
+        v = bpf_map_lookup_elem(map, key);
+        if (!v) {
+            *first_seen = now;
+            *count = 1;
+            return 1;
+        }
+    }
+
+    v->last_seen = now;
+    if (now - v->window_start < window_ns) {
+        __sync_fetch_and_add(&v->count, 1);
+        return 0;
+    }
+
+    /*
+     * 窗口到期：携带窗口内合并的次数上报，并开始新窗口。其他 CPU 可能同时在累加，
+     * 用原子交换取出计数，每次累加恰好被上报一次（交换之后的累加计入下一个窗口）
+     */
+    *first_seen = v->window_start;
+    *count = __sync_lock_test_and_set(&v->count, 0) + 1;
+    v->window_start = now;
+    return 1;
+}
+
+/* 令牌桶 key：事件源 MAC + IP */
+struct rate_limit_key {
+    __u8 mac[6];
+    __u16 pad;
+    __u32 ip;
+};
+
+/* 令牌桶：tokens 以 1/1e9 个令牌为单位的定点数 */
+struct rate_limit_bucket {
+    __u64 tokens;
+    __u64 last_ns;
+};
+
+#define TOKEN_SCALE         1000000000ULL
+#define TOKEN_MAX_ELAPSED   (60 * 1000000000ULL) /* 补充计算的最大间隔，防止溢出 */
+
+/*
+ * 每个源的令牌桶。per-CPU 存储，更新无需原子操作；同一源的 ARP 通常被 RSS
+ * 分到同一队列，实际上限约为 rate_limit_pps × 接收该源流量的 CPU 数。
+ */
+struct {
+    __uint(type, BPF_MAP_TYPE_LRU_PERCPU_HASH);
+    __uint(max_entries, 8192);
+    __type(key, struct rate_limit_key);
+    __type(value, struct rate_limit_bucket);
+} rate_limit_buckets SEC(".maps");
+
+/* 令牌桶限速：源 (mac, ip) 有令牌时消耗一个并返回 1 */
+static __always_inline int rate_limit_allow(const __u8 *mac, __u32 ip, __u64 now,
+                                            __u32 rate, __u32 burst)
+{
+    struct rate_limit_key key = {};
+    struct rate_limit_bucket *bucket;
+    __u64 cap, elapsed;
+
+    __builtin_memcpy(key.mac, mac, sizeof(key.mac));
+    key.ip = ip;
+
+    if (burst == 0)
+        burst = 1;
+    cap = (__u64)burst * TOKEN_SCALE;
+
+    bucket = bpf_map_lookup_elem(&rate_limit_buckets, &key);
+    if (!bucket) {
+        struct rate_limit_bucket init = {
+            .tokens = cap - TOKEN_SCALE,
+            .last_ns = now,
+        };
+
+        bpf_map_update_elem(&rate_limit_buckets, &key, &init, BPF_ANY);
+        return 1;
+    }
+
+    elapsed = now - bucket->last_ns;
+    if (elapsed > TOKEN_MAX_ELAPSED)
+        elapsed = TOKEN_MAX_ELAPSED;
+    bucket->last_ns = now;
+    bucket->tokens += elapsed * rate;
+    if (bucket->tokens > cap)
+        bucket->tokens = cap;
+
+    if (bucket->tokens < TOKEN_SCALE)
+        return 0;
+    bucket->tokens -= TOKEN_SCALE;
+    return 1;
+}
+
+/* 待投递的 ARP/NDP 事件：各字段指向协议自己的事件结构与 map */
+struct event_desc {
+    void *ringbuf;
+    void *agg_map;          /* 值为 struct arp_agg_value */
+    const void *agg_key;
+    void *data;
+    __u64 size;
+    __u64 *first_seen;
+    __u32 *count;
+    __u64 timestamp;
+    const __u8 *src_mac;    /* 令牌桶 key */
+    __u32 src_ip;
+    __u32 src;              /* event_stats 索引（EVENT_SRC_*） */
+};
+
+/*
+ * 按配置聚合、采样、限速后将事件写入 ring buffer，并记录投递统计。
+ * 聚合汇总（count > 1）携带的次数已从聚合表中取出，不参与采样和限速，
+ * 否则整个窗口的计数会随这一个事件丢掉
+ */
+static __always_inline void emit_event(const struct event_desc *d,
+                                       const struct monitor_config *cfg)
+{
+    struct event_stats *es;
+
+    es = bpf_map_lookup_elem(&event_stats, &d->src);
+    if (!es)
+        return;
+
+    *d->first_seen = d->timestamp;
+    *d->count = 1;
+
+    if (cfg) {
+        __u32 rate = cfg->sample_rate;
+
+        if (cfg->agg_window_ms &&
+            !agg_window(d->agg_map, d->agg_key, d->timestamp,
+                        (__u64)cfg->agg_window_ms * 1000000ULL, d->first_seen, d->count)) {
+            es->aggregated++;
+            return;
+        }
+
+        if (*d->count == 1 && rate > 1 && bpf_get_prandom_u32() % rate != 0) {
+            es->sampled_out++;
+            return;
+        }
+
+        if (*d->count == 1 && cfg->rate_limit_pps &&
+            !rate_limit_allow(d->src_mac, d->src_ip, d->timestamp,
+                              cfg->rate_limit_pps, cfg->rate_limit_burst)) {
+            es->rate_limited++;
+            return;
+        }
+    }
+
+    if (bpf_ringbuf_output(d->ringbuf, d->data, d->size,
+                           ringbuf_wakeup_flags(d->ringbuf, d->size))) {
+        es->ringbuf_full++;
+        return;
+    }
+    es->submitted++;
+}
+
+/* 投递 ARP 事件，聚合 key 为 (接收接口, 源 IP, 目标 IP, 操作码) */
+static __always_inline void emit_arp_event(struct arp_event *event,
+                                           const struct monitor_config *cfg)
+{
+    struct arp_agg_key key = {
+        .src_ip = event->src_ip,
+        .dst_ip = event->dst_ip,
+        .ifindex = event->ifindex,
+        .opcode = event->opcode,
+    };
+    struct event_desc d = {
+        .ringbuf = &arp_events,
+        .agg_map = &arp_aggregation,
+        .agg_key = &key,
+        .data = event,
+        .size = sizeof(*event),
+        .first_seen = &event->first_seen,
+        .count = &event->count,
+        .timestamp = event->timestamp,
+        .src_mac = event->src_mac,
+        .src_ip = event->src_ip,
+        .src = EVENT_SRC_ARP,
+    };
+
+    if (cfg && (cfg->disabled & FEATURE_ARP_EVENTS))
+        return;
+    emit_event(&d, cfg);
+}
+
+/*
+ * IPv6 邻居发现（ICMPv6 133–136）。NDP 与 ARP 使用相同的采样、限速与聚合配置，
+ * 计数与事件分别存放，互不挤占 ring buffer 空间。类型值与 include/arp_monitor.h 一致。
+ */
+#define NEXTHDR_ICMPV6          58
+#define NDP_ROUTER_SOLICIT      133
+#define NDP_ROUTER_ADVERT       134
+#define NDP_NEIGH_SOLICIT       135
+#define NDP_NEIGH_ADVERT        136
+
+#define NDP_OPT_SOURCE_LLADDR   1
+#define NDP_OPT_TARGET_LLADDR   2
+
+/* 邻居通告标志（ICMPv6 头后第一个字节） */
+#define NDP_NA_FLAGS_MASK       0xE0    /* R(0x80) S(0x40) O(0x20) */
+
+/* NDP 统计信息 */
+struct ndp_stats {
+    __u64 router_solicit;   /* RS */
+    __u64 router_advert;    /* RA */
+    __u64 neigh_solicit;    /* NS */
+    __u64 neigh_advert;     /* NA */
+    __u64 total_packets;    /* 总 NDP 包数 */
+};
+
+/* 按接收接口（ifindex）存储 NDP 统计信息 */
+struct {
+    __uint(type, COUNTER_MAP_TYPE);
+    __uint(max_entries, MAX_INTERFACES);
+    __type(key, __u32);
+    __type(value, struct ndp_stats);
+} ndp_statistics SEC(".maps");
+
+/* NDP 事件记录 */
+struct ndp_event {
+    __u8 src_ip[16];     /* IPv6 源地址 */
+    __u8 dst_ip[16];     /* IPv6 目标地址（NS 风暴时多为请求节点组播地址） */
+    __u8 target[16];     /* NS/NA 的目标地址，RS/RA 为全零 */
+    __u8 src_mac[6];     /* 以太网源地址 */
+    __u8 lladdr[6];      /* 源/目标链路层地址选项，缺失时为全零 */
+    __u8 type;           /* ICMPv6 类型 */
+    __u8 flags;          /* NA 的 R/S/O 标志 */
+    __u16 pad;
+    __u64 timestamp;     /* 时间戳 */
+    __u64 first_seen;    /* 聚合模式下本事件覆盖的起始时间 */
+    __u32 count;         /* 聚合模式下本事件代表的 NDP 包数 */
+    __u32 ifindex;       /* 接收接口 */
+};
+
+/* Ring buffer 用于传递 NDP 事件到用户空间 */
+struct {
+    __uint(type, BPF_MAP_TYPE_RINGBUF);
+    __uint(max_entries, 256 * 1024); /* 256KB */
+} ndp_events SEC(".maps");
+
+/* NDP 聚合 key：(接收接口, 源地址, 目标地址, 类型)，值与 ARP 聚合相同 */
+struct ndp_agg_key {
+    __u8 src_ip[16];
+    __u8 target[16];
+    __u32 ifindex;
+    __u8 type;
+    __u8 pad[3];
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_LRU_HASH);
+    __uint(max_entries, 16384);
+    __type(key, struct ndp_agg_key);
+    __type(value, struct arp_agg_value);
+} ndp_aggregation SEC(".maps");
+
+/* 将 IPv6 源地址折叠为 32 位，作为令牌桶 key 的 IP 部分 */
+static __always_inline __u32 ipv6_fold(const __u8 *addr)
+{
+    const __u32 *w = (const __u32 *)addr;
+
+    return w[0] ^ w[1] ^ w[2] ^ w[3];
+}
+
+/* 投递 NDP 事件，聚合 key 为 (接收接口, 源地址, 目标地址, 类型) */
+static __always_inline void emit_ndp_event(struct ndp_event *event,
+                                           const struct monitor_config *cfg)
+{
+    struct ndp_agg_key key = {
+        .ifindex = event->ifindex,
+        .type = event->type,
+    };
+    struct event_desc d = {
+        .ringbuf = &ndp_events,
+        .agg_map = &ndp_aggregation,
+        .agg_key = &key,
+        .data = event,
+        .size = sizeof(*event),
+        .first_seen = &event->first_seen,
+        .count = &event->count,
+        .timestamp = event->timestamp,
+        .src_mac = event->src_mac,
+        .src_ip = ipv6_fold(event->src_ip),
+        .src = EVENT_SRC_NDP,
+    };
+
+    if (cfg && (cfg->disabled & FEATURE_NDP_EVENTS))
+        return;
+    __builtin_memcpy(key.src_ip, event->src_ip, sizeof(key.src_ip));
+    __builtin_memcpy(key.target, event->target, sizeof(key.target));
+    emit_event(&d, cfg);
+}
+
+/* 比较两个 MAC 地址，无分支；相同返回 0 */
+static __always_inline __u8 mac_diff(const __u8 *a, const __u8 *b)
+{
+    __u8 diff = 0;
+
+    #pragma unroll
+    for (int i = 0; i < 6; i++)
+        diff |= a[i] ^ b[i];
+    return diff;
+}
+
+/*
+ * 强制模式：检查 ARP 应答和免费 ARP（发送方 IP == 目标 IP）的发送方绑定，
+ * 与可信绑定冲突时返回 XDP_DROP。以太网源地址与发送方硬件地址不一致只计数：
+ * 代理 ARP 和中继会代替其他 MAC 应答，这类包本身不违反绑定。
+ * 普通请求不会更新接收方以外主机的缓存，不做检查。
+ */
+static __always_inline int arp_enforce(const struct arp_event *event, const struct ethhdr *eth)
+{
+    struct binding_key key = {
+        .ifindex = event->ifindex,
+        .ip = event->src_ip,
+    };
+    struct binding_value *b;
+    struct enforce_stats *st;
+    __u32 zero = 0;
+    int garp = event->opcode == ARPOP_REQUEST && event->src_ip == event->dst_ip;
+
+    if (event->opcode != ARPOP_REPLY && !garp)
+        return XDP_PASS;
+
+    st = bpf_map_lookup_elem(&enforce_stats, &zero);
+    if (!st)
+        return XDP_PASS;
+    st->checked++;
+
+    if (mac_diff(eth->h_source, event->src_mac))
+        st->sha_mismatch++;
+
+    b = bpf_map_lookup_elem(&trusted_bindings, &key);
+    if (!b) {
+        st->unknown++;
+        return XDP_PASS;
+    }
+    if (!mac_diff(b->mac, event->src_mac))
+        return XDP_PASS;
+
+    if (garp)
+        st->garp_mismatch++;
+    else
+        st->reply_mismatch++;
+    return XDP_DROP;
+}
+
+/*
+ * 查找按 ifindex 索引的计数器。用户空间在附加时为每个接口预先插入零值，
+ * 快速路径只有一次查找；条目缺失时（用户空间未预先插入）插入零值后重新查找。
+ */
+static __always_inline void *lookup_iface_counter(void *map, __u32 *ifindex)
+{
+    void *v = bpf_map_lookup_elem(map, ifindex);
+
+    if (!v) {
+        __u64 zero[sizeof(struct arp_stats) / sizeof(__u64)] = {}; /* 容纳最大的计数器结构 */
+
+        bpf_map_update_elem(map, ifindex, zero, BPF_NOEXIST);
+        v = bpf_map_lookup_elem(map, ifindex);
+    }
+    return v;
+}
+
+/*
+ * 在 per-CPU 哈希表中累加流量计数，条目不存在时插入。
+ * 插入只写当前 CPU 的槽位；并发插入失败时重新查找后累加。
+ */
+static __always_inline void account_traffic(void *map, const void *key, __u64 bytes)
+{
+    struct traffic_counter *c;
+    struct traffic_counter init = {
+        .packets = 1,
+        .bytes = bytes,
+    };
+
+    c = bpf_map_lookup_elem(map, key);
+    if (c) {
+        c->packets++;
+        c->bytes += bytes;
+        return;
+    }
+
+    if (bpf_map_update_elem(map, key, &init, BPF_NOEXIST) == 0)
+        return;
+
+    c = bpf_map_lookup_elem(map, key);
+    if (c) {
+        c->packets++;
+        c->bytes += bytes;
+    }
+}
+
+/* 无分支的 floor(log2(v))，v 为 0 时返回 0 */
+static __always_inline __u32 log2_u64(__u64 v)
+{
+    __u32 r, shift;
+
+    r = (v > 0xFFFFFFFF) << 5; v >>= r;
+    shift = (v > 0xFFFF) << 4; v >>= shift; r |= shift;
+    shift = (v > 0xFF) << 3; v >>= shift; r |= shift;
+    shift = (v > 0xF) << 2; v >>= shift; r |= shift;
+    shift = (v > 0x3) << 1; v >>= shift; r |= shift;
+    return r | (__u32)(v >> 1);
+}
+
+/*
+ * 跟踪 ARP 请求到应答的时延。请求按 (目标 IP, 请求方 IP) 记录在 arp_pending 中，
+ * 匹配的应答到达时计算时差，计入请求所在接口的直方图。超过 ARP_RESOLVE_TIMEOUT_NS
+ * 的请求在重传或迟到的应答到达时计为超时，之后再无报文的由用户空间清扫。
+ */
+static __always_inline void arp_track_latency(const struct arp_event *event)
+{
+    struct arp_pending_key key;
+    struct arp_pending_value *p;
+    struct arp_latency_key lk = {};
+    __u64 delta;
+
+    if (event->opcode == ARPOP_REQUEST) {
+        struct arp_pending_value v = {
+            .timestamp = event->timestamp,
+            .ifindex = event->ifindex,
+        };
+
+        /* 免费 ARP 与地址探测（源 IP 为 0）不期待应答 */
+        if (event->src_ip == 0 || event->src_ip == event->dst_ip)
+            return;
+
+        key.target_ip = event->dst_ip;
+        key.requester_ip = event->src_ip;
+        p = bpf_map_lookup_elem(&arp_pending, &key);
+        if (p) {
+            /* 超时前的重传保留第一次请求的时间 */
+            if (event->timestamp - p->timestamp < ARP_RESOLVE_TIMEOUT_NS)
+                return;
+            lk.ifindex = p->ifindex;
+            lk.slot = ARP_LATENCY_TIMEOUT;
+            account_traffic(&arp_latency, &lk, 0);
+        }
+        bpf_map_update_elem(&arp_pending, &key, &v, BPF_ANY);
+        return;
+    }
+
+    if (event->opcode != ARPOP_REPLY)
+        return;
+
+    key.target_ip = event->src_ip;
+    key.requester_ip = event->dst_ip;
+    p = bpf_map_lookup_elem(&arp_pending, &key);
+    if (!p)
+        return;
+    delta = event->timestamp - p->timestamp;
+    lk.ifindex = p->ifindex;
+
+    /* 只有删除成功的一方计数，重复应答或并发的清扫不会重复计入 */
+    if (bpf_map_delete_elem(&arp_pending, &key))
+        return;
+
+    if (delta >= ARP_RESOLVE_TIMEOUT_NS) {
+        lk.slot = ARP_LATENCY_TIMEOUT;
+        account_traffic(&arp_latency, &lk, 0);
+        return;
+    }
+    lk.slot = log2_u64(delta / 1000);
+    if (lk.slot >= ARP_LATENCY_SLOTS)
+        lk.slot = ARP_LATENCY_SLOTS - 1;
+    account_traffic(&arp_latency, &lk, delta);
+}
+
+/* IPv4 L3/L4 统计：协议、源地址和五元组流，按功能开关与子网过滤跳过 */
+static __always_inline void account_ipv4(struct iphdr *ip, void *data_end, __u64 bytes,
+                                         const struct monitor_config *cfg)
+{
+    struct traffic_counter *c;
+    struct flow_key flow = {};
+    __u32 proto, saddr;
+
+    /* 检查 IPv4 头部是否完整 */
+    if ((void *)(ip + 1) > data_end || ip->ihl < 5)
+        return;
+
+    if (!subnet_filter_pass(cfg, ip->saddr, ip->daddr)) {
+        filter_count(0);
+        return;
+    }
+
+    proto = ip->protocol;
+    if (!(cfg->disabled & FEATURE_IP_STATS)) {
+        c = bpf_map_lookup_elem(&ipproto_stats, &proto);
+        if (c) {
+            c->packets++;
+            c->bytes += bytes;
+        }
+
+        saddr = ip->saddr;
+        account_traffic(&ip_stats, &saddr, bytes);
+    }
+
+    if (cfg->disabled & FEATURE_FLOW_STATS)
+        return;
+
+    flow.saddr = ip->saddr;
+    flow.daddr = ip->daddr;
+    flow.proto = ip->protocol;
+
+    /* 只有首个分片携带 TCP/UDP 端口（两者端口字段位置相同） */
+    if ((proto == IPPROTO_TCP || proto == IPPROTO_UDP) &&
+        !(ip->frag_off & bpf_htons(IP_FRAG_OFFSET_MASK))) {
+        struct udphdr *l4 = (void *)ip + ip->ihl * 4;
+
+        if ((void *)(l4 + 1) <= data_end) {
+            flow.sport = l4->source;
+            flow.dport = l4->dest;
+        }
+    }
+
+    account_traffic(&flow_stats, &flow, bytes);
+}
+
+/*
+ * 协议分发：入口程序只做计数和 EtherType 分类，按协议尾调用到 dispatch 中的处理程序。
+ * 槽位为空（用户空间禁用了该处理程序或尚未实现）时尾调用失败，直接放行，
+ * 不使用的功能对每个包没有额外开销。槽位定义与 include/arp_monitor.h 一致。
+ */
+#define DISPATCH_ARP    0
+#define DISPATCH_IPV4   1
+#define DISPATCH_IPV6   2
+#define DISPATCH_VLAN   3
+#define DISPATCH_CAPTURE 4
+#define DISPATCH_MAX    5
+
+#define ETH_P_IPV6      0x86DD
+#define ETH_P_8021Q     0x8100
+#define ETH_P_8021AD    0x88A8
+
+/*
+ * VLAN 标签（802.1Q C-tag / 802.1ad S-tag）。vmlinux.h 中的 vlan_hdr 不保证存在，这里自行定义。
+ * 最多解析 VLAN_MAX_DEPTH 层（QinQ），更深的帧只计入外两层的 VLAN 计数。
+ */
+#define VLAN_VID_MASK   0x0FFF
+#define VLAN_MAX_DEPTH  2
+
+struct vlan_tag {
+    __be16 tci;
+    __be16 encap_proto;
+};
+
+static __always_inline int is_vlan_proto(__be16 proto)
+{
+    return proto == bpf_htons(ETH_P_8021Q) || proto == bpf_htons(ETH_P_8021AD);
+}
+
+/*
+ * 跳过 VLAN 标签，返回 L3 头部并在 l3_proto 中给出内层 EtherType，标签不完整时返回 NULL。
+ * 协议处理程序既可能由入口程序（未打标签）也可能由 handle_vlan 调用，
+ * 未打标签的帧只多一次 EtherType 比较。
+ */
+static __always_inline void *l3_header_proto(void *data, void *data_end, __be16 *l3_proto)
+{
+    struct ethhdr *eth = data;
+    struct vlan_tag *tag = (void *)(eth + 1);
+    __be16 proto;
+
+    if ((void *)(eth + 1) > data_end)
+        return NULL;
+    proto = eth->h_proto;
+
+    #pragma unroll
+    for (int i = 0; i < VLAN_MAX_DEPTH; i++) {
+        if (!is_vlan_proto(proto))
+            break;
+        if ((void *)(tag + 1) > data_end)
+            return NULL;
+        proto = tag->encap_proto;
+        tag++;
+    }
+    *l3_proto = proto;
+    return tag;
+}
+
+static __always_inline void *l3_header(void *data, void *data_end)
+{
+    __be16 proto;
+
+    return l3_header_proto(data, data_end, &proto);
+}
+
+/* 按 (接收接口, 外层 VID, 内层 VID) 统计，单层标签的内层 VID 为 0 */
+struct vlan_key {
+    __u32 ifindex;
+    __u16 vid;
+    __u16 inner_vid;
+};
+
+/* VLAN 计数器，前两个字段与 traffic_counter 一致 */
+struct vlan_counter {
+    __u64 packets;
+    __u64 bytes;
+    __u64 arp_packets;
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_LRU_PERCPU_HASH);
+    __uint(max_entries, 8192);
+    __type(key, struct vlan_key);
+    __type(value, struct vlan_counter);
+} vlan_stats SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PROG_ARRAY);
+    __uint(max_entries, DISPATCH_MAX);
+    __type(key, __u32);
+    __type(value, __u32);
+} dispatch SEC(".maps");
+
+/* 按 EtherType 尾调用到协议处理程序，成功时不返回 */
+static __always_inline void dispatch_protocol(struct xdp_md *ctx, __u16 ethertype)
+{
+    switch (ethertype) {
+        case ETH_P_ARP:
+            bpf_tail_call(ctx, &dispatch, DISPATCH_ARP);
+            break;
+        case ETH_P_IP:
+            bpf_tail_call(ctx, &dispatch, DISPATCH_IPV4);
+            break;
+        case ETH_P_IPV6:
+            bpf_tail_call(ctx, &dispatch, DISPATCH_IPV6);
+            break;
+        case ETH_P_8021Q:
+        case ETH_P_8021AD:
+            bpf_tail_call(ctx, &dispatch, DISPATCH_VLAN);
+            break;
+    }
+}
+
+/*
+ * 抓包：匹配过滤条件的帧以 capture_hdr 加帧的前 caplen 字节写入 per-CPU perf buffer。
+ * bpf_perf_event_output 在 flags 高 32 位给出长度时直接从 xdp_md 复制帧数据，
+ * 不经过栈或中间缓冲区，记录长度可变；每个 CPU 一个缓冲区，线速下没有跨 CPU 争用。
+ * 记录格式与 include/arp_monitor.h 一致。
+ */
+struct capture_hdr {
+    __u64 timestamp;    /* bpf_ktime_get_ns() */
+    __u32 ifindex;      /* 接收接口 */
+    __u32 len;          /* 帧的实际长度 */
+    __u32 caplen;       /* 随后复制的字节数 */
+    __u32 pad;
+};
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PERF_EVENT_ARRAY);
+    __uint(key_size, sizeof(__u32));
+    __uint(value_size, sizeof(__u32));
+} capture_events SEC(".maps");
+
 SEC("xdp")
 int xdp_network_monitor(struct xdp_md *ctx)
 {
     void *data_end = (void *)(long)ctx->data_end;
     void *data = (void *)(long)ctx->data;
     struct ethhdr *eth = data;
-    __u32 key = 0;
-    __u64 *count;
+    __u64 bytes = data_end - data;
+    struct traffic_counter *count;
+    __u32 ifindex = ctx->ingress_ifindex;
+    __u16 ethertype;
 
     /* 检查以太网头部是否完整 */
     if (data + sizeof(struct ethhdr) > data_end)
         return XDP_PASS;
 
-    /* 1. 数据包计数 - 统计所有数据包 */
-    count = bpf_map_lookup_elem(&packet_count, &key);
+    /* 1. 数据包计数 - 按接收接口统计所有数据包的包数与字节数 */
+    count = lookup_iface_counter(&packet_count, &ifindex);
     if (count) {
-        __sync_fetch_and_add(count, 1);
+        counter_add(&count->packets, 1);
+        counter_add(&count->bytes, bytes);
     }
 
-    /* 2. ARP 监控 - 只处理 ARP 数据包 */
-    if (eth->h_proto == bpf_htons(ETH_P_ARP)) {
-        struct arphdr *arp;
-        struct arp_event *event;
-        struct arp_stats *stats;
+    /* 2. 按 EtherType 统计 */
+    ethertype = bpf_ntohs(eth->h_proto);
+    account_traffic(&ethertype_stats, &ethertype, bytes);
 
-        /* 检查 ARP 头部是否完整 */
-        arp = data + sizeof(struct ethhdr);
-        if ((void *)(arp + 1) > data_end)
-            return XDP_PASS;
+    /* 3. 抓包（只在启用时装入槽位，处理后继续分发），然后分发到协议处理程序 */
+    bpf_tail_call(ctx, &dispatch, DISPATCH_CAPTURE);
+    dispatch_protocol(ctx, ethertype);
+    return XDP_PASS;
+}
 
-        /* 查找统计 map */
-        stats = bpf_map_lookup_elem(&arp_statistics, &key);
-        if (!stats)
-            return XDP_PASS;
+/*
+ * 抓包处理程序：按 EtherType/ARP 操作码过滤后输出帧，再分发到协议处理程序。
+ * EtherType 与外层或（带 VLAN 标签时）内层 EtherType 比较，ARP 操作码从跳过标签后的头部读取。
+ */
+SEC("xdp")
+int handle_capture(struct xdp_md *ctx)
+{
+    void *data_end = (void *)(long)ctx->data_end;
+    void *data = (void *)(long)ctx->data;
+    struct ethhdr *eth = data;
+    struct monitor_config *cfg;
+    struct event_stats *es;
+    struct capture_hdr hdr = {};
+    __u32 key = EVENT_SRC_CAPTURE;
+    __u32 cfg_key = 0;
+    __u16 ethertype, inner;
+    __be16 l3_proto;
+    void *l3;
+    __u64 caplen;
 
-        /* 更新统计信息 */
-        __sync_fetch_and_add(&stats->total_packets, 1);
-
-        __u16 opcode = bpf_ntohs(arp->ar_op);
-        switch (opcode) {
-            case ARPOP_REQUEST:
-                __sync_fetch_and_add(&stats->arp_request, 1);
-                break;
-            case ARPOP_REPLY:
-                __sync_fetch_and_add(&stats->arp_reply, 1);
-                break;
-            case ARPOP_RREQUEST:
-                __sync_fetch_and_add(&stats->rarp_request, 1);
-                break;
-            case ARPOP_RREPLY:
-                __sync_fetch_and_add(&stats->rarp_reply, 1);
-                break;
-        }
+    if (data + sizeof(struct ethhdr) > data_end)
+        return XDP_PASS;
+    ethertype = bpf_ntohs(eth->h_proto);
 
-        /* 为 ARP 事件分配 ring buffer 空间 */
-        event = bpf_ringbuf_reserve(&arp_events, sizeof(struct arp_event), 0);
-        if (!event)
-            return XDP_PASS;
+    cfg = bpf_map_lookup_elem(&monitor_config, &cfg_key);
+    if (!cfg || !cfg->capture_snaplen)
+        goto out;
+
+    /* 标签不完整时 l3 为 NULL，只能按外层 EtherType 匹配 */
+    l3 = l3_header_proto(data, data_end, &l3_proto);
+    inner = l3 ? bpf_ntohs(l3_proto) : ethertype;
+    if (cfg->capture_ethertype && cfg->capture_ethertype != ethertype &&
+        cfg->capture_ethertype != inner)
+        goto out;
+    if (cfg->capture_arp_op) {
+        struct arphdr *arp = l3;
 
-        /* 记录 ARP 事件详情（需要额外边界检查）*/
-        void *arp_data = (void *)arp + sizeof(struct arphdr);
+        if (inner != ETH_P_ARP || !arp || (void *)(arp + 1) > data_end ||
+            bpf_ntohs(arp->ar_op) != cfg->capture_arp_op)
+            goto out;
+    }
+
+    es = bpf_map_lookup_elem(&event_stats, &key);
+    if (!es)
+        goto out;
+
+    hdr.timestamp = bpf_ktime_get_ns();
+    hdr.ifindex = ctx->ingress_ifindex;
+    hdr.len = data_end - data;
+    caplen = hdr.len < cfg->capture_snaplen ? hdr.len : cfg->capture_snaplen;
+    hdr.caplen = caplen;
+
+    if (bpf_perf_event_output(ctx, &capture_events, BPF_F_CURRENT_CPU | (caplen << 32),
+                              &hdr, sizeof(hdr)))
+        es->ringbuf_full++;
+    else
+        es->submitted++;
+
+out:
+    dispatch_protocol(ctx, ethertype);
+    return XDP_PASS;
+}
+
+/*
+ * VLAN 处理程序：解析最多两层标签，按 VLAN 计数，然后按内层 EtherType 分发，
+ * 协议处理程序通过 l3_header() 跳过标签
+ */
+SEC("xdp")
+int handle_vlan(struct xdp_md *ctx)
+{
+    void *data_end = (void *)(long)ctx->data_end;
+    void *data = (void *)(long)ctx->data;
+    struct ethhdr *eth = data;
+    struct vlan_tag *tag = (void *)(eth + 1);
+    struct vlan_key key = {
+        .ifindex = ctx->ingress_ifindex,
+    };
+    struct vlan_counter *c;
+    struct monitor_config *cfg;
+    __u64 bytes = data_end - data;
+    __u32 cfg_key = 0;
+    __be16 proto;
+    int arp;
 
-        /* 检查 ARP 负载是否完整（硬件地址长度 + 协议地址长度） */
-        if (arp_data + 2 * (arp->ar_hln + arp->ar_pln) > data_end) {
-            bpf_ringbuf_discard(event, 0);
+    if ((void *)(tag + 1) > data_end)
+        return XDP_PASS;
+    key.vid = bpf_ntohs(tag->tci) & VLAN_VID_MASK;
+    proto = tag->encap_proto;
+    tag++;
+    if (is_vlan_proto(proto)) {
+        if ((void *)(tag + 1) > data_end)
             return XDP_PASS;
+        key.inner_vid = bpf_ntohs(tag->tci) & VLAN_VID_MASK;
+        proto = tag->encap_proto;
+    }
+    arp = proto == bpf_htons(ETH_P_ARP);
+
+    cfg = bpf_map_lookup_elem(&monitor_config, &cfg_key);
+    if (cfg && (cfg->disabled & FEATURE_VLAN_STATS))
+        goto out;
+
+    c = bpf_map_lookup_elem(&vlan_stats, &key);
+    if (c) {
+        c->packets++;
+        c->bytes += bytes;
+        c->arp_packets += arp;
+    } else {
+        struct vlan_counter init = {
+            .packets = 1,
+            .bytes = bytes,
+            .arp_packets = arp,
+        };
+
+        /* 并发插入失败时另一个 CPU 已插入，重新查找后累加 */
+        if (bpf_map_update_elem(&vlan_stats, &key, &init, BPF_NOEXIST)) {
+            c = bpf_map_lookup_elem(&vlan_stats, &key);
+            if (c) {
+                c->packets++;
+                c->bytes += bytes;
+                c->arp_packets += arp;
+            }
         }
+    }
 
-        event->opcode = opcode;
-        event->timestamp = bpf_ktime_get_ns();
+out:
+    /* 超过两层标签的帧不再分发，避免再次尾调用到本程序 */
+    if (!is_vlan_proto(proto))
+        dispatch_protocol(ctx, bpf_ntohs(proto));
+    return XDP_PASS;
+}
 
-        /* 解析 ARP 数据（仅支持以太网和 IPv4） */
-        if (arp->ar_hrd == bpf_htons(ARPHRD_ETHER) &&
-            arp->ar_pro == bpf_htons(ETH_P_IP) &&
-            arp->ar_hln == 6 && arp->ar_pln == 4) {
+/* IPv4 处理程序：协议、源地址与流统计 */
+SEC("xdp")
+int handle_ipv4(struct xdp_md *ctx)
+{
+    void *data_end = (void *)(long)ctx->data_end;
+    void *data = (void *)(long)ctx->data;
+    struct iphdr *ip = l3_header(data, data_end);
+    struct monitor_config *cfg;
+    __u32 cfg_key = 0;
 
-            __u8 *ptr = arp_data;
+    cfg = bpf_map_lookup_elem(&monitor_config, &cfg_key);
+    if (!ip || !cfg ||
+        (cfg->disabled & (FEATURE_IP_STATS | FEATURE_FLOW_STATS)) ==
+        (FEATURE_IP_STATS | FEATURE_FLOW_STATS))
+        return XDP_PASS;
+    account_ipv4(ip, data_end, data_end - data, cfg);
+    return XDP_PASS;
+}
 
-            /* 源 MAC */
-            #pragma unroll
-            for (int i = 0; i < 6; i++) {
-                if (ptr + i >= (__u8 *)data_end) {
-                    bpf_ringbuf_discard(event, 0);
-                    return XDP_PASS;
-                }
-                event->src_mac[i] = ptr[i];
-            }
-            ptr += 6;
+/* ARP 处理程序：统计、强制模式、解析时延与事件上报 */
+SEC("xdp")
+int handle_arp(struct xdp_md *ctx)
+{
+    void *data_end = (void *)(long)ctx->data_end;
+    void *data = (void *)(long)ctx->data;
+    struct ethhdr *eth = data;
+    __u32 ifindex = ctx->ingress_ifindex;
+    struct arphdr *arp;
+    struct arp_event event = {};
+    struct arp_stats *stats;
+    struct monitor_config *cfg;
+    __u32 cfg_key = 0;
+    int action = XDP_PASS;
 
-            /* 源 IP */
-            if (ptr + 4 > (__u8 *)data_end) {
-                bpf_ringbuf_discard(event, 0);
+    /* 检查 ARP 头部是否完整 */
+    arp = l3_header(data, data_end);
+    if (!arp || (void *)(arp + 1) > data_end)
+        return XDP_PASS;
+
+    /* 查找统计 map */
+    stats = lookup_iface_counter(&arp_statistics, &ifindex);
+    if (!stats)
+        return XDP_PASS;
+
+    /* 更新统计信息 */
+    counter_add(&stats->total_packets, 1);
+
+    __u16 opcode = bpf_ntohs(arp->ar_op);
+    switch (opcode) {
+        case ARPOP_REQUEST:
+            counter_add(&stats->arp_request, 1);
+            break;
+        case ARPOP_REPLY:
+            counter_add(&stats->arp_reply, 1);
+            break;
+        case ARPOP_RREQUEST:
+            counter_add(&stats->rarp_request, 1);
+            break;
+        case ARPOP_RREPLY:
+            counter_add(&stats->rarp_reply, 1);
+            break;
+    }
+
+    /* 记录 ARP 事件详情（需要额外边界检查）*/
+    void *arp_data = (void *)arp + sizeof(struct arphdr);
+
+    /* 检查 ARP 负载是否完整（硬件地址长度 + 协议地址长度） */
+    if (arp_data + 2 * (arp->ar_hln + arp->ar_pln) > data_end)
+        return XDP_PASS;
+
+    event.opcode = opcode;
+    event.timestamp = bpf_ktime_get_ns();
+    event.ifindex = ifindex;
+    cfg = bpf_map_lookup_elem(&monitor_config, &cfg_key);
+
+    /* 解析 ARP 数据（仅支持以太网和 IPv4） */
+    if (arp->ar_hrd == bpf_htons(ARPHRD_ETHER) &&
+        arp->ar_pro == bpf_htons(ETH_P_IP) &&
+        arp->ar_hln == 6 && arp->ar_pln == 4) {
+
+        __u8 *ptr = arp_data;
+
+        /* 源 MAC */
+        #pragma unroll
+        for (int i = 0; i < 6; i++) {
+            if (ptr + i >= (__u8 *)data_end)
                 return XDP_PASS;
-            }
-            event->src_ip = *(__u32 *)ptr;
-            ptr += 4;
-
-            /* 目标 MAC */
-            #pragma unroll
-            for (int i = 0; i < 6; i++) {
-                if (ptr + i >= (__u8 *)data_end) {
-                    bpf_ringbuf_discard(event, 0);
-                    return XDP_PASS;
-                }
-                event->dst_mac[i] = ptr[i];
-            }
-            ptr += 6;
+            event.src_mac[i] = ptr[i];
+        }
+        ptr += 6;
+
+        /* 源 IP */
+        if (ptr + 4 > (__u8 *)data_end)
+            return XDP_PASS;
+        event.src_ip = *(__u32 *)ptr;
+        ptr += 4;
 
-            /* 目标 IP */
-            if (ptr + 4 > (__u8 *)data_end) {
-                bpf_ringbuf_discard(event, 0);
+        /* 目标 MAC */
+        #pragma unroll
+        for (int i = 0; i < 6; i++) {
+            if (ptr + i >= (__u8 *)data_end)
                 return XDP_PASS;
-            }
-            event->dst_ip = *(__u32 *)ptr;
+            event.dst_mac[i] = ptr[i];
         }
+        ptr += 6;
+
+        /* 目标 IP */
+        if (ptr + 4 > (__u8 *)data_end)
+            return XDP_PASS;
+        event.dst_ip = *(__u32 *)ptr;
 
-        /* 提交事件到 ring buffer */
-        bpf_ringbuf_submit(event, 0);
+        /* 强制模式只对以太网/IPv4 ARP 生效，其余流量不受影响 */
+        if (cfg && cfg->enforce)
+            action = arp_enforce(&event, eth);
+
+        /* 强制模式之后再过滤：过滤只影响时延与事件，不放过伪造的应答 */
+        if (cfg && !subnet_filter_pass(cfg, event.src_ip, event.dst_ip)) {
+            filter_count(1);
+            return action;
+        }
+
+        /* 被强制模式丢弃的伪造应答不计入解析时延 */
+        if (action == XDP_PASS && !(cfg && (cfg->disabled & FEATURE_ARP_LATENCY)))
+            arp_track_latency(&event);
+    } else if (cfg && cfg->subnet_filter) {
+        /* 非以太网/IPv4 ARP 没有可匹配的地址，启用过滤时不上报 */
+        filter_count(1);
+        return action;
+    }
+
+    /* 采样与限速通过后提交事件到 ring buffer（被丢弃的包同样上报） */
+    emit_arp_event(&event, cfg);
+    return action;
+}
+
+/* IPv6 处理程序：邻居发现统计与事件上报（不遍历扩展头，NDP 报文不携带扩展头） */
+SEC("xdp")
+int handle_ipv6(struct xdp_md *ctx)
+{
+    void *data_end = (void *)(long)ctx->data_end;
+    void *data = (void *)(long)ctx->data;
+    struct ethhdr *eth = data;
+    struct ipv6hdr *ip6 = l3_header(data, data_end);
+    __u32 ifindex = ctx->ingress_ifindex;
+    struct ndp_event event = {};
+    struct ndp_stats *stats;
+    struct monitor_config *cfg;
+    __u32 cfg_key = 0;
+    __u8 *icmp, *opt;
+    __u32 opt_off;
+
+    /* ICMPv6 头部（8 字节）紧跟 IPv6 头部 */
+    if (!ip6)
+        return XDP_PASS;
+    icmp = (__u8 *)(ip6 + 1);
+    if ((void *)(icmp + 8) > data_end || ip6->nexthdr != NEXTHDR_ICMPV6)
+        return XDP_PASS;
+    if (icmp[0] < NDP_ROUTER_SOLICIT || icmp[0] > NDP_NEIGH_ADVERT)
+        return XDP_PASS;
+
+    stats = lookup_iface_counter(&ndp_statistics, &ifindex);
+    if (!stats)
+        return XDP_PASS;
+    counter_add(&stats->total_packets, 1);
+
+    event.type = icmp[0];
+    switch (event.type) {
+        case NDP_ROUTER_SOLICIT:
+            counter_add(&stats->router_solicit, 1);
+            opt_off = 8;
+            break;
+        case NDP_ROUTER_ADVERT:
+            counter_add(&stats->router_advert, 1);
+            opt_off = 16;
+            break;
+        case NDP_NEIGH_SOLICIT:
+            counter_add(&stats->neigh_solicit, 1);
+            opt_off = 24;
+            break;
+        default:
+            counter_add(&stats->neigh_advert, 1);
+            event.flags = icmp[4] & NDP_NA_FLAGS_MASK;
+            opt_off = 24;
+            break;
     }
 
+    __builtin_memcpy(event.src_ip, &ip6->saddr, sizeof(event.src_ip));
+    __builtin_memcpy(event.dst_ip, &ip6->daddr, sizeof(event.dst_ip));
+    __builtin_memcpy(event.src_mac, eth->h_source, sizeof(event.src_mac));
+    event.timestamp = bpf_ktime_get_ns();
+    event.ifindex = ifindex;
+
+    /* NS/NA 的目标地址位于 ICMPv6 头之后 */
+    if (opt_off == 24) {
+        if ((void *)(icmp + 24) > data_end)
+            return XDP_PASS;
+        __builtin_memcpy(event.target, icmp + 8, sizeof(event.target));
+    }
+
+    /* 只检查第一个选项：链路层地址选项（长度 1 = 8 字节）通常排在首位 */
+    opt = icmp + opt_off;
+    if ((void *)(opt + 8) <= data_end && opt[1] == 1 &&
+        (opt[0] == NDP_OPT_SOURCE_LLADDR || opt[0] == NDP_OPT_TARGET_LLADDR))
+        __builtin_memcpy(event.lladdr, opt + 2, sizeof(event.lladdr));
+
+    cfg = bpf_map_lookup_elem(&monitor_config, &cfg_key);
+    emit_ndp_event(&event, cfg);
     return XDP_PASS;
 }
 
@@ -0,0 +1,251 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "../include/neigh_table.h"
+
+#define SLOT_EMPTY      0
+#define SLOT_USED       1
+#define SLOT_DELETED    2
+
+/* 负载（含删除标记）超过 70% 时扩容或重建 */
+#define NEIGH_MAX_LOAD(cap) ((cap) / 10 * 7)
+
+static uint64_t neigh_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* FNV-1a */
+static uint32_t neigh_hash(const struct neigh_key *key)
+{
+    const uint8_t *p = (const uint8_t *)key;
+    uint32_t h = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < sizeof(*key); i++) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+int neigh_table_init(struct neigh_table *t, uint32_t capacity)
+{
+    uint32_t cap = 16;
+
+    memset(t, 0, sizeof(*t));
+    while (cap < capacity)
+        cap <<= 1;
+
+    t->slots = calloc(cap, sizeof(*t->slots));
+    if (!t->slots)
+        return -ENOMEM;
+    t->capacity = cap;
+    return 0;
+}
+
+void neigh_table_free(struct neigh_table *t)
+{
+    free(t->slots);
+    free(t->ifnames);
+    t->slots = NULL;
+    t->ifnames = NULL;
+}
+
+void neigh_table_clear(struct neigh_table *t)
+{
+    memset(t->slots, 0, (size_t)t->capacity * sizeof(*t->slots));
+    t->count = 0;
+    t->tombstones = 0;
+}
+
+/* 查找 key 所在槽位；不存在时返回可插入的槽位（优先复用删除标记） */
+static struct neigh_entry *neigh_find_slot(struct neigh_table *t, const struct neigh_key *key)
+{
+    uint32_t mask = t->capacity - 1;
+    uint32_t i = neigh_hash(key) & mask;
+    struct neigh_entry *tombstone = NULL;
+
+    for (;;) {
+        struct neigh_entry *e = &t->slots[i];
+
+        if (e->used == SLOT_EMPTY)
+            return tombstone ? tombstone : e;
+        if (e->used == SLOT_DELETED) {
+            if (!tombstone)
+                tombstone = e;
+        } else if (memcmp(&e->key, key, sizeof(*key)) == 0) {
+            return e;
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+/* 扩容（或仅清除删除标记）后重新插入所有条目 */
+static int neigh_rehash(struct neigh_table *t, uint32_t capacity)
+{
+    struct neigh_entry *old = t->slots;
+    uint32_t old_cap = t->capacity, i;
+
+    t->slots = calloc(capacity, sizeof(*t->slots));
+    if (!t->slots) {
+        t->slots = old;
+        return -ENOMEM;
+    }
+    t->capacity = capacity;
+    t->tombstones = 0;
+
+    for (i = 0; i < old_cap; i++) {
+        if (old[i].used == SLOT_USED)
+            *neigh_find_slot(t, &old[i].key) = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+struct neigh_entry *neigh_table_lookup(struct neigh_table *t, const struct neigh_key *key)
+{
+    struct neigh_entry *e = neigh_find_slot(t, key);
+
+    return e->used == SLOT_USED ? e : NULL;
+}
+
+struct neigh_entry *neigh_table_next(struct neigh_table *t, uint32_t *pos)
+{
+    while (*pos < t->capacity) {
+        struct neigh_entry *e = &t->slots[(*pos)++];
+
+        if (e->used == SLOT_USED)
+            return e;
+    }
+    return NULL;
+}
+
+int neigh_state_index(uint16_t state)
+{
+    int i;
+
+    for (i = 0; i < NEIGH_NR_STATES - 1; i++) {
+        if (state & (1u << i))
+            return i + 1;
+    }
+    return 0;
+}
+
+enum neigh_change neigh_table_update(struct neigh_table *t, const struct neigh_key *key,
+                                     const uint8_t *lladdr, uint16_t state,
+                                     struct neigh_entry **entry)
+{
+    struct neigh_entry *e;
+    int from, to = neigh_state_index(state);
+
+    if (t->count + t->tombstones + 1 > NEIGH_MAX_LOAD(t->capacity)) {
+        /* 删除标记较多时原地重建即可，否则扩容一倍 */
+        uint32_t cap = t->count + 1 > NEIGH_MAX_LOAD(t->capacity) / 2 ?
+                       t->capacity * 2 : t->capacity;
+
+        neigh_rehash(t, cap);
+    }
+
+    e = neigh_find_slot(t, key);
+    if (e->used != SLOT_USED) {
+        if (e->used == SLOT_DELETED)
+            t->tombstones--;
+        memset(e, 0, sizeof(*e));
+        e->key = *key;
+        e->used = SLOT_USED;
+        e->state = state;
+        if (lladdr)
+            memcpy(e->lladdr, lladdr, sizeof(e->lladdr));
+        e->updated_ns = neigh_now_ns();
+        t->count++;
+        t->adds++;
+        t->transitions[0][to]++;
+        if (entry)
+            *entry = e;
+        return NEIGH_ADDED;
+    }
+
+    if (entry)
+        *entry = e;
+    if (e->state == state &&
+        (!lladdr || memcmp(e->lladdr, lladdr, sizeof(e->lladdr)) == 0)) {
+        t->unchanged++;
+        return NEIGH_UNCHANGED;
+    }
+
+    from = neigh_state_index(e->state);
+    t->transitions[from][to]++;
+    e->state = state;
+    if (lladdr)
+        memcpy(e->lladdr, lladdr, sizeof(e->lladdr));
+    e->updated_ns = neigh_now_ns();
+    e->changes++;
+    t->updates++;
+    return NEIGH_UPDATED;
+}
+
+enum neigh_change neigh_table_delete(struct neigh_table *t, const struct neigh_key *key,
+                                     struct neigh_entry *old)
+{
+    struct neigh_entry *e = neigh_find_slot(t, key);
+
+    if (e->used != SLOT_USED)
+        return NEIGH_UNCHANGED;
+
+    if (old)
+        *old = *e;
+    t->transitions[neigh_state_index(e->state)][0]++;
+    e->used = SLOT_DELETED;
+    t->count--;
+    t->tombstones++;
+    t->deletes++;
+    return NEIGH_DELETED;
+}
+
+int neigh_link_set(struct neigh_table *t, int ifindex, const char *name)
+{
+    if (ifindex <= 0)
+        return -EINVAL;
+
+    if ((uint32_t)ifindex >= t->ifnames_cap) {
+        uint32_t cap = t->ifnames_cap ? t->ifnames_cap : 64;
+        char (*names)[IF_NAMESIZE];
+
+        while (cap <= (uint32_t)ifindex)
+            cap <<= 1;
+        names = realloc(t->ifnames, (size_t)cap * IF_NAMESIZE);
+        if (!names)
+            return -ENOMEM;
+        memset(names + t->ifnames_cap, 0, (size_t)(cap - t->ifnames_cap) * IF_NAMESIZE);
+        t->ifnames = names;
+        t->ifnames_cap = cap;
+    }
+
+    strncpy(t->ifnames[ifindex], name, IF_NAMESIZE - 1);
+    t->ifnames[ifindex][IF_NAMESIZE - 1] = '\0';
+    return 0;
+}
+
+void neigh_link_del(struct neigh_table *t, int ifindex)
+{
+    if (ifindex > 0 && (uint32_t)ifindex < t->ifnames_cap)
+        t->ifnames[ifindex][0] = '\0';
+}
+
+const char *neigh_link_name(struct neigh_table *t, int ifindex)
+{
+    char name[IF_NAMESIZE];
+
+    if (ifindex > 0 && (uint32_t)ifindex < t->ifnames_cap && t->ifnames[ifindex][0])
+        return t->ifnames[ifindex];
+
+    /* 缓存未命中（例如 RTM_NEWLINK 尚未到达）：回退到一次系统调用 */
+    if (!if_indextoname(ifindex, name) || neigh_link_set(t, ifindex, name))
+        return "?";
+    return t->ifnames[ifindex];
+}
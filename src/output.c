@@ -0,0 +1,201 @@
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include "../include/output.h"
+
+static const char hex_digits[] = "0123456789abcdef";
+
+int output_init(struct output *out, int fd, enum output_format format)
+{
+    int i;
+
+    memset(out, 0, sizeof(*out));
+    out->buf = malloc((size_t)OUTPUT_CHUNKS * OUTPUT_CHUNK_SIZE);
+    if (!out->buf)
+        return -ENOMEM;
+
+    out->fd = fd;
+    out->format = format;
+    for (i = 0; i < OUTPUT_CHUNKS; i++) {
+        out->iov[i].iov_base = out->buf + (size_t)i * OUTPUT_CHUNK_SIZE;
+        out->iov[i].iov_len = 0;
+    }
+    return 0;
+}
+
+void output_free(struct output *out)
+{
+    if (out->buf)
+        output_flush(out);
+    free(out->buf);
+    out->buf = NULL;
+}
+
+int output_pending(const struct output *out)
+{
+    return out->cur > 0 || out->iov[0].iov_len > 0;
+}
+
+/* 写出所有已填充的块，处理部分写入 */
+int output_flush(struct output *out)
+{
+    struct iovec *iov = out->iov;
+    int iovcnt = out->cur + 1;
+    int i, err = 0;
+
+    if (!output_pending(out))
+        return 0;
+
+    while (iovcnt > 0) {
+        ssize_t n = writev(out->fd, iov, iovcnt);
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            err = -errno;
+            break;
+        }
+        out->bytes_written += n;
+
+        /* 跳过已完整写出的块，调整部分写出的块 */
+        while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+
+    /* 无论成功与否都复位缓冲区，避免输出端故障时无限积压 */
+    for (i = 0; i < OUTPUT_CHUNKS; i++) {
+        out->iov[i].iov_base = out->buf + (size_t)i * OUTPUT_CHUNK_SIZE;
+        out->iov[i].iov_len = 0;
+    }
+    out->cur = 0;
+    out->flushes++;
+    return err;
+}
+
+int output_flush_if_due(struct output *out, uint64_t now_ns, uint64_t max_delay_ns)
+{
+    if (!output_pending(out)) {
+        out->last_flush_ns = now_ns;
+        return 0;
+    }
+    if (now_ns - out->last_flush_ns < max_delay_ns)
+        return 0;
+
+    out->last_flush_ns = now_ns;
+    return output_flush(out);
+}
+
+char *output_reserve(struct output *out, size_t len)
+{
+    struct iovec *iov = &out->iov[out->cur];
+
+    if (iov->iov_len + len > OUTPUT_CHUNK_SIZE) {
+        /* 当前块放不下：换到下一块，所有块都满时整体刷新 */
+        if (out->cur + 1 >= OUTPUT_CHUNKS)
+            output_flush(out);
+        else
+            out->cur++;
+        iov = &out->iov[out->cur];
+    }
+    return (char *)iov->iov_base + iov->iov_len;
+}
+
+void output_commit(struct output *out, size_t len)
+{
+    out->iov[out->cur].iov_len += len;
+}
+
+void output_write(struct output *out, const void *data, size_t len)
+{
+    while (len > 0) {
+        size_t n = len > OUTPUT_MAX_RECORD ? OUTPUT_MAX_RECORD : len;
+        char *p = output_reserve(out, n);
+
+        memcpy(p, data, n);
+        output_commit(out, n);
+        data = (const char *)data + n;
+        len -= n;
+    }
+}
+
+char *fmt_str(char *p, const char *s)
+{
+    while (*s)
+        *p++ = *s++;
+    return p;
+}
+
+char *fmt_u64(char *p, uint64_t v)
+{
+    char tmp[20];
+    int n = 0;
+
+    do {
+        tmp[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+
+    while (n > 0)
+        *p++ = tmp[--n];
+    return p;
+}
+
+/* 0-255 的十进制，不借助除法循环 */
+static char *fmt_octet(char *p, uint8_t v)
+{
+    if (v >= 100) {
+        *p++ = '0' + v / 100;
+        v %= 100;
+        *p++ = '0' + v / 10;
+        *p++ = '0' + v % 10;
+    } else if (v >= 10) {
+        *p++ = '0' + v / 10;
+        *p++ = '0' + v % 10;
+    } else {
+        *p++ = '0' + v;
+    }
+    return p;
+}
+
+char *fmt_ipv4(char *p, uint32_t ip)
+{
+    const uint8_t *b = (const uint8_t *)&ip;
+
+    p = fmt_octet(p, b[0]);
+    *p++ = '.';
+    p = fmt_octet(p, b[1]);
+    *p++ = '.';
+    p = fmt_octet(p, b[2]);
+    *p++ = '.';
+    return fmt_octet(p, b[3]);
+}
+
+char *fmt_mac(char *p, const uint8_t *mac)
+{
+    int i;
+
+    for (i = 0; i < 6; i++) {
+        if (i)
+            *p++ = ':';
+        *p++ = hex_digits[mac[i] >> 4];
+        *p++ = hex_digits[mac[i] & 0xf];
+    }
+    return p;
+}
+
+char *fmt_ipv6(char *p, const uint8_t *addr)
+{
+    /* 零压缩规则较复杂，直接使用 inet_ntop；缓冲区保证至少 INET6_ADDRSTRLEN 字节 */
+    if (!inet_ntop(AF_INET6, addr, p, INET6_ADDRSTRLEN))
+        return fmt_str(p, "?");
+    return p + strlen(p);
+}
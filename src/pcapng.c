@@ -0,0 +1,315 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include "../include/pcapng.h"
+
+/* pcapng 块类型与选项（见 pcapng 规范，字段使用本机字节序，由字节序标记区分） */
+#define PCAPNG_BT_SHB           0x0A0D0D0A
+#define PCAPNG_BT_IDB           0x00000001
+#define PCAPNG_BT_EPB           0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1A2B3C4D
+#define PCAPNG_LINKTYPE_ETHERNET 1
+#define PCAPNG_OPT_ENDOFOPT     0
+#define PCAPNG_OPT_SHB_USERAPPL 4
+#define PCAPNG_OPT_IF_NAME      2
+#define PCAPNG_OPT_IF_TSRESOL   9
+
+#define PAD4(n) (((n) + 3) & ~3U)
+
+/* Enhanced Packet Block 的固定部分（不含数据和结尾长度） */
+struct epb_header {
+    uint32_t type;
+    uint32_t total_len;
+    uint32_t iface_id;
+    uint32_t ts_high;
+    uint32_t ts_low;
+    uint32_t caplen;
+    uint32_t len;
+};
+
+static uint8_t *put_u32(uint8_t *p, uint32_t v)
+{
+    memcpy(p, &v, sizeof(v));
+    return p + sizeof(v);
+}
+
+static uint8_t *put_u16(uint8_t *p, uint16_t v)
+{
+    memcpy(p, &v, sizeof(v));
+    return p + sizeof(v);
+}
+
+/* 写入一个选项（code, length, 值, 填充到 4 字节） */
+static uint8_t *put_opt(uint8_t *p, uint16_t code, const void *val, uint16_t len)
+{
+    p = put_u16(p, code);
+    p = put_u16(p, len);
+    memcpy(p, val, len);
+    memset(p + len, 0, PAD4(len) - len);
+    return p + PAD4(len);
+}
+
+/* 写出 buf 中 [0, n) 到文件偏移 off，处理部分写 */
+static int write_at(int fd, const uint8_t *buf, size_t n, uint64_t off)
+{
+    while (n > 0) {
+        ssize_t r = pwrite(fd, buf, n, off);
+
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            return -errno;
+        }
+        buf += r;
+        n -= r;
+        off += r;
+    }
+    return 0;
+}
+
+/* 写出缓冲区中的整块部分（非 O_DIRECT 时写出全部），剩余部分移到缓冲区开头 */
+static int flush_blocks(struct pcapng_writer *w)
+{
+    uint32_t n = w->direct ? w->len & ~(PCAPNG_ALIGN - 1) : w->len;
+    int err;
+
+    if (n == 0)
+        return 0;
+    err = write_at(w->fd, w->buf, n, w->buf_off);
+    if (err)
+        return err;
+    memmove(w->buf, w->buf + n, w->len - n);
+    w->len -= n;
+    w->buf_off += n;
+    return 0;
+}
+
+/* 预留 n 字节的缓冲区空间，必要时先写出 */
+static uint8_t *reserve(struct pcapng_writer *w, uint32_t n)
+{
+    if (w->len + n > PCAPNG_BUF_SIZE && flush_blocks(w))
+        return NULL;
+    return w->buf + w->len;
+}
+
+/* Section Header Block 与每个接口的 Interface Description Block */
+static int write_header(struct pcapng_writer *w)
+{
+    static const char appl[] = "netmon";
+    static const uint8_t tsresol = 9;     /* 时间戳单位 10^-9 秒 */
+    uint8_t *start, *p;
+    int64_t section_len = -1;
+    int i;
+
+    start = p = reserve(w, 64);
+    if (!p)
+        return -EIO;
+    p = put_u32(p, PCAPNG_BT_SHB);
+    p = put_u32(p, 28 + 4 + PAD4(sizeof(appl) - 1) + 4);
+    p = put_u32(p, PCAPNG_BYTE_ORDER_MAGIC);
+    p = put_u16(p, 1);
+    p = put_u16(p, 0);
+    memcpy(p, &section_len, sizeof(section_len));
+    p += sizeof(section_len);
+    p = put_opt(p, PCAPNG_OPT_SHB_USERAPPL, appl, sizeof(appl) - 1);
+    p = put_u32(p, PCAPNG_OPT_ENDOFOPT);
+    p = put_u32(p, p - start + 4);
+    w->len += p - start;
+
+    for (i = 0; i < w->nr_ifaces; i++) {
+        uint16_t name_len = strnlen(w->ifaces[i].name, IF_NAMESIZE);
+        uint32_t total = 20 + 4 + PAD4(name_len) + 4 + 4 + 4;
+
+        start = p = reserve(w, total);
+        if (!p)
+            return -EIO;
+        p = put_u32(p, PCAPNG_BT_IDB);
+        p = put_u32(p, total);
+        p = put_u16(p, PCAPNG_LINKTYPE_ETHERNET);
+        p = put_u16(p, 0);
+        p = put_u32(p, w->snaplen);
+        p = put_opt(p, PCAPNG_OPT_IF_NAME, w->ifaces[i].name, name_len);
+        p = put_opt(p, PCAPNG_OPT_IF_TSRESOL, &tsresol, 1);
+        p = put_u32(p, PCAPNG_OPT_ENDOFOPT);
+        p = put_u32(p, total);
+        w->len += p - start;
+    }
+    return 0;
+}
+
+/* 打开第 file_index 个文件（不轮转时为 path 本身），优先使用 O_DIRECT */
+static int open_file(struct pcapng_writer *w)
+{
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+
+    if (w->rotate_bytes)
+        snprintf(w->file, sizeof(w->file), "%s.%u", w->path, w->file_index);
+    else
+        snprintf(w->file, sizeof(w->file), "%s", w->path);
+
+    w->direct = true;
+    w->fd = open(w->file, flags | O_DIRECT, 0644);
+    if (w->fd < 0 && errno == EINVAL) {
+        w->direct = false;
+        w->fd = open(w->file, flags, 0644);
+    }
+    if (w->fd < 0)
+        return -errno;
+
+    w->len = 0;
+    w->buf_off = 0;
+    w->files++;
+    return write_header(w);
+}
+
+/* 写出剩余数据并截断到实际长度；O_DIRECT 下尾部不足一块，先清除 O_DIRECT 再写 */
+static int close_file(struct pcapng_writer *w)
+{
+    int err = flush_blocks(w);
+
+    if (!err && w->len > 0) {
+        if (w->direct)
+            fcntl(w->fd, F_SETFL, fcntl(w->fd, F_GETFL) & ~O_DIRECT);
+        err = write_at(w->fd, w->buf, w->len, w->buf_off);
+    }
+    if (!err && ftruncate(w->fd, w->buf_off + w->len))
+        err = -errno;
+    close(w->fd);
+    w->fd = -1;
+    return err;
+}
+
+int pcapng_open(struct pcapng_writer *w, const char *path,
+                const struct pcapng_iface *ifaces, int nr_ifaces, uint32_t snaplen,
+                uint64_t rotate_bytes, uint32_t rotate_count)
+{
+    struct timespec mono, real;
+    int err;
+
+    memset(w, 0, sizeof(*w));
+    w->fd = -1;
+    if (strlen(path) >= sizeof(w->path))
+        return -ENAMETOOLONG;
+    snprintf(w->path, sizeof(w->path), "%s", path);
+    w->ifaces = ifaces;
+    w->nr_ifaces = nr_ifaces;
+    w->snaplen = snaplen;
+    w->rotate_bytes = rotate_bytes;
+    w->rotate_count = rotate_count;
+
+    clock_gettime(CLOCK_REALTIME, &real);
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    w->realtime_offset_ns = (int64_t)(real.tv_sec - mono.tv_sec) * 1000000000LL +
+                            (real.tv_nsec - mono.tv_nsec);
+
+    err = posix_memalign((void **)&w->buf, PCAPNG_ALIGN, PCAPNG_BUF_SIZE);
+    if (err) {
+        w->buf = NULL;
+        return -err;
+    }
+    err = open_file(w);
+    if (err) {
+        if (w->fd >= 0)
+            close(w->fd);
+        free(w->buf);
+        w->buf = NULL;
+        return err;
+    }
+    return 0;
+}
+
+/* 接口序号：连续的包通常来自同一接口，先检查上一次的结果 */
+static uint32_t iface_id(struct pcapng_writer *w, int ifindex)
+{
+    int i;
+
+    if (w->nr_ifaces == 0)
+        return 0;
+    if (w->ifaces[w->last_iface].ifindex == ifindex)
+        return w->last_iface;
+    for (i = 0; i < w->nr_ifaces; i++) {
+        if (w->ifaces[i].ifindex == ifindex) {
+            w->last_iface = i;
+            return i;
+        }
+    }
+    return 0;
+}
+
+int pcapng_write_packet(struct pcapng_writer *w, uint64_t timestamp_ns, int ifindex,
+                        const void *data, uint32_t caplen, uint32_t len)
+{
+    uint64_t ts = timestamp_ns + w->realtime_offset_ns;
+    struct epb_header hdr;
+    uint32_t total;
+    uint8_t *p;
+    int err;
+
+    if (caplen > PCAPNG_MAX_SNAPLEN)
+        caplen = PCAPNG_MAX_SNAPLEN;
+    total = sizeof(hdr) + PAD4(caplen) + 4;
+
+    p = reserve(w, total);
+    if (!p)
+        return -EIO;
+    hdr.type = PCAPNG_BT_EPB;
+    hdr.total_len = total;
+    hdr.iface_id = iface_id(w, ifindex);
+    hdr.ts_high = ts >> 32;
+    hdr.ts_low = (uint32_t)ts;
+    hdr.caplen = caplen;
+    hdr.len = len;
+    memcpy(p, &hdr, sizeof(hdr));
+    p += sizeof(hdr);
+    memcpy(p, data, caplen);
+    memset(p + caplen, 0, PAD4(caplen) - caplen);
+    put_u32(p + PAD4(caplen), total);
+    w->len += total;
+    w->packets++;
+    w->bytes += total;
+
+    /* 轮转：关闭当前文件，打开下一个 */
+    if (w->rotate_bytes && w->buf_off + w->len >= w->rotate_bytes) {
+        err = close_file(w);
+        if (err)
+            return err;
+        w->file_index++;
+        if (w->rotate_count && w->file_index >= w->rotate_count)
+            w->file_index = 0;
+        return open_file(w);
+    }
+    return 0;
+}
+
+int pcapng_sync(struct pcapng_writer *w)
+{
+    uint32_t padded;
+    int err;
+
+    if (w->fd < 0)
+        return 0;
+    err = flush_blocks(w);
+    if (err || w->len == 0)
+        return err;
+
+    /* O_DIRECT：把不足一块的尾部补零写出，不移动缓冲区，之后的写入会覆盖这一块 */
+    padded = (w->len + PCAPNG_ALIGN - 1) & ~(PCAPNG_ALIGN - 1);
+    memset(w->buf + w->len, 0, padded - w->len);
+    return write_at(w->fd, w->buf, padded, w->buf_off);
+}
+
+int pcapng_close(struct pcapng_writer *w)
+{
+    int err = 0;
+
+    if (w->fd >= 0)
+        err = close_file(w);
+    free(w->buf);
+    w->buf = NULL;
+    return err;
+}